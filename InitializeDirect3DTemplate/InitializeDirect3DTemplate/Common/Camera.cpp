@@ -126,6 +126,8 @@ void Camera::SetLens(float fovY, float aspect, float zn, float zf)
 
 	XMMATRIX P = XMMatrixPerspectiveFovLH(mFovY, mAspect, mNearZ, mFarZ);
 	XMStoreFloat4x4(&mProj, P);
+
+	++mProjVersion;
 }
 
 void Camera::LookAt(FXMVECTOR pos, FXMVECTOR target, FXMVECTOR worldUp)
@@ -176,6 +178,16 @@ XMFLOAT4X4 Camera::GetProj4x4f()const
 	return mProj;
 }
 
+UINT Camera::GetViewVersion()const
+{
+	return mViewVersion;
+}
+
+UINT Camera::GetProjVersion()const
+{
+	return mProjVersion;
+}
+
 void Camera::Strafe(float d)
 {
 	// mPosition += d*mRight
@@ -294,6 +306,7 @@ void Camera::UpdateViewMatrix()
 		mView(3, 3) = 1.0f;
 
 		mViewDirty = false;
+		++mViewVersion;
 	}
 }
 
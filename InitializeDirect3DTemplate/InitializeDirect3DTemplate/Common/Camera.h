@@ -61,6 +61,11 @@ public:
 	DirectX::XMFLOAT4X4 GetView4x4f()const;
 	DirectX::XMFLOAT4X4 GetProj4x4f()const;
 
+	// Incremented each time the view or projection matrix changes, so data derived
+	// from them only has to be rebuilt when the version differs from the cached one.
+	UINT GetViewVersion()const;
+	UINT GetProjVersion()const;
+
 	// Strafe/Walk the camera a distance d.
 	void Strafe(float d);
 	void Walk(float d);
@@ -92,6 +97,9 @@ private:
 
 	bool mViewDirty = true;
 
+	UINT mViewVersion = 0;
+	UINT mProjVersion = 0;
+
 	// Cache View/Proj matrices.
 	DirectX::XMFLOAT4X4 mView = MathHelper::Identity4x4();
 	DirectX::XMFLOAT4X4 mProj = MathHelper::Identity4x4();
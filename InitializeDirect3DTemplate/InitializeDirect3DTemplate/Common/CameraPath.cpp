@@ -0,0 +1,63 @@
+//***************************************************************************************
+// CameraPath.cpp
+//***************************************************************************************
+
+#include "CameraPath.h"
+
+using namespace DirectX;
+
+void CameraPath::AddKey(float time, const XMFLOAT3& position, const XMFLOAT3& target)
+{
+	assert(mKeys.empty() || time >= mKeys.back().Time);
+
+	Key key;
+	key.Time = time;
+	key.Position = position;
+	key.Target = target;
+	mKeys.push_back(key);
+}
+
+void CameraPath::AddKeyAtSpeed(float speed, const XMFLOAT3& position, const XMFLOAT3& target)
+{
+	assert(speed > 0.0f);
+
+	float time = 0.0f;
+	if(!mKeys.empty())
+	{
+		XMVECTOR from = XMLoadFloat3(&mKeys.back().Position);
+		XMVECTOR to = XMLoadFloat3(&position);
+		time = mKeys.back().Time + XMVectorGetX(XMVector3Length(to - from)) / speed;
+	}
+
+	AddKey(time, position, target);
+}
+
+bool CameraPath::Empty()const
+{
+	return mKeys.empty();
+}
+
+float CameraPath::GetDuration()const
+{
+	return mKeys.empty() ? 0.0f : mKeys.back().Time;
+}
+
+void CameraPath::Evaluate(float time, Camera& camera)const
+{
+	if(mKeys.empty())
+		return;
+
+	// The first key after the time; the pose lies between it and the one before.
+	auto next = std::upper_bound(mKeys.begin(), mKeys.end(), time,
+		[](float t, const Key& key) { return t < key.Time; });
+
+	const Key& a = next == mKeys.begin() ? *next : *(next - 1);
+	const Key& b = next == mKeys.end() ? mKeys.back() : *next;
+
+	float s = b.Time > a.Time ? MathHelper::Clamp((time - a.Time) / (b.Time - a.Time), 0.0f, 1.0f) : 0.0f;
+
+	XMVECTOR position = XMVectorLerp(XMLoadFloat3(&a.Position), XMLoadFloat3(&b.Position), s);
+	XMVECTOR target = XMVectorLerp(XMLoadFloat3(&a.Target), XMLoadFloat3(&b.Target), s);
+
+	camera.LookAt(position, target, XMVectorSet(0.0f, 1.0f, 0.0f, 0.0f));
+}
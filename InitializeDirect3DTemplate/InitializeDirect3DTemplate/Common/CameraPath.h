@@ -0,0 +1,40 @@
+//***************************************************************************************
+// CameraPath.h
+//
+// Keyframed camera flythrough for scripted runs.  Each key holds a time, an eye
+// position and the point looked at; between keys both move linearly, and Evaluate()
+// places the camera with Camera::LookAt, so a path replays the same poses for the
+// same times whatever the frame rate.
+//***************************************************************************************
+
+#pragma once
+
+#include "Camera.h"
+
+class CameraPath
+{
+public:
+	// Keys are added in time order.
+	void AddKey(float time, const DirectX::XMFLOAT3& position, const DirectX::XMFLOAT3& target);
+
+	// Timed so that the eye moves from the previous key at the given speed, in
+	// units per second.  The first key goes at time zero.
+	void AddKeyAtSpeed(float speed, const DirectX::XMFLOAT3& position, const DirectX::XMFLOAT3& target);
+
+	bool Empty()const;
+	float GetDuration()const;
+
+	// Outside the keys the camera holds the first or the last pose.  The target
+	// must stay off the vertical through the eye.
+	void Evaluate(float time, Camera& camera)const;
+
+private:
+	struct Key
+	{
+		float Time = 0.0f;
+		DirectX::XMFLOAT3 Position = { 0.0f, 0.0f, 0.0f };
+		DirectX::XMFLOAT3 Target = { 0.0f, 0.0f, 1.0f };
+	};
+
+	std::vector<Key> mKeys;
+};
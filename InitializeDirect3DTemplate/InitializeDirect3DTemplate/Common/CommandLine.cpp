@@ -0,0 +1,137 @@
+//***************************************************************************************
+// CommandLine.cpp
+//***************************************************************************************
+
+#include "CommandLine.h"
+#include <vector>
+#include <cwctype>
+
+CommandLine::CommandLine()
+{
+	Parse(GetCommandLineW());
+}
+
+CommandLine::CommandLine(const std::wstring& cmdLine)
+{
+	Parse(cmdLine);
+}
+
+bool CommandLine::HasOption(const std::wstring& name)const
+{
+	return mOptions.find(ToLower(name)) != mOptions.end();
+}
+
+std::wstring CommandLine::GetString(const std::wstring& name, const std::wstring& defaultValue)const
+{
+	auto it = mOptions.find(ToLower(name));
+	if(it == mOptions.end() || it->second.empty())
+		return defaultValue;
+
+	return it->second;
+}
+
+int CommandLine::GetInt(const std::wstring& name, int defaultValue)const
+{
+	std::wstring value = GetString(name, L"");
+	if(value.empty())
+		return defaultValue;
+
+	wchar_t* end = nullptr;
+	long result = wcstol(value.c_str(), &end, 10);
+
+	return (end != value.c_str() && *end == L'\0') ? (int)result : defaultValue;
+}
+
+float CommandLine::GetFloat(const std::wstring& name, float defaultValue)const
+{
+	std::wstring value = GetString(name, L"");
+	if(value.empty())
+		return defaultValue;
+
+	wchar_t* end = nullptr;
+	float result = wcstof(value.c_str(), &end);
+
+	return (end != value.c_str() && *end == L'\0') ? result : defaultValue;
+}
+
+void CommandLine::Parse(const std::wstring& cmdLine)
+{
+	//
+	// Split into tokens on whitespace; double quotes group a token and are dropped.
+	//
+
+	std::vector<std::wstring> tokens;
+	std::wstring token;
+	bool inQuotes = false;
+	bool hasToken = false;
+
+	for(wchar_t c : cmdLine)
+	{
+		if(c == L'"')
+		{
+			inQuotes = !inQuotes;
+			hasToken = true;
+		}
+		else if(!inQuotes && iswspace(c))
+		{
+			if(hasToken)
+				tokens.push_back(token);
+
+			token.clear();
+			hasToken = false;
+		}
+		else
+		{
+			token += c;
+			hasToken = true;
+		}
+	}
+
+	if(hasToken)
+		tokens.push_back(token);
+
+	//
+	// Pair each option with the value that follows it, if any.  Tokens that are
+	// not options (the executable path, stray values) are ignored.
+	//
+
+	auto isOption = [](const std::wstring& t)
+	{
+		return t.size() > 1 && (t[0] == L'-' || t[0] == L'/') && !iswdigit(t[1]) && t[1] != L'.';
+	};
+
+	for(size_t i = 0; i < tokens.size(); ++i)
+	{
+		if(!isOption(tokens[i]))
+			continue;
+
+		size_t nameStart = tokens[i].find_first_not_of(L"-/");
+		if(nameStart == std::wstring::npos)
+			continue;
+
+		std::wstring name = tokens[i].substr(nameStart);
+		std::wstring value;
+
+		size_t equals = name.find(L'=');
+		if(equals != std::wstring::npos)
+		{
+			value = name.substr(equals + 1);
+			name = name.substr(0, equals);
+		}
+		else if(i + 1 < tokens.size() && !isOption(tokens[i + 1]))
+		{
+			value = tokens[++i];
+		}
+
+		if(!name.empty())
+			mOptions[ToLower(name)] = value;
+	}
+}
+
+std::wstring CommandLine::ToLower(std::wstring s)
+{
+	for(auto& c : s)
+		c = (wchar_t)towlower(c);
+
+	return s;
+}
@@ -0,0 +1,35 @@
+//***************************************************************************************
+// CommandLine.h
+//
+// Minimal parser for "-name value", "-name=value" and bare "-flag" options.  Used to
+// tune a deployment (frame pacing, adapter, benchmark runs) without a rebuild.
+// Option names are matched case-insensitively; a leading '-', "--" or '/' is accepted.
+//***************************************************************************************
+
+#pragma once
+
+#include <windows.h>
+#include <string>
+#include <unordered_map>
+
+class CommandLine
+{
+public:
+	// Parses the process command line.
+	CommandLine();
+	explicit CommandLine(const std::wstring& cmdLine);
+
+	bool HasOption(const std::wstring& name)const;
+
+	std::wstring GetString(const std::wstring& name, const std::wstring& defaultValue)const;
+	int GetInt(const std::wstring& name, int defaultValue)const;
+	float GetFloat(const std::wstring& name, float defaultValue)const;
+
+private:
+	void Parse(const std::wstring& cmdLine);
+	static std::wstring ToLower(std::wstring s);
+
+private:
+	// Option name (lower case, without the leading dashes) -> value, empty for flags.
+	std::unordered_map<std::wstring, std::wstring> mOptions;
+};
@@ -130,6 +130,10 @@ typedef public std::unique_ptr<void, handle_closer> ScopedHandle;
 
 inline HANDLE safe_handle( HANDLE h ) { return (h == INVALID_HANDLE_VALUE) ? 0 : h; }
 
+struct view_unmapper { void operator()(const void* p) { if (p) UnmapViewOfFile(p); } };
+
+typedef std::unique_ptr<const uint8_t, view_unmapper> ScopedFileView;
+
 template<UINT TNameLength>
 inline void SetDebugObjectName(_In_ ID3D11DeviceChild* resource, _In_ const char (&name)[TNameLength])
 {
@@ -143,6 +147,52 @@ inline void SetDebugObjectName(_In_ ID3D11DeviceChild* resource, _In_ const char
 
 };
 
+//--------------------------------------------------------------------------------------
+// Checks the magic number and headers of a DDS file in memory and returns where
+// the texel data starts.  ddsDataSize must cover at least the magic number and
+// DDS_HEADER.
+//--------------------------------------------------------------------------------------
+static HRESULT GetDDSDataOffset( _In_reads_bytes_(ddsDataSize) const uint8_t* ddsData,
+                                 size_t ddsDataSize,
+                                 size_t* offset
+                               )
+{
+    // DDS files always start with the same magic number ("DDS ")
+    uint32_t dwMagicNumber = *( const uint32_t* )( ddsData );
+    if (dwMagicNumber != DDS_MAGIC)
+    {
+        return E_FAIL;
+    }
+
+    auto hdr = reinterpret_cast<const DDS_HEADER*>( ddsData + sizeof( uint32_t ) );
+
+    // Verify header to validate DDS file
+    if (hdr->size != sizeof(DDS_HEADER) ||
+        hdr->ddspf.size != sizeof(DDS_PIXELFORMAT))
+    {
+        return E_FAIL;
+    }
+
+    // Check for DX10 extension
+    bool bDXT10Header = false;
+    if ((hdr->ddspf.flags & DDS_FOURCC) &&
+        (MAKEFOURCC( 'D', 'X', '1', '0' ) == hdr->ddspf.fourCC))
+    {
+        // Must be long enough for both headers and magic value
+        if (ddsDataSize < ( sizeof(DDS_HEADER) + sizeof(uint32_t) + sizeof(DDS_HEADER_DXT10) ) )
+        {
+            return E_FAIL;
+        }
+
+        bDXT10Header = true;
+    }
+
+    *offset = sizeof( uint32_t ) + sizeof( DDS_HEADER )
+              + (bDXT10Header ? sizeof( DDS_HEADER_DXT10 ) : 0);
+
+    return S_OK;
+}
+
 //--------------------------------------------------------------------------------------
 static HRESULT LoadTextureDataFromFile( _In_z_ const wchar_t* fileName,
                                         std::unique_ptr<uint8_t[]>& ddsData,
@@ -228,41 +278,110 @@ static HRESULT LoadTextureDataFromFile( _In_z_ const wchar_t* fileName,
         return E_FAIL;
     }
 
-    // DDS files always start with the same magic number ("DDS ")
-    uint32_t dwMagicNumber = *( const uint32_t* )( ddsData.get() );
-    if (dwMagicNumber != DDS_MAGIC)
+    size_t offset = 0;
+    HRESULT hr = GetDDSDataOffset( ddsData.get(), FileSize.LowPart, &offset );
+    if (FAILED(hr))
     {
-        return E_FAIL;
+        return hr;
     }
 
-    auto hdr = reinterpret_cast<DDS_HEADER*>( ddsData.get() + sizeof( uint32_t ) );
+    // setup the pointers in the process request
+    *header = reinterpret_cast<DDS_HEADER*>( ddsData.get() + sizeof( uint32_t ) );
+    *bitData = ddsData.get() + offset;
+    *bitSize = FileSize.LowPart - offset;
 
-    // Verify header to validate DDS file
-    if (hdr->size != sizeof(DDS_HEADER) ||
-        hdr->ddspf.size != sizeof(DDS_PIXELFORMAT))
+    return S_OK;
+}
+
+
+//--------------------------------------------------------------------------------------
+// Same as LoadTextureDataFromFile, but maps the file instead of reading it into a
+// heap buffer.  header and bitData point into the read-only view, which stays
+// valid as long as ddsView does.
+//--------------------------------------------------------------------------------------
+static HRESULT MapTextureDataFromFile( _In_z_ const wchar_t* fileName,
+                                       ScopedFileView& ddsView,
+                                       const DDS_HEADER** header,
+                                       const uint8_t** bitData,
+                                       size_t* bitSize
+                                     )
+{
+    if (!header || !bitData || !bitSize)
+    {
+        return E_POINTER;
+    }
+
+    // open the file
+#if (_WIN32_WINNT >= _WIN32_WINNT_WIN8)
+    CREATEFILE2_EXTENDED_PARAMETERS createParams = {};
+    createParams.dwSize = sizeof(createParams);
+    createParams.dwFileAttributes = FILE_ATTRIBUTE_NORMAL;
+    createParams.dwFileFlags = FILE_FLAG_SEQUENTIAL_SCAN;
+
+    ScopedHandle hFile( safe_handle( CreateFile2( fileName,
+                                                  GENERIC_READ,
+                                                  FILE_SHARE_READ,
+                                                  OPEN_EXISTING,
+                                                  &createParams ) ) );
+#else
+    ScopedHandle hFile( safe_handle( CreateFileW( fileName,
+                                                  GENERIC_READ,
+                                                  FILE_SHARE_READ,
+                                                  nullptr,
+                                                  OPEN_EXISTING,
+                                                  FILE_ATTRIBUTE_NORMAL | FILE_FLAG_SEQUENTIAL_SCAN,
+                                                  nullptr ) ) );
+#endif
+
+    if ( !hFile )
+    {
+        return HRESULT_FROM_WIN32( GetLastError() );
+    }
+
+    // Get the file size
+    LARGE_INTEGER FileSize = { 0 };
+    if ( !GetFileSizeEx( hFile.get(), &FileSize ) )
+    {
+        return HRESULT_FROM_WIN32( GetLastError() );
+    }
+
+    // File is too big for a 32-bit view, so reject it
+    if (FileSize.HighPart > 0)
     {
         return E_FAIL;
     }
 
-    // Check for DX10 extension
-    bool bDXT10Header = false;
-    if ((hdr->ddspf.flags & DDS_FOURCC) &&
-        (MAKEFOURCC( 'D', 'X', '1', '0' ) == hdr->ddspf.fourCC))
+    // Need at least enough data to fill the header and magic number to be a valid DDS
+    if (FileSize.LowPart < ( sizeof(DDS_HEADER) + sizeof(uint32_t) ) )
     {
-        // Must be long enough for both headers and magic value
-        if (FileSize.LowPart < ( sizeof(DDS_HEADER) + sizeof(uint32_t) + sizeof(DDS_HEADER_DXT10) ) )
-        {
-            return E_FAIL;
-        }
+        return E_FAIL;
+    }
 
-        bDXT10Header = true;
+    // The view keeps the mapping object alive, so its handle can be closed
+    // right away.
+    ScopedHandle hMapping( CreateFileMappingW( hFile.get(), nullptr, PAGE_READONLY, 0, 0, nullptr ) );
+    if ( !hMapping )
+    {
+        return HRESULT_FROM_WIN32( GetLastError() );
+    }
+
+    ddsView.reset( static_cast<const uint8_t*>( MapViewOfFile( hMapping.get(), FILE_MAP_READ, 0, 0, 0 ) ) );
+    if ( !ddsView )
+    {
+        return HRESULT_FROM_WIN32( GetLastError() );
+    }
+
+    size_t offset = 0;
+    HRESULT hr = GetDDSDataOffset( ddsView.get(), FileSize.LowPart, &offset );
+    if (FAILED(hr))
+    {
+        ddsView.reset();
+        return hr;
     }
 
     // setup the pointers in the process request
-    *header = hdr;
-    ptrdiff_t offset = sizeof( uint32_t ) + sizeof( DDS_HEADER )
-                       + (bDXT10Header ? sizeof( DDS_HEADER_DXT10 ) : 0);
-    *bitData = ddsData.get() + offset;
+    *header = reinterpret_cast<const DDS_HEADER*>( ddsView.get() + sizeof( uint32_t ) );
+    *bitData = ddsView.get() + offset;
     *bitSize = FileSize.LowPart - offset;
 
     return S_OK;
@@ -1324,6 +1443,125 @@ static HRESULT CreateD3DResources12(
 }
 
 
+static HRESULT CreateD3DResourcesForUpload12(
+	ID3D12Device* device,
+	_In_ uint32_t resDim,
+	_In_ size_t width,
+	_In_ size_t height,
+	_In_ size_t depth,
+	_In_ size_t mipCount,
+	_In_ size_t arraySize,
+	_In_ DXGI_FORMAT format,
+	_In_ bool isCubeMap,
+	_In_reads_(mipCount*arraySize) const D3D12_SUBRESOURCE_DATA* initData,
+	_In_opt_ const DDSUploadAllocator12* allocator,
+	DDSTextureUpload12& upload
+	)
+{
+	if (device == nullptr)
+		return E_POINTER;
+
+	if (resDim != D3D12_RESOURCE_DIMENSION_TEXTURE2D)
+		return HRESULT_FROM_WIN32(ERROR_NOT_SUPPORTED);
+
+	D3D12_RESOURCE_DESC texDesc;
+	ZeroMemory(&texDesc, sizeof(D3D12_RESOURCE_DESC));
+	texDesc.Dimension = D3D12_RESOURCE_DIMENSION_TEXTURE2D;
+	texDesc.Alignment = 0;
+	texDesc.Width = width;
+	texDesc.Height = (uint32_t)height;
+	texDesc.DepthOrArraySize = (depth > 1) ? (uint16_t)depth : (uint16_t)arraySize;
+	texDesc.MipLevels = (uint16_t)mipCount;
+	texDesc.Format = format;
+	texDesc.SampleDesc.Count = 1;
+	texDesc.SampleDesc.Quality = 0;
+	texDesc.Layout = D3D12_TEXTURE_LAYOUT_UNKNOWN;
+	texDesc.Flags = D3D12_RESOURCE_FLAG_NONE;
+
+	auto defaultHeap = CD3DX12_HEAP_PROPERTIES(D3D12_HEAP_TYPE_DEFAULT);
+	HRESULT hr = device->CreateCommittedResource(
+		&defaultHeap,
+		D3D12_HEAP_FLAG_NONE,
+		&texDesc,
+		D3D12_RESOURCE_STATE_COMMON,
+		nullptr,
+		IID_PPV_ARGS(&upload.Texture));
+	if (FAILED(hr))
+		return hr;
+
+	// Lay the subresources out the way CopyTextureRegion expects them and write
+	// each row straight into the upload heap.
+	const UINT numSubresources = texDesc.DepthOrArraySize * texDesc.MipLevels;
+
+	std::vector<UINT> numRows(numSubresources);
+	std::vector<UINT64> rowSizes(numSubresources);
+	UINT64 uploadBufferSize = 0;
+
+	upload.Layouts.resize(numSubresources);
+	device->GetCopyableFootprints(&texDesc, 0, numSubresources, 0,
+		upload.Layouts.data(), numRows.data(), rowSizes.data(), &uploadBufferSize);
+
+	BYTE* mappedData = nullptr;
+	UINT64 baseOffset = 0;
+
+	if (allocator && (*allocator)(uploadBufferSize, D3D12_TEXTURE_DATA_PLACEMENT_ALIGNMENT,
+		&upload.UploadSource, &baseOffset, &mappedData))
+	{
+		// Make the footprints relative to the start of the buffer, which is
+		// what CopyTextureRegion expects, and mappedData point at that start.
+		for (auto& layout : upload.Layouts)
+			layout.Offset += baseOffset;
+
+		mappedData -= baseOffset;
+	}
+	else
+	{
+		auto uploadHeap = CD3DX12_HEAP_PROPERTIES(D3D12_HEAP_TYPE_UPLOAD);
+		auto buffer = CD3DX12_RESOURCE_DESC::Buffer(uploadBufferSize);
+		hr = device->CreateCommittedResource(
+			&uploadHeap,
+			D3D12_HEAP_FLAG_NONE,
+			&buffer,
+			D3D12_RESOURCE_STATE_GENERIC_READ,
+			nullptr,
+			IID_PPV_ARGS(&upload.UploadHeap));
+		if (FAILED(hr))
+		{
+			upload.Texture = nullptr;
+			return hr;
+		}
+
+		hr = upload.UploadHeap->Map(0, nullptr, reinterpret_cast<void**>(&mappedData));
+		if (FAILED(hr))
+		{
+			upload.Texture = nullptr;
+			upload.UploadHeap = nullptr;
+			return hr;
+		}
+
+		upload.UploadSource = upload.UploadHeap.Get();
+	}
+
+	for (UINT i = 0; i < numSubresources; ++i)
+	{
+		const D3D12_PLACED_SUBRESOURCE_FOOTPRINT& layout = upload.Layouts[i];
+
+		D3D12_MEMCPY_DEST dest = {
+			mappedData + layout.Offset,
+			layout.Footprint.RowPitch,
+			SIZE_T(layout.Footprint.RowPitch) * SIZE_T(numRows[i]) };
+
+		MemcpySubresource(&dest, &initData[i], (SIZE_T)rowSizes[i], numRows[i], layout.Footprint.Depth);
+	}
+
+	if (upload.UploadHeap)
+		upload.UploadHeap->Unmap(0, nullptr);
+
+	upload.IsCubeMap = isCubeMap;
+
+	return S_OK;
+}
+
 //--------------------------------------------------------------------------------------
 static HRESULT CreateTextureFromDDS( _In_ ID3D11Device* d3dDevice,
                                      _In_opt_ ID3D11DeviceContext* d3dContext,
@@ -1683,7 +1921,9 @@ static HRESULT CreateTextureFromDDS12(
 	_In_ size_t maxsize,
 	_In_ bool forceSRGB,
 	ComPtr<ID3D12Resource>& texture,
-	ComPtr<ID3D12Resource>& textureUploadHeap)
+	ComPtr<ID3D12Resource>& textureUploadHeap,
+	_Inout_opt_ DDSTextureUpload12* upload,
+	_In_opt_ const DDSUploadAllocator12* allocator)
 {
 	HRESULT hr = S_OK;
 
@@ -1860,7 +2100,20 @@ static HRESULT CreateTextureFromDDS12(
 		twidth, theight, tdepth, skipMip, initData.get()
 		);
 
-	if (SUCCEEDED(hr))
+	if (SUCCEEDED(hr) && upload)
+	{
+		hr = CreateD3DResourcesForUpload12(
+			device,
+			resDim, twidth, theight, tdepth,
+			mipCount - skipMip,
+			arraySize,
+			format,
+			isCubeMap,
+			initData.get(),
+			allocator,
+			*upload);
+	}
+	else if (SUCCEEDED(hr))
 	{
 		hr = CreateD3DResources12(
 			device, cmdList,
@@ -1984,7 +2237,9 @@ HRESULT DirectX::CreateDDSTextureFromMemory12(
 		maxsize,
 		false,
 		texture,
-		textureUploadHeap
+		textureUploadHeap,
+		nullptr,
+		nullptr
 		);
 
 	if (SUCCEEDED(hr))
@@ -2165,19 +2420,21 @@ HRESULT DirectX::CreateDDSTextureFromFile12(_In_ ID3D12Device* device,
 		return E_INVALIDARG;
 	}
 
-	DDS_HEADER* header = nullptr;
-	uint8_t* bitData = nullptr;
+	const DDS_HEADER* header = nullptr;
+	const uint8_t* bitData = nullptr;
 	size_t bitSize = 0;
 
-	std::unique_ptr<uint8_t[]> ddsData;
-	HRESULT hr = LoadTextureDataFromFile(szFileName, ddsData, &header, &bitData, &bitSize);
+	// The texel rows are copied from the mapped file straight into the upload
+	// heap, with no intermediate heap buffer.
+	ScopedFileView ddsView;
+	HRESULT hr = MapTextureDataFromFile(szFileName, ddsView, &header, &bitData, &bitSize);
 	if (FAILED(hr))
 	{
 		return hr;
 	}
 
 	hr = CreateTextureFromDDS12(device, cmdList, header,
-		bitData, bitSize, maxsize, false, texture, textureUploadHeap);
+		bitData, bitSize, maxsize, false, texture, textureUploadHeap, nullptr, nullptr);
 
 	if (SUCCEEDED(hr))
 	{
@@ -2233,6 +2490,59 @@ HRESULT DirectX::CreateDDSTextureFromFile12(_In_ ID3D12Device* device,
 	return hr;
 }
 
+HRESULT DirectX::PrepareDDSTextureFromFile12(_In_ ID3D12Device* device,
+	_In_z_ const wchar_t* szFileName,
+	_Out_ DDSTextureUpload12& upload,
+	_In_ size_t maxsize,
+	_Out_opt_ DDS_ALPHA_MODE* alphaMode,
+	_In_opt_ const DDSUploadAllocator12* allocator)
+{
+	upload = DDSTextureUpload12();
+	if (alphaMode)
+	{
+		*alphaMode = DDS_ALPHA_MODE_UNKNOWN;
+	}
+
+	if (!device || !szFileName)
+	{
+		return E_INVALIDARG;
+	}
+
+	const DDS_HEADER* header = nullptr;
+	const uint8_t* bitData = nullptr;
+	size_t bitSize = 0;
+
+	// The texel rows are copied from the mapped file straight into the upload
+	// heap, with no intermediate heap buffer.
+	ScopedFileView ddsView;
+	HRESULT hr = MapTextureDataFromFile(szFileName, ddsView, &header, &bitData, &bitSize);
+	if (FAILED(hr))
+	{
+		return hr;
+	}
+
+	ComPtr<ID3D12Resource> unusedTexture;
+	ComPtr<ID3D12Resource> unusedUploadHeap;
+	hr = CreateTextureFromDDS12(device, nullptr, header,
+		bitData, bitSize, maxsize, false, unusedTexture, unusedUploadHeap, &upload, allocator);
+
+	if (SUCCEEDED(hr) && alphaMode)
+		*alphaMode = GetAlphaMode(header);
+
+	return hr;
+}
+
+void DirectX::RecordDDSTextureUpload12(_In_ ID3D12GraphicsCommandList* cmdList,
+	_In_ const DDSTextureUpload12& upload)
+{
+	for (UINT i = 0; i < (UINT)upload.Layouts.size(); ++i)
+	{
+		CD3DX12_TEXTURE_COPY_LOCATION dst(upload.Texture.Get(), i);
+		CD3DX12_TEXTURE_COPY_LOCATION src(upload.UploadSource, upload.Layouts[i]);
+		cmdList->CopyTextureRegion(&dst, 0, 0, 0, &src, nullptr);
+	}
+}
+
 _Use_decl_annotations_
 HRESULT DirectX::CreateDDSTextureFromFile( ID3D11Device* d3dDevice,
                                            ID3D11DeviceContext* d3dContext,
@@ -24,6 +24,8 @@
 
 #include <wrl.h>
 #include <d3d11_1.h>
+#include <vector>
+#include <functional>
 #include "d3dx12.h"
 
 #pragma warning(push)
@@ -92,6 +94,42 @@ namespace DirectX
 		                               _Out_opt_ DDS_ALPHA_MODE* alphaMode = nullptr
 		                               );
 
+	// Texture whose data has been written to an upload heap but not copied yet.
+	// The texture is left in the COMMON state, so the copy can go through a copy
+	// queue and the first read on the direct queue promotes it implicitly.
+	struct DDSTextureUpload12
+	{
+		Microsoft::WRL::ComPtr<ID3D12Resource> Texture;
+		// Buffer the Layouts point into: UploadHeap, or memory handed out by the
+		// allocator given to PrepareDDSTextureFromFile12.
+		ID3D12Resource* UploadSource = nullptr;
+		Microsoft::WRL::ComPtr<ID3D12Resource> UploadHeap;
+		std::vector<D3D12_PLACED_SUBRESOURCE_FOOTPRINT> Layouts;
+		bool IsCubeMap = false;
+	};
+
+	// Optional source of upload memory for PrepareDDSTextureFromFile12.  Fills in
+	// the buffer, the offset in it and the CPU address of that offset and returns
+	// true, or returns false to have a committed upload heap created instead.
+	typedef std::function<bool(UINT64 byteSize, UINT64 alignment,
+		ID3D12Resource** buffer, UINT64* offset, BYTE** cpuAddress)> DDSUploadAllocator12;
+
+	// CPU half of CreateDDSTextureFromFile12: reads the file, creates the texture
+	// and fills the upload memory.  Touches no command list, so it may run on any
+	// thread, as long as allocator may too.
+	HRESULT PrepareDDSTextureFromFile12(_In_ ID3D12Device* device,
+		                                _In_z_ const wchar_t* szFileName,
+		                                _Out_ DDSTextureUpload12& upload,
+		                                _In_ size_t maxsize = 0,
+		                                _Out_opt_ DDS_ALPHA_MODE* alphaMode = nullptr,
+		                                _In_opt_ const DDSUploadAllocator12* allocator = nullptr
+		                                );
+
+	// GPU half: records the copies from the upload heap into the texture.  No
+	// barriers are recorded, so cmdList may be a copy command list.
+	void RecordDDSTextureUpload12(_In_ ID3D12GraphicsCommandList* cmdList,
+		                          _In_ const DDSTextureUpload12& upload);
+
     // Standard version with optional auto-gen mipmap support
     HRESULT CreateDDSTextureFromMemory( _In_ ID3D11Device* d3dDevice,
                                         _In_opt_ ID3D11DeviceContext* d3dContext,
@@ -0,0 +1,32 @@
+//***************************************************************************************
+// FreeList.cpp
+//***************************************************************************************
+
+#include "FreeList.h"
+#include <cassert>
+
+UINT FreeList::Allocate()
+{
+	if(mFree.empty())
+		return mSize++;
+
+	UINT index = mFree.back();
+	mFree.pop_back();
+	return index;
+}
+
+void FreeList::Release(UINT index)
+{
+	assert(index < mSize);
+	mFree.push_back(index);
+}
+
+UINT FreeList::GetSize()const
+{
+	return mSize;
+}
+
+UINT FreeList::GetLiveCount()const
+{
+	return mSize - (UINT)mFree.size();
+}
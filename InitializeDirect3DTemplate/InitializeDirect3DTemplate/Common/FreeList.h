@@ -0,0 +1,31 @@
+//***************************************************************************************
+// FreeList.h
+//
+// Hands out small integer indices for slots in arrays, giving back released ones
+// before new ones so the arrays only grow with the number of slots in use at once.
+// Released indices are reused most recent first.
+//***************************************************************************************
+
+#pragma once
+
+#include <windows.h>
+#include <vector>
+
+class FreeList
+{
+public:
+	UINT Allocate();
+
+	// The index must have come from Allocate() and not have been released since.
+	void Release(UINT index);
+
+	// Indices handed out so far, released or not.  Arrays indexed by them need
+	// this many elements.
+	UINT GetSize()const;
+
+	UINT GetLiveCount()const;
+
+private:
+	std::vector<UINT> mFree;
+	UINT mSize = 0;
+};
@@ -27,6 +27,13 @@ float GameTimer::TotalTime()const
 	// ----*---------------*-----------------*------------*------------*------> time
 	//  mBaseTime       mStopTime        startTime     mStopTime    mCurrTime
 
+	// On a fixed step the time only moves in Tick(), so a stop freezes it at the
+	// last tick rather than at the clock's stop time.
+	if( mStopped && mFixedStepCount > 0 )
+	{
+		return (float)(((mPrevTime - mPausedTime)-mBaseTime)*mSecondsPerCount);
+	}
+
 	if( mStopped )
 	{
 		return (float)(((mStopTime - mPausedTime)-mBaseTime)*mSecondsPerCount);
@@ -76,6 +83,15 @@ void GameTimer::Start()
 	// ----*---------------*-----------------*------------> time
 	//  mBaseTime       mStopTime        startTime     
 
+	// A fixed step never read the clock, so there is no paused time to take
+	// out and the timeline carries on from the last tick.
+	if( mStopped && mFixedStepCount > 0 )
+	{
+		mStopTime = 0;
+		mStopped  = false;
+		return;
+	}
+
 	if( mStopped )
 	{
 		mPausedTime += (startTime - mStopTime);	
@@ -106,6 +122,14 @@ void GameTimer::Tick()
 		return;
 	}
 
+	if( mFixedStepCount > 0 )
+	{
+		mCurrTime = mPrevTime + mFixedStepCount;
+		mDeltaTime = mFixedStepCount*mSecondsPerCount;
+		mPrevTime = mCurrTime;
+		return;
+	}
+
 	__int64 currTime;
 	QueryPerformanceCounter((LARGE_INTEGER*)&currTime);
 	mCurrTime = currTime;
@@ -130,3 +154,8 @@ void GameTimer::Tick()
 
 
 
+
+void GameTimer::SetFixedTimeStep(double seconds)
+{
+	mFixedStepCount = seconds > 0.0 ? (__int64)(seconds / mSecondsPerCount + 0.5) : 0;
+}
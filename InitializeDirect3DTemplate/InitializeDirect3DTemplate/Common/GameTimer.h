@@ -18,9 +18,16 @@ public:
 	void Stop();  // Call when paused.
 	void Tick();  // Call every frame.
 
+	// With a step above zero every Tick() advances the time by exactly that many
+	// seconds, whatever the clock says, so runs can be replayed frame for frame.
+	// Stop()/Start() then only hold the time; they do not skip it forward.
+	// Zero goes back to the clock.
+	void SetFixedTimeStep(double seconds);
+
 private:
 	double mSecondsPerCount;
 	double mDeltaTime;
+	__int64 mFixedStepCount = 0;
 
 	__int64 mBaseTime;
 	__int64 mPausedTime;
@@ -9,7 +9,23 @@ using namespace DirectX;
 
 GeometryGenerator::MeshData GeometryGenerator::CreateBox(float width, float height, float depth, uint32 numSubdivisions)
 {
-    MeshData meshData;
+	return ToMeshData([&](Vertex* vertices, uint32* indices)
+	{
+		return CreateBox(width, height, depth, numSubdivisions, vertices, indices);
+	});
+}
+
+GeometryGenerator::MeshSize GeometryGenerator::CreateBox(float width, float height, float depth, uint32 numSubdivisions,
+														 Vertex* vertices, uint32* indices)
+{
+    // Put a cap on the number of subdivisions.
+    numSubdivisions = std::min<uint32>(numSubdivisions, 6u);
+
+	MeshSize size = numSubdivisions == 0 ? MeshSize{ 24, 36 } : GetSubdividedSize(12, numSubdivisions);
+	if(vertices == nullptr || indices == nullptr)
+		return size;
+
+	MeshWriter out(vertices, indices, size);
 
     //
 	// Create the vertices.
@@ -56,8 +72,6 @@ GeometryGenerator::MeshData GeometryGenerator::CreateBox(float width, float heig
 	v[21] = Vertex(+w2, +h2, -d2, 1.0f, 0.0f, 0.0f, 0.0f, 0.0f, 1.0f, 0.0f, 0.0f);
 	v[22] = Vertex(+w2, +h2, +d2, 1.0f, 0.0f, 0.0f, 0.0f, 0.0f, 1.0f, 1.0f, 0.0f);
 	v[23] = Vertex(+w2, -h2, +d2, 1.0f, 0.0f, 0.0f, 0.0f, 0.0f, 1.0f, 1.0f, 1.0f);
-
-	meshData.Vertices.assign(&v[0], &v[24]);
  
 	//
 	// Create the indices.
@@ -89,20 +103,41 @@ GeometryGenerator::MeshData GeometryGenerator::CreateBox(float width, float heig
 	i[30] = 20; i[31] = 21; i[32] = 22;
 	i[33] = 20; i[34] = 22; i[35] = 23;
 
-	meshData.Indices32.assign(&i[0], &i[36]);
-
-    // Put a cap on the number of subdivisions.
-    numSubdivisions = std::min<uint32>(numSubdivisions, 6u);
+	if(numSubdivisions == 0)
+	{
+		for(uint32 k = 0; k < 24; ++k)
+			out.AddVertex(v[k]);
 
-    for(uint32 i = 0; i < numSubdivisions; ++i)
-        Subdivide(meshData);
+		for(uint32 k = 0; k < 36; k += 3)
+			out.AddTriangle(i[k], i[k+1], i[k+2]);
+	}
+	else
+	{
+		for(uint32 k = 0; k < 36; k += 3)
+			SubdivideTriangle(v[i[k]], v[i[k+1]], v[i[k+2]], numSubdivisions, out);
+	}
 
-    return meshData;
+    return size;
 }
 
 GeometryGenerator::MeshData GeometryGenerator::CreateSphere(float radius, uint32 sliceCount, uint32 stackCount)
 {
-    MeshData meshData;
+	return ToMeshData([&](Vertex* vertices, uint32* indices)
+	{
+		return CreateSphere(radius, sliceCount, stackCount, vertices, indices);
+	});
+}
+
+GeometryGenerator::MeshSize GeometryGenerator::CreateSphere(float radius, uint32 sliceCount, uint32 stackCount,
+															Vertex* vertices, uint32* indices)
+{
+	// The poles, stackCount-1 rings, and a triangle pair per slice of every
+	// stack but the two at the poles, which get one triangle each.
+	MeshSize size = { 2 + (stackCount-1)*(sliceCount+1), 6*sliceCount*(stackCount-1) };
+	if(vertices == nullptr || indices == nullptr)
+		return size;
+
+	MeshWriter out(vertices, indices, size);
 
 	//
 	// Compute the vertices stating at the top pole and moving down the stacks.
@@ -114,7 +149,7 @@ GeometryGenerator::MeshData GeometryGenerator::CreateSphere(float radius, uint32
 	Vertex topVertex(0.0f, +radius, 0.0f, 0.0f, +1.0f, 0.0f, 1.0f, 0.0f, 0.0f, 0.0f, 0.0f);
 	Vertex bottomVertex(0.0f, -radius, 0.0f, 0.0f, -1.0f, 0.0f, 1.0f, 0.0f, 0.0f, 0.0f, 1.0f);
 
-	meshData.Vertices.push_back( topVertex );
+	out.AddVertex( topVertex );
 
 	float phiStep   = XM_PI/stackCount;
 	float thetaStep = 2.0f*XM_PI/sliceCount;
@@ -150,11 +185,11 @@ GeometryGenerator::MeshData GeometryGenerator::CreateSphere(float radius, uint32
 			v.TexC.x = theta / XM_2PI;
 			v.TexC.y = phi / XM_PI;
 
-			meshData.Vertices.push_back( v );
+			out.AddVertex( v );
 		}
 	}
 
-	meshData.Vertices.push_back( bottomVertex );
+	out.AddVertex( bottomVertex );
 
 	//
 	// Compute indices for top stack.  The top stack was written first to the vertex buffer
@@ -163,9 +198,7 @@ GeometryGenerator::MeshData GeometryGenerator::CreateSphere(float radius, uint32
 
     for(uint32 i = 1; i <= sliceCount; ++i)
 	{
-		meshData.Indices32.push_back(0);
-		meshData.Indices32.push_back(i+1);
-		meshData.Indices32.push_back(i);
+		out.AddTriangle(0, i+1, i);
 	}
 	
 	//
@@ -180,13 +213,15 @@ GeometryGenerator::MeshData GeometryGenerator::CreateSphere(float radius, uint32
 	{
 		for(uint32 j = 0; j < sliceCount; ++j)
 		{
-			meshData.Indices32.push_back(baseIndex + i*ringVertexCount + j);
-			meshData.Indices32.push_back(baseIndex + i*ringVertexCount + j+1);
-			meshData.Indices32.push_back(baseIndex + (i+1)*ringVertexCount + j);
-
-			meshData.Indices32.push_back(baseIndex + (i+1)*ringVertexCount + j);
-			meshData.Indices32.push_back(baseIndex + i*ringVertexCount + j+1);
-			meshData.Indices32.push_back(baseIndex + (i+1)*ringVertexCount + j+1);
+			out.AddTriangle(
+				baseIndex + i*ringVertexCount + j,
+				baseIndex + i*ringVertexCount + j+1,
+				baseIndex + (i+1)*ringVertexCount + j);
+
+			out.AddTriangle(
+				baseIndex + (i+1)*ringVertexCount + j,
+				baseIndex + i*ringVertexCount + j+1,
+				baseIndex + (i+1)*ringVertexCount + j+1);
 		}
 	}
 
@@ -196,19 +231,17 @@ GeometryGenerator::MeshData GeometryGenerator::CreateSphere(float radius, uint32
 	//
 
 	// South pole vertex was added last.
-	uint32 southPoleIndex = (uint32)meshData.Vertices.size()-1;
+	uint32 southPoleIndex = out.VertexCount-1;
 
 	// Offset the indices to the index of the first vertex in the last ring.
 	baseIndex = southPoleIndex - ringVertexCount;
 	
 	for(uint32 i = 0; i < sliceCount; ++i)
 	{
-		meshData.Indices32.push_back(southPoleIndex);
-		meshData.Indices32.push_back(baseIndex+i);
-		meshData.Indices32.push_back(baseIndex+i+1);
+		out.AddTriangle(southPoleIndex, baseIndex+i, baseIndex+i+1);
 	}
 
-    return meshData;
+    return size;
 }
  
 void GeometryGenerator::Subdivide(MeshData& meshData)
@@ -273,6 +306,48 @@ void GeometryGenerator::Subdivide(MeshData& meshData)
 		meshData.Indices32.push_back(i*6+4);
 	}
 }
+
+void GeometryGenerator::SubdivideTriangle(const Vertex& v0, const Vertex& v1, const Vertex& v2, uint32 levelCount, MeshWriter& out)
+{
+	Vertex m0 = MidPoint(v0, v1);
+	Vertex m1 = MidPoint(v1, v2);
+	Vertex m2 = MidPoint(v0, v2);
+
+	// Subdivide keeps the four triangles of each input triangle together, so
+	// going depth first gives the order of repeated Subdivide calls.
+	if(levelCount > 1)
+	{
+		SubdivideTriangle(v0, m0, m2, levelCount-1, out);
+		SubdivideTriangle(m0, m1, m2, levelCount-1, out);
+		SubdivideTriangle(m2, m1, v2, levelCount-1, out);
+		SubdivideTriangle(m0, v1, m1, levelCount-1, out);
+		return;
+	}
+
+	uint32 baseIndex = out.VertexCount;
+
+	out.AddVertex(v0); // 0
+	out.AddVertex(v1); // 1
+	out.AddVertex(v2); // 2
+	out.AddVertex(m0); // 3
+	out.AddVertex(m1); // 4
+	out.AddVertex(m2); // 5
+
+	out.AddTriangle(baseIndex+0, baseIndex+3, baseIndex+5);
+	out.AddTriangle(baseIndex+3, baseIndex+4, baseIndex+5);
+	out.AddTriangle(baseIndex+5, baseIndex+4, baseIndex+2);
+	out.AddTriangle(baseIndex+3, baseIndex+1, baseIndex+4);
+}
+
+GeometryGenerator::MeshSize GeometryGenerator::GetSubdividedSize(uint32 triangleCount, uint32 numSubdivisions)
+{
+	assert(numSubdivisions > 0);
+
+	// The last level turns each of its input triangles into six vertices and
+	// four triangles; the ones before only multiply the triangles by four.
+	uint32 lastInputCount = triangleCount << (2*(numSubdivisions-1));
+	return MeshSize{ 6*lastInputCount, 12*lastInputCount };
+}
 GeometryGenerator::Vertex GeometryGenerator::MidPoint(const Vertex& v0, const Vertex& v1)
 {
     XMVECTOR p0 = XMLoadFloat3(&v0.Position);
@@ -304,11 +379,24 @@ GeometryGenerator::Vertex GeometryGenerator::MidPoint(const Vertex& v0, const Ve
 }
 GeometryGenerator::MeshData GeometryGenerator::CreateGeosphere(float radius, uint32 numSubdivisions)
 {
-    MeshData meshData;
+	return ToMeshData([&](Vertex* vertices, uint32* indices)
+	{
+		return CreateGeosphere(radius, numSubdivisions, vertices, indices);
+	});
+}
 
+GeometryGenerator::MeshSize GeometryGenerator::CreateGeosphere(float radius, uint32 numSubdivisions,
+															   Vertex* vertices, uint32* indices)
+{
 	// Put a cap on the number of subdivisions.
     numSubdivisions = std::min<uint32>(numSubdivisions, 6u);
 
+	MeshSize size = numSubdivisions == 0 ? MeshSize{ 12, 60 } : GetSubdividedSize(20, numSubdivisions);
+	if(vertices == nullptr || indices == nullptr)
+		return size;
+
+	MeshWriter out(vertices, indices, size);
+
 	// Approximate a sphere by tessellating an icosahedron.
 
 	const float X = 0.525731f; 
@@ -332,53 +420,78 @@ GeometryGenerator::MeshData GeometryGenerator::CreateGeosphere(float radius, uin
 		10,1,6, 11,0,9, 2,11,9, 5,2,9,  11,2,7 
 	};
 
-    meshData.Vertices.resize(12);
-    meshData.Indices32.assign(&k[0], &k[60]);
-
+	// Only the positions matter; the rest is derived from them below.
+	Vertex v[12];
 	for(uint32 i = 0; i < 12; ++i)
-		meshData.Vertices[i].Position = pos[i];
+		v[i] = Vertex(pos[i], XMFLOAT3(0.0f, 0.0f, 0.0f), XMFLOAT3(0.0f, 0.0f, 0.0f), XMFLOAT2(0.0f, 0.0f));
+
+	if(numSubdivisions == 0)
+	{
+		for(uint32 i = 0; i < 12; ++i)
+			out.AddVertex(v[i]);
 
-	for(uint32 i = 0; i < numSubdivisions; ++i)
-		Subdivide(meshData);
+		for(uint32 i = 0; i < 60; i += 3)
+			out.AddTriangle(k[i], k[i+1], k[i+2]);
+	}
+	else
+	{
+		for(uint32 i = 0; i < 60; i += 3)
+			SubdivideTriangle(v[k[i]], v[k[i+1]], v[k[i+2]], numSubdivisions, out);
+	}
 
 	// Project vertices onto sphere and scale.
-	for(uint32 i = 0; i < meshData.Vertices.size(); ++i)
+	for(uint32 i = 0; i < size.VertexCount; ++i)
 	{
 		// Project onto unit sphere.
-		XMVECTOR n = XMVector3Normalize(XMLoadFloat3(&meshData.Vertices[i].Position));
+		XMVECTOR n = XMVector3Normalize(XMLoadFloat3(&vertices[i].Position));
 
 		// Project onto sphere.
 		XMVECTOR p = radius*n;
 
-		XMStoreFloat3(&meshData.Vertices[i].Position, p);
-		XMStoreFloat3(&meshData.Vertices[i].Normal, n);
+		XMStoreFloat3(&vertices[i].Position, p);
+		XMStoreFloat3(&vertices[i].Normal, n);
 
 		// Derive texture coordinates from spherical coordinates.
-        float theta = atan2f(meshData.Vertices[i].Position.z, meshData.Vertices[i].Position.x);
+        float theta = atan2f(vertices[i].Position.z, vertices[i].Position.x);
 
         // Put in [0, 2pi].
         if(theta < 0.0f)
             theta += XM_2PI;
 
-		float phi = acosf(meshData.Vertices[i].Position.y / radius);
+		float phi = acosf(vertices[i].Position.y / radius);
 
-		meshData.Vertices[i].TexC.x = theta/XM_2PI;
-		meshData.Vertices[i].TexC.y = phi/XM_PI;
+		vertices[i].TexC.x = theta/XM_2PI;
+		vertices[i].TexC.y = phi/XM_PI;
 
 		// Partial derivative of P with respect to theta
-		meshData.Vertices[i].TangentU.x = -radius*sinf(phi)*sinf(theta);
-		meshData.Vertices[i].TangentU.y = 0.0f;
-		meshData.Vertices[i].TangentU.z = +radius*sinf(phi)*cosf(theta);
+		vertices[i].TangentU.x = -radius*sinf(phi)*sinf(theta);
+		vertices[i].TangentU.y = 0.0f;
+		vertices[i].TangentU.z = +radius*sinf(phi)*cosf(theta);
 
-		XMVECTOR T = XMLoadFloat3(&meshData.Vertices[i].TangentU);
-		XMStoreFloat3(&meshData.Vertices[i].TangentU, XMVector3Normalize(T));
+		XMVECTOR T = XMLoadFloat3(&vertices[i].TangentU);
+		XMStoreFloat3(&vertices[i].TangentU, XMVector3Normalize(T));
 	}
 
-    return meshData;
+    return size;
 }
 GeometryGenerator::MeshData GeometryGenerator::CreateCylinder(float bottomRadius, float topRadius, float height, uint32 sliceCount, uint32 stackCount)
 {
-    MeshData meshData;
+	return ToMeshData([&](Vertex* vertices, uint32* indices)
+	{
+		return CreateCylinder(bottomRadius, topRadius, height, sliceCount, stackCount, vertices, indices);
+	});
+}
+
+GeometryGenerator::MeshSize GeometryGenerator::CreateCylinder(float bottomRadius, float topRadius, float height, uint32 sliceCount, uint32 stackCount,
+															  Vertex* vertices, uint32* indices)
+{
+	// stackCount+1 rings of sliceCount+1 vertices, and a cap at each end with
+	// its own ring and a center vertex.
+	MeshSize size = { (stackCount+1)*(sliceCount+1) + 2*(sliceCount+2), 6*stackCount*sliceCount + 6*sliceCount };
+	if(vertices == nullptr || indices == nullptr)
+		return size;
+
+	MeshWriter out(vertices, indices, size);
 
 	//
 	// Build Stacks.
@@ -441,7 +554,7 @@ GeometryGenerator::MeshData GeometryGenerator::CreateCylinder(float bottomRadius
 			XMVECTOR N = XMVector3Normalize(XMVector3Cross(T, B));
 			XMStoreFloat3(&vertex.Normal, N);
 
-			meshData.Vertices.push_back(vertex);
+			out.AddVertex(vertex);
 		}
 	}
 
@@ -454,25 +567,20 @@ GeometryGenerator::MeshData GeometryGenerator::CreateCylinder(float bottomRadius
 	{
 		for(uint32 j = 0; j < sliceCount; ++j)
 		{
-			meshData.Indices32.push_back(i*ringVertexCount + j);
-			meshData.Indices32.push_back((i+1)*ringVertexCount + j);
-			meshData.Indices32.push_back((i+1)*ringVertexCount + j+1);
-
-			meshData.Indices32.push_back(i*ringVertexCount + j);
-			meshData.Indices32.push_back((i+1)*ringVertexCount + j+1);
-			meshData.Indices32.push_back(i*ringVertexCount + j+1);
+			out.AddTriangle(i*ringVertexCount + j, (i+1)*ringVertexCount + j, (i+1)*ringVertexCount + j+1);
+			out.AddTriangle(i*ringVertexCount + j, (i+1)*ringVertexCount + j+1, i*ringVertexCount + j+1);
 		}
 	}
 
-	BuildCylinderTopCap(bottomRadius, topRadius, height, sliceCount, stackCount, meshData);
-	BuildCylinderBottomCap(bottomRadius, topRadius, height, sliceCount, stackCount, meshData);
+	BuildCylinderTopCap(bottomRadius, topRadius, height, sliceCount, stackCount, out);
+	BuildCylinderBottomCap(bottomRadius, topRadius, height, sliceCount, stackCount, out);
 
-    return meshData;
+    return size;
 }
 void GeometryGenerator::BuildCylinderTopCap(float bottomRadius, float topRadius, float height,
-											uint32 sliceCount, uint32 stackCount, MeshData& meshData)
+											uint32 sliceCount, uint32 stackCount, MeshWriter& out)
 {
-	uint32 baseIndex = (uint32)meshData.Vertices.size();
+	uint32 baseIndex = out.VertexCount;
 
 	float y = 0.5f*height;
 	float dTheta = 2.0f*XM_PI/sliceCount;
@@ -488,30 +596,28 @@ void GeometryGenerator::BuildCylinderTopCap(float bottomRadius, float topRadius,
 		float u = x/height + 0.5f;
 		float v = z/height + 0.5f;
 
-		meshData.Vertices.push_back( Vertex(x, y, z, 0.0f, 1.0f, 0.0f, 1.0f, 0.0f, 0.0f, u, v) );
+		out.AddVertex( Vertex(x, y, z, 0.0f, 1.0f, 0.0f, 1.0f, 0.0f, 0.0f, u, v) );
 	}
 
 	// Cap center vertex.
-	meshData.Vertices.push_back( Vertex(0.0f, y, 0.0f, 0.0f, 1.0f, 0.0f, 1.0f, 0.0f, 0.0f, 0.5f, 0.5f) );
+	out.AddVertex( Vertex(0.0f, y, 0.0f, 0.0f, 1.0f, 0.0f, 1.0f, 0.0f, 0.0f, 0.5f, 0.5f) );
 
 	// Index of center vertex.
-	uint32 centerIndex = (uint32)meshData.Vertices.size()-1;
+	uint32 centerIndex = out.VertexCount-1;
 
 	for(uint32 i = 0; i < sliceCount; ++i)
 	{
-		meshData.Indices32.push_back(centerIndex);
-		meshData.Indices32.push_back(baseIndex + i+1);
-		meshData.Indices32.push_back(baseIndex + i);
+		out.AddTriangle(centerIndex, baseIndex + i+1, baseIndex + i);
 	}
 }
 void GeometryGenerator::BuildCylinderBottomCap(float bottomRadius, float topRadius, float height,
-											   uint32 sliceCount, uint32 stackCount, MeshData& meshData)
+											   uint32 sliceCount, uint32 stackCount, MeshWriter& out)
 {
 	// 
 	// Build bottom cap.
 	//
 
-	uint32 baseIndex = (uint32)meshData.Vertices.size();
+	uint32 baseIndex = out.VertexCount;
 	float y = -0.5f*height;
 
 	// vertices of ring
@@ -526,31 +632,40 @@ void GeometryGenerator::BuildCylinderBottomCap(float bottomRadius, float topRadi
 		float u = x/height + 0.5f;
 		float v = z/height + 0.5f;
 
-		meshData.Vertices.push_back( Vertex(x, y, z, 0.0f, -1.0f, 0.0f, 1.0f, 0.0f, 0.0f, u, v) );
+		out.AddVertex( Vertex(x, y, z, 0.0f, -1.0f, 0.0f, 1.0f, 0.0f, 0.0f, u, v) );
 	}
 
 	// Cap center vertex.
-	meshData.Vertices.push_back( Vertex(0.0f, y, 0.0f, 0.0f, -1.0f, 0.0f, 1.0f, 0.0f, 0.0f, 0.5f, 0.5f) );
+	out.AddVertex( Vertex(0.0f, y, 0.0f, 0.0f, -1.0f, 0.0f, 1.0f, 0.0f, 0.0f, 0.5f, 0.5f) );
 
 	// Cache the index of center vertex.
-	uint32 centerIndex = (uint32)meshData.Vertices.size()-1;
+	uint32 centerIndex = out.VertexCount-1;
 
 	for(uint32 i = 0; i < sliceCount; ++i)
 	{
-		meshData.Indices32.push_back(centerIndex);
-		meshData.Indices32.push_back(baseIndex + i);
-		meshData.Indices32.push_back(baseIndex + i+1);
+		out.AddTriangle(centerIndex, baseIndex + i, baseIndex + i+1);
 	}
 }
 
 
 GeometryGenerator::MeshData GeometryGenerator::CreateGrid(float width, float depth, uint32 m, uint32 n)
 {
-    MeshData meshData;
+	return ToMeshData([&](Vertex* vertices, uint32* indices)
+	{
+		return CreateGrid(width, depth, m, n, vertices, indices);
+	});
+}
 
+GeometryGenerator::MeshSize GeometryGenerator::CreateGrid(float width, float depth, uint32 m, uint32 n,
+														  Vertex* vertices, uint32* indices)
+{
 	uint32 vertexCount = m*n;
 	uint32 faceCount   = (m-1)*(n-1)*2;
 
+	MeshSize size = { vertexCount, faceCount*3 }; // 3 indices per face
+	if(vertices == nullptr || indices == nullptr)
+		return size;
+
 	//
 	// Create the vertices.
 	//
@@ -564,7 +679,6 @@ GeometryGenerator::MeshData GeometryGenerator::CreateGrid(float width, float dep
 	float du = 1.0f / (n-1);
 	float dv = 1.0f / (m-1);
 
-	meshData.Vertices.resize(vertexCount);
 	for(uint32 i = 0; i < m; ++i)
 	{
 		float z = halfDepth - i*dz;
@@ -572,13 +686,13 @@ GeometryGenerator::MeshData GeometryGenerator::CreateGrid(float width, float dep
 		{
 			float x = -halfWidth + j*dx;
 
-			meshData.Vertices[i*n+j].Position = XMFLOAT3(x, 0.0f, z);
-			meshData.Vertices[i*n+j].Normal   = XMFLOAT3(0.0f, 1.0f, 0.0f);
-			meshData.Vertices[i*n+j].TangentU = XMFLOAT3(1.0f, 0.0f, 0.0f);
+			vertices[i*n+j].Position = XMFLOAT3(x, 0.0f, z);
+			vertices[i*n+j].Normal   = XMFLOAT3(0.0f, 1.0f, 0.0f);
+			vertices[i*n+j].TangentU = XMFLOAT3(1.0f, 0.0f, 0.0f);
 
 			// Stretch texture over grid.
-			meshData.Vertices[i*n+j].TexC.x = j*du;
-			meshData.Vertices[i*n+j].TexC.y = i*dv;
+			vertices[i*n+j].TexC.x = j*du;
+			vertices[i*n+j].TexC.y = i*dv;
 		}
 	}
  
@@ -586,69 +700,75 @@ GeometryGenerator::MeshData GeometryGenerator::CreateGrid(float width, float dep
 	// Create the indices.
 	//
 
-	meshData.Indices32.resize(faceCount*3); // 3 indices per face
-
 	// Iterate over each quad and compute indices.
 	uint32 k = 0;
 	for(uint32 i = 0; i < m-1; ++i)
 	{
 		for(uint32 j = 0; j < n-1; ++j)
 		{
-			meshData.Indices32[k]   = i*n+j;
-			meshData.Indices32[k+1] = i*n+j+1;
-			meshData.Indices32[k+2] = (i+1)*n+j;
+			indices[k]   = i*n+j;
+			indices[k+1] = i*n+j+1;
+			indices[k+2] = (i+1)*n+j;
 
-			meshData.Indices32[k+3] = (i+1)*n+j;
-			meshData.Indices32[k+4] = i*n+j+1;
-			meshData.Indices32[k+5] = (i+1)*n+j+1;
+			indices[k+3] = (i+1)*n+j;
+			indices[k+4] = i*n+j+1;
+			indices[k+5] = (i+1)*n+j+1;
 
 			k += 6; // next quad
 		}
 	}
 
-    return meshData;
+    return size;
 }
 GeometryGenerator::MeshData GeometryGenerator::CreateQuad(float x, float y, float w, float h, float depth)
 {
-    MeshData meshData;
+	return ToMeshData([&](Vertex* vertices, uint32* indices)
+	{
+		return CreateQuad(x, y, w, h, depth, vertices, indices);
+	});
+}
 
-	meshData.Vertices.resize(4);
-	meshData.Indices32.resize(6);
+GeometryGenerator::MeshSize GeometryGenerator::CreateQuad(float x, float y, float w, float h, float depth,
+														  Vertex* vertices, uint32* indices)
+{
+	MeshSize size = { 4, 6 };
+	if(vertices == nullptr || indices == nullptr)
+		return size;
 
 	// Position coordinates specified in NDC space.
-	meshData.Vertices[0] = Vertex(
+	vertices[0] = Vertex(
         x, y - h, depth,
 		0.0f, 0.0f, -1.0f,
 		1.0f, 0.0f, 0.0f,
 		0.0f, 1.0f);
 
-	meshData.Vertices[1] = Vertex(
+	vertices[1] = Vertex(
 		x, y, depth,
 		0.0f, 0.0f, -1.0f,
 		1.0f, 0.0f, 0.0f,
 		0.0f, 0.0f);
 
-	meshData.Vertices[2] = Vertex(
+	vertices[2] = Vertex(
 		x+w, y, depth,
 		0.0f, 0.0f, -1.0f,
 		1.0f, 0.0f, 0.0f,
 		1.0f, 0.0f);
 
-	meshData.Vertices[3] = Vertex(
+	vertices[3] = Vertex(
 		x+w, y-h, depth,
 		0.0f, 0.0f, -1.0f,
 		1.0f, 0.0f, 0.0f,
 		1.0f, 1.0f);
 
-	meshData.Indices32[0] = 0;
-	meshData.Indices32[1] = 1;
-	meshData.Indices32[2] = 2;
+	indices[0] = 0;
+	indices[1] = 1;
+	indices[2] = 2;
 
-	meshData.Indices32[3] = 0;
-	meshData.Indices32[4] = 2;
-	meshData.Indices32[5] = 3;
+	indices[3] = 0;
+	indices[4] = 2;
+	indices[5] = 3;
 
-    return meshData;
+    return size;
 }
 
 GeometryGenerator::MeshData GeometryGenerator::CreateCone(float radius, float height, uint32 sliceCount, uint32 stackCount)
@@ -656,9 +776,28 @@ GeometryGenerator::MeshData GeometryGenerator::CreateCone(float radius, float he
 	// A cone is just a cylinder with topRadius = 0.
 	return CreateCylinder(radius, 0.0f, height, sliceCount, stackCount);
 }
+
+GeometryGenerator::MeshSize GeometryGenerator::CreateCone(float radius, float height, uint32 sliceCount, uint32 stackCount,
+														  Vertex* vertices, uint32* indices)
+{
+	return CreateCylinder(radius, 0.0f, height, sliceCount, stackCount, vertices, indices);
+}
 GeometryGenerator::MeshData GeometryGenerator::CreateTorus(float majorRadius, uint32 sliceCount, uint32 stackCount)
 {
-	MeshData meshData;
+	return ToMeshData([&](Vertex* vertices, uint32* indices)
+	{
+		return CreateTorus(majorRadius, sliceCount, stackCount, vertices, indices);
+	});
+}
+
+GeometryGenerator::MeshSize GeometryGenerator::CreateTorus(float majorRadius, uint32 sliceCount, uint32 stackCount,
+														   Vertex* vertices, uint32* indices)
+{
+	MeshSize size = { (stackCount + 1) * (sliceCount + 1), 6 * stackCount * sliceCount };
+	if (vertices == nullptr || indices == nullptr)
+		return size;
+
+	MeshWriter out(vertices, indices, size);
 
 	// Minor radius: keep it smaller than major radius.
 	const float minorRadius = majorRadius * 0.30f; //Tube thickness
@@ -713,12 +852,12 @@ GeometryGenerator::MeshData GeometryGenerator::CreateTorus(float majorRadius, ui
 			// u wraps around the ring, v wraps around the tube
 			XMFLOAT2 uv(u, v);
 
-			meshData.Vertices.emplace_back(
+			out.AddVertex(Vertex(
 				XMFLOAT3(x, y, z),
 				normal,
 				tangent,
 				uv
-			);
+			));
 		}
 	}
 
@@ -736,21 +875,29 @@ GeometryGenerator::MeshData GeometryGenerator::CreateTorus(float majorRadius, ui
 			const uint32 d = i * stride + (j + 1);
 
 			// Two triangles: (a,b,c) and (a,c,d)
-			meshData.Indices32.push_back(a);
-			meshData.Indices32.push_back(b);
-			meshData.Indices32.push_back(c);
-
-			meshData.Indices32.push_back(a);
-			meshData.Indices32.push_back(c);
-			meshData.Indices32.push_back(d);
+			out.AddTriangle(a, b, c);
+			out.AddTriangle(a, c, d);
 		}
 	}
 
-	return meshData;
+	return size;
 }
 GeometryGenerator::MeshData GeometryGenerator::CreatePyramid(float width, float height, float depth)
 {
-	MeshData meshData;
+	return ToMeshData([&](Vertex* vertices, uint32* indices)
+	{
+		return CreatePyramid(width, height, depth, vertices, indices);
+	});
+}
+
+GeometryGenerator::MeshSize GeometryGenerator::CreatePyramid(float width, float height, float depth, Vertex* vertices, uint32* indices)
+{
+	// A quad base and four triangles, each with its own vertices.
+	MeshSize size = { 16, 18 };
+	if (vertices == nullptr || indices == nullptr)
+		return size;
+
+	MeshWriter out(vertices, indices, size);
 
 	const float w2 = 0.5f * width;
 	const float h2 = 0.5f * height;
@@ -784,17 +931,15 @@ GeometryGenerator::MeshData GeometryGenerator::CreatePyramid(float width, float
 	XMFLOAT3 nBase(0.0f, -1.0f, 0.0f);
 	XMFLOAT3 tBase(1.0f, 0.0f, 0.0f);
 
-	uint32 baseStart = (uint32)meshData.Vertices.size();
-	meshData.Vertices.emplace_back(p0, nBase, tBase, XMFLOAT2(0, 1));
-	meshData.Vertices.emplace_back(p1, nBase, tBase, XMFLOAT2(1, 1));
-	meshData.Vertices.emplace_back(p2, nBase, tBase, XMFLOAT2(1, 0));
-	meshData.Vertices.emplace_back(p3, nBase, tBase, XMFLOAT2(0, 0));
+	uint32 baseStart = out.VertexCount;
+	out.AddVertex(Vertex(p0, nBase, tBase, XMFLOAT2(0, 1)));
+	out.AddVertex(Vertex(p1, nBase, tBase, XMFLOAT2(1, 1)));
+	out.AddVertex(Vertex(p2, nBase, tBase, XMFLOAT2(1, 0)));
+	out.AddVertex(Vertex(p3, nBase, tBase, XMFLOAT2(0, 0)));
 
 	// Indices for base (make sure winding gives outward; base is outward downward)
-	meshData.Indices32.insert(meshData.Indices32.end(), {
-		baseStart + 0, baseStart + 2, baseStart + 1,
-		baseStart + 0, baseStart + 3, baseStart + 2
-		});
+	out.AddTriangle(baseStart + 0, baseStart + 2, baseStart + 1);
+	out.AddTriangle(baseStart + 0, baseStart + 3, baseStart + 2);
 
 	// 4 side faces
 	auto addTriFace = [&](const XMFLOAT3& a, const XMFLOAT3& b, const XMFLOAT3& c)
@@ -802,14 +947,12 @@ GeometryGenerator::MeshData GeometryGenerator::CreatePyramid(float width, float
 			XMFLOAT3 n = faceNormal(a, b, c);
 			XMFLOAT3 t(1, 0, 0);
 
-			uint32 start = (uint32)meshData.Vertices.size();
-			meshData.Vertices.emplace_back(a, n, t, XMFLOAT2(0, 1));
-			meshData.Vertices.emplace_back(b, n, t, XMFLOAT2(1, 1));
-			meshData.Vertices.emplace_back(c, n, t, XMFLOAT2(0.5f, 0));
+			uint32 start = out.VertexCount;
+			out.AddVertex(Vertex(a, n, t, XMFLOAT2(0, 1)));
+			out.AddVertex(Vertex(b, n, t, XMFLOAT2(1, 1)));
+			out.AddVertex(Vertex(c, n, t, XMFLOAT2(0.5f, 0)));
 
-			meshData.Indices32.push_back(start + 0);
-			meshData.Indices32.push_back(start + 1);
-			meshData.Indices32.push_back(start + 2);
+			out.AddTriangle(start + 0, start + 1, start + 2);
 		};
 
 	addTriFace(p0, p1, apex);
@@ -817,11 +960,24 @@ GeometryGenerator::MeshData GeometryGenerator::CreatePyramid(float width, float
 	addTriFace(p2, p3, apex);
 	addTriFace(p3, p0, apex);
 
-	return meshData;
+	return size;
 }
 GeometryGenerator::MeshData GeometryGenerator::CreateWedge(float width, float height, float depth)
 {
-	MeshData meshData;
+	return ToMeshData([&](Vertex* vertices, uint32* indices)
+	{
+		return CreateWedge(width, height, depth, vertices, indices);
+	});
+}
+
+GeometryGenerator::MeshSize GeometryGenerator::CreateWedge(float width, float height, float depth, Vertex* vertices, uint32* indices)
+{
+	// Three quads and two triangles, each with its own vertices.
+	MeshSize size = { 18, 24 };
+	if (vertices == nullptr || indices == nullptr)
+		return size;
+
+	MeshWriter out(vertices, indices, size);
 
 	// Half sizes
 	const float w2 = 0.5f * width;
@@ -857,14 +1013,12 @@ GeometryGenerator::MeshData GeometryGenerator::CreateWedge(float width, float he
 			XMFLOAT3 n = faceNormal(a, b, c);
 			XMFLOAT3 t(1, 0, 0);
 
-			uint32 start = (uint32)meshData.Vertices.size();
-			meshData.Vertices.emplace_back(a, n, t, XMFLOAT2(0, 1));
-			meshData.Vertices.emplace_back(b, n, t, XMFLOAT2(1, 1));
-			meshData.Vertices.emplace_back(c, n, t, XMFLOAT2(0.5f, 0));
+			uint32 start = out.VertexCount;
+			out.AddVertex(Vertex(a, n, t, XMFLOAT2(0, 1)));
+			out.AddVertex(Vertex(b, n, t, XMFLOAT2(1, 1)));
+			out.AddVertex(Vertex(c, n, t, XMFLOAT2(0.5f, 0)));
 
-			meshData.Indices32.push_back(start + 0);
-			meshData.Indices32.push_back(start + 1);
-			meshData.Indices32.push_back(start + 2);
+			out.AddTriangle(start + 0, start + 1, start + 2);
 		};
 
 	// Quad builder
@@ -873,16 +1027,14 @@ GeometryGenerator::MeshData GeometryGenerator::CreateWedge(float width, float he
 			XMFLOAT3 n = faceNormal(a, b, c);
 			XMFLOAT3 t(1, 0, 0);
 
-			uint32 start = (uint32)meshData.Vertices.size();
-			meshData.Vertices.emplace_back(a, n, t, XMFLOAT2(0, 1));
-			meshData.Vertices.emplace_back(b, n, t, XMFLOAT2(1, 1));
-			meshData.Vertices.emplace_back(c, n, t, XMFLOAT2(1, 0));
-			meshData.Vertices.emplace_back(d, n, t, XMFLOAT2(0, 0));
+			uint32 start = out.VertexCount;
+			out.AddVertex(Vertex(a, n, t, XMFLOAT2(0, 1)));
+			out.AddVertex(Vertex(b, n, t, XMFLOAT2(1, 1)));
+			out.AddVertex(Vertex(c, n, t, XMFLOAT2(1, 0)));
+			out.AddVertex(Vertex(d, n, t, XMFLOAT2(0, 0)));
 
-			meshData.Indices32.insert(meshData.Indices32.end(), {
-				start + 0, start + 1, start + 2,
-				start + 0, start + 2, start + 3
-				});
+			out.AddTriangle(start + 0, start + 1, start + 2);
+			out.AddTriangle(start + 0, start + 2, start + 3);
 		};
 
 	// Bottom face
@@ -903,12 +1055,24 @@ GeometryGenerator::MeshData GeometryGenerator::CreateWedge(float width, float he
 	// No right wall
 
 	// Return mesh
-	return meshData;
+	return size;
 }
 
 GeometryGenerator::MeshData GeometryGenerator::CreateDiamond(float radius)
 {
-	MeshData meshData;
+	return ToMeshData([&](Vertex* vertices, uint32* indices)
+	{
+		return CreateDiamond(radius, vertices, indices);
+	});
+}
+
+GeometryGenerator::MeshSize GeometryGenerator::CreateDiamond(float radius, Vertex* vertices, uint32* indices)
+{
+	MeshSize size = { 6, 24 };
+	if (vertices == nullptr || indices == nullptr)
+		return size;
+
+	MeshWriter out(vertices, indices, size);
 
 	XMFLOAT3 top(0, +radius, 0);
 	XMFLOAT3 bot(0, -radius, 0);
@@ -921,34 +1085,43 @@ GeometryGenerator::MeshData GeometryGenerator::CreateDiamond(float radius)
 	// We can share vertices; normals are not used in your current shader.
 	// We reuse the same vertices for multiple faces to reduce memory usage.
 
-	meshData.Vertices.emplace_back(top, XMFLOAT3(0, 1, 0), XMFLOAT3(1, 0, 0), XMFLOAT2(0, 0)); //0
-	meshData.Vertices.emplace_back(bot, XMFLOAT3(0, -1, 0), XMFLOAT3(1, 0, 0), XMFLOAT2(0, 1)); //1
-	meshData.Vertices.emplace_back(a, XMFLOAT3(1, 0, 0), XMFLOAT3(0, 0, 1), XMFLOAT2(1, 0)); //2
-	meshData.Vertices.emplace_back(b, XMFLOAT3(-1, 0, 0), XMFLOAT3(0, 0, 1), XMFLOAT2(0, 0)); //3
-	meshData.Vertices.emplace_back(c, XMFLOAT3(0, 0, 1), XMFLOAT3(1, 0, 0), XMFLOAT2(1, 1)); //4
-	meshData.Vertices.emplace_back(d, XMFLOAT3(0, 0, -1), XMFLOAT3(1, 0, 0), XMFLOAT2(0, 1)); //5
+	out.AddVertex(Vertex(top, XMFLOAT3(0, 1, 0), XMFLOAT3(1, 0, 0), XMFLOAT2(0, 0))); //0
+	out.AddVertex(Vertex(bot, XMFLOAT3(0, -1, 0), XMFLOAT3(1, 0, 0), XMFLOAT2(0, 1))); //1
+	out.AddVertex(Vertex(a, XMFLOAT3(1, 0, 0), XMFLOAT3(0, 0, 1), XMFLOAT2(1, 0))); //2
+	out.AddVertex(Vertex(b, XMFLOAT3(-1, 0, 0), XMFLOAT3(0, 0, 1), XMFLOAT2(0, 0))); //3
+	out.AddVertex(Vertex(c, XMFLOAT3(0, 0, 1), XMFLOAT3(1, 0, 0), XMFLOAT2(1, 1))); //4
+	out.AddVertex(Vertex(d, XMFLOAT3(0, 0, -1), XMFLOAT3(1, 0, 0), XMFLOAT2(0, 1))); //5
 
 	// Top 4 triangles
-	meshData.Indices32.insert(meshData.Indices32.end(), {
-		0, 2, 4,
-		0, 4, 3,
-		0, 3, 5,
-		0, 5, 2
-		});
+	out.AddTriangle(0, 2, 4);
+	out.AddTriangle(0, 4, 3);
+	out.AddTriangle(0, 3, 5);
+	out.AddTriangle(0, 5, 2);
 
 	// Bottom 4 triangles
-	meshData.Indices32.insert(meshData.Indices32.end(), {
-		1, 4, 2,
-		1, 3, 4,
-		1, 5, 3,
-		1, 2, 5
-		});
-
-	return meshData;
+	out.AddTriangle(1, 4, 2);
+	out.AddTriangle(1, 3, 4);
+	out.AddTriangle(1, 5, 3);
+	out.AddTriangle(1, 2, 5);
+
+	return size;
 }
 GeometryGenerator::MeshData GeometryGenerator::CreateTriPrism(float width, float height, float depth)
 {
-	MeshData meshData;
+	return ToMeshData([&](Vertex* vertices, uint32* indices)
+	{
+		return CreateTriPrism(width, height, depth, vertices, indices);
+	});
+}
+
+GeometryGenerator::MeshSize GeometryGenerator::CreateTriPrism(float width, float height, float depth, Vertex* vertices, uint32* indices)
+{
+	// Two triangles and three quads, each with its own vertices.
+	MeshSize size = { 18, 24 };
+	if (vertices == nullptr || indices == nullptr)
+		return size;
+
+	MeshWriter out(vertices, indices, size);
 
 	const float w2 = 0.5f * width;
 	const float h2 = 0.5f * height;
@@ -982,14 +1155,12 @@ GeometryGenerator::MeshData GeometryGenerator::CreateTriPrism(float width, float
 			XMFLOAT3 n = faceNormal(a, b, c);
 			XMFLOAT3 t(1, 0, 0);
 
-			uint32 start = (uint32)meshData.Vertices.size();
-			meshData.Vertices.emplace_back(a, n, t, XMFLOAT2(0, 1));
-			meshData.Vertices.emplace_back(b, n, t, XMFLOAT2(1, 1));
-			meshData.Vertices.emplace_back(c, n, t, XMFLOAT2(0.5f, 0));
+			uint32 start = out.VertexCount;
+			out.AddVertex(Vertex(a, n, t, XMFLOAT2(0, 1)));
+			out.AddVertex(Vertex(b, n, t, XMFLOAT2(1, 1)));
+			out.AddVertex(Vertex(c, n, t, XMFLOAT2(0.5f, 0)));
 
-			meshData.Indices32.push_back(start + 0);
-			meshData.Indices32.push_back(start + 1);
-			meshData.Indices32.push_back(start + 2);
+			out.AddTriangle(start + 0, start + 1, start + 2);
 		};
 
 	auto addQuad = [&](const XMFLOAT3& a, const XMFLOAT3& b, const XMFLOAT3& c, const XMFLOAT3& d)
@@ -997,16 +1168,14 @@ GeometryGenerator::MeshData GeometryGenerator::CreateTriPrism(float width, float
 			XMFLOAT3 n = faceNormal(a, b, c);
 			XMFLOAT3 t(1, 0, 0);
 
-			uint32 start = (uint32)meshData.Vertices.size();
-			meshData.Vertices.emplace_back(a, n, t, XMFLOAT2(0, 1));
-			meshData.Vertices.emplace_back(b, n, t, XMFLOAT2(1, 1));
-			meshData.Vertices.emplace_back(c, n, t, XMFLOAT2(1, 0));
-			meshData.Vertices.emplace_back(d, n, t, XMFLOAT2(0, 0));
+			uint32 start = out.VertexCount;
+			out.AddVertex(Vertex(a, n, t, XMFLOAT2(0, 1)));
+			out.AddVertex(Vertex(b, n, t, XMFLOAT2(1, 1)));
+			out.AddVertex(Vertex(c, n, t, XMFLOAT2(1, 0)));
+			out.AddVertex(Vertex(d, n, t, XMFLOAT2(0, 0)));
 
-			meshData.Indices32.insert(meshData.Indices32.end(), {
-				start + 0, start + 1, start + 2,
-				start + 0, start + 2, start + 3
-				});
+			out.AddTriangle(start + 0, start + 1, start + 2);
+			out.AddTriangle(start + 0, start + 2, start + 3);
 		};
 
 	// Front triangle (make sure outward normal faces -Z)
@@ -1020,5 +1189,5 @@ GeometryGenerator::MeshData GeometryGenerator::CreateTriPrism(float width, float
 	addQuad(f1, f2, b2, b1); // right side
 	addQuad(f2, f0, b0, b2); // left side
 
-	return meshData;
+	return size;
 }
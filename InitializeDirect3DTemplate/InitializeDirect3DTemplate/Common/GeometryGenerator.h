@@ -14,6 +14,7 @@
 
 #pragma once
 
+#include <cassert>
 #include <cstdint>
 #include <DirectXMath.h>
 #include <vector>
@@ -74,35 +75,108 @@ public:
 		std::vector<uint16> mIndices16;
 	};
 
+	struct MeshSize
+	{
+		uint32 VertexCount = 0;
+		uint32 IndexCount = 0;
+	};
+
+	// Every shape comes in two forms.  The MeshData one allocates the mesh.
+	// The other writes it into the caller's arrays, such as one arena shared by
+	// many meshes or mapped upload memory: with null arrays it only returns
+	// the size they need, otherwise it fills them and returns the same size.
+	// Its indices count from the first vertex written.
+
     MeshData CreateBox(float width, float height, float depth, uint32 numSubdivisions);
+	MeshSize CreateBox(float width, float height, float depth, uint32 numSubdivisions, Vertex* vertices, uint32* indices);
 
     MeshData CreateSphere(float radius, uint32 sliceCount, uint32 stackCount);
+	MeshSize CreateSphere(float radius, uint32 sliceCount, uint32 stackCount, Vertex* vertices, uint32* indices);
 
     MeshData CreateGeosphere(float radius, uint32 numSubdivisions);
+	MeshSize CreateGeosphere(float radius, uint32 numSubdivisions, Vertex* vertices, uint32* indices);
 
     MeshData CreateCylinder(float bottomRadius, float topRadius, float height, uint32 sliceCount, uint32 stackCount);
+	MeshSize CreateCylinder(float bottomRadius, float topRadius, float height, uint32 sliceCount, uint32 stackCount, Vertex* vertices, uint32* indices);
 
     MeshData CreateGrid(float width, float depth, uint32 m, uint32 n);
+	MeshSize CreateGrid(float width, float depth, uint32 m, uint32 n, Vertex* vertices, uint32* indices);
 	
 	MeshData CreateCone(float radius, float height, uint32 sliceCount, uint32 stackCount);
+	MeshSize CreateCone(float radius, float height, uint32 sliceCount, uint32 stackCount, Vertex* vertices, uint32* indices);
 
 	MeshData CreateTorus(float majorRadius, uint32 sliceCount, uint32 stackCount);
+	MeshSize CreateTorus(float majorRadius, uint32 sliceCount, uint32 stackCount, Vertex* vertices, uint32* indices);
 
 	MeshData CreatePyramid(float width, float height, float depth);
+	MeshSize CreatePyramid(float width, float height, float depth, Vertex* vertices, uint32* indices);
 
 	MeshData CreateWedge(float width, float height, float depth);
+	MeshSize CreateWedge(float width, float height, float depth, Vertex* vertices, uint32* indices);
 
 	MeshData CreateDiamond(float radius);
+	MeshSize CreateDiamond(float radius, Vertex* vertices, uint32* indices);
 
 	MeshData CreateTriPrism(float width, float height, float depth);
+	MeshSize CreateTriPrism(float width, float height, float depth, Vertex* vertices, uint32* indices);
 
     MeshData CreateQuad(float x, float y, float w, float h, float depth);
+	MeshSize CreateQuad(float x, float y, float w, float h, float depth, Vertex* vertices, uint32* indices);
+
 	void Subdivide(MeshData& meshData);
 
 private:
-	
+
+	// Appends to the caller's arrays, checking they were sized for the mesh.
+	struct MeshWriter
+	{
+		MeshWriter(Vertex* vertices, uint32* indices, const MeshSize& size) :
+			Vertices(vertices),
+			Indices(indices),
+			Size(size){}
+
+		void AddVertex(const Vertex& v)
+		{
+			assert(VertexCount < Size.VertexCount);
+			Vertices[VertexCount++] = v;
+		}
+
+		void AddTriangle(uint32 i0, uint32 i1, uint32 i2)
+		{
+			assert(IndexCount + 3 <= Size.IndexCount);
+			Indices[IndexCount++] = i0;
+			Indices[IndexCount++] = i1;
+			Indices[IndexCount++] = i2;
+		}
+
+		Vertex* Vertices;
+		uint32* Indices;
+		MeshSize Size;
+		uint32 VertexCount = 0;
+		uint32 IndexCount = 0;
+	};
+
+	// The MeshData form of a shape from its array form.
+	template<typename CreateFn>
+	static MeshData ToMeshData(CreateFn create)
+	{
+		MeshData meshData;
+
+		MeshSize size = create(nullptr, nullptr);
+		meshData.Vertices.resize(size.VertexCount);
+		meshData.Indices32.resize(size.IndexCount);
+		create(meshData.Vertices.data(), meshData.Indices32.data());
+
+		return meshData;
+	}
+
+	// Subdivide applied levelCount times to one triangle, in the same order,
+	// so a mesh can be subdivided straight into its final arrays.
+	void SubdivideTriangle(const Vertex& v0, const Vertex& v1, const Vertex& v2, uint32 levelCount, MeshWriter& out);
+	static MeshSize GetSubdividedSize(uint32 triangleCount, uint32 numSubdivisions);
+
     Vertex MidPoint(const Vertex& v0, const Vertex& v1);
-    void BuildCylinderTopCap(float bottomRadius, float topRadius, float height, uint32 sliceCount, uint32 stackCount, MeshData& meshData);
-    void BuildCylinderBottomCap(float bottomRadius, float topRadius, float height, uint32 sliceCount, uint32 stackCount, MeshData& meshData);
+    void BuildCylinderTopCap(float bottomRadius, float topRadius, float height, uint32 sliceCount, uint32 stackCount, MeshWriter& out);
+    void BuildCylinderBottomCap(float bottomRadius, float topRadius, float height, uint32 sliceCount, uint32 stackCount, MeshWriter& out);
 };
 
@@ -0,0 +1,350 @@
+//***************************************************************************************
+// MeshCache.cpp
+//***************************************************************************************
+
+#include "MeshCache.h"
+
+using namespace DirectX;
+
+// File layout: MeshCacheHeader, SectionCount MeshCacheSections, then the section
+// payloads at 16-byte aligned offsets.  A geometry payload is a MeshCacheGeometry,
+// Count MeshCacheSubmeshes, the vertex data and the index data, each aligned.
+static const UINT MeshCacheMagic = 0x4843534d; // "MSCH"
+static const UINT MeshCacheFormatVersion = 1;
+static const UINT64 MeshCacheAlignment = 16;
+
+enum MeshCacheSectionType
+{
+	SectionGeometry = 1,
+	SectionBoxes,
+	SectionPoints
+};
+
+struct MeshCacheHeader
+{
+	UINT Magic;
+	UINT FormatVersion;
+	UINT ContentVersion;
+	UINT SectionCount;
+	UINT64 FileSize;
+};
+
+struct MeshCacheSection
+{
+	char Name[48];
+	UINT Type;
+	UINT Count;
+	UINT64 Offset;
+	UINT64 ByteSize;
+};
+
+struct MeshCacheGeometry
+{
+	UINT VertexByteStride;
+	UINT VertexBufferByteSize;
+	UINT IndexFormat;
+	UINT IndexBufferByteSize;
+};
+
+struct MeshCacheSubmesh
+{
+	char Name[48];
+	UINT IndexCount;
+	UINT StartIndexLocation;
+	INT BaseVertexLocation;
+	XMFLOAT3 Center;
+	XMFLOAT3 Extents;
+	UINT Pad;
+};
+
+static UINT64 AlignOffset(UINT64 offset)
+{
+	return (offset + MeshCacheAlignment - 1) & ~(MeshCacheAlignment - 1);
+}
+
+static void CopyName(char (&dst)[48], const std::string& name)
+{
+	assert(name.size() < sizeof(dst));
+
+	memset(dst, 0, sizeof(dst));
+	memcpy(dst, name.data(), MathHelper::Min(name.size(), sizeof(dst) - 1));
+}
+
+static std::string ReadName(const char (&src)[48])
+{
+	return std::string(src, strnlen(src, sizeof(src)));
+}
+
+//****************************************************************************
+// MeshCacheReader
+//****************************************************************************
+
+MeshCacheReader::~MeshCacheReader()
+{
+	Close();
+}
+
+bool MeshCacheReader::Open(const std::wstring& filename, UINT contentVersion)
+{
+	Close();
+
+	mFile = CreateFileW(filename.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr,
+		OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL | FILE_FLAG_SEQUENTIAL_SCAN, nullptr);
+	if(mFile == INVALID_HANDLE_VALUE)
+		return false;
+
+	LARGE_INTEGER fileSize = {};
+	if(!GetFileSizeEx(mFile, &fileSize) || fileSize.QuadPart < (LONGLONG)sizeof(MeshCacheHeader))
+	{
+		Close();
+		return false;
+	}
+
+	mMapping = CreateFileMappingW(mFile, nullptr, PAGE_READONLY, 0, 0, nullptr);
+	if(mMapping != nullptr)
+		mData = static_cast<const BYTE*>(MapViewOfFile(mMapping, FILE_MAP_READ, 0, 0, 0));
+
+	if(mData == nullptr)
+	{
+		Close();
+		return false;
+	}
+
+	mSize = (UINT64)fileSize.QuadPart;
+
+	const MeshCacheHeader* header = reinterpret_cast<const MeshCacheHeader*>(mData);
+	bool valid =
+		header->Magic == MeshCacheMagic &&
+		header->FormatVersion == MeshCacheFormatVersion &&
+		header->ContentVersion == contentVersion &&
+		header->FileSize == mSize &&
+		sizeof(MeshCacheHeader) + (UINT64)header->SectionCount * sizeof(MeshCacheSection) <= mSize;
+
+	// Every payload has to lie inside the file.
+	const MeshCacheSection* sections = reinterpret_cast<const MeshCacheSection*>(header + 1);
+	for(UINT i = 0; valid && i < header->SectionCount; ++i)
+		valid = sections[i].Offset <= mSize && sections[i].ByteSize <= mSize - sections[i].Offset;
+
+	if(!valid)
+	{
+		Close();
+		return false;
+	}
+
+	return true;
+}
+
+void MeshCacheReader::Close()
+{
+	if(mData != nullptr)
+		UnmapViewOfFile(mData);
+	if(mMapping != nullptr)
+		CloseHandle(mMapping);
+	if(mFile != INVALID_HANDLE_VALUE)
+		CloseHandle(mFile);
+
+	mData = nullptr;
+	mMapping = nullptr;
+	mFile = INVALID_HANDLE_VALUE;
+	mSize = 0;
+}
+
+bool MeshCacheReader::FindGeometry(const std::string& name, GeometryView& view)const
+{
+	const MeshCacheSection* section = FindSection(name, SectionGeometry);
+	if(section == nullptr || section->ByteSize < sizeof(MeshCacheGeometry))
+		return false;
+
+	const BYTE* payload = mData + section->Offset;
+	const MeshCacheGeometry* geometry = reinterpret_cast<const MeshCacheGeometry*>(payload);
+	const MeshCacheSubmesh* submeshes = reinterpret_cast<const MeshCacheSubmesh*>(geometry + 1);
+
+	UINT64 vertexOffset = AlignOffset(sizeof(MeshCacheGeometry) + (UINT64)section->Count * sizeof(MeshCacheSubmesh));
+	UINT64 indexOffset = AlignOffset(vertexOffset + geometry->VertexBufferByteSize);
+	if(indexOffset + geometry->IndexBufferByteSize > section->ByteSize)
+		return false;
+
+	view.VertexByteStride = geometry->VertexByteStride;
+	view.VertexBufferByteSize = geometry->VertexBufferByteSize;
+	view.IndexFormat = (DXGI_FORMAT)geometry->IndexFormat;
+	view.IndexBufferByteSize = geometry->IndexBufferByteSize;
+	view.VertexData = payload + vertexOffset;
+	view.IndexData = payload + indexOffset;
+
+	view.DrawArgs.clear();
+	for(UINT i = 0; i < section->Count; ++i)
+	{
+		SubmeshGeometry submesh;
+		submesh.IndexCount = submeshes[i].IndexCount;
+		submesh.StartIndexLocation = submeshes[i].StartIndexLocation;
+		submesh.BaseVertexLocation = submeshes[i].BaseVertexLocation;
+		submesh.Bounds = BoundingBox(submeshes[i].Center, submeshes[i].Extents);
+
+		view.DrawArgs[ReadName(submeshes[i].Name)] = submesh;
+	}
+
+	return true;
+}
+
+bool MeshCacheReader::FindBoxes(const std::string& name, std::vector<BoundingBox>& boxes)const
+{
+	const MeshCacheSection* section = FindSection(name, SectionBoxes);
+	if(section == nullptr || section->ByteSize < (UINT64)section->Count * sizeof(BoundingBox))
+		return false;
+
+	const BoundingBox* data = reinterpret_cast<const BoundingBox*>(mData + section->Offset);
+	boxes.assign(data, data + section->Count);
+
+	return true;
+}
+
+bool MeshCacheReader::FindPoints(const std::string& name, std::vector<XMFLOAT3>& points)const
+{
+	const MeshCacheSection* section = FindSection(name, SectionPoints);
+	if(section == nullptr || section->ByteSize < (UINT64)section->Count * sizeof(XMFLOAT3))
+		return false;
+
+	const XMFLOAT3* data = reinterpret_cast<const XMFLOAT3*>(mData + section->Offset);
+	points.assign(data, data + section->Count);
+
+	return true;
+}
+
+const MeshCacheSection* MeshCacheReader::FindSection(const std::string& name, UINT type)const
+{
+	if(mData == nullptr)
+		return nullptr;
+
+	const MeshCacheHeader* header = reinterpret_cast<const MeshCacheHeader*>(mData);
+	const MeshCacheSection* sections = reinterpret_cast<const MeshCacheSection*>(header + 1);
+
+	for(UINT i = 0; i < header->SectionCount; ++i)
+	{
+		if(sections[i].Type == type && ReadName(sections[i].Name) == name)
+			return &sections[i];
+	}
+
+	return nullptr;
+}
+
+//****************************************************************************
+// MeshCacheWriter
+//****************************************************************************
+
+void MeshCacheWriter::AddGeometry(const MeshGeometry& geo)
+{
+	assert(geo.VertexBufferCPU != nullptr && geo.IndexBufferCPU != nullptr);
+
+	MeshCacheGeometry geometry = {};
+	geometry.VertexByteStride = geo.VertexByteStride;
+	geometry.VertexBufferByteSize = geo.VertexBufferByteSize;
+	geometry.IndexFormat = (UINT)geo.IndexFormat;
+	geometry.IndexBufferByteSize = geo.IndexBufferByteSize;
+
+	const UINT64 vertexOffset = AlignOffset(sizeof(MeshCacheGeometry) + geo.DrawArgs.size() * sizeof(MeshCacheSubmesh));
+	const UINT64 indexOffset = AlignOffset(vertexOffset + geo.VertexBufferByteSize);
+
+	std::vector<BYTE> data((size_t)(indexOffset + geo.IndexBufferByteSize), 0);
+	memcpy(data.data(), &geometry, sizeof(geometry));
+
+	MeshCacheSubmesh* submeshes = reinterpret_cast<MeshCacheSubmesh*>(data.data() + sizeof(MeshCacheGeometry));
+	for(const auto& e : geo.DrawArgs)
+	{
+		MeshCacheSubmesh submesh = {};
+		CopyName(submesh.Name, e.first);
+		submesh.IndexCount = e.second.IndexCount;
+		submesh.StartIndexLocation = e.second.StartIndexLocation;
+		submesh.BaseVertexLocation = e.second.BaseVertexLocation;
+		submesh.Center = e.second.Bounds.Center;
+		submesh.Extents = e.second.Bounds.Extents;
+
+		*submeshes++ = submesh;
+	}
+
+	memcpy(data.data() + vertexOffset, geo.VertexBufferCPU->GetBufferPointer(), geo.VertexBufferByteSize);
+	memcpy(data.data() + indexOffset, geo.IndexBufferCPU->GetBufferPointer(), geo.IndexBufferByteSize);
+
+	AddSection(geo.Name, SectionGeometry, (UINT)geo.DrawArgs.size(), data.data(), data.size());
+}
+
+void MeshCacheWriter::AddBoxes(const std::string& name, const std::vector<BoundingBox>& boxes)
+{
+	AddSection(name, SectionBoxes, (UINT)boxes.size(), boxes.data(), boxes.size() * sizeof(BoundingBox));
+}
+
+void MeshCacheWriter::AddPoints(const std::string& name, const std::vector<XMFLOAT3>& points)
+{
+	AddSection(name, SectionPoints, (UINT)points.size(), points.data(), points.size() * sizeof(XMFLOAT3));
+}
+
+void MeshCacheWriter::AddSection(const std::string& name, UINT type, UINT count, const void* data, size_t byteSize)
+{
+	Section section;
+	section.Name = name;
+	section.Type = type;
+	section.Count = count;
+	section.Data.assign(static_cast<const BYTE*>(data), static_cast<const BYTE*>(data) + byteSize);
+
+	mSections.push_back(std::move(section));
+}
+
+bool MeshCacheWriter::Save(const std::wstring& filename, UINT contentVersion)const
+{
+	std::vector<MeshCacheSection> table(mSections.size());
+
+	UINT64 offset = AlignOffset(sizeof(MeshCacheHeader) + table.size() * sizeof(MeshCacheSection));
+	for(size_t i = 0; i < mSections.size(); ++i)
+	{
+		memset(&table[i], 0, sizeof(MeshCacheSection));
+		CopyName(table[i].Name, mSections[i].Name);
+		table[i].Type = mSections[i].Type;
+		table[i].Count = mSections[i].Count;
+		table[i].Offset = offset;
+		table[i].ByteSize = mSections[i].Data.size();
+
+		offset = AlignOffset(offset + mSections[i].Data.size());
+	}
+
+	MeshCacheHeader header = {};
+	header.Magic = MeshCacheMagic;
+	header.FormatVersion = MeshCacheFormatVersion;
+	header.ContentVersion = contentVersion;
+	header.SectionCount = (UINT)table.size();
+	header.FileSize = offset;
+
+	std::wstring tempFilename = filename + L".tmp";
+
+	HANDLE file = CreateFileW(tempFilename.c_str(), GENERIC_WRITE, 0, nullptr,
+		CREATE_ALWAYS, FILE_ATTRIBUTE_NORMAL, nullptr);
+	if(file == INVALID_HANDLE_VALUE)
+		return false;
+
+	UINT64 written = 0;
+	auto write = [&](const void* data, UINT64 byteSize)
+	{
+		DWORD count = 0;
+		bool ok = WriteFile(file, data, (DWORD)byteSize, &count, nullptr) && count == byteSize;
+		written += byteSize;
+		return ok;
+	};
+
+	static const BYTE zeros[MeshCacheAlignment] = {};
+	auto pad = [&]()
+	{
+		return write(zeros, AlignOffset(written) - written);
+	};
+
+	bool ok = write(&header, sizeof(header)) && write(table.data(), table.size() * sizeof(MeshCacheSection)) && pad();
+	for(size_t i = 0; ok && i < mSections.size(); ++i)
+		ok = write(mSections[i].Data.data(), mSections[i].Data.size()) && pad();
+
+	CloseHandle(file);
+
+	if(!ok || !MoveFileExW(tempFilename.c_str(), filename.c_str(), MOVEFILE_REPLACE_EXISTING))
+	{
+		DeleteFileW(tempFilename.c_str());
+		return false;
+	}
+
+	return true;
+}
@@ -0,0 +1,92 @@
+//***************************************************************************************
+// MeshCache.h
+//
+// Versioned binary cache of generated scene data: MeshGeometry vertex/index data
+// with its submesh table, and named arrays of boxes and points.  The writer collects
+// sections in memory and writes them in one go; the reader memory-maps the file and
+// hands out views into it, so a cached scene goes from disk to the upload heap
+// without being parsed or copied on the CPU.
+//
+// A file is only accepted when both the format version and the caller's content
+// version match, so bumping the content version whenever the generators change
+// invalidates old caches.
+//***************************************************************************************
+
+#pragma once
+
+#include "d3dUtil.h"
+#include <string>
+#include <vector>
+#include <unordered_map>
+
+struct MeshCacheSection;
+
+class MeshCacheReader
+{
+public:
+	struct GeometryView
+	{
+		UINT VertexByteStride = 0;
+		UINT VertexBufferByteSize = 0;
+		DXGI_FORMAT IndexFormat = DXGI_FORMAT_R16_UINT;
+		UINT IndexBufferByteSize = 0;
+
+		// Point into the mapped file.
+		const void* VertexData = nullptr;
+		const void* IndexData = nullptr;
+
+		std::unordered_map<std::string, SubmeshGeometry> DrawArgs;
+	};
+
+public:
+	MeshCacheReader() = default;
+	MeshCacheReader(const MeshCacheReader& rhs) = delete;
+	MeshCacheReader& operator=(const MeshCacheReader& rhs) = delete;
+	~MeshCacheReader();
+
+	// Returns false if the file is missing, was written by another format or
+	// content version, or is truncated.
+	bool Open(const std::wstring& filename, UINT contentVersion);
+	void Close();
+
+	// The views stay valid until Close().
+	bool FindGeometry(const std::string& name, GeometryView& view)const;
+	bool FindBoxes(const std::string& name, std::vector<DirectX::BoundingBox>& boxes)const;
+	bool FindPoints(const std::string& name, std::vector<DirectX::XMFLOAT3>& points)const;
+
+private:
+	const MeshCacheSection* FindSection(const std::string& name, UINT type)const;
+
+private:
+	HANDLE mFile = INVALID_HANDLE_VALUE;
+	HANDLE mMapping = nullptr;
+	const BYTE* mData = nullptr;
+	UINT64 mSize = 0;
+};
+
+class MeshCacheWriter
+{
+public:
+	// Copies the geometry's VertexBufferCPU and IndexBufferCPU.
+	void AddGeometry(const MeshGeometry& geo);
+	void AddBoxes(const std::string& name, const std::vector<DirectX::BoundingBox>& boxes);
+	void AddPoints(const std::string& name, const std::vector<DirectX::XMFLOAT3>& points);
+
+	// Writes next to filename first and renames it over, so an interrupted
+	// write never leaves a file the reader would accept.
+	bool Save(const std::wstring& filename, UINT contentVersion)const;
+
+private:
+	struct Section
+	{
+		std::string Name;
+		UINT Type = 0;
+		UINT Count = 0;
+		std::vector<BYTE> Data;
+	};
+
+	void AddSection(const std::string& name, UINT type, UINT count, const void* data, size_t byteSize);
+
+private:
+	std::vector<Section> mSections;
+};
@@ -0,0 +1,398 @@
+//***************************************************************************************
+// MeshOptimizer.cpp
+//***************************************************************************************
+
+#include "MeshOptimizer.h"
+#include <algorithm>
+#include <cmath>
+
+using namespace DirectX;
+using namespace DirectX::PackedVector;
+
+namespace
+{
+	// Simulated post-transform cache of the vertex cache pass, and the scoring
+	// constants from Forsyth's article.
+	const int CacheSize = 32;
+	const float CacheDecayPower = 1.5f;
+	const float LastTriScore = 0.75f;
+	const float ValenceBoostScale = 2.0f;
+	const float ValenceBoostPower = 0.5f;
+
+	// Triangles of fewer than this many are not split off as their own
+	// overdraw cluster.
+	const size_t MinClusterTriangles = 16;
+
+	float VertexScore(int cachePosition, uint32_t remainingTriangles)
+	{
+		if(remainingTriangles == 0)
+			return -1.0f;
+
+		float score = 0.0f;
+
+		if(cachePosition >= 0)
+		{
+			if(cachePosition < 3)
+			{
+				// Used by the last triangle: fixed score, so a strip-like walk
+				// does not always win.
+				score = LastTriScore;
+			}
+			else
+			{
+				float scaler = 1.0f / (CacheSize - 3);
+				score = powf(1.0f - (cachePosition - 3) * scaler, CacheDecayPower);
+			}
+		}
+
+		// Favour vertices with few triangles left, so none are left stranded.
+		score += ValenceBoostScale * powf((float)remainingTriangles, -ValenceBoostPower);
+
+		return score;
+	}
+}
+
+void MeshOptimizer::Scratch::Reserve(size_t vertexCount, size_t indexCount)
+{
+	const size_t triangleCount = indexCount / 3;
+	const size_t clusterCount = triangleCount / MinClusterTriangles + 2;
+
+	Remaining.reserve(vertexCount);
+	AdjacencyOffsets.reserve(vertexCount + 1);
+	AdjacencyFill.reserve(vertexCount);
+	Adjacency.reserve(triangleCount * 3);
+	CachePosition.reserve(vertexCount);
+	VertexScores.reserve(vertexCount);
+	TriangleScores.reserve(triangleCount);
+	Emitted.reserve(triangleCount);
+	Output.reserve(triangleCount * 3);
+	LastUse.reserve(vertexCount);
+	ClusterStarts.reserve(clusterCount);
+	ClusterCentroids.reserve(clusterCount);
+	ClusterNormals.reserve(clusterCount);
+	SortKeys.reserve(clusterCount);
+	Order.reserve(clusterCount);
+	Remap.reserve(vertexCount);
+}
+
+void MeshOptimizer::OptimizeVertexCache(uint32* indices, size_t indexCount, size_t vertexCount,
+	Scratch& scratch)
+{
+	const size_t triangleCount = indexCount / 3;
+	if(triangleCount == 0)
+		return;
+
+	//
+	// Vertex -> triangle adjacency.
+	//
+
+	std::vector<uint32>& remaining = scratch.Remaining;
+	remaining.assign(vertexCount, 0);
+	for(size_t i = 0; i < triangleCount * 3; ++i)
+		++remaining[indices[i]];
+
+	std::vector<uint32>& adjacencyOffsets = scratch.AdjacencyOffsets;
+	adjacencyOffsets.assign(vertexCount + 1, 0);
+	for(size_t v = 0; v < vertexCount; ++v)
+		adjacencyOffsets[v + 1] = adjacencyOffsets[v] + remaining[v];
+
+	std::vector<uint32>& adjacency = scratch.Adjacency;
+	adjacency.resize(triangleCount * 3);
+	{
+		std::vector<uint32>& fill = scratch.AdjacencyFill;
+		fill.assign(adjacencyOffsets.begin(), adjacencyOffsets.end() - 1);
+		for(size_t t = 0; t < triangleCount; ++t)
+		{
+			for(int k = 0; k < 3; ++k)
+				adjacency[fill[indices[t * 3 + k]]++] = (uint32)t;
+		}
+	}
+
+	std::vector<int>& cachePosition = scratch.CachePosition;
+	cachePosition.assign(vertexCount, -1);
+	std::vector<float>& vertexScore = scratch.VertexScores;
+	vertexScore.resize(vertexCount);
+	for(size_t v = 0; v < vertexCount; ++v)
+		vertexScore[v] = VertexScore(-1, remaining[v]);
+
+	std::vector<float>& triangleScore = scratch.TriangleScores;
+	triangleScore.resize(triangleCount);
+	for(size_t t = 0; t < triangleCount; ++t)
+	{
+		triangleScore[t] =
+			vertexScore[indices[t * 3 + 0]] +
+			vertexScore[indices[t * 3 + 1]] +
+			vertexScore[indices[t * 3 + 2]];
+	}
+
+	std::vector<char>& emitted = scratch.Emitted;
+	emitted.assign(triangleCount, 0);
+	std::vector<uint32>& output = scratch.Output;
+	output.clear();
+	output.reserve(triangleCount * 3);
+
+	// Most recently used first; three extra slots hold the vertices pushed out
+	// by the newest triangle, whose scores still need updating.
+	uint32 cache[CacheSize + 3];
+	int cacheCount = 0;
+
+	size_t scanCursor = 0;
+	size_t bestTriangle = 0;
+	float bestScore = -1.0f;
+	for(size_t t = 0; t < triangleCount; ++t)
+	{
+		if(triangleScore[t] > bestScore)
+		{
+			bestScore = triangleScore[t];
+			bestTriangle = t;
+		}
+	}
+
+	for(size_t emittedCount = 0; emittedCount < triangleCount; ++emittedCount)
+	{
+		if(bestScore < 0.0f)
+		{
+			// Nothing in the cache has triangles left; take the next one in
+			// the original order.
+			while(emitted[scanCursor])
+				++scanCursor;
+			bestTriangle = scanCursor;
+		}
+
+		emitted[bestTriangle] = 1;
+
+		uint32 tri[3] = { indices[bestTriangle * 3 + 0], indices[bestTriangle * 3 + 1], indices[bestTriangle * 3 + 2] };
+
+		uint32 newCache[CacheSize + 3];
+		int newCount = 0;
+
+		for(int k = 0; k < 3; ++k)
+		{
+			uint32 v = tri[k];
+			output.push_back(v);
+
+			if(std::find(newCache, newCache + newCount, v) == newCache + newCount)
+				newCache[newCount++] = v;
+
+			// Drop the triangle from the vertex's adjacency.
+			uint32* begin = &adjacency[adjacencyOffsets[v]];
+			uint32* end = begin + remaining[v];
+			uint32* it = std::find(begin, end, (uint32)bestTriangle);
+			*it = *(end - 1);
+			--remaining[v];
+		}
+
+		for(int i = 0; i < cacheCount; ++i)
+		{
+			uint32 v = cache[i];
+			if(v != tri[0] && v != tri[1] && v != tri[2])
+				newCache[newCount++] = v;
+		}
+
+		// Update the scores of everything that was in the cache, including the
+		// vertices that just fell out of it.
+		for(int i = 0; i < newCount; ++i)
+		{
+			uint32 v = newCache[i];
+			cachePosition[v] = i < CacheSize ? i : -1;
+
+			float score = VertexScore(cachePosition[v], remaining[v]);
+			float delta = score - vertexScore[v];
+			vertexScore[v] = score;
+
+			for(uint32 a = 0; a < remaining[v]; ++a)
+				triangleScore[adjacency[adjacencyOffsets[v] + a]] += delta;
+		}
+
+		cacheCount = std::min(newCount, CacheSize);
+		std::copy(newCache, newCache + cacheCount, cache);
+
+		// The next triangle comes from the ones touching the cache.
+		bestScore = -1.0f;
+		for(int i = 0; i < cacheCount; ++i)
+		{
+			uint32 v = cache[i];
+			for(uint32 a = 0; a < remaining[v]; ++a)
+			{
+				uint32 t = adjacency[adjacencyOffsets[v] + a];
+				if(triangleScore[t] > bestScore)
+				{
+					bestScore = triangleScore[t];
+					bestTriangle = t;
+				}
+			}
+		}
+	}
+
+	std::copy(output.begin(), output.end(), indices);
+}
+
+void MeshOptimizer::OptimizeOverdraw(uint32* indices, size_t indexCount,
+	const XMFLOAT3* positions, size_t positionStride, size_t vertexCount,
+	Scratch& scratch)
+{
+	const size_t triangleCount = indexCount / 3;
+	if(triangleCount < 2 * MinClusterTriangles)
+		return;
+
+	auto position = [&](uint32 v)
+	{
+		const char* p = reinterpret_cast<const char*>(positions) + v * positionStride;
+		return XMLoadFloat3(reinterpret_cast<const XMFLOAT3*>(p));
+	};
+
+	//
+	// Split the cache-ordered list into clusters where a triangle misses the
+	// cache with all three vertices; such a point is where the previous run
+	// ended, so reordering whole clusters costs little cache efficiency.
+	//
+
+	std::vector<size_t>& clusterStarts = scratch.ClusterStarts;
+	clusterStarts.clear();
+	{
+		const int fifoSize = 16;
+		std::vector<size_t>& lastUse = scratch.LastUse;
+		lastUse.assign(vertexCount, (size_t)-fifoSize - 1);
+		size_t time = 0;
+		size_t clusterStart = 0;
+
+		for(size_t t = 0; t < triangleCount; ++t)
+		{
+			int misses = 0;
+			for(int k = 0; k < 3; ++k)
+			{
+				uint32 v = indices[t * 3 + k];
+				if(time - lastUse[v] > (size_t)fifoSize || lastUse[v] > time)
+				{
+					lastUse[v] = time++;
+					++misses;
+				}
+			}
+
+			if(t == 0 || (misses == 3 && t - clusterStart >= MinClusterTriangles))
+			{
+				clusterStarts.push_back(t);
+				clusterStart = t;
+			}
+		}
+	}
+
+	if(clusterStarts.size() < 2)
+		return;
+
+	clusterStarts.push_back(triangleCount);
+
+	//
+	// Area-weighted centroid and normal of every cluster and of the mesh.
+	//
+
+	const size_t clusterCount = clusterStarts.size() - 1;
+	std::vector<XMFLOAT3>& clusterCentroids = scratch.ClusterCentroids;
+	std::vector<XMFLOAT3>& clusterNormals = scratch.ClusterNormals;
+	clusterCentroids.resize(clusterCount);
+	clusterNormals.resize(clusterCount);
+
+	XMVECTOR meshCentroid = XMVectorZero();
+	float meshArea = 0.0f;
+
+	for(size_t c = 0; c < clusterCount; ++c)
+	{
+		XMVECTOR centroid = XMVectorZero();
+		XMVECTOR normal = XMVectorZero();
+		float area = 0.0f;
+
+		for(size_t t = clusterStarts[c]; t < clusterStarts[c + 1]; ++t)
+		{
+			XMVECTOR p0 = position(indices[t * 3 + 0]);
+			XMVECTOR p1 = position(indices[t * 3 + 1]);
+			XMVECTOR p2 = position(indices[t * 3 + 2]);
+
+			XMVECTOR n = XMVector3Cross(p1 - p0, p2 - p0);
+			float triArea = XMVectorGetX(XMVector3Length(n));
+
+			centroid += (p0 + p1 + p2) * (triArea / 3.0f);
+			normal += n;
+			area += triArea;
+		}
+
+		meshCentroid += centroid;
+		meshArea += area;
+
+		XMStoreFloat3(&clusterCentroids[c], area > 0.0f ? centroid / area : centroid);
+		XMStoreFloat3(&clusterNormals[c], XMVector3Normalize(normal));
+	}
+
+	if(meshArea > 0.0f)
+		meshCentroid /= meshArea;
+
+	// The further a cluster points away from the center, the earlier it goes.
+	std::vector<float>& sortKeys = scratch.SortKeys;
+	sortKeys.resize(clusterCount);
+	for(size_t c = 0; c < clusterCount; ++c)
+	{
+		XMVECTOR toCluster = XMLoadFloat3(&clusterCentroids[c]) - meshCentroid;
+		sortKeys[c] = XMVectorGetX(XMVector3Dot(toCluster, XMLoadFloat3(&clusterNormals[c])));
+	}
+
+	std::vector<uint32>& order = scratch.Order;
+	order.resize(clusterCount);
+	for(size_t c = 0; c < clusterCount; ++c)
+		order[c] = (uint32)c;
+
+	// Ties keep the cache order, as a stable sort would; std::stable_sort
+	// allocates a buffer of its own.
+	std::sort(order.begin(), order.end(),
+		[&](uint32 a, uint32 b) { return sortKeys[a] != sortKeys[b] ? sortKeys[a] > sortKeys[b] : a < b; });
+
+	std::vector<uint32>& output = scratch.Output;
+	output.clear();
+	output.reserve(triangleCount * 3);
+	for(uint32 c : order)
+		output.insert(output.end(), indices + clusterStarts[c] * 3, indices + clusterStarts[c + 1] * 3);
+
+	std::copy(output.begin(), output.end(), indices);
+}
+
+void MeshOptimizer::OptimizeVertexFetch(uint32* indices, size_t indexCount, size_t vertexCount,
+	std::vector<uint32>& remap)
+{
+	const uint32 unused = ~0u;
+	remap.assign(vertexCount, unused);
+
+	uint32 next = 0;
+	for(size_t i = 0; i < indexCount; ++i)
+	{
+		uint32& slot = remap[indices[i]];
+		if(slot == unused)
+			slot = next++;
+
+		indices[i] = slot;
+	}
+
+	for(auto& slot : remap)
+	{
+		if(slot == unused)
+			slot = next++;
+	}
+}
+
+XMSHORTN2 MeshOptimizer::EncodeOctahedral(const XMFLOAT3& n)
+{
+	float l1 = fabsf(n.x) + fabsf(n.y) + fabsf(n.z);
+	if(l1 == 0.0f)
+		return XMSHORTN2(0.0f, 0.0f);
+
+	float x = n.x / l1;
+	float y = n.y / l1;
+
+	// Fold the lower hemisphere over the diagonals.
+	if(n.z < 0.0f)
+	{
+		float fx = (1.0f - fabsf(y)) * (x >= 0.0f ? 1.0f : -1.0f);
+		float fy = (1.0f - fabsf(x)) * (y >= 0.0f ? 1.0f : -1.0f);
+		x = fx;
+		y = fy;
+	}
+
+	return XMSHORTN2(x, y);
+}
@@ -0,0 +1,101 @@
+//***************************************************************************************
+// MeshOptimizer.h
+//
+// Offline-style passes that reorder a triangle list for the GPU without
+// changing what it draws:
+//   1. OptimizeVertexCache: triangle order for post-transform cache hits
+//      (Forsyth, "Linear-Speed Vertex Cache Optimisation").
+//   2. OptimizeOverdraw: keeps the cache-friendly runs but draws the ones that
+//      face away from the mesh center first, as they tend to hide the rest.
+//   3. OptimizeVertexFetch: renumbers the vertices in first-use order so the
+//      vertex fetches walk the buffer front to back.
+// Optimize() runs all three on one submesh.  The passes work in a Scratch the
+// caller keeps, so optimizing mesh after mesh stops allocating once it has
+// grown to the largest one.  Also has the vertex attribute quantization
+// helpers used when packing vertices for upload.
+//***************************************************************************************
+
+#pragma once
+
+#include <cstdint>
+#include <utility>
+#include <vector>
+#include <DirectXMath.h>
+#include <DirectXPackedVector.h>
+
+class MeshOptimizer
+{
+public:
+	using uint32 = std::uint32_t;
+
+	// Working memory of the passes.  Only ever grows, so keeping one between
+	// meshes reuses it; Reserve() grows it for the largest mesh up front.
+	struct Scratch
+	{
+		void Reserve(size_t vertexCount, size_t indexCount);
+
+		std::vector<uint32> Remaining;
+		std::vector<uint32> AdjacencyOffsets;
+		std::vector<uint32> AdjacencyFill;
+		std::vector<uint32> Adjacency;
+		std::vector<int> CachePosition;
+		std::vector<float> VertexScores;
+		std::vector<float> TriangleScores;
+		std::vector<char> Emitted;
+		std::vector<uint32> Output;
+		std::vector<size_t> LastUse;
+		std::vector<size_t> ClusterStarts;
+		std::vector<DirectX::XMFLOAT3> ClusterCentroids;
+		std::vector<DirectX::XMFLOAT3> ClusterNormals;
+		std::vector<float> SortKeys;
+		std::vector<uint32> Order;
+		std::vector<uint32> Remap;
+	};
+
+	// indices[0, indexCount) is a triangle list over vertices [0, vertexCount).
+	static void OptimizeVertexCache(uint32* indices, size_t indexCount, size_t vertexCount,
+		Scratch& scratch);
+
+	// positions points at the first vertex position; positionStride is the
+	// distance in bytes between two positions.
+	static void OptimizeOverdraw(uint32* indices, size_t indexCount,
+		const DirectX::XMFLOAT3* positions, size_t positionStride, size_t vertexCount,
+		Scratch& scratch);
+
+	// Rewrites the indices and fills remap with the new slot of every vertex.
+	// Unreferenced vertices are moved to the end.
+	static void OptimizeVertexFetch(uint32* indices, size_t indexCount, size_t vertexCount,
+		std::vector<uint32>& remap);
+
+	// All three passes over one submesh, reordering the vertices in place.
+	// position selects the position member of VertexT.
+	template<typename VertexT>
+	static void Optimize(VertexT* vertices, size_t vertexCount, uint32* indices, size_t indexCount,
+		DirectX::XMFLOAT3 VertexT::* position, Scratch& scratch)
+	{
+		if(vertexCount == 0 || indexCount < 3)
+			return;
+
+		OptimizeVertexCache(indices, indexCount, vertexCount, scratch);
+		OptimizeOverdraw(indices, indexCount, &(vertices[0].*position), sizeof(VertexT), vertexCount, scratch);
+
+		std::vector<uint32>& remap = scratch.Remap;
+		OptimizeVertexFetch(indices, indexCount, vertexCount, remap);
+
+		// Walk the cycles of the remap, swapping every vertex straight into its
+		// slot; the remap is swapped along so it tracks what sits where.
+		for(size_t i = 0; i < vertexCount; ++i)
+		{
+			while(remap[i] != i)
+			{
+				uint32 j = remap[i];
+				std::swap(vertices[i], vertices[j]);
+				std::swap(remap[i], remap[j]);
+			}
+		}
+	}
+
+	// Octahedral mapping of a unit vector onto two SNORM16 values.  The shader
+	// side is DecodeOctahedral in VS.hlsl.
+	static DirectX::PackedVector::XMSHORTN2 EncodeOctahedral(const DirectX::XMFLOAT3& n);
+};
@@ -0,0 +1,109 @@
+//***************************************************************************************
+// ObjectPool.h
+//
+// Objects allocated from chunks that never move, so pointers to them stay valid
+// for as long as they live, and addressed by handles that go stale when they are
+// freed.  A handle carries the generation of its entry, which Free() bumps, so a
+// handle to a freed object never resolves to whatever later takes its place.
+//***************************************************************************************
+
+#pragma once
+
+#include "FreeList.h"
+#include <memory>
+#include <cassert>
+
+struct PoolHandle
+{
+	UINT Index = 0xffffffff;
+	UINT Generation = 0;
+};
+
+template<typename T>
+class ObjectPool
+{
+public:
+	explicit ObjectPool(UINT chunkSize = 256) :
+		mChunkSize(chunkSize)
+	{
+	}
+
+	ObjectPool(const ObjectPool& rhs) = delete;
+	ObjectPool& operator=(const ObjectPool& rhs) = delete;
+
+	// The object starts out default constructed.
+	PoolHandle Allocate()
+	{
+		UINT index = mIndices.Allocate();
+		if(index / mChunkSize == mChunks.size())
+			mChunks.push_back(std::make_unique<Entry[]>(mChunkSize));
+
+		Entry& entry = GetEntry(index);
+		entry.Value = T();
+		entry.Live = true;
+
+		PoolHandle handle;
+		handle.Index = index;
+		handle.Generation = entry.Generation;
+		return handle;
+	}
+
+	void Free(PoolHandle handle)
+	{
+		assert(Get(handle) != nullptr);
+
+		Entry& entry = GetEntry(handle.Index);
+		entry.Live = false;
+		++entry.Generation;
+
+		mIndices.Release(handle.Index);
+	}
+
+	// Null once the object has been freed.
+	T* Get(PoolHandle handle)const
+	{
+		if(handle.Index >= mIndices.GetSize())
+			return nullptr;
+
+		Entry& entry = GetEntry(handle.Index);
+		if(!entry.Live || entry.Generation != handle.Generation)
+			return nullptr;
+
+		return &entry.Value;
+	}
+
+	UINT GetLiveCount()const
+	{
+		return mIndices.GetLiveCount();
+	}
+
+	// Calls f(T&) on every live object.
+	template<typename F>
+	void ForEach(F f)
+	{
+		for(UINT i = 0; i < mIndices.GetSize(); ++i)
+		{
+			Entry& entry = GetEntry(i);
+			if(entry.Live)
+				f(entry.Value);
+		}
+	}
+
+private:
+	struct Entry
+	{
+		T Value;
+		UINT Generation = 0;
+		bool Live = false;
+	};
+
+	Entry& GetEntry(UINT index)const
+	{
+		return mChunks[index / mChunkSize][index % mChunkSize];
+	}
+
+private:
+	std::vector<std::unique_ptr<Entry[]>> mChunks;
+	FreeList mIndices;
+	UINT mChunkSize = 0;
+};
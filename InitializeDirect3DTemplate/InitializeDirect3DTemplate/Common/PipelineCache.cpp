@@ -0,0 +1,145 @@
+//***************************************************************************************
+// PipelineCache.cpp
+//***************************************************************************************
+
+#include "PipelineCache.h"
+
+using Microsoft::WRL::ComPtr;
+
+PipelineCache::PipelineCache(ID3D12Device* device, const std::wstring& filename)
+	: md3dDevice(device), mFilename(filename)
+{
+	if(mFilename.empty())
+		return;
+
+	D3D12_FEATURE_DATA_SHADER_CACHE shaderCache = {};
+	if(FAILED(md3dDevice->CheckFeatureSupport(D3D12_FEATURE_SHADER_CACHE, &shaderCache, sizeof(shaderCache))) ||
+		(shaderCache.SupportFlags & D3D12_SHADER_CACHE_SUPPORT_LIBRARY) == 0)
+		return;
+
+	if(FAILED(md3dDevice->QueryInterface(IID_PPV_ARGS(&md3dDevice1))))
+		return;
+
+	if(GetFileAttributesW(mFilename.c_str()) != INVALID_FILE_ATTRIBUTES)
+	{
+		mLibraryBlob = d3dUtil::LoadBinary(mFilename);
+		mLibrary = CreateLibrary(mLibraryBlob->GetBufferPointer(), mLibraryBlob->GetBufferSize());
+	}
+
+	// No file, or one from another driver or adapter: start over.
+	if(mLibrary == nullptr)
+	{
+		mLibraryBlob = nullptr;
+		mLibrary = CreateLibrary(nullptr, 0);
+	}
+}
+
+void PipelineCache::CreateGraphicsPipeline(const std::wstring& name, const D3D12_GRAPHICS_PIPELINE_STATE_DESC& desc,
+	ComPtr<ID3D12PipelineState>& pso)
+{
+	if(mLibrary != nullptr && SUCCEEDED(mLibrary->LoadGraphicsPipeline(name.c_str(), &desc, IID_PPV_ARGS(&pso))))
+	{
+		++mLoadedCount;
+		mPipelines.emplace_back(name, pso);
+		return;
+	}
+
+	ThrowIfFailed(md3dDevice->CreateGraphicsPipelineState(&desc, IID_PPV_ARGS(&pso)));
+	++mCreatedCount;
+	Store(name, pso.Get());
+}
+
+void PipelineCache::CreateComputePipeline(const std::wstring& name, const D3D12_COMPUTE_PIPELINE_STATE_DESC& desc,
+	ComPtr<ID3D12PipelineState>& pso)
+{
+	if(mLibrary != nullptr && SUCCEEDED(mLibrary->LoadComputePipeline(name.c_str(), &desc, IID_PPV_ARGS(&pso))))
+	{
+		++mLoadedCount;
+		mPipelines.emplace_back(name, pso);
+		return;
+	}
+
+	ThrowIfFailed(md3dDevice->CreateComputePipelineState(&desc, IID_PPV_ARGS(&pso)));
+	++mCreatedCount;
+	Store(name, pso.Get());
+}
+
+bool PipelineCache::Save()
+{
+	if(mLibrary == nullptr || !mDirty)
+		return true;
+
+	// Entries cannot be replaced, so a library with outdated ones is rebuilt
+	// from this run's pipelines.
+	if(mStale)
+	{
+		ComPtr<ID3D12PipelineLibrary> library = CreateLibrary(nullptr, 0);
+		if(library == nullptr)
+			return false;
+
+		for(auto& e : mPipelines)
+		{
+			if(FAILED(library->StorePipeline(e.first.c_str(), e.second.Get())))
+				return false;
+		}
+
+		mLibrary = library;
+		mStale = false;
+	}
+
+	std::vector<BYTE> data(mLibrary->GetSerializedSize());
+	if(FAILED(mLibrary->Serialize(data.data(), data.size())))
+		return false;
+
+	// Written next to the old file and renamed over it, so a torn write is
+	// never loaded.
+	std::wstring tempFilename = mFilename + L".tmp";
+	{
+		std::ofstream fout(tempFilename, std::ios::binary | std::ios::trunc);
+		fout.write(reinterpret_cast<const char*>(data.data()), data.size());
+		if(!fout)
+			return false;
+	}
+
+	if(!MoveFileExW(tempFilename.c_str(), mFilename.c_str(), MOVEFILE_REPLACE_EXISTING))
+	{
+		DeleteFileW(tempFilename.c_str());
+		return false;
+	}
+
+	mDirty = false;
+	return true;
+}
+
+UINT PipelineCache::GetLoadedCount()const
+{
+	return mLoadedCount;
+}
+
+UINT PipelineCache::GetCreatedCount()const
+{
+	return mCreatedCount;
+}
+
+void PipelineCache::Store(const std::wstring& name, ID3D12PipelineState* pso)
+{
+	mPipelines.emplace_back(name, pso);
+
+	if(mLibrary == nullptr)
+		return;
+
+	// Fails when the name is taken by a pipeline whose description has changed.
+	if(FAILED(mLibrary->StorePipeline(name.c_str(), pso)))
+		mStale = true;
+
+	mDirty = true;
+}
+
+ComPtr<ID3D12PipelineLibrary> PipelineCache::CreateLibrary(const void* data, SIZE_T byteSize)
+{
+	ComPtr<ID3D12PipelineLibrary> library;
+	if(FAILED(md3dDevice1->CreatePipelineLibrary(data, byteSize, IID_PPV_ARGS(&library))))
+		return nullptr;
+
+	return library;
+}
@@ -0,0 +1,56 @@
+//***************************************************************************************
+// PipelineCache.h
+//
+// Pipeline state objects persisted through an ID3D12PipelineLibrary.  A pipeline
+// found in the library, under its name and with a matching description, is loaded
+// from the driver's compiled form; anything else is created from scratch and stored
+// for the next run.  On devices or drivers without library support, or when the
+// saved library belongs to another driver, every pipeline is simply created.
+//***************************************************************************************
+
+#pragma once
+
+#include "d3dUtil.h"
+
+class PipelineCache
+{
+public:
+	// An empty filename turns the cache off.
+	PipelineCache(ID3D12Device* device, const std::wstring& filename);
+	PipelineCache(const PipelineCache& rhs) = delete;
+	PipelineCache& operator=(const PipelineCache& rhs) = delete;
+
+	// Throw on failure just like the device methods behind them.
+	void CreateGraphicsPipeline(const std::wstring& name, const D3D12_GRAPHICS_PIPELINE_STATE_DESC& desc,
+		Microsoft::WRL::ComPtr<ID3D12PipelineState>& pso);
+	void CreateComputePipeline(const std::wstring& name, const D3D12_COMPUTE_PIPELINE_STATE_DESC& desc,
+		Microsoft::WRL::ComPtr<ID3D12PipelineState>& pso);
+
+	// Writes the library if this run added pipelines to it.
+	bool Save();
+
+	UINT GetLoadedCount()const;
+	UINT GetCreatedCount()const;
+
+private:
+	void Store(const std::wstring& name, ID3D12PipelineState* pso);
+	Microsoft::WRL::ComPtr<ID3D12PipelineLibrary> CreateLibrary(const void* data, SIZE_T byteSize);
+
+private:
+	ID3D12Device* md3dDevice = nullptr;
+	Microsoft::WRL::ComPtr<ID3D12Device1> md3dDevice1;
+	Microsoft::WRL::ComPtr<ID3D12PipelineLibrary> mLibrary;
+	std::wstring mFilename;
+
+	// The library reads from the serialized blob for as long as it lives.
+	Microsoft::WRL::ComPtr<ID3DBlob> mLibraryBlob;
+
+	// Every pipeline of this run, to rebuild the library from when a stale
+	// entry is in the way of storing a new one.
+	std::vector<std::pair<std::wstring, Microsoft::WRL::ComPtr<ID3D12PipelineState>>> mPipelines;
+
+	bool mDirty = false;
+	bool mStale = false;
+	UINT mLoadedCount = 0;
+	UINT mCreatedCount = 0;
+};
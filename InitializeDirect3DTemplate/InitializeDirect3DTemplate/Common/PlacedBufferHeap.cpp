@@ -0,0 +1,74 @@
+//***************************************************************************************
+// PlacedBufferHeap.cpp
+//***************************************************************************************
+
+#include "PlacedBufferHeap.h"
+
+using Microsoft::WRL::ComPtr;
+
+static UINT64 AlignToPlacement(UINT64 byteSize)
+{
+	const UINT64 alignment = D3D12_DEFAULT_RESOURCE_PLACEMENT_ALIGNMENT;
+	return (byteSize + alignment - 1) & ~(alignment - 1);
+}
+
+PlacedBufferHeap::PlacedBufferHeap(ID3D12Device* device, D3D12_HEAP_TYPE heapType, UINT64 heapSize)
+	: md3dDevice(device), mHeapType(heapType), mHeapSize(AlignToPlacement(heapSize))
+{
+}
+
+ComPtr<ID3D12Resource> PlacedBufferHeap::CreateBuffer(UINT64 byteSize, D3D12_RESOURCE_STATES initialState,
+	D3D12_RESOURCE_FLAGS flags)
+{
+	const UINT64 allocSize = AlignToPlacement(byteSize);
+
+	ID3D12Heap* heap = nullptr;
+	UINT64 offset = 0;
+
+	if(allocSize > mHeapSize)
+	{
+		// Dedicated heap; the current shared heap keeps filling up.
+		mHeaps.push_back(CreateHeap(allocSize));
+		heap = mHeaps.back().Get();
+	}
+	else
+	{
+		if(mCurrentHeap == nullptr || mOffset + allocSize > mHeapSize)
+		{
+			mHeaps.push_back(CreateHeap(mHeapSize));
+			mCurrentHeap = mHeaps.back().Get();
+			mOffset = 0;
+		}
+
+		heap = mCurrentHeap;
+		offset = mOffset;
+		mOffset += allocSize;
+	}
+
+	auto buffer = CD3DX12_RESOURCE_DESC::Buffer(byteSize, flags);
+
+	ComPtr<ID3D12Resource> resource;
+	ThrowIfFailed(md3dDevice->CreatePlacedResource(
+		heap,
+		offset,
+		&buffer,
+		initialState,
+		nullptr,
+		IID_PPV_ARGS(&resource)));
+
+	return resource;
+}
+
+UINT PlacedBufferHeap::GetHeapCount()const
+{
+	return (UINT)mHeaps.size();
+}
+
+ComPtr<ID3D12Heap> PlacedBufferHeap::CreateHeap(UINT64 heapSize)
+{
+	ComPtr<ID3D12Heap> heap;
+	CD3DX12_HEAP_DESC heapDesc(heapSize, mHeapType, 0, D3D12_HEAP_FLAG_ALLOW_ONLY_BUFFERS);
+	ThrowIfFailed(md3dDevice->CreateHeap(&heapDesc, IID_PPV_ARGS(&heap)));
+
+	return heap;
+}
@@ -0,0 +1,42 @@
+//***************************************************************************************
+// PlacedBufferHeap.h
+//
+// Sub-allocates buffers as placed resources from a few large heaps instead of
+// one committed resource (and one implicit heap) per buffer.  Allocation is a
+// bump of the offset in the newest heap; a new heap is added when it is full.
+// Buffers are never returned individually: the memory goes away with the
+// heaps, so this is meant for buffers that live as long as the app.
+//***************************************************************************************
+
+#pragma once
+
+#include "d3dUtil.h"
+
+class PlacedBufferHeap
+{
+public:
+	// Heaps of heapType and heapSize bytes each; buffers larger than heapSize
+	// get a heap of their own.
+	PlacedBufferHeap(ID3D12Device* device, D3D12_HEAP_TYPE heapType, UINT64 heapSize);
+	PlacedBufferHeap(const PlacedBufferHeap& rhs) = delete;
+	PlacedBufferHeap& operator=(const PlacedBufferHeap& rhs) = delete;
+
+	Microsoft::WRL::ComPtr<ID3D12Resource> CreateBuffer(UINT64 byteSize, D3D12_RESOURCE_STATES initialState,
+		D3D12_RESOURCE_FLAGS flags = D3D12_RESOURCE_FLAG_NONE);
+
+	UINT GetHeapCount()const;
+
+private:
+	Microsoft::WRL::ComPtr<ID3D12Heap> CreateHeap(UINT64 heapSize);
+
+private:
+	ID3D12Device* md3dDevice = nullptr;
+	D3D12_HEAP_TYPE mHeapType = D3D12_HEAP_TYPE_DEFAULT;
+	UINT64 mHeapSize = 0;
+
+	std::vector<Microsoft::WRL::ComPtr<ID3D12Heap>> mHeaps;
+
+	// Shared heap being filled and the next free byte in it.
+	ID3D12Heap* mCurrentHeap = nullptr;
+	UINT64 mOffset = 0;
+};
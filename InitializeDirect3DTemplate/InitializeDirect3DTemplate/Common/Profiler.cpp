@@ -0,0 +1,372 @@
+//***************************************************************************************
+// Profiler.cpp
+//***************************************************************************************
+
+#include "Profiler.h"
+
+using Microsoft::WRL::ComPtr;
+
+static INT64 QueryTicks()
+{
+	LARGE_INTEGER ticks;
+	QueryPerformanceCounter(&ticks);
+	return ticks.QuadPart;
+}
+
+Profiler::Profiler(ID3D12Device* device, ID3D12CommandQueue* queue, UINT frameResourceCount, UINT historySize)
+	: mFrameResourceCount(frameResourceCount)
+{
+	LARGE_INTEGER frequency;
+	QueryPerformanceFrequency(&frequency);
+	mMsPerTick = 1000.0 / (double)frequency.QuadPart;
+
+	for(auto& ticks : mCpuTicks)
+		ticks = 0;
+
+	mHistory.resize(MathHelper::Max(historySize, 1u));
+	mSlotFrame.resize(frameResourceCount, 0);
+	mSlotScopes.resize(frameResourceCount, 0);
+	mSlotScopeTypes.resize(frameResourceCount * MaxScopes, D3D12_COMMAND_LIST_TYPE_DIRECT);
+
+	AddQueue(queue);
+
+	// A begin and an end timestamp per scope and frame resource.
+	const UINT queryCount = frameResourceCount * MaxScopes * 2;
+
+	D3D12_QUERY_HEAP_DESC queryHeapDesc = {};
+	queryHeapDesc.Type = D3D12_QUERY_HEAP_TYPE_TIMESTAMP;
+	queryHeapDesc.Count = queryCount;
+	ThrowIfFailed(device->CreateQueryHeap(&queryHeapDesc, IID_PPV_ARGS(&mQueryHeap)));
+
+	auto readbackHeap = CD3DX12_HEAP_PROPERTIES(D3D12_HEAP_TYPE_READBACK);
+	auto readbackDesc = CD3DX12_RESOURCE_DESC::Buffer((UINT64)queryCount * sizeof(UINT64));
+	ThrowIfFailed(device->CreateCommittedResource(
+		&readbackHeap,
+		D3D12_HEAP_FLAG_NONE,
+		&readbackDesc,
+		D3D12_RESOURCE_STATE_COPY_DEST,
+		nullptr,
+		IID_PPV_ARGS(&mReadbackBuffer)));
+
+	mFrameStart = QueryTicks();
+}
+
+void Profiler::AddQueue(ID3D12CommandQueue* queue)
+{
+	D3D12_COMMAND_LIST_TYPE type = queue->GetDesc().Type;
+	assert(type < _countof(mTimestampFrequencies));
+
+	ThrowIfFailed(queue->GetTimestampFrequency(&mTimestampFrequencies[type]));
+}
+
+UINT Profiler::AddCpuScope(const std::string& name)
+{
+	assert(mCpuScopeNames.size() < MaxScopes);
+
+	mCpuScopeNames.push_back(name);
+	return (UINT)mCpuScopeNames.size() - 1;
+}
+
+UINT Profiler::AddGpuScope(const std::string& name)
+{
+	assert(mGpuScopeNames.size() < MaxScopes);
+
+	mGpuScopeNames.push_back(name);
+	return (UINT)mGpuScopeNames.size() - 1;
+}
+
+void Profiler::BeginFrame(UINT frameResourceIndex)
+{
+	assert(frameResourceIndex < mFrameResourceCount);
+
+	INT64 now = QueryTicks();
+
+	if(FrameRecord* previous = FindRecord(mFrameNumber))
+	{
+		previous->FrameMs = (float)((now - mFrameStart) * mMsPerTick);
+
+		for(UINT i = 0; i < (UINT)mCpuScopeNames.size(); ++i)
+			previous->CpuMs[i] = (float)(mCpuTicks[i].exchange(0) * mMsPerTick);
+	}
+
+	mFrameStart = now;
+	mSlot = frameResourceIndex;
+
+	FrameRecord& record = mHistory[++mFrameNumber % mHistory.size()];
+	record = FrameRecord();
+	record.FrameNumber = mFrameNumber;
+}
+
+void Profiler::ReadGpuScopes()
+{
+	UINT scopes = mSlotScopes[mSlot];
+	FrameRecord* record = FindRecord(mSlotFrame[mSlot]);
+
+	mSlotFrame[mSlot] = 0;
+	mSlotScopes[mSlot] = 0;
+
+	if(record == nullptr || scopes == 0)
+		return;
+
+	const UINT first = GetQueryIndex(mSlot, 0);
+	D3D12_RANGE readRange = { first * sizeof(UINT64), (first + MaxScopes * 2) * sizeof(UINT64) };
+
+	UINT64* timestamps = nullptr;
+	ThrowIfFailed(mReadbackBuffer->Map(0, &readRange, reinterpret_cast<void**>(&timestamps)));
+
+	for(UINT i = 0; i < (UINT)mGpuScopeNames.size(); ++i)
+	{
+		if((scopes & (1u << i)) == 0)
+			continue;
+
+		UINT64 frequency = mTimestampFrequencies[mSlotScopeTypes[mSlot * MaxScopes + i]];
+		const double msPerTimestamp = frequency != 0 ? 1000.0 / (double)frequency : 0.0;
+
+		UINT query = GetQueryIndex(mSlot, i);
+		UINT64 begin = timestamps[query];
+		UINT64 end = timestamps[query + 1];
+		record->GpuMs[i] = end > begin ? (float)((end - begin) * msPerTimestamp) : 0.0f;
+	}
+
+	D3D12_RANGE writeRange = { 0, 0 };
+	mReadbackBuffer->Unmap(0, &writeRange);
+
+	record->GpuResolved = true;
+	mLatestGpuFrame = MathHelper::Max(mLatestGpuFrame, record->FrameNumber);
+}
+
+void Profiler::AddCpuTime(UINT scope, INT64 ticks)
+{
+	assert(scope < mCpuScopeNames.size());
+	mCpuTicks[scope] += ticks;
+}
+
+void Profiler::BeginGpuScope(ID3D12GraphicsCommandList* cmdList, UINT scope)
+{
+	assert(scope < mGpuScopeNames.size());
+
+	cmdList->EndQuery(mQueryHeap.Get(), D3D12_QUERY_TYPE_TIMESTAMP, GetQueryIndex(mSlot, scope));
+}
+
+void Profiler::EndGpuScope(ID3D12GraphicsCommandList* cmdList, UINT scope)
+{
+	assert(scope < mGpuScopeNames.size());
+
+	cmdList->EndQuery(mQueryHeap.Get(), D3D12_QUERY_TYPE_TIMESTAMP, GetQueryIndex(mSlot, scope) + 1);
+	mSlotScopes[mSlot] |= 1u << scope;
+
+	// A queue of this type has to have been added to know its frequency.
+	D3D12_COMMAND_LIST_TYPE type = cmdList->GetType();
+	assert(type < _countof(mTimestampFrequencies) && mTimestampFrequencies[type] != 0);
+	mSlotScopeTypes[mSlot * MaxScopes + scope] = type;
+}
+
+void Profiler::ResolveGpuScopes(ID3D12GraphicsCommandList* cmdList)
+{
+	// Only the pairs written this frame hold timestamps.
+	for(UINT i = 0; i < (UINT)mGpuScopeNames.size(); ++i)
+	{
+		if((mSlotScopes[mSlot] & (1u << i)) == 0)
+			continue;
+
+		UINT query = GetQueryIndex(mSlot, i);
+		cmdList->ResolveQueryData(mQueryHeap.Get(), D3D12_QUERY_TYPE_TIMESTAMP,
+			query, 2, mReadbackBuffer.Get(), query * sizeof(UINT64));
+	}
+
+	mSlotFrame[mSlot] = mFrameNumber;
+}
+
+Profiler::Percentiles Profiler::GetFrameTimePercentiles()const
+{
+	return ComputePercentiles(GetCompletedFrames(), [](const FrameRecord& r) { return r.FrameMs; });
+}
+
+UINT64 Profiler::GetFrameNumber()const
+{
+	return mFrameNumber;
+}
+
+Profiler::Percentiles Profiler::GetFrameTimePercentiles(UINT64 firstFrame, UINT64 endFrame)const
+{
+	return ComputePercentiles(GetCompletedFrames(firstFrame, endFrame), [](const FrameRecord& r) { return r.FrameMs; });
+}
+
+Profiler::Percentiles Profiler::GetGpuTimePercentiles(UINT scope, UINT64 firstFrame, UINT64 endFrame)const
+{
+	assert(scope < mGpuScopeNames.size());
+
+	std::vector<const FrameRecord*> gpuFrames;
+	for(const FrameRecord* r : GetCompletedFrames(firstFrame, endFrame))
+	{
+		if(r->GpuResolved)
+			gpuFrames.push_back(r);
+	}
+
+	return ComputePercentiles(gpuFrames, [scope](const FrameRecord& r) { return r.GpuMs[scope]; });
+}
+
+UINT64 Profiler::GetLatestGpuFrame()const
+{
+	return mLatestGpuFrame;
+}
+
+float Profiler::GetGpuTime(UINT64 frameNumber, UINT scope)const
+{
+	assert(scope < mGpuScopeNames.size());
+
+	const FrameRecord& record = mHistory[frameNumber % mHistory.size()];
+	if(frameNumber == 0 || record.FrameNumber != frameNumber || !record.GpuResolved)
+		return 0.0f;
+
+	return record.GpuMs[scope];
+}
+
+bool Profiler::WriteCsv(const std::wstring& filename)const
+{
+	std::ofstream fout(filename, std::ios::trunc);
+	if(!fout)
+		return false;
+
+	fout << "frame,frame_ms";
+	for(const auto& name : mCpuScopeNames)
+		fout << ",cpu_" << name << "_ms";
+	for(const auto& name : mGpuScopeNames)
+		fout << ",gpu_" << name << "_ms";
+	fout << "\n";
+
+	// GPU columns stay empty for frames whose timings never came back.
+	for(const FrameRecord* r : GetCompletedFrames())
+	{
+		fout << r->FrameNumber << "," << r->FrameMs;
+		for(UINT i = 0; i < (UINT)mCpuScopeNames.size(); ++i)
+			fout << "," << r->CpuMs[i];
+		for(UINT i = 0; i < (UINT)mGpuScopeNames.size(); ++i)
+		{
+			fout << ",";
+			if(r->GpuResolved)
+				fout << r->GpuMs[i];
+		}
+		fout << "\n";
+	}
+
+	return (bool)fout;
+}
+
+bool Profiler::WriteJson(const std::wstring& filename)const
+{
+	std::ofstream fout(filename, std::ios::trunc);
+	if(!fout)
+		return false;
+
+	std::vector<const FrameRecord*> frames = GetCompletedFrames();
+
+	std::vector<const FrameRecord*> gpuFrames;
+	for(const FrameRecord* r : frames)
+	{
+		if(r->GpuResolved)
+			gpuFrames.push_back(r);
+	}
+
+	auto writePercentiles = [&](const Percentiles& p)
+	{
+		fout << "{ \"p50\": " << p.P50 << ", \"p95\": " << p.P95
+			<< ", \"p99\": " << p.P99 << ", \"max\": " << p.Max << " }";
+	};
+
+	fout << "{\n";
+	fout << "  \"frames\": " << frames.size() << ",\n";
+	fout << "  \"frame_ms\": ";
+	writePercentiles(ComputePercentiles(frames, [](const FrameRecord& r) { return r.FrameMs; }));
+	fout << ",\n  \"cpu_ms\": {";
+	for(UINT i = 0; i < (UINT)mCpuScopeNames.size(); ++i)
+	{
+		fout << (i == 0 ? "\n" : ",\n") << "    \"" << mCpuScopeNames[i] << "\": ";
+		writePercentiles(ComputePercentiles(frames, [i](const FrameRecord& r) { return r.CpuMs[i]; }));
+	}
+	fout << "\n  },\n  \"gpu_ms\": {";
+	for(UINT i = 0; i < (UINT)mGpuScopeNames.size(); ++i)
+	{
+		fout << (i == 0 ? "\n" : ",\n") << "    \"" << mGpuScopeNames[i] << "\": ";
+		writePercentiles(ComputePercentiles(gpuFrames, [i](const FrameRecord& r) { return r.GpuMs[i]; }));
+	}
+	fout << "\n  }\n}\n";
+
+	return (bool)fout;
+}
+
+Profiler::FrameRecord* Profiler::FindRecord(UINT64 frameNumber)
+{
+	if(frameNumber == 0)
+		return nullptr;
+
+	FrameRecord& record = mHistory[frameNumber % mHistory.size()];
+	return record.FrameNumber == frameNumber ? &record : nullptr;
+}
+
+std::vector<const Profiler::FrameRecord*> Profiler::GetCompletedFrames(UINT64 firstFrame, UINT64 endFrame)const
+{
+	std::vector<const FrameRecord*> frames;
+
+	// The current frame is still running.
+	UINT64 first = mFrameNumber > mHistory.size() ? mFrameNumber - mHistory.size() + 1 : 1;
+	first = MathHelper::Max(first, firstFrame);
+	UINT64 end = MathHelper::Min(endFrame, mFrameNumber);
+	for(UINT64 n = first; n < end; ++n)
+	{
+		const FrameRecord& record = mHistory[n % mHistory.size()];
+		if(record.FrameNumber == n)
+			frames.push_back(&record);
+	}
+
+	return frames;
+}
+
+template<typename Metric>
+Profiler::Percentiles Profiler::ComputePercentiles(const std::vector<const FrameRecord*>& frames, Metric metric)const
+{
+	Percentiles p;
+	if(frames.empty())
+		return p;
+
+	std::vector<float> values;
+	values.reserve(frames.size());
+	for(const FrameRecord* r : frames)
+		values.push_back(metric(*r));
+
+	std::sort(values.begin(), values.end());
+
+	// Nearest rank.
+	auto rank = [&](float q)
+	{
+		size_t i = (size_t)ceilf(q * values.size());
+		return values[MathHelper::Clamp(i, (size_t)1, values.size()) - 1];
+	};
+
+	p.P50 = rank(0.50f);
+	p.P95 = rank(0.95f);
+	p.P99 = rank(0.99f);
+	p.Max = values.back();
+
+	return p;
+}
+
+UINT Profiler::GetQueryIndex(UINT frameResourceIndex, UINT scope)const
+{
+	return (frameResourceIndex * MaxScopes + scope) * 2;
+}
+
+//****************************************************************************
+// Profiler::CpuScope
+//****************************************************************************
+
+Profiler::CpuScope::CpuScope(Profiler* profiler, UINT scope)
+	: mProfiler(profiler), mScope(scope), mStart(QueryTicks())
+{
+}
+
+Profiler::CpuScope::~CpuScope()
+{
+	if(mProfiler != nullptr)
+		mProfiler->AddCpuTime(mScope, QueryTicks() - mStart);
+}
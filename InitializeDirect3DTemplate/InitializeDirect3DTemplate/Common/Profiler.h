@@ -0,0 +1,149 @@
+//***************************************************************************************
+// Profiler.h
+//
+// Per-frame CPU and GPU timings with a history for percentiles and export.
+//
+// CPU scopes accumulate QueryPerformanceCounter ticks into the current frame and may
+// be timed from several threads at once.  GPU scopes are pairs of timestamp queries;
+// each frame resource has its own range of queries and readback memory, and its
+// timings are read back once its fence has passed, gNumFrameResources frames later,
+// into the record of the frame that wrote them.
+//
+// Frame time is measured from one BeginFrame() to the next, so it covers everything
+// the frame loop does, including the waits.
+//***************************************************************************************
+
+#pragma once
+
+#include "d3dUtil.h"
+#include <atomic>
+
+class Profiler
+{
+public:
+	static const UINT MaxScopes = 32;
+
+	Profiler(ID3D12Device* device, ID3D12CommandQueue* queue, UINT frameResourceCount, UINT historySize = 4096);
+	Profiler(const Profiler& rhs) = delete;
+	Profiler& operator=(const Profiler& rhs) = delete;
+
+	// Timestamps of lists of another queue type, such as the compute queue's,
+	// are converted with that queue's frequency, which need not match the
+	// frequency of the queue given to the constructor.
+	void AddQueue(ID3D12CommandQueue* queue);
+
+	// Scopes are registered up front; ids count up from zero in call order.
+	UINT AddCpuScope(const std::string& name);
+	UINT AddGpuScope(const std::string& name);
+
+	// Closes the previous frame's record and starts one for the frame that
+	// will use the given frame resource.
+	void BeginFrame(UINT frameResourceIndex);
+
+	// Call once the frame resource's fence has passed: reads back the GPU
+	// timings left by the last frame that used it.
+	void ReadGpuScopes();
+
+	// Thread safe.
+	void AddCpuTime(UINT scope, INT64 ticks);
+
+	// Timestamps around GPU work of the current frame; a scope may begin and
+	// end in different command lists of the same queue.  Lists of an added
+	// compute queue work too, and a scope may move between queues from one
+	// frame to the next, but the frame's timestamps are resolved on the direct
+	// queue, which has to wait for the compute work first.
+	void BeginGpuScope(ID3D12GraphicsCommandList* cmdList, UINT scope);
+	void EndGpuScope(ID3D12GraphicsCommandList* cmdList, UINT scope);
+
+	// Copies the frame's timestamps to its readback memory; record it after the
+	// last EndGpuScope of the frame.
+	void ResolveGpuScopes(ID3D12GraphicsCommandList* cmdList);
+
+	struct Percentiles
+	{
+		float P50 = 0.0f;
+		float P95 = 0.0f;
+		float P99 = 0.0f;
+		float Max = 0.0f;
+	};
+
+	// Over the completed frames in the history, in milliseconds.
+	Percentiles GetFrameTimePercentiles()const;
+
+	// The frame started by the last BeginFrame(); frames are numbered from 1.
+	UINT64 GetFrameNumber()const;
+
+	// Over the completed frames numbered [firstFrame, endFrame) still in the
+	// history.  GPU timings only count frames whose timings came back.
+	Percentiles GetFrameTimePercentiles(UINT64 firstFrame, UINT64 endFrame)const;
+	Percentiles GetGpuTimePercentiles(UINT scope, UINT64 firstFrame, UINT64 endFrame)const;
+
+	// The last frame whose GPU timings came back, zero before any did, and a
+	// scope's time in a frame; zero if it did not come back or has dropped out
+	// of the history.  For frame time feedback.
+	UINT64 GetLatestGpuFrame()const;
+	float GetGpuTime(UINT64 frameNumber, UINT scope)const;
+
+	// One row per frame, or a summary of percentiles per timing.
+	bool WriteCsv(const std::wstring& filename)const;
+	bool WriteJson(const std::wstring& filename)const;
+
+	class CpuScope
+	{
+	public:
+		CpuScope(Profiler* profiler, UINT scope);
+		CpuScope(const CpuScope& rhs) = delete;
+		CpuScope& operator=(const CpuScope& rhs) = delete;
+		~CpuScope();
+
+	private:
+		Profiler* mProfiler;
+		UINT mScope;
+		INT64 mStart;
+	};
+
+private:
+	struct FrameRecord
+	{
+		UINT64 FrameNumber = 0;
+		float FrameMs = 0.0f;
+		float CpuMs[MaxScopes] = {};
+		float GpuMs[MaxScopes] = {};
+		bool GpuResolved = false;
+	};
+
+	// Null once the frame has dropped out of the history.
+	FrameRecord* FindRecord(UINT64 frameNumber);
+
+	// Completed frames, oldest first.
+	std::vector<const FrameRecord*> GetCompletedFrames(UINT64 firstFrame = 0, UINT64 endFrame = UINT64_MAX)const;
+
+	template<typename Metric>
+	Percentiles ComputePercentiles(const std::vector<const FrameRecord*>& frames, Metric metric)const;
+
+	UINT GetQueryIndex(UINT frameResourceIndex, UINT scope)const;
+
+private:
+	Microsoft::WRL::ComPtr<ID3D12QueryHeap> mQueryHeap;
+	Microsoft::WRL::ComPtr<ID3D12Resource> mReadbackBuffer;
+	// Per command list type; zero for types without a queue.
+	UINT64 mTimestampFrequencies[D3D12_COMMAND_LIST_TYPE_COPY + 1] = {};
+	UINT mFrameResourceCount = 0;
+
+	// Per frame resource: the frame that last wrote its queries, which scopes
+	// it wrote, and per scope the type of the list that ended it.
+	std::vector<UINT64> mSlotFrame;
+	std::vector<UINT> mSlotScopes;
+	std::vector<D3D12_COMMAND_LIST_TYPE> mSlotScopeTypes;
+
+	std::vector<std::string> mCpuScopeNames;
+	std::vector<std::string> mGpuScopeNames;
+	std::atomic<INT64> mCpuTicks[MaxScopes];
+
+	std::vector<FrameRecord> mHistory;
+	UINT64 mFrameNumber = 0;
+	UINT64 mLatestGpuFrame = 0;
+	UINT mSlot = 0;
+	INT64 mFrameStart = 0;
+	double mMsPerTick = 0.0;
+};
@@ -0,0 +1,96 @@
+//***************************************************************************************
+// RenderQueue.cpp
+//***************************************************************************************
+
+#include "RenderQueue.h"
+#include <cstring>
+
+// Bit pattern of a non-negative float, which orders the same way as the value.
+static UINT32 DepthBits(float depth)
+{
+	if(!(depth > 0.0f))
+		return 0;
+
+	UINT32 bits;
+	memcpy(&bits, &depth, sizeof(bits));
+	return bits;
+}
+
+static UINT64 StateBits(UINT psoId, UINT geoId, UINT materialId)
+{
+	return ((UINT64)(psoId & 0xff) << 24) | ((UINT64)(geoId & 0xff) << 16) | (UINT64)(materialId & 0xffff);
+}
+
+UINT64 RenderQueue::MakeOpaqueKey(UINT psoId, UINT geoId, UINT materialId, float depth)
+{
+	return (StateBits(psoId, geoId, materialId) << 32) | DepthBits(depth);
+}
+
+UINT64 RenderQueue::MakeTransparentKey(UINT psoId, UINT geoId, UINT materialId, float depth)
+{
+	return ((UINT64)~DepthBits(depth) << 32) | StateBits(psoId, geoId, materialId);
+}
+
+void RenderQueue::Clear()
+{
+	mEntries.clear();
+}
+
+void RenderQueue::Reserve(size_t count)
+{
+	mEntries.reserve(count);
+	mScratch.reserve(count);
+}
+
+void RenderQueue::Push(UINT64 sortKey, UINT index)
+{
+	mEntries.push_back({ sortKey, index });
+}
+
+void RenderQueue::Sort()
+{
+	const size_t count = mEntries.size();
+	if(count < 2)
+		return;
+
+	mScratch.resize(count);
+
+	// Bits that differ between at least two keys; bytes without any are
+	// already in order and cost no pass.
+	UINT64 differing = 0;
+	for(size_t i = 1; i < count; ++i)
+		differing |= mEntries[i].SortKey ^ mEntries[0].SortKey;
+
+	for(UINT shift = 0; shift < 64; shift += 8)
+	{
+		if(((differing >> shift) & 0xff) == 0)
+			continue;
+
+		size_t offsets[256] = {};
+		for(size_t i = 0; i < count; ++i)
+			++offsets[(mEntries[i].SortKey >> shift) & 0xff];
+
+		size_t sum = 0;
+		for(size_t& offset : offsets)
+		{
+			size_t digitCount = offset;
+			offset = sum;
+			sum += digitCount;
+		}
+
+		for(size_t i = 0; i < count; ++i)
+			mScratch[offsets[(mEntries[i].SortKey >> shift) & 0xff]++] = mEntries[i];
+
+		mEntries.swap(mScratch);
+	}
+}
+
+size_t RenderQueue::Size()const
+{
+	return mEntries.size();
+}
+
+const RenderQueueEntry& RenderQueue::operator[](size_t i)const
+{
+	return mEntries[i];
+}
@@ -0,0 +1,48 @@
+//***************************************************************************************
+// RenderQueue.h
+//
+// List of draws ordered by a packed 64-bit sort key.  The caller pushes one key
+// per draw along with the draw's index in its own arrays, sorts, and walks the
+// entries in order.  Keys are sorted with an LSD radix sort, one pass per byte,
+// skipping the bytes every key has in common.
+//
+// The opaque key puts the pipeline state in the top bits, then the geometry,
+// then the material, then the view depth, so draws that share state end up
+// next to each other and are front-to-back within a state.  The transparent
+// key puts the inverted depth on top instead, giving back-to-front order.
+//***************************************************************************************
+
+#pragma once
+
+#include <windows.h>
+#include <vector>
+
+struct RenderQueueEntry
+{
+	UINT64 SortKey;
+	UINT Index;
+};
+
+class RenderQueue
+{
+public:
+	// The state ids are truncated to the bits they get in the key: 8 for the
+	// pipeline state and the geometry, 16 for the material.  Depth is the view
+	// depth of the draw; negative values sort as zero.
+	static UINT64 MakeOpaqueKey(UINT psoId, UINT geoId, UINT materialId, float depth);
+	static UINT64 MakeTransparentKey(UINT psoId, UINT geoId, UINT materialId, float depth);
+
+	void Clear();
+	void Reserve(size_t count);
+	void Push(UINT64 sortKey, UINT index);
+
+	// Stable ascending sort by key.
+	void Sort();
+
+	size_t Size()const;
+	const RenderQueueEntry& operator[](size_t i)const;
+
+private:
+	std::vector<RenderQueueEntry> mEntries;
+	std::vector<RenderQueueEntry> mScratch;
+};
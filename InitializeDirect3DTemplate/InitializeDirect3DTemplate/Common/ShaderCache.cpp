@@ -0,0 +1,119 @@
+//***************************************************************************************
+// ShaderCache.cpp
+//***************************************************************************************
+
+#include "ShaderCache.h"
+
+using Microsoft::WRL::ComPtr;
+
+// FNV-1a, 64 bit.
+static UINT64 HashBytes(UINT64 hash, const void* data, size_t byteSize)
+{
+	const BYTE* bytes = static_cast<const BYTE*>(data);
+	for(size_t i = 0; i < byteSize; ++i)
+	{
+		hash ^= bytes[i];
+		hash *= 1099511628211ull;
+	}
+
+	return hash;
+}
+
+static UINT64 HashString(UINT64 hash, const std::string& s)
+{
+	// The terminator keeps "ab" + "c" apart from "a" + "bc".
+	return HashBytes(hash, s.c_str(), s.size() + 1);
+}
+
+ShaderCache::ShaderCache(const std::wstring& directory)
+	: mDirectory(directory)
+{
+	if(!mDirectory.empty())
+		CreateDirectoryW(mDirectory.c_str(), nullptr);
+}
+
+ComPtr<ID3DBlob> ShaderCache::CompileShader(
+	const std::wstring& filename,
+	const D3D_SHADER_MACRO* defines,
+	const std::string& entrypoint,
+	const std::string& target)
+{
+	UINT64 key = 0;
+	if(mDirectory.empty() || !ComputeKey(filename, defines, entrypoint, target, key))
+		return d3dUtil::CompileShader(filename, defines, entrypoint, target);
+
+	wchar_t keyName[17];
+	swprintf_s(keyName, L"%016llx", key);
+	std::wstring cachedFile = mDirectory + L"\\" + keyName + L".cso";
+
+	ComPtr<ID3DBlob> byteCode;
+	if(SUCCEEDED(D3DReadFileToBlob(cachedFile.c_str(), byteCode.GetAddressOf())))
+	{
+		++mHitCount;
+		return byteCode;
+	}
+
+	++mMissCount;
+	byteCode = d3dUtil::CompileShader(filename, defines, entrypoint, target);
+
+	// A failed write only costs a compile next time. Written next to the final
+	// name and renamed over it, so a torn write is never read back as a hit.
+	std::wstring tempFile = cachedFile + L".tmp";
+	if(FAILED(D3DWriteBlobToFile(byteCode.Get(), tempFile.c_str(), TRUE)) ||
+		!MoveFileExW(tempFile.c_str(), cachedFile.c_str(), MOVEFILE_REPLACE_EXISTING))
+	{
+		DeleteFileW(tempFile.c_str());
+	}
+
+	return byteCode;
+}
+
+UINT ShaderCache::GetHitCount()const
+{
+	return mHitCount;
+}
+
+UINT ShaderCache::GetMissCount()const
+{
+	return mMissCount;
+}
+
+bool ShaderCache::ComputeKey(const std::wstring& filename, const D3D_SHADER_MACRO* defines,
+	const std::string& entrypoint, const std::string& target, UINT64& key)const
+{
+	ComPtr<ID3DBlob> source;
+	if(FAILED(D3DReadFileToBlob(filename.c_str(), source.GetAddressOf())))
+		return false;
+
+	char sourceName[MAX_PATH];
+	if(WideCharToMultiByte(CP_ACP, 0, filename.c_str(), -1, sourceName, MAX_PATH, nullptr, nullptr) == 0)
+		return false;
+
+	// Preprocessed, the source includes its headers and has the defines applied.
+	ComPtr<ID3DBlob> preprocessed;
+	ComPtr<ID3DBlob> errors;
+	HRESULT hr = D3DPreprocess(source->GetBufferPointer(), source->GetBufferSize(), sourceName,
+		defines, D3D_COMPILE_STANDARD_FILE_INCLUDE, &preprocessed, &errors);
+	if(FAILED(hr))
+		return false;
+
+	// Same flags as d3dUtil::CompileShader.
+	UINT compileFlags = 0;
+#if defined(DEBUG) || defined(_DEBUG)
+	compileFlags = D3DCOMPILE_DEBUG | D3DCOMPILE_SKIP_OPTIMIZATION;
+#endif
+
+	UINT64 hash = 14695981039346656037ull;
+	hash = HashBytes(hash, preprocessed->GetBufferPointer(), preprocessed->GetBufferSize());
+	for(const D3D_SHADER_MACRO* d = defines; d != nullptr && d->Name != nullptr; ++d)
+	{
+		hash = HashString(hash, d->Name);
+		hash = HashString(hash, d->Definition != nullptr ? d->Definition : "");
+	}
+	hash = HashString(hash, entrypoint);
+	hash = HashString(hash, target);
+	hash = HashBytes(hash, &compileFlags, sizeof(compileFlags));
+
+	key = hash;
+	return true;
+}
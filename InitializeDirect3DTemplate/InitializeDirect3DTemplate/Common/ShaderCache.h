@@ -0,0 +1,39 @@
+//***************************************************************************************
+// ShaderCache.h
+//
+// Compiled shader bytecode kept on disk between runs.  Each entry is named after a
+// hash of the preprocessed source (so edits to included files count), the defines,
+// the entry point, the target and the compile flags; a hit loads the .cso instead of
+// compiling, a miss compiles with d3dUtil::CompileShader and writes the result.
+//***************************************************************************************
+
+#pragma once
+
+#include "d3dUtil.h"
+
+class ShaderCache
+{
+public:
+	// An empty directory turns the cache off: every shader is compiled.
+	explicit ShaderCache(const std::wstring& directory);
+
+	Microsoft::WRL::ComPtr<ID3DBlob> CompileShader(
+		const std::wstring& filename,
+		const D3D_SHADER_MACRO* defines,
+		const std::string& entrypoint,
+		const std::string& target);
+
+	UINT GetHitCount()const;
+	UINT GetMissCount()const;
+
+private:
+	// Returns false if the source cannot be read or preprocessed; the compiler
+	// then gets to report the error.
+	bool ComputeKey(const std::wstring& filename, const D3D_SHADER_MACRO* defines,
+		const std::string& entrypoint, const std::string& target, UINT64& key)const;
+
+private:
+	std::wstring mDirectory;
+	UINT mHitCount = 0;
+	UINT mMissCount = 0;
+};
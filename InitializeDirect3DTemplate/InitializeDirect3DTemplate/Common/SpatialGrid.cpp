@@ -0,0 +1,195 @@
+//***************************************************************************************
+// SpatialGrid.cpp
+//***************************************************************************************
+
+#include "SpatialGrid.h"
+#include <cmath>
+#include <cfloat>
+
+using namespace DirectX;
+
+void SpatialGrid::Build(const std::vector<BoundingBox>& boxes, float cellSize)
+{
+	Clear();
+
+	if(boxes.empty() || cellSize <= 0.0f)
+		return;
+
+	mCellSize = cellSize;
+	mInvCellSize = 1.0f / cellSize;
+
+	//
+	// Store the boxes as min/max corners and find the extents of the grid.
+	//
+
+	float minX = +FLT_MAX, minZ = +FLT_MAX;
+	float maxX = -FLT_MAX, maxZ = -FLT_MAX;
+
+	mBoxes.resize(boxes.size());
+	for(size_t i = 0; i < boxes.size(); ++i)
+	{
+		const BoundingBox& b = boxes[i];
+
+		mBoxes[i].Min = XMFLOAT3(b.Center.x - b.Extents.x, b.Center.y - b.Extents.y, b.Center.z - b.Extents.z);
+		mBoxes[i].Max = XMFLOAT3(b.Center.x + b.Extents.x, b.Center.y + b.Extents.y, b.Center.z + b.Extents.z);
+
+		minX = fminf(minX, mBoxes[i].Min.x);
+		minZ = fminf(minZ, mBoxes[i].Min.z);
+		maxX = fmaxf(maxX, mBoxes[i].Max.x);
+		maxZ = fmaxf(maxZ, mBoxes[i].Max.z);
+	}
+
+	mOriginX = minX;
+	mOriginZ = minZ;
+	mCols = (int)floorf((maxX - minX) * mInvCellSize) + 1;
+	mRows = (int)floorf((maxZ - minZ) * mInvCellSize) + 1;
+
+	//
+	// Two passes: count the boxes per cell, then fill the compressed lists.
+	//
+
+	const size_t cellCount = (size_t)mCols * mRows;
+	mCellStart.assign(cellCount + 1, 0);
+
+	for(const Aabb& b : mBoxes)
+	{
+		int col0, row0, col1, row1;
+		CellRange(b.Min.x, b.Min.z, b.Max.x, b.Max.z, col0, row0, col1, row1);
+
+		for(int r = row0; r <= row1; ++r)
+			for(int c = col0; c <= col1; ++c)
+				mCellStart[r * mCols + c + 1]++;
+	}
+
+	for(size_t i = 0; i < cellCount; ++i)
+		mCellStart[i + 1] += mCellStart[i];
+
+	mCellBoxes.resize(mCellStart[cellCount]);
+	std::vector<uint32> cursor(mCellStart.begin(), mCellStart.end() - 1);
+
+	for(uint32 i = 0; i < (uint32)mBoxes.size(); ++i)
+	{
+		const Aabb& b = mBoxes[i];
+
+		int col0, row0, col1, row1;
+		CellRange(b.Min.x, b.Min.z, b.Max.x, b.Max.z, col0, row0, col1, row1);
+
+		for(int r = row0; r <= row1; ++r)
+			for(int c = col0; c <= col1; ++c)
+				mCellBoxes[cursor[r * mCols + c]++] = i;
+	}
+}
+
+void SpatialGrid::Clear()
+{
+	mBoxes.clear();
+	mCellStart.clear();
+	mCellBoxes.clear();
+	mCols = 0;
+	mRows = 0;
+}
+
+bool SpatialGrid::IntersectsSphere(const XMFLOAT3& center, float radius)const
+{
+	int col0, row0, col1, row1;
+	if(!CellRange(center.x - radius, center.z - radius, center.x + radius, center.z + radius,
+		col0, row0, col1, row1))
+		return false;
+
+	const float radiusSq = radius * radius;
+
+	for(int r = row0; r <= row1; ++r)
+	{
+		for(int c = col0; c <= col1; ++c)
+		{
+			const int cell = r * mCols + c;
+			for(uint32 i = mCellStart[cell]; i < mCellStart[cell + 1]; ++i)
+			{
+				if(SphereOverlapsBox(center, radiusSq, mBoxes[mCellBoxes[i]]))
+					return true;
+			}
+		}
+	}
+
+	return false;
+}
+
+void SpatialGrid::QuerySphere(const XMFLOAT3& center, float radius, std::vector<uint32>& results)const
+{
+	int col0, row0, col1, row1;
+	if(!CellRange(center.x - radius, center.z - radius, center.x + radius, center.z + radius,
+		col0, row0, col1, row1))
+		return;
+
+	const float radiusSq = radius * radius;
+
+	for(int r = row0; r <= row1; ++r)
+	{
+		for(int c = col0; c <= col1; ++c)
+		{
+			const int cell = r * mCols + c;
+			for(uint32 i = mCellStart[cell]; i < mCellStart[cell + 1]; ++i)
+			{
+				const uint32 boxIndex = mCellBoxes[i];
+				const Aabb& b = mBoxes[boxIndex];
+
+				// A box that spans several cells is only reported from the first
+				// cell of the query range it covers, so no per-query bookkeeping
+				// is needed to remove duplicates.
+				int bc0, br0, bc1, br1;
+				CellRange(b.Min.x, b.Min.z, b.Max.x, b.Max.z, bc0, br0, bc1, br1);
+				if(c != (bc0 > col0 ? bc0 : col0) || r != (br0 > row0 ? br0 : row0))
+					continue;
+
+				if(SphereOverlapsBox(center, radiusSq, b))
+					results.push_back(boxIndex);
+			}
+		}
+	}
+}
+
+SpatialGrid::uint32 SpatialGrid::GetBoxCount()const
+{
+	return (uint32)mBoxes.size();
+}
+
+BoundingBox SpatialGrid::GetBox(uint32 index)const
+{
+	const Aabb& b = mBoxes[index];
+
+	BoundingBox box;
+	BoundingBox::CreateFromPoints(box, XMLoadFloat3(&b.Min), XMLoadFloat3(&b.Max));
+	return box;
+}
+
+bool SpatialGrid::CellRange(float minX, float minZ, float maxX, float maxZ,
+	int& col0, int& row0, int& col1, int& row1)const
+{
+	if(mCols == 0 || mRows == 0)
+		return false;
+
+	col0 = (int)floorf((minX - mOriginX) * mInvCellSize);
+	row0 = (int)floorf((minZ - mOriginZ) * mInvCellSize);
+	col1 = (int)floorf((maxX - mOriginX) * mInvCellSize);
+	row1 = (int)floorf((maxZ - mOriginZ) * mInvCellSize);
+
+	if(col1 < 0 || row1 < 0 || col0 >= mCols || row0 >= mRows)
+		return false;
+
+	col0 = col0 < 0 ? 0 : col0;
+	row0 = row0 < 0 ? 0 : row0;
+	col1 = col1 >= mCols ? mCols - 1 : col1;
+	row1 = row1 >= mRows ? mRows - 1 : row1;
+
+	return true;
+}
+
+bool SpatialGrid::SphereOverlapsBox(const XMFLOAT3& center, float radiusSq, const Aabb& box)const
+{
+	// Squared distance from the sphere center to the closest point of the box.
+	float dx = fmaxf(fmaxf(box.Min.x - center.x, 0.0f), center.x - box.Max.x);
+	float dy = fmaxf(fmaxf(box.Min.y - center.y, 0.0f), center.y - box.Max.y);
+	float dz = fmaxf(fmaxf(box.Min.z - center.z, 0.0f), center.z - box.Max.z);
+
+	return dx * dx + dy * dy + dz * dz < radiusSq;
+}
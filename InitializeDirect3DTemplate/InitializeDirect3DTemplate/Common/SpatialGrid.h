@@ -0,0 +1,67 @@
+//***************************************************************************************
+// SpatialGrid.h
+//
+// Uniform grid over the XZ plane used to accelerate sphere-vs-box queries against
+// axis-aligned world geometry (maze walls, castle walls, props).  Queries only
+// visit the cells overlapped by the sphere and compare squared distances, so
+// thousands of tests per frame stay cheap.  The grid is read-only after Build(),
+// so queries may be issued from several threads at once.
+//***************************************************************************************
+
+#pragma once
+
+#include <DirectXCollision.h>
+#include <vector>
+#include <cstdint>
+
+class SpatialGrid
+{
+public:
+	using uint32 = std::uint32_t;
+
+	// Builds the grid over the union of the given boxes.  cellSize is the edge
+	// length of one grid cell in world units; matching the spacing the boxes
+	// were placed on keeps each box in one or two cells.
+	void Build(const std::vector<DirectX::BoundingBox>& boxes, float cellSize);
+	void Clear();
+
+	// Returns true if the sphere overlaps at least one box.
+	bool IntersectsSphere(const DirectX::XMFLOAT3& center, float radius)const;
+
+	// Appends the index of every box overlapped by the sphere to results.
+	// Each box is reported once.  Results come out in cell-scan order (row by
+	// row, then column by column), not in Build() order; sort them if needed.
+	void QuerySphere(const DirectX::XMFLOAT3& center, float radius, std::vector<uint32>& results)const;
+
+	uint32 GetBoxCount()const;
+	DirectX::BoundingBox GetBox(uint32 index)const;
+
+private:
+	struct Aabb
+	{
+		DirectX::XMFLOAT3 Min;
+		DirectX::XMFLOAT3 Max;
+	};
+
+	// Range of cells covered by [minX, maxX] x [minZ, maxZ], clamped to the grid.
+	// Returns false if the range lies completely outside the grid.
+	bool CellRange(float minX, float minZ, float maxX, float maxZ,
+		int& col0, int& row0, int& col1, int& row1)const;
+
+	bool SphereOverlapsBox(const DirectX::XMFLOAT3& center, float radiusSq, const Aabb& box)const;
+
+private:
+	std::vector<Aabb> mBoxes;
+
+	// Compressed cell lists: the boxes of cell i are
+	// mCellBoxes[mCellStart[i]] .. mCellBoxes[mCellStart[i+1]-1].
+	std::vector<uint32> mCellStart;
+	std::vector<uint32> mCellBoxes;
+
+	float mOriginX = 0.0f;
+	float mOriginZ = 0.0f;
+	float mCellSize = 1.0f;
+	float mInvCellSize = 1.0f;
+	int mCols = 0;
+	int mRows = 0;
+};
@@ -0,0 +1,296 @@
+//***************************************************************************************
+// TextureStreamer.cpp
+//***************************************************************************************
+
+#include "TextureStreamer.h"
+
+using Microsoft::WRL::ComPtr;
+
+TextureStreamer::TextureStreamer(ID3D12Device* device, ID3D12DescriptorHeap* srvHeap, UINT srvDescriptorSize,
+	UINT textureCount, unsigned threadCount, UINT64 uploadRingSize)
+	: md3dDevice(device), mSrvHeap(srvHeap), mSrvDescriptorSize(srvDescriptorSize), mTextureCount(textureCount)
+{
+	mTextures.resize(textureCount);
+	mResident.resize(textureCount, 0);
+
+	D3D12_COMMAND_QUEUE_DESC queueDesc = {};
+	queueDesc.Type = D3D12_COMMAND_LIST_TYPE_COPY;
+	queueDesc.Flags = D3D12_COMMAND_QUEUE_FLAG_NONE;
+	ThrowIfFailed(md3dDevice->CreateCommandQueue(&queueDesc, IID_PPV_ARGS(&mCopyQueue)));
+
+	ThrowIfFailed(md3dDevice->CreateCommandAllocator(
+		D3D12_COMMAND_LIST_TYPE_COPY,
+		IID_PPV_ARGS(mCopyCmdListAlloc.GetAddressOf())));
+
+	ThrowIfFailed(md3dDevice->CreateCommandList(
+		0,
+		D3D12_COMMAND_LIST_TYPE_COPY,
+		mCopyCmdListAlloc.Get(),
+		nullptr,
+		IID_PPV_ARGS(mCopyCmdList.GetAddressOf())));
+
+	ThrowIfFailed(md3dDevice->CreateFence(0, D3D12_FENCE_FLAG_NONE, IID_PPV_ARGS(&mCopyFence)));
+
+	mCopyFenceEvent = CreateEventEx(nullptr, nullptr, 0, EVENT_ALL_ACCESS);
+	if(mCopyFenceEvent == nullptr)
+		ThrowIfFailed(HRESULT_FROM_WIN32(GetLastError()));
+
+	mUploadRing = std::make_unique<UploadRing>(md3dDevice, uploadRingSize);
+
+	// The fallback goes through the freshly opened copy list, so it is resident
+	// before the first frame is drawn.
+	BuildFallbackTexture();
+
+	threadCount = MathHelper::Max(threadCount, 1u);
+	mThreads.reserve(threadCount);
+	for(unsigned i = 0; i < threadCount; ++i)
+		mThreads.emplace_back(&TextureStreamer::LoaderMain, this);
+}
+
+TextureStreamer::~TextureStreamer()
+{
+	{
+		std::lock_guard<std::mutex> lock(mMutex);
+		mQuit = true;
+	}
+	mJobReady.notify_all();
+
+	for(auto& t : mThreads)
+		t.join();
+
+	// The copy queue may still be writing into textures and upload heaps.
+	WaitForCopies();
+
+	if(mCopyFenceEvent != nullptr)
+		CloseHandle(mCopyFenceEvent);
+}
+
+void TextureStreamer::Request(const std::wstring& filename, UINT srvIndex)
+{
+	assert(srvIndex < mTextureCount);
+
+	auto job = std::make_unique<Job>();
+	job->Filename = filename;
+	job->SrvIndex = srvIndex;
+
+	{
+		std::lock_guard<std::mutex> lock(mMutex);
+		mPendingJobs.push_back(std::move(job));
+	}
+	mJobReady.notify_one();
+}
+
+bool TextureStreamer::Update()
+{
+	mUploadRing->Reclaim(mCopyFence->GetCompletedValue());
+
+	bool published = false;
+
+	// Publish the batch on the copy queue once the GPU is done with it.
+	if(!mInFlightJobs.empty() && mCopyFence->GetCompletedValue() >= mInFlightFenceValue)
+	{
+		for(auto& job : mInFlightJobs)
+		{
+			CreateSrv(job->Upload.Texture.Get(), job->Upload.IsCubeMap, job->SrvIndex);
+
+			mTextures[job->SrvIndex] = job->Upload.Texture;
+			mResident[job->SrvIndex] = 1;
+		}
+
+		mInFlightJobs.clear();
+		published = true;
+	}
+
+	if(mInFlightJobs.empty())
+		SubmitCopies();
+
+	return published;
+}
+
+UINT TextureStreamer::GetSrvIndex(UINT srvIndex)const
+{
+	return (srvIndex < mTextureCount && mResident[srvIndex]) ? srvIndex : GetFallbackSrvIndex();
+}
+
+UINT TextureStreamer::GetFallbackSrvIndex()const
+{
+	return mTextureCount;
+}
+
+bool TextureStreamer::IsIdle()const
+{
+	std::lock_guard<std::mutex> lock(mMutex);
+	return mPendingJobs.empty() && mLoadedJobs.empty() && mJobsInProgress == 0 && mInFlightJobs.empty();
+}
+
+void TextureStreamer::LoaderMain()
+{
+	DirectX::DDSUploadAllocator12 allocator =
+		[this](UINT64 byteSize, UINT64 alignment, ID3D12Resource** buffer, UINT64* offset, BYTE** cpuAddress)
+	{
+		UploadAllocation allocation;
+		if(!mUploadRing->Allocate(byteSize, alignment, allocation))
+			return false;
+
+		*buffer = allocation.Resource;
+		*offset = allocation.Offset;
+		*cpuAddress = allocation.CpuAddress;
+		return true;
+	};
+
+	for(;;)
+	{
+		std::unique_ptr<Job> job;
+		{
+			std::unique_lock<std::mutex> lock(mMutex);
+			mJobReady.wait(lock, [this]{ return mQuit || !mPendingJobs.empty(); });
+
+			if(mQuit)
+				return;
+
+			job = std::move(mPendingJobs.front());
+			mPendingJobs.pop_front();
+			++mJobsInProgress;
+		}
+
+		// File read, DDS parsing and the upload heap fill; no command list involved.
+		job->Result = DirectX::PrepareDDSTextureFromFile12(
+			md3dDevice, job->Filename.c_str(), job->Upload, 0, nullptr, &allocator);
+
+		{
+			std::lock_guard<std::mutex> lock(mMutex);
+			mLoadedJobs.push_back(std::move(job));
+			--mJobsInProgress;
+		}
+	}
+}
+
+void TextureStreamer::BuildFallbackTexture()
+{
+	D3D12_RESOURCE_DESC texDesc = CD3DX12_RESOURCE_DESC::Tex2D(DXGI_FORMAT_R8G8B8A8_UNORM, 1, 1, 1, 1);
+
+	auto defaultHeap = CD3DX12_HEAP_PROPERTIES(D3D12_HEAP_TYPE_DEFAULT);
+	ThrowIfFailed(md3dDevice->CreateCommittedResource(
+		&defaultHeap,
+		D3D12_HEAP_FLAG_NONE,
+		&texDesc,
+		D3D12_RESOURCE_STATE_COMMON,
+		nullptr,
+		IID_PPV_ARGS(&mFallbackTexture)));
+
+	D3D12_PLACED_SUBRESOURCE_FOOTPRINT layout;
+	UINT64 uploadBufferSize = 0;
+	md3dDevice->GetCopyableFootprints(&texDesc, 0, 1, 0, &layout, nullptr, nullptr, &uploadBufferSize);
+
+	ComPtr<ID3D12Resource> uploadHeap;
+	auto uploadHeapProps = CD3DX12_HEAP_PROPERTIES(D3D12_HEAP_TYPE_UPLOAD);
+	auto uploadDesc = CD3DX12_RESOURCE_DESC::Buffer(uploadBufferSize);
+	ThrowIfFailed(md3dDevice->CreateCommittedResource(
+		&uploadHeapProps,
+		D3D12_HEAP_FLAG_NONE,
+		&uploadDesc,
+		D3D12_RESOURCE_STATE_GENERIC_READ,
+		nullptr,
+		IID_PPV_ARGS(&uploadHeap)));
+
+	// Mid grey, so untextured surfaces still show their lighting.
+	BYTE* mappedData = nullptr;
+	ThrowIfFailed(uploadHeap->Map(0, nullptr, reinterpret_cast<void**>(&mappedData)));
+	const UINT32 grey = 0xff808080;
+	memcpy(mappedData + layout.Offset, &grey, sizeof(grey));
+	uploadHeap->Unmap(0, nullptr);
+
+	CD3DX12_TEXTURE_COPY_LOCATION dst(mFallbackTexture.Get(), 0);
+	CD3DX12_TEXTURE_COPY_LOCATION src(uploadHeap.Get(), layout);
+	mCopyCmdList->CopyTextureRegion(&dst, 0, 0, 0, &src, nullptr);
+
+	ThrowIfFailed(mCopyCmdList->Close());
+	ID3D12CommandList* cmdsLists[] = { mCopyCmdList.Get() };
+	mCopyQueue->ExecuteCommandLists(_countof(cmdsLists), cmdsLists);
+
+	mInFlightFenceValue = ++mCopyFenceValue;
+	ThrowIfFailed(mCopyQueue->Signal(mCopyFence.Get(), mInFlightFenceValue));
+
+	// One texel; waiting here keeps the upload heap alive only as long as needed.
+	WaitForCopies();
+
+	CreateSrv(mFallbackTexture.Get(), false, GetFallbackSrvIndex());
+}
+
+void TextureStreamer::CreateSrv(ID3D12Resource* resource, bool isCubeMap, UINT srvIndex)
+{
+	D3D12_RESOURCE_DESC desc = resource->GetDesc();
+
+	D3D12_SHADER_RESOURCE_VIEW_DESC srvDesc = {};
+	srvDesc.Shader4ComponentMapping = D3D12_DEFAULT_SHADER_4_COMPONENT_MAPPING;
+	srvDesc.Format = desc.Format;
+
+	if(isCubeMap)
+	{
+		srvDesc.ViewDimension = D3D12_SRV_DIMENSION_TEXTURECUBE;
+		srvDesc.TextureCube.MostDetailedMip = 0;
+		srvDesc.TextureCube.MipLevels = desc.MipLevels;
+		srvDesc.TextureCube.ResourceMinLODClamp = 0.0f;
+	}
+	else
+	{
+		srvDesc.ViewDimension = D3D12_SRV_DIMENSION_TEXTURE2D;
+		srvDesc.Texture2D.MostDetailedMip = 0;
+		srvDesc.Texture2D.MipLevels = desc.MipLevels;
+		srvDesc.Texture2D.ResourceMinLODClamp = 0.0f;
+	}
+
+	CD3DX12_CPU_DESCRIPTOR_HANDLE hDescriptor(mSrvHeap->GetCPUDescriptorHandleForHeapStart());
+	hDescriptor.Offset(srvIndex, mSrvDescriptorSize);
+
+	md3dDevice->CreateShaderResourceView(resource, &srvDesc, hDescriptor);
+}
+
+void TextureStreamer::SubmitCopies()
+{
+	{
+		std::lock_guard<std::mutex> lock(mMutex);
+		mInFlightJobs.swap(mLoadedJobs);
+
+		if(mInFlightJobs.empty())
+			return;
+
+		// The ring is retired in allocation order, but loaders finish out of
+		// order.  With no loader mid-job every allocation so far belongs to this
+		// batch or an earlier one, so all of it can wait on this batch's fence.
+		// Otherwise it stays in use until a later batch gets here.
+		if(mJobsInProgress == 0)
+			mUploadRing->Retire(mCopyFenceValue + 1);
+	}
+
+	// The previous batch has completed, so the allocator can be reused.
+	ThrowIfFailed(mCopyCmdListAlloc->Reset());
+	ThrowIfFailed(mCopyCmdList->Reset(mCopyCmdListAlloc.Get(), nullptr));
+
+	for(auto& job : mInFlightJobs)
+	{
+		if(FAILED(job->Result))
+			throw DxException(job->Result, L"PrepareDDSTextureFromFile12", job->Filename, __LINE__);
+
+		// The textures are created in COMMON: the copy promotes them to
+		// COPY_DEST, and they decay back once the copy queue is done, ready for
+		// the direct queue to promote to PIXEL_SHADER_RESOURCE on first use.
+		DirectX::RecordDDSTextureUpload12(mCopyCmdList.Get(), job->Upload);
+	}
+
+	ThrowIfFailed(mCopyCmdList->Close());
+	ID3D12CommandList* cmdsLists[] = { mCopyCmdList.Get() };
+	mCopyQueue->ExecuteCommandLists(_countof(cmdsLists), cmdsLists);
+
+	mInFlightFenceValue = ++mCopyFenceValue;
+	ThrowIfFailed(mCopyQueue->Signal(mCopyFence.Get(), mInFlightFenceValue));
+}
+
+void TextureStreamer::WaitForCopies()
+{
+	if(mCopyFence != nullptr && mCopyFence->GetCompletedValue() < mCopyFenceValue)
+	{
+		ThrowIfFailed(mCopyFence->SetEventOnCompletion(mCopyFenceValue, mCopyFenceEvent));
+		WaitForSingleObject(mCopyFenceEvent, INFINITE);
+	}
+}
@@ -0,0 +1,97 @@
+//***************************************************************************************
+// TextureStreamer.h
+//
+// Loads DDS textures in the background so the first frame does not wait for them.
+// Loader threads read the files and fill upload heaps, the copies run on a copy
+// queue of their own, and the SRV of a texture is written once its copy has
+// completed.  Until then GetSrvIndex() returns a small grey fallback texture.
+// Texel data is staged in an UploadRing reclaimed against the copy fence.
+//***************************************************************************************
+
+#pragma once
+
+#include "d3dUtil.h"
+#include "UploadRing.h"
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <deque>
+
+class TextureStreamer
+{
+public:
+	// srvHeap needs textureCount + 1 descriptors: one per texture slot and the
+	// fallback texture in the last one.  Textures that do not fit in the upload
+	// ring when they are loaded get an upload heap of their own.
+	TextureStreamer(ID3D12Device* device, ID3D12DescriptorHeap* srvHeap, UINT srvDescriptorSize,
+		UINT textureCount, unsigned threadCount, UINT64 uploadRingSize);
+	TextureStreamer(const TextureStreamer& rhs) = delete;
+	TextureStreamer& operator=(const TextureStreamer& rhs) = delete;
+	~TextureStreamer();
+
+	// Queues filename for loading into SRV slot srvIndex.
+	void Request(const std::wstring& filename, UINT srvIndex);
+
+	// Call once per frame on the main thread, outside of command list recording.
+	// Submits the textures the loaders have finished and publishes the SRVs of
+	// the copies that have completed.  Never waits on the GPU.  Returns true
+	// when GetSrvIndex() changed for some slot.
+	bool Update();
+
+	// Slot to bind for srvIndex: srvIndex itself once the texture is resident,
+	// the fallback slot before.  Safe to call from recording threads.
+	UINT GetSrvIndex(UINT srvIndex)const;
+
+	UINT GetFallbackSrvIndex()const;
+	bool IsIdle()const;
+
+private:
+	struct Job
+	{
+		std::wstring Filename;
+		UINT SrvIndex = 0;
+		HRESULT Result = S_OK;
+		DirectX::DDSTextureUpload12 Upload;
+	};
+
+	void LoaderMain();
+	void BuildFallbackTexture();
+	void CreateSrv(ID3D12Resource* resource, bool isCubeMap, UINT srvIndex);
+	void SubmitCopies();
+	void WaitForCopies();
+
+private:
+	ID3D12Device* md3dDevice = nullptr;
+	ID3D12DescriptorHeap* mSrvHeap = nullptr;
+	UINT mSrvDescriptorSize = 0;
+	UINT mTextureCount = 0;
+
+	Microsoft::WRL::ComPtr<ID3D12CommandQueue> mCopyQueue;
+	Microsoft::WRL::ComPtr<ID3D12CommandAllocator> mCopyCmdListAlloc;
+	Microsoft::WRL::ComPtr<ID3D12GraphicsCommandList> mCopyCmdList;
+	Microsoft::WRL::ComPtr<ID3D12Fence> mCopyFence;
+	UINT64 mCopyFenceValue = 0;
+	HANDLE mCopyFenceEvent = nullptr;
+
+	std::unique_ptr<UploadRing> mUploadRing;
+
+	// Loader threads and the jobs between them and the main thread.
+	std::vector<std::thread> mThreads;
+	mutable std::mutex mMutex;
+	std::condition_variable mJobReady;
+	std::deque<std::unique_ptr<Job>> mPendingJobs;
+	std::vector<std::unique_ptr<Job>> mLoadedJobs;
+	UINT mJobsInProgress = 0;
+	bool mQuit = false;
+
+	// Copies submitted to the copy queue, complete once mCopyFence reaches
+	// mInFlightFenceValue.  Only one batch is in flight at a time.
+	std::vector<std::unique_ptr<Job>> mInFlightJobs;
+	UINT64 mInFlightFenceValue = 0;
+
+	// Written only by Update(), so recording threads may read them freely.
+	std::vector<Microsoft::WRL::ComPtr<ID3D12Resource>> mTextures;
+	std::vector<UINT8> mResident;
+
+	Microsoft::WRL::ComPtr<ID3D12Resource> mFallbackTexture;
+};
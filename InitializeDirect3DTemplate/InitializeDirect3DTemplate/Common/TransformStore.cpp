@@ -0,0 +1,278 @@
+//***************************************************************************************
+// TransformStore.cpp
+//***************************************************************************************
+
+#include "TransformStore.h"
+#include <intrin.h>
+
+using namespace DirectX;
+
+// Below this many pending slots an upload stays on the calling thread.
+static const UINT ParallelWriteThreshold = 4096;
+
+TransformStore::TransformStore(UINT frameResourceCount)
+	: mFrames(frameResourceCount)
+{
+}
+
+UINT TransformStore::Add(FXMMATRIX local, UINT parent, UINT slot)
+{
+	assert(parent == None || parent < (UINT)mLocal.size());
+
+	UINT index = mIndices.Allocate();
+	if(index == (UINT)mLocal.size())
+	{
+		mLocal.emplace_back();
+		mWorld.emplace_back();
+		mParent.push_back(None);
+		mSlot.push_back(None);
+		mFirstChild.push_back(None);
+		mNextSibling.push_back(None);
+	}
+
+	XMStoreFloat4x4A(&mLocal[index], local);
+	XMStoreFloat4x4A(&mWorld[index], local);
+	mParent[index] = parent;
+	mSlot[index] = slot;
+	mFirstChild[index] = None;
+	mNextSibling[index] = None;
+
+	if(parent != None)
+	{
+		mNextSibling[index] = mFirstChild[parent];
+		mFirstChild[parent] = index;
+	}
+
+	UINT wordCount = ((UINT)mLocal.size() + 31) / 32;
+	mDirty.resize(wordCount, 0);
+	mChangedBits.resize(wordCount, 0);
+	for(auto& frame : mFrames)
+		frame.Pending.resize(wordCount, 0);
+
+	SetBit(mDirty, index);
+	mAnyDirty = true;
+
+	return index;
+}
+
+void TransformStore::Remove(UINT index)
+{
+	assert(mFirstChild[index] == None);
+
+	UINT parent = mParent[index];
+	if(parent != None)
+	{
+		UINT* link = &mFirstChild[parent];
+		while(*link != index)
+			link = &mNextSibling[*link];
+		*link = mNextSibling[index];
+	}
+
+	ClearBit(mDirty, index);
+
+	if(mSlot[index] != None)
+	{
+		for(auto& frame : mFrames)
+		{
+			if(TestBit(frame.Pending, index))
+			{
+				ClearBit(frame.Pending, index);
+				--frame.PendingCount;
+			}
+		}
+	}
+
+	mParent[index] = None;
+	mSlot[index] = None;
+	mNextSibling[index] = None;
+
+	mIndices.Release(index);
+}
+
+void TransformStore::SetLocal(UINT index, FXMMATRIX local)
+{
+	XMStoreFloat4x4A(&mLocal[index], local);
+
+	SetBit(mDirty, index);
+	mAnyDirty = true;
+}
+
+XMMATRIX TransformStore::GetWorld(UINT index)const
+{
+	return XMLoadFloat4x4A(&mWorld[index]);
+}
+
+UINT TransformStore::GetCount()const
+{
+	return (UINT)mLocal.size();
+}
+
+void TransformStore::UpdateWorld()
+{
+	mChanged.clear();
+
+	if(!mAnyDirty)
+		return;
+
+	std::fill(mChangedBits.begin(), mChangedBits.end(), 0);
+
+	// Dirty transforms come up in index order.  An ancestor added before its
+	// descendant has the lower index, so its subtree is redone first and the
+	// dirty transforms inside it are then skipped; one that reused a lower
+	// index is simply redone twice.
+	for(UINT w = 0; w < (UINT)mDirty.size(); ++w)
+	{
+		std::uint32_t bits = mDirty[w];
+		mDirty[w] = 0;
+
+		unsigned long bit;
+		while(_BitScanForward(&bit, bits))
+		{
+			bits &= bits - 1;
+
+			UINT index = w * 32 + bit;
+			if(!TestBit(mChangedBits, index))
+				UpdateSubtree(index);
+		}
+	}
+
+	mAnyDirty = false;
+}
+
+const std::vector<UINT>& TransformStore::GetChanged()const
+{
+	return mChanged;
+}
+
+void TransformStore::InvalidateFrame(UINT frameResourceIndex)
+{
+	FrameState& frame = mFrames[frameResourceIndex];
+
+	std::fill(frame.Pending.begin(), frame.Pending.end(), 0);
+	frame.PendingCount = 0;
+
+	for(UINT i = 0; i < (UINT)mSlot.size(); ++i)
+	{
+		if(mSlot[i] != None)
+		{
+			SetBit(frame.Pending, i);
+			++frame.PendingCount;
+		}
+	}
+}
+
+void TransformStore::UpdateSubtree(UINT root)
+{
+	mStack.push_back(root);
+
+	while(!mStack.empty())
+	{
+		UINT i = mStack.back();
+		mStack.pop_back();
+
+		UINT parent = mParent[i];
+		XMMATRIX world = XMLoadFloat4x4A(&mLocal[i]);
+		if(parent != None)
+			world = XMMatrixMultiply(world, XMLoadFloat4x4A(&mWorld[parent]));
+		XMStoreFloat4x4A(&mWorld[i], world);
+
+		if(!TestBit(mChangedBits, i))
+		{
+			SetBit(mChangedBits, i);
+			mChanged.push_back(i);
+		}
+
+		if(mSlot[i] != None)
+		{
+			for(auto& frame : mFrames)
+			{
+				if(!TestBit(frame.Pending, i))
+				{
+					SetBit(frame.Pending, i);
+					++frame.PendingCount;
+				}
+			}
+		}
+
+		for(UINT child = mFirstChild[i]; child != None; child = mNextSibling[child])
+			mStack.push_back(child);
+	}
+}
+
+void TransformStore::WriteConstants(UINT frameResourceIndex, BYTE* dest, UINT stride, WorkerPool* pool)
+{
+	assert(((size_t)dest & 15) == 0 && (stride & 15) == 0);
+
+	FrameState& frame = mFrames[frameResourceIndex];
+	if(frame.PendingCount == 0)
+		return;
+
+	// Parts own whole words of the bitset, so they never touch the same bits.
+	UINT wordCount = (UINT)frame.Pending.size();
+	UINT partCount = 1;
+	if(pool != nullptr && frame.PendingCount >= ParallelWriteThreshold)
+		partCount = MathHelper::Min(pool->GetThreadCount() + 1, wordCount);
+
+	if(partCount > 1)
+	{
+		pool->ParallelFor(partCount, [&](unsigned part)
+		{
+			WriteWords(frame.Pending, dest, stride, wordCount * part / partCount, wordCount * (part + 1) / partCount);
+		});
+	}
+	else
+	{
+		WriteWords(frame.Pending, dest, stride, 0, wordCount);
+	}
+
+	frame.PendingCount = 0;
+}
+
+void TransformStore::WriteWords(std::vector<std::uint32_t>& pending, BYTE* dest, UINT stride, UINT firstWord, UINT lastWord)
+{
+	for(UINT w = firstWord; w < lastWord; ++w)
+	{
+		std::uint32_t bits = pending[w];
+		pending[w] = 0;
+
+		unsigned long bit;
+		while(_BitScanForward(&bit, bits))
+		{
+			bits &= bits - 1;
+
+			UINT index = w * 32 + bit;
+			XMMATRIX m = XMMatrixTranspose(XMLoadFloat4x4A(&mWorld[index]));
+			float* out = reinterpret_cast<float*>(dest + (size_t)mSlot[index] * stride);
+
+#if defined(_XM_SSE_INTRINSICS_)
+			_mm_stream_ps(out + 0, m.r[0]);
+			_mm_stream_ps(out + 4, m.r[1]);
+			_mm_stream_ps(out + 8, m.r[2]);
+			_mm_stream_ps(out + 12, m.r[3]);
+#else
+			XMStoreFloat4x4A(reinterpret_cast<XMFLOAT4X4A*>(out), m);
+#endif
+		}
+	}
+
+#if defined(_XM_SSE_INTRINSICS_)
+	// Streaming stores are weakly ordered; make this thread's visible before
+	// the command list that reads them is submitted.
+	_mm_sfence();
+#endif
+}
+
+bool TransformStore::TestBit(const std::vector<std::uint32_t>& bits, UINT index)
+{
+	return (bits[index / 32] & (1u << (index % 32))) != 0;
+}
+
+void TransformStore::SetBit(std::vector<std::uint32_t>& bits, UINT index)
+{
+	bits[index / 32] |= 1u << (index % 32);
+}
+
+void TransformStore::ClearBit(std::vector<std::uint32_t>& bits, UINT index)
+{
+	bits[index / 32] &= ~(1u << (index % 32));
+}
@@ -0,0 +1,100 @@
+//***************************************************************************************
+// TransformStore.h
+//
+// Object transforms kept as arrays rather than per object: local matrices, world
+// matrices and parent indices side by side, so updating and uploading many of them
+// walks contiguous memory.
+//
+// A transform's world is its local matrix times its parent's world.  UpdateWorld()
+// starts from the transforms whose local matrix was set and walks down their
+// subtrees, so the cost follows what moved, not the size of the store.  Removed
+// transforms leave their index to the next one added.
+//
+// Transforms bound to a constant buffer slot are tracked with one dirty bit per frame
+// resource.  WriteConstants() streams the transposed worlds of the pending ones into
+// the frame resource's mapped buffer with non-temporal stores, since upload memory
+// is write-combined and never read back, and splits large uploads over a WorkerPool.
+//***************************************************************************************
+
+#pragma once
+
+#include "d3dUtil.h"
+#include "WorkerPool.h"
+#include "FreeList.h"
+
+class TransformStore
+{
+public:
+	static const UINT None = 0xffffffff;
+
+	explicit TransformStore(UINT frameResourceCount);
+	TransformStore(const TransformStore& rhs) = delete;
+	TransformStore& operator=(const TransformStore& rhs) = delete;
+
+	// The parent, if any, must already be in the store.  A slot makes the world
+	// part of the per-frame constants.  Returns the new transform's index.
+	UINT Add(DirectX::FXMMATRIX local, UINT parent = None, UINT slot = None);
+
+	// The transform must have no children left.  Its slot is no longer written.
+	void Remove(UINT index);
+
+	void SetLocal(UINT index, DirectX::FXMMATRIX local);
+
+	// As of the last UpdateWorld().
+	DirectX::XMMATRIX GetWorld(UINT index)const;
+
+	// Indices in use are below this.
+	UINT GetCount()const;
+
+	// Recomputes the worlds changed by SetLocal and Add since the last call, and
+	// marks their slots pending in every frame resource.
+	void UpdateWorld();
+
+	// Indices whose world changed in the last UpdateWorld(), each once.
+	const std::vector<UINT>& GetChanged()const;
+
+	// Marks every slot pending in the frame resource, for when the buffer the
+	// slots are written to has been replaced.
+	void InvalidateFrame(UINT frameResourceIndex);
+
+	// Writes the transposed world of every transform pending in the frame
+	// resource to its slot, stride bytes apart; dest must be 16-byte aligned, as
+	// must the stride.  The pool, if any, takes a share of large uploads.
+	void WriteConstants(UINT frameResourceIndex, BYTE* dest, UINT stride, WorkerPool* pool);
+
+private:
+	void UpdateSubtree(UINT root);
+	void WriteWords(std::vector<std::uint32_t>& pending, BYTE* dest, UINT stride, UINT firstWord, UINT lastWord);
+
+	static bool TestBit(const std::vector<std::uint32_t>& bits, UINT index);
+	static void SetBit(std::vector<std::uint32_t>& bits, UINT index);
+	static void ClearBit(std::vector<std::uint32_t>& bits, UINT index);
+
+private:
+	std::vector<DirectX::XMFLOAT4X4A> mLocal;
+	std::vector<DirectX::XMFLOAT4X4A> mWorld;
+	std::vector<UINT> mParent;
+	std::vector<UINT> mSlot;
+	FreeList mIndices;
+
+	// Children of each transform as a singly linked list.
+	std::vector<UINT> mFirstChild;
+	std::vector<UINT> mNextSibling;
+
+	// Subtree walk of UpdateSubtree, kept to reuse its memory.
+	std::vector<UINT> mStack;
+
+	// Locals set since the last update, and the worlds that update changed.
+	std::vector<std::uint32_t> mDirty;
+	std::vector<std::uint32_t> mChangedBits;
+	std::vector<UINT> mChanged;
+	bool mAnyDirty = false;
+
+	struct FrameState
+	{
+		std::vector<std::uint32_t> Pending;
+		UINT PendingCount = 0;
+	};
+
+	std::vector<FrameState> mFrames;
+};
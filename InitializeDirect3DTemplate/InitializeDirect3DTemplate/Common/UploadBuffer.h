@@ -1,12 +1,14 @@
 #pragma once
 
 #include "d3dUtil.h"
+#include "PlacedBufferHeap.h"
 
 template<typename T>
 class UploadBuffer
 {
 public:
     UploadBuffer(ID3D12Device* device, UINT elementCount, bool isConstantBuffer) : 
+        mElementCount(elementCount),
         mIsConstantBuffer(isConstantBuffer)
     {
         mElementByteSize = sizeof(T);
@@ -37,6 +39,20 @@ public:
         // the resource while it is in use by the GPU (so we must use synchronization techniques).
     }
 
+    // Same, but placed in one of the heaps of heap, which must be an upload heap.
+    UploadBuffer(PlacedBufferHeap& heap, UINT elementCount, bool isConstantBuffer) :
+        mElementCount(elementCount),
+        mIsConstantBuffer(isConstantBuffer)
+    {
+        mElementByteSize = sizeof(T);
+        if(isConstantBuffer)
+            mElementByteSize = d3dUtil::CalcConstantBufferByteSize(sizeof(T));
+
+        mUploadBuffer = heap.CreateBuffer((UINT64)mElementByteSize * elementCount, D3D12_RESOURCE_STATE_GENERIC_READ);
+
+        ThrowIfFailed(mUploadBuffer->Map(0, nullptr, reinterpret_cast<void**>(&mMappedData)));
+    }
+
     UploadBuffer(const UploadBuffer& rhs) = delete;
     UploadBuffer& operator=(const UploadBuffer& rhs) = delete;
     ~UploadBuffer()
@@ -52,6 +68,23 @@ public:
         return mUploadBuffer.Get();
     }
 
+    // For writers that fill elements in place; elements are ElementByteSize()
+    // bytes apart.
+    BYTE* MappedData()const
+    {
+        return mMappedData;
+    }
+
+    UINT ElementByteSize()const
+    {
+        return mElementByteSize;
+    }
+
+    UINT ElementCount()const
+    {
+        return mElementCount;
+    }
+
     void CopyData(int elementIndex, const T& data)
     {
         memcpy(&mMappedData[elementIndex*mElementByteSize], &data, sizeof(T));
@@ -61,6 +94,7 @@ private:
     Microsoft::WRL::ComPtr<ID3D12Resource> mUploadBuffer;
     BYTE* mMappedData = nullptr;
 
+    UINT mElementCount = 0;
     UINT mElementByteSize = 0;
     bool mIsConstantBuffer = false;
 };
\ No newline at end of file
@@ -0,0 +1,93 @@
+//***************************************************************************************
+// UploadRing.cpp
+//***************************************************************************************
+
+#include "UploadRing.h"
+
+UploadRing::UploadRing(ID3D12Device* device, UINT64 byteSize)
+{
+	// Keep the capacity a multiple of the largest alignment handed out, so an
+	// aligned running count is also aligned within the buffer.
+	const UINT64 maxAlignment = D3D12_DEFAULT_RESOURCE_PLACEMENT_ALIGNMENT;
+	mCapacity = (byteSize + maxAlignment - 1) & ~(maxAlignment - 1);
+
+	auto upload = CD3DX12_HEAP_PROPERTIES(D3D12_HEAP_TYPE_UPLOAD);
+	auto buffer = CD3DX12_RESOURCE_DESC::Buffer(mCapacity);
+	ThrowIfFailed(device->CreateCommittedResource(
+		&upload,
+		D3D12_HEAP_FLAG_NONE,
+		&buffer,
+		D3D12_RESOURCE_STATE_GENERIC_READ,
+		nullptr,
+		IID_PPV_ARGS(&mBuffer)));
+
+	ThrowIfFailed(mBuffer->Map(0, nullptr, reinterpret_cast<void**>(&mMappedData)));
+}
+
+UploadRing::~UploadRing()
+{
+	if(mBuffer != nullptr)
+		mBuffer->Unmap(0, nullptr);
+
+	mMappedData = nullptr;
+}
+
+bool UploadRing::Allocate(UINT64 byteSize, UINT64 alignment, UploadAllocation& allocation)
+{
+	assert(alignment != 0 && (alignment & (alignment - 1)) == 0);
+	assert(alignment <= D3D12_DEFAULT_RESOURCE_PLACEMENT_ALIGNMENT);
+
+	if(byteSize == 0 || byteSize > mCapacity)
+		return false;
+
+	std::lock_guard<std::mutex> lock(mMutex);
+
+	UINT64 start = (mHead + alignment - 1) & ~(alignment - 1);
+
+	// Allocations never straddle the end of the buffer; skip to the start.
+	UINT64 position = start % mCapacity;
+	if(position + byteSize > mCapacity)
+	{
+		start += mCapacity - position;
+		position = 0;
+	}
+
+	if(start + byteSize - mTail > mCapacity)
+		return false;
+
+	mHead = start + byteSize;
+
+	allocation.Resource = mBuffer.Get();
+	allocation.Offset = position;
+	allocation.CpuAddress = mMappedData + position;
+	allocation.GpuAddress = mBuffer->GetGPUVirtualAddress() + position;
+
+	return true;
+}
+
+void UploadRing::Retire(UINT64 fenceValue)
+{
+	std::lock_guard<std::mutex> lock(mMutex);
+
+	UINT64 lastHead = mRetired.empty() ? mTail : mRetired.back().Head;
+	if(mHead == lastHead)
+		return;
+
+	mRetired.push_back({ fenceValue, mHead });
+}
+
+void UploadRing::Reclaim(UINT64 completedFenceValue)
+{
+	std::lock_guard<std::mutex> lock(mMutex);
+
+	while(!mRetired.empty() && mRetired.front().FenceValue <= completedFenceValue)
+	{
+		mTail = mRetired.front().Head;
+		mRetired.pop_front();
+	}
+}
+
+UINT64 UploadRing::GetCapacity()const
+{
+	return mCapacity;
+}
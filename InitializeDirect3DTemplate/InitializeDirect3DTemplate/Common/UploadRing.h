@@ -0,0 +1,62 @@
+//***************************************************************************************
+// UploadRing.h
+//
+// One persistently mapped upload buffer handed out as a ring.  Allocations are
+// tagged with a fence value by Retire() and handed back by Reclaim() once the GPU
+// has passed that value, so staging memory for copies is reused instead of being
+// kept alive in a committed resource per upload.
+//***************************************************************************************
+
+#pragma once
+
+#include "d3dUtil.h"
+#include <deque>
+#include <mutex>
+
+struct UploadAllocation
+{
+	ID3D12Resource* Resource = nullptr;
+	UINT64 Offset = 0;
+	BYTE* CpuAddress = nullptr;
+	D3D12_GPU_VIRTUAL_ADDRESS GpuAddress = 0;
+};
+
+class UploadRing
+{
+public:
+	UploadRing(ID3D12Device* device, UINT64 byteSize);
+	UploadRing(const UploadRing& rhs) = delete;
+	UploadRing& operator=(const UploadRing& rhs) = delete;
+	~UploadRing();
+
+	// Returns false when there is no room until more memory is reclaimed.
+	// alignment must be a power of two no larger than 64KB.  Thread safe.
+	bool Allocate(UINT64 byteSize, UINT64 alignment, UploadAllocation& allocation);
+
+	// Everything allocated so far stays in use until the fence reaches fenceValue.
+	void Retire(UINT64 fenceValue);
+
+	// Frees the retired allocations whose fence value has been reached.
+	void Reclaim(UINT64 completedFenceValue);
+
+	UINT64 GetCapacity()const;
+
+private:
+	Microsoft::WRL::ComPtr<ID3D12Resource> mBuffer;
+	BYTE* mMappedData = nullptr;
+	UINT64 mCapacity = 0;
+
+	// Running byte counts; the ring position is the count modulo mCapacity.
+	// Bytes in [mTail, mHead) are in use.
+	UINT64 mHead = 0;
+	UINT64 mTail = 0;
+
+	struct RetiredRange
+	{
+		UINT64 FenceValue;
+		UINT64 Head;
+	};
+	std::deque<RetiredRange> mRetired;
+
+	std::mutex mMutex;
+};
@@ -0,0 +1,123 @@
+//***************************************************************************************
+// WorkerPool.cpp
+//***************************************************************************************
+
+#include "WorkerPool.h"
+
+WorkerPool::WorkerPool(unsigned threadCount)
+{
+	mThreads.reserve(threadCount);
+	for(unsigned i = 0; i < threadCount; ++i)
+		mThreads.emplace_back(&WorkerPool::WorkerMain, this);
+}
+
+WorkerPool::~WorkerPool()
+{
+	{
+		std::lock_guard<std::mutex> lock(mMutex);
+		mQuit = true;
+	}
+	mWorkReady.notify_all();
+
+	for(auto& t : mThreads)
+		t.join();
+}
+
+unsigned WorkerPool::GetThreadCount()const
+{
+	return (unsigned)mThreads.size();
+}
+
+void WorkerPool::ParallelFor(unsigned taskCount, const std::function<void(unsigned)>& task)
+{
+	if(taskCount == 0)
+		return;
+
+	if(mThreads.empty() || taskCount == 1)
+	{
+		for(unsigned i = 0; i < taskCount; ++i)
+			task(i);
+		return;
+	}
+
+	{
+		std::lock_guard<std::mutex> lock(mMutex);
+		mTask = &task;
+		mTaskCount = taskCount;
+		mNextTask = 0;
+		mError = nullptr;
+		++mGeneration;
+	}
+	mWorkReady.notify_all();
+
+	// The calling thread takes tasks too instead of sitting idle.
+	RunTasks(task, taskCount);
+
+	// Every index has been handed out at this point; wait for the workers that
+	// are still running one.
+	std::exception_ptr error;
+	{
+		std::unique_lock<std::mutex> lock(mMutex);
+		mWorkDone.wait(lock, [this]{ return mActiveWorkers == 0; });
+
+		mTask = nullptr;
+		mTaskCount = 0;
+		error = mError;
+		mError = nullptr;
+	}
+
+	if(error)
+		std::rethrow_exception(error);
+}
+
+void WorkerPool::WorkerMain()
+{
+	std::uint64_t lastGeneration = 0;
+
+	for(;;)
+	{
+		const std::function<void(unsigned)>* task = nullptr;
+		unsigned taskCount = 0;
+		{
+			std::unique_lock<std::mutex> lock(mMutex);
+			mWorkReady.wait(lock, [&]{ return mQuit || (mTask != nullptr && mGeneration != lastGeneration); });
+
+			if(mQuit)
+				return;
+
+			lastGeneration = mGeneration;
+			task = mTask;
+			taskCount = mTaskCount;
+			++mActiveWorkers;
+		}
+
+		RunTasks(*task, taskCount);
+
+		{
+			std::lock_guard<std::mutex> lock(mMutex);
+			--mActiveWorkers;
+		}
+		mWorkDone.notify_one();
+	}
+}
+
+void WorkerPool::RunTasks(const std::function<void(unsigned)>& task, unsigned taskCount)
+{
+	for(;;)
+	{
+		unsigned i = mNextTask.fetch_add(1);
+		if(i >= taskCount)
+			break;
+
+		try
+		{
+			task(i);
+		}
+		catch(...)
+		{
+			std::lock_guard<std::mutex> lock(mMutex);
+			if(!mError)
+				mError = std::current_exception();
+		}
+	}
+}
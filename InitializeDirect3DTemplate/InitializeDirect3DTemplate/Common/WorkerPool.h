@@ -0,0 +1,57 @@
+//***************************************************************************************
+// WorkerPool.h
+//
+// Fixed set of worker threads for fork/join work such as recording command lists
+// in parallel.  ParallelFor() hands out task indices to the workers and to the
+// calling thread and returns once every task has finished, so the caller can
+// treat it like an ordinary loop.
+//***************************************************************************************
+
+#pragma once
+
+#include <vector>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+#include <functional>
+#include <exception>
+#include <cstdint>
+
+class WorkerPool
+{
+public:
+	// threadCount is the number of threads created in addition to the caller;
+	// zero makes ParallelFor() run every task on the calling thread.
+	explicit WorkerPool(unsigned threadCount);
+	WorkerPool(const WorkerPool& rhs) = delete;
+	WorkerPool& operator=(const WorkerPool& rhs) = delete;
+	~WorkerPool();
+
+	unsigned GetThreadCount()const;
+
+	// Calls task(i) for every i in [0, taskCount) and blocks until all calls
+	// have returned.  The first exception thrown by a task is rethrown here.
+	void ParallelFor(unsigned taskCount, const std::function<void(unsigned)>& task);
+
+private:
+	void WorkerMain();
+	void RunTasks(const std::function<void(unsigned)>& task, unsigned taskCount);
+
+private:
+	std::vector<std::thread> mThreads;
+
+	std::mutex mMutex;
+	std::condition_variable mWorkReady;
+	std::condition_variable mWorkDone;
+
+	// Current job, only valid while ParallelFor() is running.
+	const std::function<void(unsigned)>* mTask = nullptr;
+	unsigned mTaskCount = 0;
+	std::uint64_t mGeneration = 0;
+	unsigned mActiveWorkers = 0;
+	bool mQuit = false;
+
+	std::atomic<unsigned> mNextTask{ 0 };
+	std::exception_ptr mError;
+};
@@ -35,6 +35,12 @@ D3DApp::~D3DApp()
 {
 	if(md3dDevice != nullptr)
 		FlushCommandQueue();
+
+	if(mFrameLatencyWaitableObject != nullptr)
+		CloseHandle(mFrameLatencyWaitableObject);
+
+	if(mFenceEvent != nullptr)
+		CloseHandle(mFenceEvent);
 }
 
 HINSTANCE D3DApp::AppInst()const
@@ -91,6 +97,7 @@ int D3DApp::Run()
 			if( !mAppPaused )
 			{
 				CalculateFrameStats();
+				WaitForFrameLatency();
 				Update(mTimer);	
                 Draw(mTimer);
 			}
@@ -159,7 +166,7 @@ void D3DApp::OnResize()
 		SwapChainBufferCount, 
 		mClientWidth, mClientHeight, 
 		mBackBufferFormat, 
-		DXGI_SWAP_CHAIN_FLAG_ALLOW_MODE_SWITCH));
+		mSwapChainFlags));
 
 	mCurrBackBuffer = 0;
  
@@ -246,7 +253,7 @@ LRESULT D3DApp::MsgProc(HWND hwnd, UINT msg, WPARAM wParam, LPARAM lParam)
 	//! We pause the game when the window is deactivated and unpause it 
 	//! when it becomes active.  
 	case WM_ACTIVATE:
-		if( LOWORD(wParam) == WA_INACTIVE )
+		if( LOWORD(wParam) == WA_INACTIVE && mPauseWhenInactive )
 		{
 			mAppPaused = true;
 			mTimer.Stop();
@@ -368,6 +375,8 @@ LRESULT D3DApp::MsgProc(HWND hwnd, UINT msg, WPARAM wParam, LPARAM lParam)
         }
         else if((int)wParam == VK_F2)
             Set4xMsaaState(!m4xMsaaState);
+        else
+            OnKeyUp(wParam);
 
         return 0;
 	}
@@ -437,38 +446,57 @@ bool D3DApp::InitDirect3D()
      //! (resolution, refresh rate, and such); it also defines the various supported surface formats(DXGI_FORMAT).
 	ThrowIfFailed(CreateDXGIFactory1(IID_PPV_ARGS(&mdxgiFactory)));
 
-	UINT i = 0;
-	IDXGIAdapter* adapter = nullptr;
-	//! I added this code to take advantage of your "stronger" GPU. 
-    //! sometimes your seond graphics card (like mine: NVDIA) is much stronger, that would stop blinking!
-	std::vector<IDXGIAdapter*> adapterList;
-	while (mdxgiFactory->EnumAdapters(i, &adapter) != DXGI_ERROR_NOT_FOUND)
+	//! Try to create hardware device.  The default adapter is often the integrated
+	//! GPU on machines that have two, so pick one explicitly.
+	ComPtr<IDXGIAdapter1> adapter = SelectAdapter();
+	HRESULT hardwareResult = DXGI_ERROR_NOT_FOUND;
+	if(adapter != nullptr)
 	{
-		adapterList.push_back(adapter);
-		++i;
+		hardwareResult = D3D12CreateDevice(
+			adapter.Get(),
+			D3D_FEATURE_LEVEL_12_0,
+			IID_PPV_ARGS(&md3dDevice));
 	}
-	//! Try to create hardware device.
-	HRESULT hardwareResult = D3D12CreateDevice(
-		nullptr,             // default adapter
-		//adapterList[0],          //NVDIA adapter! at home, you can comment this out and use nullptr to point to a stronger adapter
-		D3D_FEATURE_LEVEL_12_0,
-		IID_PPV_ARGS(&md3dDevice));
 
 	//! Fallback to WARP device.
 	if(FAILED(hardwareResult))
 	{
-		ComPtr<IDXGIAdapter> pWarpAdapter;
-		ThrowIfFailed(mdxgiFactory->EnumWarpAdapter(IID_PPV_ARGS(&pWarpAdapter)));
+		adapter.Reset();
+		ThrowIfFailed(mdxgiFactory->EnumWarpAdapter(IID_PPV_ARGS(&adapter)));
 
 		ThrowIfFailed(D3D12CreateDevice(
-			pWarpAdapter.Get(),
+			adapter.Get(),
 			D3D_FEATURE_LEVEL_12_0,
 			IID_PPV_ARGS(&md3dDevice)));
 	}
 
+	ThrowIfFailed(adapter->GetDesc1(&mAdapterDesc));
+	adapter.As(&mAdapter);
+
+	DXGI_QUERY_VIDEO_MEMORY_INFO memoryInfo = GetVideoMemoryInfo();
+	std::wstring text = L"***Using adapter: ";
+	text += mAdapterDesc.Description;
+	text += L" (LUID " + FormatLuid(mAdapterDesc.AdapterLuid) +
+		L", " + std::to_wstring(mAdapterDesc.DedicatedVideoMemory >> 20) + L" MB dedicated" +
+		L", budget " + std::to_wstring(memoryInfo.Budget >> 20) + L" MB" +
+		L", in use " + std::to_wstring(memoryInfo.CurrentUsage >> 20) + L" MB)\n";
+	OutputDebugString(text.c_str());
+
+	mMainWndCaption += L" - ";
+	mMainWndCaption += mAdapterDesc.Description;
+
 	ThrowIfFailed(md3dDevice->CreateFence(0, D3D12_FENCE_FLAG_NONE,
 		IID_PPV_ARGS(&mFence)));
 
+	ThrowIfFailed(md3dDevice->CreateFence(0, D3D12_FENCE_FLAG_NONE,
+		IID_PPV_ARGS(&mComputeFence)));
+	ThrowIfFailed(md3dDevice->CreateFence(0, D3D12_FENCE_FLAG_NONE,
+		IID_PPV_ARGS(&mDirectSyncFence)));
+
+	mFenceEvent = CreateEventEx(nullptr, nullptr, 0, EVENT_ALL_ACCESS);
+	if(mFenceEvent == nullptr)
+		ThrowIfFailed(HRESULT_FROM_WIN32(GetLastError()));
+
 	mRtvDescriptorSize = md3dDevice->GetDescriptorHandleIncrementSize(D3D12_DESCRIPTOR_HEAP_TYPE_RTV);
 	mDsvDescriptorSize = md3dDevice->GetDescriptorHandleIncrementSize(D3D12_DESCRIPTOR_HEAP_TYPE_DSV);
 	mCbvSrvUavDescriptorSize = md3dDevice->GetDescriptorHandleIncrementSize(D3D12_DESCRIPTOR_HEAP_TYPE_CBV_SRV_UAV);
@@ -503,6 +531,76 @@ bool D3DApp::InitDirect3D()
 
 
 
+ComPtr<IDXGIAdapter1> D3DApp::SelectAdapter()
+{
+	//! IDXGIFactory6 lists adapters in order of preference; older runtimes only
+	//! have the system order.
+	ComPtr<IDXGIFactory6> factory6;
+	mdxgiFactory.As(&factory6);
+
+	std::vector<ComPtr<IDXGIAdapter1>> candidates;
+	for(UINT i = 0; ; ++i)
+	{
+		ComPtr<IDXGIAdapter1> adapter;
+		HRESULT hr = factory6 != nullptr ?
+			factory6->EnumAdapterByGpuPreference(i, mGpuPreference, IID_PPV_ARGS(&adapter)) :
+			mdxgiFactory->EnumAdapters1(i, &adapter);
+		if(hr == DXGI_ERROR_NOT_FOUND)
+			break;
+		ThrowIfFailed(hr);
+
+		DXGI_ADAPTER_DESC1 desc;
+		ThrowIfFailed(adapter->GetDesc1(&desc));
+
+		std::wstring text = L"***Adapter " + std::to_wstring(i) + L": ";
+		text += desc.Description;
+		text += L" (LUID " + FormatLuid(desc.AdapterLuid) +
+			L", " + std::to_wstring(desc.DedicatedVideoMemory >> 20) + L" MB dedicated)\n";
+		OutputDebugString(text.c_str());
+
+		//! WARP is only the fallback, and the check creates no device.
+		if((desc.Flags & DXGI_ADAPTER_FLAG_SOFTWARE) == 0 &&
+			SUCCEEDED(D3D12CreateDevice(adapter.Get(), D3D_FEATURE_LEVEL_12_0, __uuidof(ID3D12Device), nullptr)))
+		{
+			candidates.push_back(adapter);
+		}
+	}
+
+	if(candidates.empty())
+		return nullptr;
+
+	if(mAdapterLuid.LowPart != 0 || mAdapterLuid.HighPart != 0)
+	{
+		for(auto& adapter : candidates)
+		{
+			DXGI_ADAPTER_DESC1 desc;
+			ThrowIfFailed(adapter->GetDesc1(&desc));
+			if(desc.AdapterLuid.LowPart == mAdapterLuid.LowPart && desc.AdapterLuid.HighPart == mAdapterLuid.HighPart)
+				return adapter;
+		}
+
+		std::wstring text = L"***No usable adapter with LUID " + FormatLuid(mAdapterLuid) + L"; using the preferred one.\n";
+		OutputDebugString(text.c_str());
+	}
+
+	return candidates.front();
+}
+
+DXGI_QUERY_VIDEO_MEMORY_INFO D3DApp::GetVideoMemoryInfo()const
+{
+	DXGI_QUERY_VIDEO_MEMORY_INFO info = {};
+	if(mAdapter != nullptr)
+		mAdapter->QueryVideoMemoryInfo(0, DXGI_MEMORY_SEGMENT_GROUP_LOCAL, &info);
+	return info;
+}
+
+std::wstring D3DApp::FormatLuid(const LUID& luid)
+{
+	wchar_t text[32];
+	swprintf_s(text, L"0x%08X%08X", (UINT)luid.HighPart, (UINT)luid.LowPart);
+	return text;
+}
+
 void D3DApp::CreateCommandObjects()
 {
 	D3D12_COMMAND_QUEUE_DESC queueDesc = {};
@@ -525,6 +623,25 @@ void D3DApp::CreateCommandObjects()
 	//! to the command list we will Reset it, and it needs to be closed before
 	//! calling Reset.
 	mCommandList->Close();
+
+	//! The same again for the compute queue.
+	D3D12_COMMAND_QUEUE_DESC computeQueueDesc = {};
+	computeQueueDesc.Type = D3D12_COMMAND_LIST_TYPE_COMPUTE;
+	computeQueueDesc.Flags = D3D12_COMMAND_QUEUE_FLAG_NONE;
+	ThrowIfFailed(md3dDevice->CreateCommandQueue(&computeQueueDesc, IID_PPV_ARGS(&mComputeQueue)));
+
+	ThrowIfFailed(md3dDevice->CreateCommandAllocator(
+		D3D12_COMMAND_LIST_TYPE_COMPUTE,
+		IID_PPV_ARGS(mComputeCmdListAlloc.GetAddressOf())));
+
+	ThrowIfFailed(md3dDevice->CreateCommandList(
+		0,
+		D3D12_COMMAND_LIST_TYPE_COMPUTE,
+		mComputeCmdListAlloc.Get(),
+		nullptr,
+		IID_PPV_ARGS(mComputeCmdList.GetAddressOf())));
+
+	mComputeCmdList->Close();
 }
 
 void D3DApp::CreateSwapChain()
@@ -532,6 +649,17 @@ void D3DApp::CreateSwapChain()
     //! Release the previous swapchain we will be recreating.
     mSwapChain.Reset();
 
+	if(mFrameLatencyWaitableObject != nullptr)
+	{
+		CloseHandle(mFrameLatencyWaitableObject);
+		mFrameLatencyWaitableObject = nullptr;
+	}
+
+	//! The same flags have to be passed to ResizeBuffers() later on.
+	mSwapChainFlags = DXGI_SWAP_CHAIN_FLAG_ALLOW_MODE_SWITCH;
+	if(mWaitableSwapChain)
+		mSwapChainFlags |= DXGI_SWAP_CHAIN_FLAG_FRAME_LATENCY_WAITABLE_OBJECT;
+
     DXGI_SWAP_CHAIN_DESC sd;
     sd.BufferDesc.Width = mClientWidth;
     sd.BufferDesc.Height = mClientHeight;
@@ -547,13 +675,21 @@ void D3DApp::CreateSwapChain()
     sd.OutputWindow = mhMainWnd;
     sd.Windowed = true;
 	sd.SwapEffect = DXGI_SWAP_EFFECT_FLIP_DISCARD;
-    sd.Flags = DXGI_SWAP_CHAIN_FLAG_ALLOW_MODE_SWITCH;
+    sd.Flags = mSwapChainFlags;
 
 	// Note: Swap chain uses queue to perform flush.
     ThrowIfFailed(mdxgiFactory->CreateSwapChain(
 		mCommandQueue.Get(),
 		&sd, 
 		mSwapChain.GetAddressOf()));
+
+	if(mWaitableSwapChain)
+	{
+		ComPtr<IDXGISwapChain2> swapChain2;
+		ThrowIfFailed(mSwapChain.As(&swapChain2));
+		ThrowIfFailed(swapChain2->SetMaximumFrameLatency(mMaxFrameLatency));
+		mFrameLatencyWaitableObject = swapChain2->GetFrameLatencyWaitableObject();
+	}
 }
 
 void D3DApp::FlushCommandQueue()
@@ -569,15 +705,44 @@ void D3DApp::FlushCommandQueue()
 	//! Wait until the GPU has completed commands up to this fence point.
     if(mFence->GetCompletedValue() < mCurrentFence)
 	{
-		HANDLE eventHandle = CreateEventEx(nullptr, nullptr, false, EVENT_ALL_ACCESS);
-
         //! Fire event when GPU hits current fence.  
-        ThrowIfFailed(mFence->SetEventOnCompletion(mCurrentFence, eventHandle));
+        ThrowIfFailed(mFence->SetEventOnCompletion(mCurrentFence, mFenceEvent));
 
         //! Wait until the GPU hits current fence event is fired.
-		WaitForSingleObject(eventHandle, INFINITE);
-        CloseHandle(eventHandle);
+		WaitForSingleObject(mFenceEvent, INFINITE);
 	}
+
+	//! The compute queue may still be running work the direct queue did not wait for.
+	if(mComputeQueue != nullptr)
+	{
+		ThrowIfFailed(mComputeQueue->Signal(mComputeFence.Get(), ++mCurrentComputeFence));
+
+		if(mComputeFence->GetCompletedValue() < mCurrentComputeFence)
+		{
+			ThrowIfFailed(mComputeFence->SetEventOnCompletion(mCurrentComputeFence, mFenceEvent));
+			WaitForSingleObject(mFenceEvent, INFINITE);
+		}
+	}
+}
+
+void D3DApp::ComputeWaitForDirect()
+{
+	ThrowIfFailed(mCommandQueue->Signal(mDirectSyncFence.Get(), ++mCurrentDirectSyncFence));
+	ThrowIfFailed(mComputeQueue->Wait(mDirectSyncFence.Get(), mCurrentDirectSyncFence));
+}
+
+void D3DApp::DirectWaitForCompute()
+{
+	ThrowIfFailed(mComputeQueue->Signal(mComputeFence.Get(), ++mCurrentComputeFence));
+	ThrowIfFailed(mCommandQueue->Wait(mComputeFence.Get(), mCurrentComputeFence));
+}
+
+void D3DApp::WaitForFrameLatency()
+{
+	//! Signalled once per completed present, so waiting here keeps at most
+	//! mMaxFrameLatency frames queued.  The timeout guards against a lost signal.
+	if(mFrameLatencyWaitableObject != nullptr)
+		WaitForSingleObjectEx(mFrameLatencyWaitableObject, 1000, TRUE);
 }
 
 
@@ -51,21 +51,46 @@ protected:
 	virtual void OnMouseUp(WPARAM btnState, int x, int y)  { }
 	virtual void OnMouseMove(WPARAM btnState, int x, int y){ }
 
+	// Convenience override for handling key releases not consumed by the framework.
+	virtual void OnKeyUp(WPARAM key){ }
+
 protected:
 
 	bool InitMainWindow();
 	bool InitDirect3D();
+
+	// The first adapter that supports feature level 12.0: the one named by
+	// mAdapterLuid if it does, or else the first in mGpuPreference order.
+	// Returns null when no hardware adapter qualifies.
+	Microsoft::WRL::ComPtr<IDXGIAdapter1> SelectAdapter();
 	void CreateCommandObjects();
     void CreateSwapChain();
 
 	void FlushCommandQueue();
 
+	// Orders the two queues on the GPU timeline without blocking the CPU: work
+	// submitted to the waiting queue from now on starts once the other queue
+	// has finished everything submitted to it so far.
+	void ComputeWaitForDirect();
+	void DirectWaitForCompute();
+
+	// Blocks until the swap chain is ready to accept another frame.  Returns at
+	// once when the swap chain was created without a frame latency waitable object.
+	void WaitForFrameLatency();
+
 	ID3D12Resource* CurrentBackBuffer()const;
 	D3D12_CPU_DESCRIPTOR_HANDLE CurrentBackBufferView()const;
 	D3D12_CPU_DESCRIPTOR_HANDLE DepthStencilView()const;
 
 	void CalculateFrameStats();
 
+	// The budget the OS gives this process in the adapter's local memory, and how
+	// much of it is in use.  Zero when the adapter predates DXGI 1.4.
+	DXGI_QUERY_VIDEO_MEMORY_INFO GetVideoMemoryInfo()const;
+
+	// An adapter LUID as one hex number, high part first, the form -adapterLuid takes.
+	static std::wstring FormatLuid(const LUID& luid);
+
     void LogAdapters();
     void LogAdapterOutputs(IDXGIAdapter* adapter);
     void LogOutputDisplayModes(IDXGIOutput* output, DXGI_FORMAT format);
@@ -93,14 +118,31 @@ protected:
     Microsoft::WRL::ComPtr<IDXGISwapChain> mSwapChain;
     Microsoft::WRL::ComPtr<ID3D12Device> md3dDevice;
 
+	// The adapter the device was created on.
+	Microsoft::WRL::ComPtr<IDXGIAdapter3> mAdapter;
+	DXGI_ADAPTER_DESC1 mAdapterDesc = {};
+
     Microsoft::WRL::ComPtr<ID3D12Fence> mFence;
     UINT64 mCurrentFence = 0;
+    HANDLE mFenceEvent = nullptr; // reused by every FlushCommandQueue() wait
 	
     Microsoft::WRL::ComPtr<ID3D12CommandQueue> mCommandQueue;
     Microsoft::WRL::ComPtr<ID3D12CommandAllocator> mDirectCmdListAlloc;
     Microsoft::WRL::ComPtr<ID3D12GraphicsCommandList> mCommandList;
 
+	// Async compute: a second queue whose work can overlap the direct queue's.
+	// Each queue signals its own fence for the other to wait on.
+    Microsoft::WRL::ComPtr<ID3D12CommandQueue> mComputeQueue;
+    Microsoft::WRL::ComPtr<ID3D12CommandAllocator> mComputeCmdListAlloc;
+    Microsoft::WRL::ComPtr<ID3D12GraphicsCommandList> mComputeCmdList;
+    Microsoft::WRL::ComPtr<ID3D12Fence> mComputeFence;
+    UINT64 mCurrentComputeFence = 0;
+    Microsoft::WRL::ComPtr<ID3D12Fence> mDirectSyncFence;
+    UINT64 mCurrentDirectSyncFence = 0;
+
 	static const int SwapChainBufferCount = 2;
+	UINT mSwapChainFlags = 0;
+	HANDLE mFrameLatencyWaitableObject = nullptr;
 	int mCurrBackBuffer = 0;
     Microsoft::WRL::ComPtr<ID3D12Resource> mSwapChainBuffer[SwapChainBufferCount];
     Microsoft::WRL::ComPtr<ID3D12Resource> mDepthStencilBuffer;
@@ -122,5 +164,20 @@ protected:
     DXGI_FORMAT mDepthStencilFormat = DXGI_FORMAT_D24_UNORM_S8_UINT;
 	int mClientWidth = 800;
 	int mClientHeight = 600;
+
+	// Frame pacing.  With a waitable swap chain Run() waits before each frame until
+	// fewer than mMaxFrameLatency presents are queued; 1 gives the lowest latency,
+	// larger values let the CPU run further ahead for throughput.
+	bool mWaitableSwapChain = true;
+	UINT mMaxFrameLatency = 1;
+
+	// Unattended runs keep going while another window has the focus.
+	bool mPauseWhenInactive = true;
+
+	// Adapter choice.  A nonzero mAdapterLuid asks for that adapter; otherwise, or
+	// when it is missing or unsuitable, hardware adapters are tried in
+	// mGpuPreference order.  WARP is the last resort.
+	DXGI_GPU_PREFERENCE mGpuPreference = DXGI_GPU_PREFERENCE_HIGH_PERFORMANCE;
+	LUID mAdapterLuid = {};
 };
 
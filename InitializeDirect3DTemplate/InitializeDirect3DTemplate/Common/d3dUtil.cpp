@@ -1,5 +1,7 @@
 
 #include "d3dUtil.h"
+#include "UploadRing.h"
+#include "PlacedBufferHeap.h"
 #include <comdef.h>
 #include <fstream>
 
@@ -93,6 +95,48 @@ Microsoft::WRL::ComPtr<ID3D12Resource> d3dUtil::CreateDefaultBuffer(
     return defaultBuffer;
 }
 
+Microsoft::WRL::ComPtr<ID3D12Resource> d3dUtil::CreateDefaultBuffer(
+    ID3D12Device* device,
+    ID3D12GraphicsCommandList* cmdList,
+    const void* initData,
+    UINT64 byteSize,
+    PlacedBufferHeap& bufferHeap,
+    UploadRing& uploadRing)
+{
+    void* stagingData = nullptr;
+    ComPtr<ID3D12Resource> defaultBuffer = CreateDefaultBuffer(device, cmdList, byteSize, bufferHeap, uploadRing, &stagingData);
+
+    memcpy(stagingData, initData, (size_t)byteSize);
+
+    return defaultBuffer;
+}
+
+Microsoft::WRL::ComPtr<ID3D12Resource> d3dUtil::CreateDefaultBuffer(
+    ID3D12Device* device,
+    ID3D12GraphicsCommandList* cmdList,
+    UINT64 byteSize,
+    PlacedBufferHeap& bufferHeap,
+    UploadRing& uploadRing,
+    void** stagingData)
+{
+    ComPtr<ID3D12Resource> defaultBuffer = bufferHeap.CreateBuffer(byteSize, D3D12_RESOURCE_STATE_COPY_DEST);
+
+    UploadAllocation staging;
+    if(!uploadRing.Allocate(byteSize, 16, staging))
+        throw DxException(E_OUTOFMEMORY, L"UploadRing::Allocate", AnsiToWString(__FILE__), __LINE__);
+
+    // The copy only runs once the list is submitted, after the caller has
+    // written the data.
+    cmdList->CopyBufferRegion(defaultBuffer.Get(), 0, staging.Resource, staging.Offset, byteSize);
+
+    auto transition = CD3DX12_RESOURCE_BARRIER::Transition(defaultBuffer.Get(),
+        D3D12_RESOURCE_STATE_COPY_DEST, D3D12_RESOURCE_STATE_GENERIC_READ);
+    cmdList->ResourceBarrier(1, &transition);
+
+    *stagingData = staging.CpuAddress;
+    return defaultBuffer;
+}
+
 ComPtr<ID3DBlob> d3dUtil::CompileShader(
 	const std::wstring& filename,
 	const D3D_SHADER_MACRO* defines,
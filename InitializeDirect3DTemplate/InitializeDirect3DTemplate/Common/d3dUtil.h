@@ -4,7 +4,7 @@
 
 #include <windows.h>
 #include <wrl.h>
-#include <dxgi1_4.h>
+#include <dxgi1_6.h>
 #include <d3d12.h>
 #include <D3Dcompiler.h>
 #include <DirectXMath.h>
@@ -25,7 +25,9 @@
 #include "DDSTextureLoader.h"
 #include "MathHelper.h"
 
-extern const int gNumFrameResources;
+// Number of frames the CPU may record ahead of the GPU.  Chosen at startup (it can
+// come from the command line) and must not change once frame resources exist.
+extern int gNumFrameResources;
 
 inline void d3dSetDebugName(IDXGIObject* obj, const char* name)
 {
@@ -55,6 +57,10 @@ inline std::wstring AnsiToWString(const std::string& str)
 	MultiByteToWideChar(CP_ACP, 0, str.c_str(), -1, buffer, 512);
 	return std::wstring(buffer);
 }
+
+class UploadRing;
+class PlacedBufferHeap;
+
 class d3dUtil
 {
 public:
@@ -88,6 +94,28 @@ public:
 		UINT64 byteSize,
 		Microsoft::WRL::ComPtr<ID3D12Resource>& uploadBuffer);
 
+	// Same, but the buffer is placed in bufferHeap and the data is staged in
+	// uploadRing.  The caller retires the ring once cmdList has been submitted.
+	static Microsoft::WRL::ComPtr<ID3D12Resource> CreateDefaultBuffer(
+		ID3D12Device* device,
+		ID3D12GraphicsCommandList* cmdList,
+		const void* initData,
+		UINT64 byteSize,
+		PlacedBufferHeap& bufferHeap,
+		UploadRing& uploadRing);
+
+	// Same again, but the caller writes the data: stagingData is set to the
+	// byteSize bytes the buffer is copied from, which must be filled before
+	// cmdList is submitted.  They are write-combined, so write them in order
+	// and never read them back.
+	static Microsoft::WRL::ComPtr<ID3D12Resource> CreateDefaultBuffer(
+		ID3D12Device* device,
+		ID3D12GraphicsCommandList* cmdList,
+		UINT64 byteSize,
+		PlacedBufferHeap& bufferHeap,
+		UploadRing& uploadRing,
+		void** stagingData);
+
 	static Microsoft::WRL::ComPtr<ID3DBlob> CompileShader(
 		const std::wstring& filename,
 		const D3D_SHADER_MACRO* defines,
@@ -125,7 +153,8 @@ struct MeshGeometry
 	std::string Name;
 
 	// System memory copies.  Use Blobs because the vertex/index format can be generic.
-	// It is up to the client to cast appropriately. 
+	// It is up to the client to cast appropriately.  Optional: null unless the
+	// data is read back on the CPU.
 
 	Microsoft::WRL::ComPtr<ID3DBlob> VertexBufferCPU = nullptr;
 	Microsoft::WRL::ComPtr<ID3DBlob> IndexBufferCPU = nullptr;
@@ -210,7 +239,9 @@ struct Light
 	float SpotPower = 64.0f;                            // spot light only
 };
 
-#define MaxLights 16
+// Capacity of the light structured buffer.  Lights are culled per cluster on the
+// GPU, so this no longer bounds the per-pixel cost.
+#define MaxLights 1024
 
 struct MaterialConstants
 {
@@ -220,6 +251,12 @@ struct MaterialConstants
 
 	// Used in texture mapping.
 	DirectX::XMFLOAT4X4 MatTransform = MathHelper::Identity4x4();
+
+	// SRV heap slot of the diffuse texture, read by the bindless shaders.
+	UINT DiffuseMapIndex = 0;
+	UINT MaterialPad0;
+	UINT MaterialPad1;
+	UINT MaterialPad2;
 };
 struct Material
 {
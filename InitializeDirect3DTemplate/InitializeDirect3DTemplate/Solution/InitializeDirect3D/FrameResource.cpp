@@ -1,16 +1,70 @@
 #include "FrameResource.h"
 
-FrameResource::FrameResource(ID3D12Device* device, UINT passCount, UINT objectCount, UINT materialCount)
+FrameResource::FrameResource(ID3D12Device* device, PlacedBufferHeap& uploadHeap, UINT passCount, UINT objectCount, UINT materialCount, UINT instanceCount, UINT lightCount, UINT workerCount)
 {
     ThrowIfFailed(device->CreateCommandAllocator(
         D3D12_COMMAND_LIST_TYPE_DIRECT,
         IID_PPV_ARGS(CmdListAlloc.GetAddressOf())));
 
-    PassCB = std::make_unique<UploadBuffer<PassConstants>>(device, passCount, true);
-    ObjectCB = std::make_unique<UploadBuffer<ObjectConstants>>(device, objectCount, true);
-    MaterialCB = std::make_unique<UploadBuffer<MaterialConstants>>(device, materialCount, true);
+    WorkerCmdListAllocs.resize(workerCount);
+    WorkerCmdLists.resize(workerCount);
+    for (UINT i = 0; i < workerCount; ++i)
+    {
+        ThrowIfFailed(device->CreateCommandAllocator(
+            D3D12_COMMAND_LIST_TYPE_DIRECT,
+            IID_PPV_ARGS(WorkerCmdListAllocs[i].GetAddressOf())));
+
+        ThrowIfFailed(device->CreateCommandList(
+            0,
+            D3D12_COMMAND_LIST_TYPE_DIRECT,
+            WorkerCmdListAllocs[i].Get(),
+            nullptr,
+            IID_PPV_ARGS(WorkerCmdLists[i].GetAddressOf())));
+
+        // Lists are created in the recording state; Draw() expects them closed.
+        ThrowIfFailed(WorkerCmdLists[i]->Close());
+    }
+
+    ThrowIfFailed(device->CreateCommandAllocator(
+        D3D12_COMMAND_LIST_TYPE_COMPUTE,
+        IID_PPV_ARGS(ComputeCmdListAlloc.GetAddressOf())));
+
+    // Placed side by side in the shared upload heaps rather than committed one by one.
+    PassCB = std::make_unique<UploadBuffer<PassConstants>>(uploadHeap, passCount, true);
+    ObjectCB = std::make_unique<UploadBuffer<ObjectConstants>>(uploadHeap, objectCount, true);
+    MaterialCB = std::make_unique<UploadBuffer<MaterialConstants>>(uploadHeap, materialCount, true);
+    InstanceBuffer = std::make_unique<UploadBuffer<InstanceData>>(uploadHeap, instanceCount, false);
+    LightBuffer = std::make_unique<UploadBuffer<Light>>(uploadHeap, lightCount, false);
+
+    FenceEvent = CreateEventEx(nullptr, nullptr, 0, EVENT_ALL_ACCESS);
+    if (FenceEvent == nullptr)
+        ThrowIfFailed(HRESULT_FROM_WIN32(GetLastError()));
 }
 
 FrameResource::~FrameResource()
 {
+    if (FenceEvent != nullptr)
+        CloseHandle(FenceEvent);
+}
+
+void FrameResource::WaitForGpu(ID3D12Fence* fence)
+{
+    if (Fence != 0 && fence->GetCompletedValue() < Fence)
+    {
+        ThrowIfFailed(fence->SetEventOnCompletion(Fence, FenceEvent));
+        WaitForSingleObject(FenceEvent, INFINITE);
+    }
+}
+
+bool FrameResource::ReserveObjects(ID3D12Device* device, UINT objectCount)
+{
+    UINT capacity = ObjectCB->ElementCount();
+    if (objectCount <= capacity)
+        return false;
+
+    // Committed rather than placed: buffers placed in the shared heaps are never
+    // given back, and this one is dropped the next time it grows.
+    capacity = MathHelper::Max(objectCount, capacity + capacity / 2);
+    ObjectCB = std::make_unique<UploadBuffer<ObjectConstants>>(device, capacity, true);
+    return true;
 }
\ No newline at end of file
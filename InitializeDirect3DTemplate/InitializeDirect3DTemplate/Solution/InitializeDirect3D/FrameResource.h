@@ -9,6 +9,15 @@ struct ObjectConstants
     DirectX::XMFLOAT4X4 World = MathHelper::Identity4x4();
 };
 
+// Per-instance data read by the instanced vertex shader through a structured buffer.
+struct InstanceData
+{
+    DirectX::XMFLOAT4X4 World = MathHelper::Identity4x4();
+};
+
+// Cascades of the sun's shadow map; SHADOW_CASCADE_COUNT in PS.hlsl.
+const UINT gShadowCascadeCount = 4;
+
 struct PassConstants
 {
     DirectX::XMFLOAT4X4 View = MathHelper::Identity4x4();
@@ -26,12 +35,43 @@ struct PassConstants
 
     float NearZ = 0.0f;
     float FarZ = 0.0f;
-    float TotalTime = 0.0f;
-    float DeltaTime = 0.0f;
+    DirectX::XMFLOAT2 cbPerObjectPad2 = { 0.0f, 0.0f };
 
     DirectX::XMFLOAT4 AmbientLight = { 0.25f, 0.25f, 0.35f, 1.0f };
 
-    Light Lights[16];
+    // The lights themselves live in FrameResource::LightBuffer; the first
+    // DirectionalLightCount entries are directional, the rest point lights.
+    UINT LightCount = 0;
+    UINT DirectionalLightCount = 0;
+
+    // Maps view depth to a cluster slice: slice = log(z) * Scale + Bias.
+    float ClusterDepthScale = 0.0f;
+    float ClusterDepthBias = 0.0f;
+
+    UINT ClusterCountX = 0;
+    UINT ClusterCountY = 0;
+    UINT ClusterCountZ = 0;
+    UINT MaxLightsPerCluster = 0;
+
+    // Size of one screen tile in pixels.
+    DirectX::XMFLOAT2 ClusterTileSize = { 0.0f, 0.0f };
+    DirectX::XMFLOAT2 cbPerObjectPad3 = { 0.0f, 0.0f };
+
+    // World to shadow map texture space for each cascade of the first
+    // directional light, the view depth each cascade ends at, and the size of
+    // a shadow map texel in texture coordinates.
+    DirectX::XMFLOAT4X4 ShadowTransforms[gShadowCascadeCount];
+    float ShadowCascadeEnds[gShadowCascadeCount] = {};
+    float ShadowTexelSize = 0.0f;
+    DirectX::XMFLOAT3 cbPerObjectPad4 = { 0.0f, 0.0f, 0.0f };
+};
+
+// Values that change every frame.  They are set as root constants so the pass
+// buffer above only has to be rewritten when the camera or the window changes.
+struct FrameConstants
+{
+    float TotalTime = 0.0f;
+    float DeltaTime = 0.0f;
 };
 
 struct Vertex
@@ -41,19 +81,56 @@ struct Vertex
     DirectX::XMFLOAT2 TexC;
 };
 
+// Vertex as stored in the vertex buffers, 20 bytes instead of 32: the position
+// stays at full precision, the normal is octahedral-mapped to two SNORM16
+// values and the texture coordinates are halves.
+struct PackedVertex
+{
+    DirectX::XMFLOAT3 Pos;
+    DirectX::PackedVector::XMSHORTN2 Normal;
+    DirectX::PackedVector::XMHALF2 TexC;
+};
+
 struct FrameResource
 {
 public:
-    FrameResource(ID3D12Device* device, UINT passCount, UINT objectCount, UINT materialCount);
+    FrameResource(ID3D12Device* device, PlacedBufferHeap& uploadHeap, UINT passCount, UINT objectCount, UINT materialCount, UINT instanceCount, UINT lightCount, UINT workerCount);
     FrameResource(const FrameResource& rhs) = delete;
     FrameResource& operator=(const FrameResource& rhs) = delete;
     ~FrameResource();
 
+    // Blocks until the GPU has finished the commands that last used this frame
+    // resource.  Returns at once if they are already done.
+    void WaitForGpu(ID3D12Fence* fence);
+
+    // Replaces ObjectCB with a larger buffer when it has fewer than objectCount
+    // elements, leaving room to grow.  Only this frame resource's buffer changes,
+    // so call it once WaitForGpu() has returned, with nothing to flush.  The old
+    // contents are not kept; returns true when the buffer was replaced.
+    bool ReserveObjects(ID3D12Device* device, UINT objectCount);
+
     Microsoft::WRL::ComPtr<ID3D12CommandAllocator> CmdListAlloc;
 
+    // One allocator and command list per recording worker.  A command allocator
+    // must only be used by one thread at a time, so each worker owns a pair.
+    std::vector<Microsoft::WRL::ComPtr<ID3D12CommandAllocator>> WorkerCmdListAllocs;
+    std::vector<Microsoft::WRL::ComPtr<ID3D12GraphicsCommandList>> WorkerCmdLists;
+
+    // Backs the frame's lists for the async compute queue.
+    Microsoft::WRL::ComPtr<ID3D12CommandAllocator> ComputeCmdListAlloc;
+
     std::unique_ptr<UploadBuffer<PassConstants>> PassCB = nullptr;
     std::unique_ptr<UploadBuffer<ObjectConstants>> ObjectCB = nullptr;
     std::unique_ptr<UploadBuffer<MaterialConstants>> MaterialCB = nullptr;
 
+    // World matrices of every instance drawn this frame, packed batch by batch.
+    std::unique_ptr<UploadBuffer<InstanceData>> InstanceBuffer = nullptr;
+
+    // Scene lights, read by the light culling pass and the pixel shader.
+    std::unique_ptr<UploadBuffer<Light>> LightBuffer = nullptr;
+
     UINT64 Fence = 0;
+
+    // Created once and reused by every WaitForGpu() call.
+    HANDLE FenceEvent = nullptr;
 };
\ No newline at end of file
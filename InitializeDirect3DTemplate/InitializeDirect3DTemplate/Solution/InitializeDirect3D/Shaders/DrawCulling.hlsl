@@ -0,0 +1,205 @@
+// Culls the opaque render items on the GPU.  Every item has an indirect command
+// prepared once at load time; one thread tests the item's bounds against the
+// camera frustum and the Hi-Z pyramid of the occluder prepass, and appends the
+// command of each visible item to the argument buffer consumed by
+// ExecuteIndirect, bumping the draw count as it goes.  The appended command
+// draws the level of detail that fits the item's size on screen.
+
+// Same layout as IndirectCommand on the C++ side: vertex buffer view, index
+// buffer view, the three bindless draw constants, D3D12_DRAW_INDEXED_ARGUMENTS.
+struct IndirectCommand
+{
+    uint2 VertexBufferLocation;
+    uint VertexSizeInBytes;
+    uint VertexStrideInBytes;
+    uint2 IndexBufferLocation;
+    uint IndexSizeInBytes;
+    uint IndexFormat;
+    uint ObjectIndex;
+    uint MaterialIndex;
+    uint InstanceOffset;
+    uint IndexCountPerInstance;
+    uint InstanceCount;
+    uint StartIndexLocation;
+    int BaseVertexLocation;
+    uint StartInstanceLocation;
+};
+
+#define MAX_LODS 3
+
+// Local-space box of the item's submesh and its submesh chain, each level as
+// (IndexCount, StartIndexLocation, BaseVertexLocation, unused).
+struct DrawBounds
+{
+    float3 Center;
+    uint LodCount;
+    float3 Extents;
+    float Pad;
+    uint4 Lods[MAX_LODS];
+};
+
+// One object constant buffer element (256 bytes).
+struct ObjectData
+{
+    float4x4 World;
+    float4x4 Pad[3];
+};
+
+cbuffer cbCull : register(b0)
+{
+    uint gCommandCount;
+    uint gCullingEnabled;
+    uint gOcclusionEnabled;
+    uint gHiZMipCount;
+    uint2 gHiZSize;
+    float2 gLodCoverage;
+};
+
+cbuffer cbPass : register(b1)
+{
+    float4x4 gView;
+    float4x4 gInvView;
+    float4x4 gProj;
+    float4x4 gInvProj;
+    float4x4 gViewProj;
+};
+
+StructuredBuffer<IndirectCommand> gCommands : register(t0);
+StructuredBuffer<DrawBounds> gBounds : register(t1);
+StructuredBuffer<ObjectData> gObjectData : register(t2);
+Texture2D<float> gHiZ : register(t3);
+
+RWStructuredBuffer<IndirectCommand> gVisibleCommands : register(u0);
+RWStructuredBuffer<uint> gDrawCount : register(u1);
+
+bool IsBoxInFrustum(float3 center, float3 extents)
+{
+    // Clip space is p * gViewProj, so the planes are sums and differences of
+    // its columns, which are the rows of the transpose.
+    float4x4 m = transpose(gViewProj);
+
+    float4 planes[6] =
+    {
+        m[3] + m[0],
+        m[3] - m[0],
+        m[3] + m[1],
+        m[3] - m[1],
+        m[2],
+        m[3] - m[2]
+    };
+
+    [unroll]
+    for (int i = 0; i < 6; ++i)
+    {
+        float d = dot(planes[i].xyz, center) + planes[i].w;
+        float r = dot(abs(planes[i].xyz), extents);
+
+        if (d + r < 0.0f)
+            return false;
+    }
+
+    return true;
+}
+
+bool IsBoxOccluded(float3 center, float3 extents)
+{
+    // Screen rectangle and nearest depth of the box's corners.
+    float2 uvMin = 1.0f;
+    float2 uvMax = 0.0f;
+    float nearestZ = 1.0f;
+
+    [unroll]
+    for (uint i = 0; i < 8; ++i)
+    {
+        float3 corner = center + extents * float3(
+            (i & 1) ? 1.0f : -1.0f,
+            (i & 2) ? 1.0f : -1.0f,
+            (i & 4) ? 1.0f : -1.0f);
+
+        float4 clip = mul(float4(corner, 1.0f), gViewProj);
+
+        // Reaches behind the camera: the rectangle is unbounded.
+        if (clip.w <= 0.0f)
+            return false;
+
+        float3 ndc = clip.xyz / clip.w;
+        float2 uv = float2(ndc.x * 0.5f + 0.5f, 0.5f - ndc.y * 0.5f);
+
+        uvMin = min(uvMin, uv);
+        uvMax = max(uvMax, uv);
+        nearestZ = min(nearestZ, ndc.z);
+    }
+
+    uvMin = saturate(uvMin);
+    uvMax = saturate(uvMax);
+
+    // The level where the rectangle is at most one texel wide, so its four
+    // corner texels cover all of it.
+    float2 sizeInTexels = (uvMax - uvMin) * gHiZSize;
+    uint mip = (uint)ceil(log2(max(max(sizeInTexels.x, sizeInTexels.y), 1.0f)));
+    mip = min(mip, gHiZMipCount - 1);
+
+    uint2 mipSize = max(gHiZSize >> mip, 1);
+    int2 p0 = (int2)min(uvMin * mipSize, mipSize - 1);
+    int2 p1 = (int2)min(uvMax * mipSize, mipSize - 1);
+
+    float farthest = max(
+        max(gHiZ.Load(int3(p0.x, p0.y, mip)), gHiZ.Load(int3(p1.x, p0.y, mip))),
+        max(gHiZ.Load(int3(p0.x, p1.y, mip)), gHiZ.Load(int3(p1.x, p1.y, mip))));
+
+    return nearestZ > farthest;
+}
+
+// Same measure as UpdateLods: the bounding sphere of the world box over the
+// view height at its distance.
+uint SelectLod(float3 center, float3 extents, uint lodCount)
+{
+    float3 eyePos = gInvView[3].xyz;
+    float radius = length(extents);
+    float distance = length(center - eyePos);
+
+    float coverage = distance > radius ? radius * gProj[1][1] / distance : 1.0f;
+
+    uint lod = 0;
+    if (lod + 1 < lodCount && coverage < gLodCoverage.x)
+        ++lod;
+    if (lod + 1 < lodCount && coverage < gLodCoverage.y)
+        ++lod;
+
+    return lod;
+}
+
+[numthreads(64, 1, 1)]
+void CS(uint3 dispatchThreadID : SV_DispatchThreadID)
+{
+    uint index = dispatchThreadID.x;
+
+    if (index >= gCommandCount)
+        return;
+
+    IndirectCommand command = gCommands[index];
+    DrawBounds bounds = gBounds[index];
+    float4x4 world = gObjectData[command.ObjectIndex].World;
+
+    // World-space box around the transformed local box.
+    float3 center = mul(float4(bounds.Center, 1.0f), world).xyz;
+    float3 extents = abs(world[0].xyz) * bounds.Extents.x +
+                     abs(world[1].xyz) * bounds.Extents.y +
+                     abs(world[2].xyz) * bounds.Extents.z;
+
+    if (gCullingEnabled != 0 && !IsBoxInFrustum(center, extents))
+        return;
+
+    if (gOcclusionEnabled != 0 && IsBoxOccluded(center, extents))
+        return;
+
+    uint4 lod = bounds.Lods[SelectLod(center, extents, bounds.LodCount)];
+    command.IndexCountPerInstance = lod.x;
+    command.StartIndexLocation = lod.y;
+    command.BaseVertexLocation = (int)lod.z;
+
+    uint slot;
+    InterlockedAdd(gDrawCount[0], 1, slot);
+
+    gVisibleCommands[slot] = command;
+}
@@ -0,0 +1,37 @@
+// Builds one level of the Hi-Z pyramid.  Every destination texel holds the
+// farthest depth of the source texels it covers, so a box whose nearest depth
+// lies beyond it is hidden everywhere in that texel.  Level 0 is a copy of the
+// depth buffer; the others halve the previous level, rounding the size down,
+// so a texel at an odd edge covers three source texels.
+
+cbuffer cbHiZ : register(b0)
+{
+    uint2 gSrcSize;
+    uint2 gDstSize;
+};
+
+Texture2D<float> gSrc : register(t0);
+RWTexture2D<float> gDst : register(u0);
+
+[numthreads(8, 8, 1)]
+void CS(uint3 dispatchThreadID : SV_DispatchThreadID)
+{
+    uint2 dst = dispatchThreadID.xy;
+
+    if (any(dst >= gDstSize))
+        return;
+
+    // Source texels [first, last) that overlap this texel.
+    uint2 first = dst * gSrcSize / gDstSize;
+    uint2 last = ((dst + 1) * gSrcSize + gDstSize - 1) / gDstSize;
+
+    float farthest = 0.0f;
+
+    for (uint y = first.y; y < last.y; ++y)
+    {
+        for (uint x = first.x; x < last.x; ++x)
+            farthest = max(farthest, gSrc.Load(int3(x, y, 0)));
+    }
+
+    gDst[dst] = farthest;
+}
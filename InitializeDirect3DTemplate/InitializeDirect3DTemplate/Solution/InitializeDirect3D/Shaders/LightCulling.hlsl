@@ -0,0 +1,129 @@
+// Bins the point lights into a 3D grid of view-space clusters.  The screen is cut
+// into gClusterCount.x * gClusterCount.y tiles and the view depth range into
+// gClusterCount.z exponentially spaced slices.  One thread handles one cluster
+// and writes the indices of the lights touching it to its fixed-size slot.
+
+struct Light
+{
+    float3 Strength;
+    float FalloffStart;
+    float3 Direction;
+    float FalloffEnd;
+    float3 Position;
+    float SpotPower;
+};
+
+cbuffer cbPass : register(b1)
+{
+    float4x4 gView;
+    float4x4 gInvView;
+    float4x4 gProj;
+    float4x4 gInvProj;
+    float4x4 gViewProj;
+    float4x4 gInvViewProj;
+    float3 gEyePosW;
+    float cbPerObjectPad1;
+    float2 gRenderTargetSize;
+    float2 gInvRenderTargetSize;
+    float gNearZ;
+    float gFarZ;
+    float2 cbPerObjectPad2;
+    float4 gAmbientLight;
+    uint gLightCount;
+    uint gDirectionalLightCount;
+    float gClusterDepthScale;
+    float gClusterDepthBias;
+    uint3 gClusterCount;
+    uint gMaxLightsPerCluster;
+    float2 gClusterTileSize;
+    float2 cbPerObjectPad3;
+};
+
+StructuredBuffer<Light> gLights : register(t0);
+
+RWStructuredBuffer<uint> gClusterLightCounts : register(u0);
+RWStructuredBuffer<uint> gClusterLightIndices : register(u1);
+
+// View-space point on the ray through the given pixel, at view depth z.
+float3 PixelToView(float2 pixel, float z)
+{
+    float2 ndc = float2(pixel.x * gInvRenderTargetSize.x * 2.0f - 1.0f,
+                        1.0f - pixel.y * gInvRenderTargetSize.y * 2.0f);
+
+    float4 p = mul(float4(ndc, 1.0f, 1.0f), gInvProj);
+    p.xyz /= p.w;
+
+    return p.xyz * (z / p.z);
+}
+
+float SliceDepth(uint slice)
+{
+    return gNearZ * pow(gFarZ / gNearZ, (float)slice / (float)gClusterCount.z);
+}
+
+[numthreads(64, 1, 1)]
+void CS(uint3 dispatchThreadID : SV_DispatchThreadID)
+{
+    uint clusterIndex = dispatchThreadID.x;
+    uint clusterTotal = gClusterCount.x * gClusterCount.y * gClusterCount.z;
+
+    if (clusterIndex >= clusterTotal)
+        return;
+
+    uint x = clusterIndex % gClusterCount.x;
+    uint y = (clusterIndex / gClusterCount.x) % gClusterCount.y;
+    uint z = clusterIndex / (gClusterCount.x * gClusterCount.y);
+
+    // View-space bounds of the cluster: the tile corners at the near and far
+    // depth of the slice.
+    float2 pixelMin = float2(x, y) * gClusterTileSize;
+    float2 pixelMax = min(pixelMin + gClusterTileSize, gRenderTargetSize);
+
+    float zNear = SliceDepth(z);
+    float zFar = SliceDepth(z + 1);
+
+    float3 corners[8] =
+    {
+        PixelToView(float2(pixelMin.x, pixelMin.y), zNear),
+        PixelToView(float2(pixelMax.x, pixelMin.y), zNear),
+        PixelToView(float2(pixelMin.x, pixelMax.y), zNear),
+        PixelToView(float2(pixelMax.x, pixelMax.y), zNear),
+        PixelToView(float2(pixelMin.x, pixelMin.y), zFar),
+        PixelToView(float2(pixelMax.x, pixelMin.y), zFar),
+        PixelToView(float2(pixelMin.x, pixelMax.y), zFar),
+        PixelToView(float2(pixelMax.x, pixelMax.y), zFar)
+    };
+
+    float3 boxMin = corners[0];
+    float3 boxMax = corners[0];
+
+    [unroll]
+    for (int i = 1; i < 8; ++i)
+    {
+        boxMin = min(boxMin, corners[i]);
+        boxMax = max(boxMax, corners[i]);
+    }
+
+    // Directional lights come first in the buffer and apply everywhere, so
+    // only the point lights after them are binned.
+    uint base = clusterIndex * gMaxLightsPerCluster;
+    uint count = 0;
+
+    for (uint lightIndex = gDirectionalLightCount; lightIndex < gLightCount; ++lightIndex)
+    {
+        Light L = gLights[lightIndex];
+
+        float3 centerV = mul(float4(L.Position, 1.0f), gView).xyz;
+        float3 d = max(max(boxMin - centerV, 0.0f), centerV - boxMax);
+
+        if (dot(d, d) <= L.FalloffEnd * L.FalloffEnd)
+        {
+            gClusterLightIndices[base + count] = lightIndex;
+
+            if (++count == gMaxLightsPerCluster)
+                break;
+        }
+    }
+
+    gClusterLightCounts[clusterIndex] = count;
+}
@@ -1,5 +1,7 @@
-Texture2D gDiffuseMap : register(t0);
 SamplerState gsamLinear : register(s0);
+SamplerComparisonState gsamShadow : register(s1);
+
+#define SHADOW_CASCADE_COUNT 4
 
 struct Light
 {
@@ -25,18 +27,77 @@ cbuffer cbPass : register(b1)
     float2 gInvRenderTargetSize;
     float gNearZ;
     float gFarZ;
+    float2 cbPerObjectPad2;
+    float4 gAmbientLight;
+    uint gLightCount;
+    uint gDirectionalLightCount;
+    float gClusterDepthScale;
+    float gClusterDepthBias;
+    uint3 gClusterCount;
+    uint gMaxLightsPerCluster;
+    float2 gClusterTileSize;
+    float2 cbPerObjectPad3;
+    float4x4 gShadowTransforms[SHADOW_CASCADE_COUNT];
+    float4 gShadowCascadeEnds;
+    float gShadowTexelSize;
+    float3 cbPerObjectPad4;
+};
+
+// Scene lights, directional lights first, and the per-cluster light lists
+// written by LightCulling.hlsl.
+StructuredBuffer<Light> gLights : register(t0, space2);
+StructuredBuffer<uint> gClusterLightCounts : register(t1, space2);
+StructuredBuffer<uint> gClusterLightIndices : register(t2, space2);
+
+// Shadow cascades of the first directional light, one array slice each.  The
+// static map holds the casters that never move and is only redrawn when a
+// cascade is refit; the dynamic map holds the rest and is redrawn every frame.
+Texture2DArray gStaticShadowMap : register(t0, space5);
+Texture2DArray gDynamicShadowMap : register(t1, space5);
+
+// Per-frame values, set as root constants.
+cbuffer cbFrame : register(b4)
+{
     float gTotalTime;
     float gDeltaTime;
-    float4 gAmbientLight;
-    Light gLights[16];
 };
 
+#ifdef BINDLESS
+// Per-draw indices, set as root constants.
+cbuffer cbDraw : register(b5)
+{
+    uint gObjectIndex;
+    uint gMaterialIndex;
+    uint gInstanceOffset;
+};
+
+// The material constant buffer viewed as a structured buffer, keeping the
+// 256-byte stride of the constant buffer views.
+struct MaterialData
+{
+    float4 DiffuseAlbedo;
+    float3 FresnelR0;
+    float Roughness;
+    float4x4 MatTransform;
+    uint DiffuseMapIndex;
+    uint3 MatPad;
+    float4 Pad[9];
+};
+
+StructuredBuffer<MaterialData> gMaterialData : register(t0, space3);
+
+// Every texture in the SRV heap.
+Texture2D gTextureMaps[] : register(t0, space4);
+#else
+Texture2D gDiffuseMap : register(t0);
+
 cbuffer cbMaterial : register(b2)
 {
     float4 gDiffuseAlbedo;
     float3 gFresnelR0;
     float gRoughness;
 };
+#endif
 
 struct VertexOut
 {
@@ -51,6 +112,37 @@ float CalcAttenuation(float d, float start, float end)
     return saturate((end - d) / (end - start));
 }
 
+// Fraction of the sun that reaches posW, from a 3x3 PCF lookup in the cascade
+// covering the view depth.  A caster in either map shadows the point.
+float CalcShadowFactor(float3 posW, float viewZ)
+{
+    if (viewZ >= gShadowCascadeEnds[SHADOW_CASCADE_COUNT - 1])
+        return 1.0f;
+
+    uint cascade = 0;
+    [unroll]
+    for (uint i = 0; i < SHADOW_CASCADE_COUNT - 1; ++i)
+        cascade += viewZ >= gShadowCascadeEnds[i] ? 1 : 0;
+
+    // Orthographic, so w is 1.
+    float3 shadowPos = mul(float4(posW, 1.0f), gShadowTransforms[cascade]).xyz;
+
+    float lit = 0.0f;
+    [unroll]
+    for (int y = -1; y <= 1; ++y)
+    {
+        [unroll]
+        for (int x = -1; x <= 1; ++x)
+        {
+            float3 uv = float3(shadowPos.xy + float2(x, y) * gShadowTexelSize, cascade);
+            lit += gStaticShadowMap.SampleCmpLevelZero(gsamShadow, uv, shadowPos.z) *
+                gDynamicShadowMap.SampleCmpLevelZero(gsamShadow, uv, shadowPos.z);
+        }
+    }
+
+    return lit / 9.0f;
+}
+
 float3 ComputeDirectionalLight(Light L, float3 N, float3 baseColor)
 {
     float3 lightDir = normalize(-L.Direction);
@@ -75,28 +167,57 @@ float3 ComputePointLight(Light L, float3 posW, float3 N, float3 baseColor)
 
 float4 PS(VertexOut pin) : SV_Target
 {
+#ifdef BINDLESS
+    // gMaterialIndex is the same for the whole draw, so the texture index is
+    // uniform and needs no NonUniformResourceIndex.
+    MaterialData mat = gMaterialData[gMaterialIndex];
+    float4 diffuseAlbedo = mat.DiffuseAlbedo;
+    float roughness = mat.Roughness;
+    Texture2D diffuseMap = gTextureMaps[mat.DiffuseMapIndex];
+#else
+    float4 diffuseAlbedo = gDiffuseAlbedo;
+    float roughness = gRoughness;
+    Texture2D diffuseMap = gDiffuseMap;
+#endif
+
     float3 N = normalize(pin.NormalW);
 
     float2 uv = pin.TexC;
 
-    if (gRoughness < 0.06f)
+    if (roughness < 0.06f)
     {
         uv.x += gTotalTime * 0.08f;
         uv.y += gTotalTime * 0.03f;
     }
 
-    float4 texColor = gDiffuseMap.Sample(gsamLinear, uv);
-    float3 baseColor = texColor.rgb * gDiffuseAlbedo.rgb;
+    float4 texColor = diffuseMap.Sample(gsamLinear, uv);
+    float3 baseColor = texColor.rgb * diffuseAlbedo.rgb;
 
     float3 ambient = gAmbientLight.rgb * baseColor;
 
     float3 lighting = float3(0.0f, 0.0f, 0.0f);
-    lighting += ComputeDirectionalLight(gLights[0], N, baseColor);
-    lighting += ComputePointLight(gLights[1], pin.PosW, N, baseColor);
-    lighting += ComputePointLight(gLights[2], pin.PosW, N, baseColor);
-    lighting += ComputePointLight(gLights[3], pin.PosW, N, baseColor);
-    lighting += ComputePointLight(gLights[4], pin.PosW, N, baseColor);
-    lighting += ComputePointLight(gLights[5], pin.PosW, N, baseColor);
-
-    return float4(ambient + lighting, texColor.a * gDiffuseAlbedo.a);
+
+    float viewZ = mul(float4(pin.PosW, 1.0f), gView).z;
+
+    // Only the first directional light casts shadows.
+    for (uint i = 0; i < gDirectionalLightCount; ++i)
+    {
+        float shadow = i == 0 ? CalcShadowFactor(pin.PosW, viewZ) : 1.0f;
+        lighting += shadow * ComputeDirectionalLight(gLights[i], N, baseColor);
+    }
+
+    // Find the cluster of this pixel and only visit the point lights binned
+    // into it.
+    uint3 cluster;
+    cluster.xy = min((uint2)(pin.PosH.xy / gClusterTileSize), gClusterCount.xy - 1);
+    cluster.z = (uint)clamp(log(viewZ) * gClusterDepthScale + gClusterDepthBias, 0.0f, (float)(gClusterCount.z - 1));
+
+    uint clusterIndex = (cluster.z * gClusterCount.y + cluster.y) * gClusterCount.x + cluster.x;
+    uint base = clusterIndex * gMaxLightsPerCluster;
+    uint count = gClusterLightCounts[clusterIndex];
+
+    for (uint j = 0; j < count; ++j)
+        lighting += ComputePointLight(gLights[gClusterLightIndices[base + j]], pin.PosW, N, baseColor);
+
+    return float4(ambient + lighting, texColor.a * diffuseAlbedo.a);
 }
\ No newline at end of file
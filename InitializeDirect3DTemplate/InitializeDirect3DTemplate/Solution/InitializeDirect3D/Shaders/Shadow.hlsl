@@ -0,0 +1,33 @@
+// Depth-only pass of the sun's shadow cascades.  The object constants are read
+// as a structured buffer through a root descriptor, so the pass runs the same
+// with or without bindless support.
+
+// The cascade's light view-projection, set once per cascade, and the object
+// index, set per draw.
+cbuffer cbShadow : register(b0)
+{
+    float4x4 gLightViewProj;
+    uint gObjectIndex;
+};
+
+// Same layout as gObjectData in VS.hlsl.
+struct ObjectData
+{
+    float4x4 World;
+    float4x4 Pad[3];
+};
+
+StructuredBuffer<ObjectData> gObjectData : register(t0);
+
+struct VertexIn
+{
+    float3 PosL : POSITION;
+    float2 NormalOct : NORMAL;
+    float2 TexC : TEXCOORD;
+};
+
+float4 VS(VertexIn vin) : SV_POSITION
+{
+    float4 posW = mul(float4(vin.PosL, 1.0f), gObjectData[gObjectIndex].World);
+    return mul(posW, gLightViewProj);
+}
@@ -0,0 +1,39 @@
+// Stretches the dynamic resolution scene over the back buffer.  The scene was
+// drawn into the top-left part of the offscreen target; one triangle covering
+// the screen samples that part with bilinear filtering.
+
+cbuffer cbUpscale : register(b0)
+{
+    // Texture coordinates of the back buffer's bottom-right corner in the
+    // scene target, and the largest ones whose filter footprint stays inside
+    // the part that was drawn.
+    float2 gUvScale;
+    float2 gUvMax;
+};
+
+Texture2D gSceneColor : register(t0);
+SamplerState gsamLinearClamp : register(s0);
+
+struct VertexOut
+{
+    float4 PosH : SV_POSITION;
+    float2 TexC : TEXCOORD;
+};
+
+VertexOut VS(uint vertexID : SV_VertexID)
+{
+    // (0,0), (2,0), (0,2) in texture space covers the screen.
+    float2 texC = float2((vertexID << 1) & 2, vertexID & 2);
+
+    VertexOut vout;
+    vout.PosH = float4(texC.x * 2.0f - 1.0f, 1.0f - texC.y * 2.0f, 0.0f, 1.0f);
+    vout.TexC = texC;
+
+    return vout;
+}
+
+float4 PS(VertexOut pin) : SV_Target
+{
+    float2 uv = min(pin.TexC * gUvScale, gUvMax);
+    return gSceneColor.SampleLevel(gsamLinearClamp, uv, 0.0f);
+}
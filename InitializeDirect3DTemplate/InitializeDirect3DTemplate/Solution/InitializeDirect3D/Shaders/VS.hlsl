@@ -1,8 +1,41 @@
+struct InstanceData
+{
+    float4x4 World;
+};
+
+// Instanced path: world matrices of the current batch start at gInstanceOffset.
+StructuredBuffer<InstanceData> gInstanceData : register(t0, space1);
+
+#ifdef BINDLESS
+// Per-draw indices, set as root constants.
+cbuffer cbDraw : register(b5)
+{
+    uint gObjectIndex;
+    uint gMaterialIndex;
+    uint gInstanceOffset;
+};
+
+// The object constant buffer viewed as a structured buffer.  Its elements keep
+// the 256-byte stride the constant buffer views need.
+struct ObjectData
+{
+    float4x4 World;
+    float4x4 Pad[3];
+};
+
+StructuredBuffer<ObjectData> gObjectData : register(t1, space1);
+#else
 cbuffer cbPerObject : register(b0)
 {
     float4x4 gWorld;
 };
 
+cbuffer cbInstance : register(b3)
+{
+    uint gInstanceOffset;
+};
+#endif
+
 cbuffer cbPass : register(b1)
 {
     float4x4 gView;
@@ -17,17 +50,25 @@ cbuffer cbPass : register(b1)
     float2 gInvRenderTargetSize;
     float gNearZ;
     float gFarZ;
-    float gTotalTime;
-    float gDeltaTime;
+    float2 cbPerObjectPad2;
     float4 gAmbientLight;
 };
 
+#ifdef DEPTH_ONLY
+// The depth prepass only fetches the positions.
 struct VertexIn
 {
     float3 PosL : POSITION;
-    float3 NormalL : NORMAL;
+};
+#else
+// Normals arrive octahedral-mapped in two SNORM16 values (PackedVertex).
+struct VertexIn
+{
+    float3 PosL : POSITION;
+    float2 NormalOct : NORMAL;
     float2 TexC : TEXCOORD;
 };
+#endif
 
 struct VertexOut
 {
@@ -37,15 +78,58 @@ struct VertexOut
     float2 TexC : TEXCOORD;
 };
 
-VertexOut VS(VertexIn vin)
+float3 DecodeOctahedral(float2 e)
+{
+    float3 n = float3(e.x, e.y, 1.0f - abs(e.x) - abs(e.y));
+
+    // Unfold the lower hemisphere.
+    float t = saturate(-n.z);
+    n.x += n.x >= 0.0f ? -t : t;
+    n.y += n.y >= 0.0f ? -t : t;
+
+    return normalize(n);
+}
+
+float4x4 GetWorld(uint instanceID)
 {
+#if defined(INSTANCED)
+    return gInstanceData[gInstanceOffset + instanceID].World;
+#elif defined(BINDLESS)
+    return gObjectData[gObjectIndex].World;
+#else
+    return gWorld;
+#endif
+}
+
+// Shared by the depth prepass and the shaded pass, whose EQUAL depth test needs
+// both to come out with the same bits; precise keeps the compiler from
+// reordering or fusing the math differently in the two.
+float4 TransformToClip(float3 posL, float4x4 world, out float3 posW)
+{
+    precise float4 p = mul(float4(posL, 1.0f), world);
+    precise float4 posH = mul(p, gViewProj);
+    posW = p.xyz;
+    return posH;
+}
+
+#ifdef DEPTH_ONLY
+float4 VS(VertexIn vin, uint instanceID : SV_InstanceID) : SV_POSITION
+{
+    float3 posW;
+    return TransformToClip(vin.PosL, GetWorld(instanceID), posW);
+}
+#else
+VertexOut VS(VertexIn vin, uint instanceID : SV_InstanceID)
+{
+    float4x4 world = GetWorld(instanceID);
+
     VertexOut vout;
 
-    float4 posW = mul(float4(vin.PosL, 1.0f), gWorld);
-    vout.PosW = posW.xyz;
-    vout.NormalW = mul(vin.NormalL, (float3x3) gWorld);
-    vout.PosH = mul(posW, gViewProj);
+    vout.PosH = TransformToClip(vin.PosL, world, vout.PosW);
+    float3 normalL = DecodeOctahedral(vin.NormalOct);
+    vout.NormalW = mul(normalL, (float3x3) world);
     vout.TexC = vin.TexC;
 
     return vout;
-}
\ No newline at end of file
+}
+#endif
\ No newline at end of file
@@ -0,0 +1,105 @@
+// Water waves: a height field advanced with the wave equation, then written
+// into the water grid's vertex buffer.  The grid is GeometryGenerator's, not
+// reordered, so the vertex of a cell is row * gColumnCount + column, rows
+// running from the far edge (+z) to the near one.  The border stays flat.
+
+cbuffer cbWaves : register(b0)
+{
+    // next = K1 * previous + K2 * current + K3 * (sum of the four neighbours)
+    float gK1;
+    float gK2;
+    float gK3;
+    float gSpatialStep;
+
+    uint gColumnCount;
+    uint gRowCount;
+
+    // Where a drop lands and how hard, for DisturbCS.
+    uint2 gDisturbCell;
+    float gDisturbMagnitude;
+};
+
+// Holds the previous step on entry to UpdateCS and the next one after it.
+RWStructuredBuffer<float> gNextHeights : register(u0);
+RWStructuredBuffer<float> gHeights : register(u1);
+
+// PackedVertex: float3 position, octahedral normal as two SNORM16, half2 texture
+// coordinates; 20 bytes.
+RWByteAddressBuffer gVertices : register(u2);
+
+static const uint VertexStride = 20;
+
+bool IsInterior(uint2 cell)
+{
+    return cell.x > 0 && cell.y > 0 && cell.x < gColumnCount - 1 && cell.y < gRowCount - 1;
+}
+
+[numthreads(16, 16, 1)]
+void UpdateCS(uint3 dispatchThreadID : SV_DispatchThreadID)
+{
+    uint2 cell = dispatchThreadID.xy;
+    if (!IsInterior(cell))
+        return;
+
+    // Each thread only reads its own entry of the field it overwrites.
+    uint i = cell.y * gColumnCount + cell.x;
+    float neighbours = gHeights[i - 1] + gHeights[i + 1] + gHeights[i - gColumnCount] + gHeights[i + gColumnCount];
+    gNextHeights[i] = gK1 * gNextHeights[i] + gK2 * gHeights[i] + gK3 * neighbours;
+}
+
+[numthreads(1, 1, 1)]
+void DisturbCS()
+{
+    uint2 cell = gDisturbCell;
+    if (!IsInterior(cell))
+        return;
+
+    // The drop and half of it around, so it does not start as a single spike.
+    uint i = cell.y * gColumnCount + cell.x;
+    float halfMagnitude = 0.5f * gDisturbMagnitude;
+    gHeights[i] += gDisturbMagnitude;
+    gHeights[i - 1] += halfMagnitude;
+    gHeights[i + 1] += halfMagnitude;
+    gHeights[i - gColumnCount] += halfMagnitude;
+    gHeights[i + gColumnCount] += halfMagnitude;
+}
+
+// Same mapping as MeshOptimizer::EncodeOctahedral, rounded like XMSHORTN2.
+uint EncodeOctahedral(float3 n)
+{
+    float2 e = n.xy / (abs(n.x) + abs(n.y) + abs(n.z));
+
+    // Fold the lower hemisphere over the diagonals.
+    if (n.z < 0.0f)
+        e = (1.0f - abs(e.yx)) * float2(e.x >= 0.0f ? 1.0f : -1.0f, e.y >= 0.0f ? 1.0f : -1.0f);
+
+    int2 s = int2(round(clamp(e, -1.0f, 1.0f) * 32767.0f));
+    return (uint(s.x) & 0xffff) | (uint(s.y) << 16);
+}
+
+[numthreads(16, 16, 1)]
+void VerticesCS(uint3 dispatchThreadID : SV_DispatchThreadID)
+{
+    uint2 cell = dispatchThreadID.xy;
+    if (cell.x >= gColumnCount || cell.y >= gRowCount)
+        return;
+
+    uint i = cell.y * gColumnCount + cell.x;
+
+    // Central differences, with the border repeated outwards.
+    float left = gHeights[cell.x > 0 ? i - 1 : i];
+    float right = gHeights[cell.x < gColumnCount - 1 ? i + 1 : i];
+    float farRow = gHeights[cell.y > 0 ? i - gColumnCount : i];
+    float nearRow = gHeights[cell.y < gRowCount - 1 ? i + gColumnCount : i];
+    float3 normal = normalize(float3(left - right, 2.0f * gSpatialStep, nearRow - farRow));
+
+    float2 gridSize = float2(gColumnCount - 1, gRowCount - 1);
+    float2 halfExtent = 0.5f * gSpatialStep * gridSize;
+    float3 position = float3(cell.x * gSpatialStep - halfExtent.x, gHeights[i], halfExtent.y - cell.y * gSpatialStep);
+    float2 texC = cell / gridSize;
+
+    uint address = i * VertexStride;
+    gVertices.Store3(address, asuint(position));
+    gVertices.Store(address + 12, EncodeOctahedral(normal));
+    gVertices.Store(address + 16, f32tof16(texC.x) | (f32tof16(texC.y) << 16));
+}
@@ -3,31 +3,322 @@
 #include "../../Common/UploadBuffer.h"
 #include "../../Common/GeometryGenerator.h"
 #include "../../Common/Camera.h"
+#include "../../Common/SpatialGrid.h"
+#include "../../Common/WorkerPool.h"
+#include "../../Common/CommandLine.h"
+#include "../../Common/TextureStreamer.h"
+#include "../../Common/UploadRing.h"
+#include "../../Common/PlacedBufferHeap.h"
+#include "../../Common/RenderQueue.h"
+#include "../../Common/MeshOptimizer.h"
+#include "../../Common/MeshCache.h"
+#include "../../Common/ShaderCache.h"
+#include "../../Common/PipelineCache.h"
+#include "../../Common/Profiler.h"
+#include "../../Common/CameraPath.h"
+#include "../../Common/TransformStore.h"
+#include "../../Common/ObjectPool.h"
 #include "FrameResource.h"
 #include <DirectXCollision.h>
+#include <deque>
 
 using Microsoft::WRL::ComPtr;
 using namespace DirectX;
 using namespace DirectX::PackedVector;
 
-const int gNumFrameResources = 3;
+int gNumFrameResources = 3;
+
+// Clustered lighting grid: screen tiles along x and y, exponentially spaced
+// depth slices along z.  Each cluster holds at most gMaxLightsPerCluster lights.
+const UINT gClusterCountX = 16;
+const UINT gClusterCountY = 9;
+const UINT gClusterCountZ = 24;
+const UINT gMaxLightsPerCluster = 64;
+
+// Diffuse texture slots in the SRV heap; the texture streamer puts its fallback
+// texture in the slot after the last one.
+const UINT gTextureCount = 5;
+
+// Hi-Z pyramid descriptors follow the textures in the SRV heap: the depth
+// buffer, the whole pyramid, then one SRV and one UAV per mip.
+const UINT gMaxHiZMips = 16;
+const UINT gHiZDescriptorBase = gTextureCount + 1;
+const UINT gHiZDescriptorCount = 2 + 2 * gMaxHiZMips;
+
+// The static and the dynamic shadow map arrays come last in the SRV heap.
+const UINT gShadowDescriptorBase = gHiZDescriptorBase + gHiZDescriptorCount;
+const UINT gShadowDescriptorCount = 2;
+
+// Then the offscreen scene target that dynamic resolution upscales from.
+const UINT gUpscaleDescriptorBase = gShadowDescriptorBase + gShadowDescriptorCount;
+const UINT gUpscaleDescriptorCount = 1;
+
+// Sun shadows: the side of each cascade's map in texels, the view depth the
+// cascades reach, and how far the splits lean from even towards logarithmic.
+const UINT gShadowMapSize = 2048;
+const float gShadowDistance = 160.0f;
+const float gShadowSplitLambda = 0.7f;
+
+// A cascade covers its slice of the view plus this many texels on every side.
+// It is refit, and its static casters drawn again, only once the slice has
+// drifted out of that margin.
+const float gShadowCacheMarginTexels = 64.0f;
+
+// Dynamic resolution: the smallest scale of either side, and the band of GPU
+// frame times, as fractions of the target, inside which the scale is left
+// alone.  Outside it the scale heads for gRenderScaleAim of the target, by at
+// most gMaxRenderScaleStep of itself per change.
+const float gMinRenderScale = 0.5f;
+const float gRenderScaleLowerBand = 0.8f;
+const float gRenderScaleAim = 0.9f;
+const float gMaxRenderScaleStep = 0.1f;
+
+// Opaque items with a world box at least this large along some axis are drawn
+// into the depth buffer ahead of the occlusion test.
+const float gMinOccluderExtent = 4.0f;
+
+// Level-of-detail chains: a submesh "name" may be followed by "name_lod1" and
+// "name_lod2".  An item moves to level i + 1 once its bounding sphere covers
+// less than gLodCoverage[i] of the view height.  DrawCulling.hlsl checks the
+// same thresholds with the same measure.
+const UINT gMaxLods = 3;
+const float gLodCoverage[gMaxLods - 1] = { 0.15f, 0.05f };
+
+// Content version of the geometry cache.  Bump it whenever BuildShapeGeometry
+// or BuildMazeGeometry change what they generate, so old caches are rebuilt.
+const UINT gGeometryCacheVersion = 1;
+
+// Edge length of a maze cell, also the cell size of the collision grid.
+const float gMazeCellSize = 3.0f;
+
+// Benchmark runs advance the simulation by this much every frame.
+const float gBenchmarkTimeStep = 1.0f / 60.0f;
+
+// Seconds a -spawnRate item lives before it is destroyed again.
+const float gTransientLifetime = 3.0f;
+
+// Water: a wave simulation on a grid of gWaveColumnCount x gWaveRowCount
+// vertices gWaveSpacing apart, resting at gWaterHeight.  It advances in fixed
+// steps of gWaveTimeStep, at most gMaxWaveStepsPerFrame a frame, and a drop
+// lands every gWaveDisturbInterval seconds.  Stable while speed * step /
+// spacing stays well below 1/sqrt(2).  Culling takes the surface to stay
+// within gMaxWaveHeight of rest.
+const UINT gWaveColumnCount = 181;
+const UINT gWaveRowCount = 261;
+const float gWaveSpacing = 0.5f;
+const float gWaterHeight = -0.3f;
+const float gWaveTimeStep = 0.03f;
+const float gWaveSpeed = 4.0f;
+const float gWaveDamping = 0.2f;
+const float gWaveDisturbInterval = 0.25f;
+const UINT gMaxWaveStepsPerFrame = 4;
+const float gMaxWaveHeight = 0.5f;
+static_assert(gWaveColumnCount * gWaveRowCount <= 65536, "The water grid has 16-bit indices");
 
 struct RenderItem
 {
     RenderItem() = default;
 
-    XMFLOAT4X4 World = MathHelper::Identity4x4();
-    int NumFramesDirty = gNumFrameResources;
+    // The item's entry in ShapesApp::mRitemPool.
+    PoolHandle Handle;
+
+    // The item's world lives in ShapesApp::mTransforms, which uploads it to
+    // the ObjCBIndex slot of the object constants whenever it changes.
+    UINT TransformIndex = TransformStore::None;
     UINT ObjCBIndex = -1;
 
     Material* Mat = nullptr;
     MeshGeometry* Geo = nullptr;
 
+    // Small id of Geo for the render queue sort keys.
+    UINT GeoSortId = 0;
+
     D3D12_PRIMITIVE_TOPOLOGY PrimitiveType = D3D_PRIMITIVE_TOPOLOGY_TRIANGLELIST;
 
+    // The submesh drawn this frame, one of Lods.
     UINT IndexCount = 0;
     UINT StartIndexLocation = 0;
     int BaseVertexLocation = 0;
+
+    // Submeshes from finest to coarsest; UpdateLods picks Lod by screen size.
+    SubmeshGeometry Lods[gMaxLods];
+    UINT LodCount = 1;
+    UINT Lod = 0;
+
+    // Local-space bounds of the submesh, and the same box transformed by the
+    // world matrix.  WorldBounds is refreshed whenever the transform changes.
+    BoundingBox Bounds;
+    BoundingBox WorldBounds;
+
+    // Result of the frustum culling stage for the current frame.
+    bool Visible = true;
+
+    // Part of the occluder depth prepass.
+    bool Occluder = false;
+
+    // Drawn into the cached static shadow cascades.  Items built at startup
+    // start out static and stay so until they first move; the others are drawn
+    // into the dynamic map.
+    bool StaticCaster = false;
+
+    // Made by SpawnRenderItem, so kept out of the startup batches and indirect
+    // buffers and free to destroy.
+    bool Spawned = false;
+};
+
+// Render items that share a submesh chain and a material, drawn with one
+// DrawIndexedInstanced call per level of detail.  The world matrices of the
+// items at level i are packed into the frame's instance buffer starting at
+// InstanceOffset[i].
+struct InstanceBatch
+{
+    MeshGeometry* Geo = nullptr;
+    UINT GeoSortId = 0;
+    Material* Mat = nullptr;
+
+    D3D12_PRIMITIVE_TOPOLOGY PrimitiveType = D3D_PRIMITIVE_TOPOLOGY_TRIANGLELIST;
+
+    SubmeshGeometry Lods[gMaxLods];
+    UINT LodCount = 1;
+
+    std::vector<RenderItem*> Items;
+
+    UINT InstanceOffset[gMaxLods] = {};
+    UINT InstanceCount[gMaxLods] = {};
+};
+
+// One draw of the GPU-driven path, laid out as mCommandSignature describes it:
+// the item's buffers, its bindless draw constants, then the draw itself.  The
+// culling shader copies these around as IndirectCommand in DrawCulling.hlsl.
+struct IndirectCommand
+{
+    D3D12_VERTEX_BUFFER_VIEW VertexBufferView;
+    D3D12_INDEX_BUFFER_VIEW IndexBufferView;
+    UINT ObjectIndex;
+    UINT MaterialIndex;
+    UINT InstanceOffset;
+    D3D12_DRAW_INDEXED_ARGUMENTS DrawArguments;
+};
+static_assert(sizeof(IndirectCommand) == 64, "IndirectCommand must match DrawCulling.hlsl");
+
+// Local-space bounds of an IndirectCommand's item, padded to float4s, and its
+// submesh chain as (IndexCount, StartIndexLocation, BaseVertexLocation) for the
+// culling shader to pick from.
+struct DrawBounds
+{
+    XMFLOAT3 Center;
+    UINT LodCount;
+    XMFLOAT3 Extents;
+    float Pad;
+    XMUINT4 Lods[gMaxLods];
+};
+
+// Root constants of the wave simulation, cbWaves in Waves.hlsl.
+struct WaveConstants
+{
+    float K1 = 0.0f;
+    float K2 = 0.0f;
+    float K3 = 0.0f;
+    float SpatialStep = 0.0f;
+    UINT ColumnCount = 0;
+    UINT RowCount = 0;
+    XMUINT2 DisturbCell = { 0, 0 };
+    float DisturbMagnitude = 0.0f;
+};
+
+// One leg of the benchmark flythrough.  Once it has run, FirstFrame and
+// EndFrame bound its frames in the profiler and the counters hold its totals.
+struct BenchmarkSegment
+{
+    std::string Name;
+    CameraPath Path;
+
+    UINT64 FirstFrame = 0;
+    UINT64 EndFrame = 0;
+    UINT64 DrawCalls = 0;
+    UINT64 VisibleItems = 0;
+};
+
+// A transform turning about its local vertical axis: its local matrix is
+// RotationY(Rate * t) * Rest.
+struct SpinningTransform
+{
+    UINT Transform = TransformStore::None;
+    XMFLOAT4X4 Rest = MathHelper::Identity4x4();
+    float Rate = 0.0f;
+};
+
+// One cascade of the sun's shadow map, covering a slice of the view frustum.
+// Its projection only changes when the slice drifts out of the margin around it,
+// so the static casters drawn for it stay valid while the camera moves a little.
+struct ShadowCascade
+{
+    // The slice's far view depth, and the sphere around it: centered on the
+    // view axis at SliceCenter, so its size does not change as the view turns.
+    float ViewEnd = 0.0f;
+    float SliceCenter = 0.0f;
+    float Radius = 0.0f;
+
+    // Half the side of the square covered, slice plus margin; the center of the
+    // square in light space; the projection; and the box covered, in world space.
+    float HalfWidth = 0.0f;
+    XMFLOAT2 Center = { 0.0f, 0.0f };
+    XMFLOAT4X4 ViewProj = MathHelper::Identity4x4();
+    BoundingOrientedBox Bounds;
+
+    // The static casters have to be drawn again.
+    bool StaticDirty = true;
+};
+
+// A destroyed render item, handed back to the pool once the GPU is past Fence.
+struct RetiredRenderItem
+{
+    PoolHandle Handle;
+    UINT64 Fence = 0;
+};
+
+// A render item spawned by -spawnRate, destroyed again at ExpireTime.
+struct TransientItem
+{
+    PoolHandle Handle;
+    float ExpireTime = 0.0f;
+};
+
+// Pipeline states Draw switches between, also the pipeline state part of the
+// render queue sort keys.
+enum PsoId
+{
+    PsoOpaque = 0,
+    PsoOpaqueInstanced,
+    PsoTransparent,
+    PsoCount
+};
+
+// Profiler scopes, registered in this order.
+enum CpuScopeId
+{
+    CpuUpdate = 0,
+    CpuFenceWait,
+    CpuUpdateMainPassCB,
+    CpuUpdateObjectCBs,
+    CpuDraw,
+    CpuDrawRenderItems,
+    CpuScopeCount
+};
+
+enum GpuScopeId
+{
+    GpuFrame = 0,
+    GpuWaves,
+    GpuLightCulling,
+    GpuShadows,
+    GpuOcclusion,
+    GpuHiZ,
+    GpuDrawCulling,
+    GpuDepthPrepass,
+    GpuScene,
+    GpuUpscale,
+    GpuScopeCount
 };
 
 class ShapesApp : public D3DApp
@@ -41,6 +332,7 @@ public:
     virtual bool Initialize() override;
 
 private:
+    virtual void CreateRtvAndDsvDescriptorHeaps() override;
     virtual void OnResize() override;
     virtual void Update(const GameTimer& gt) override;
     virtual void Draw(const GameTimer& gt) override;
@@ -48,56 +340,375 @@ private:
     virtual void OnMouseDown(WPARAM btnState, int x, int y) override;
     virtual void OnMouseUp(WPARAM btnState, int x, int y) override;
     virtual void OnMouseMove(WPARAM btnState, int x, int y) override;
+    virtual void OnKeyUp(WPARAM key) override;
 
     void OnKeyboardInput(const GameTimer& gt);
+    void UpdateBenchmark(const GameTimer& gt);
+    void UpdateTransients(const GameTimer& gt);
     void UpdateObjectCBs(const GameTimer& gt);
+    void UpdateLods(const GameTimer& gt);
+    void UpdateVisibleRitems(const GameTimer& gt);
+    void SortVisibleRitems(RenderQueue& queue, std::vector<RenderItem*>& ritems, PsoId pso);
+    void UpdateInstanceBuffer(const GameTimer& gt);
+    void UpdateLightBuffer(const GameTimer& gt);
     void UpdateMainPassCB(const GameTimer& gt);
+    void UpdateShadowCascades();
+    void UpdateRenderScale();
     void UpdateMaterialCBs(const GameTimer& gt);
+    void UpdateWaves(const GameTimer& gt);
 
     void BuildRootSignature();
+    void BuildBindlessRootSignature();
+    void BuildLightCullRootSignature();
+    void BuildDrawCullRootSignature();
+    void BuildHiZRootSignature();
+    void BuildShadowRootSignature();
+    void BuildUpscaleRootSignature();
+    void BuildWavesRootSignature();
+    void BuildCommandSignature();
     void BuildShadersAndInputLayout();
-    void BuildShapeGeometry();
-    void BuildMazeGeometry();
+    void BuildShapeGeometry(bool keepCpuCopies);
+    void BuildMazeGeometry(bool keepCpuCopies);
+    void BuildWaterGeometry();
+    template<typename FillFn>
+    ComPtr<ID3D12Resource> CreateGeometryBuffer(UINT byteSize, ComPtr<ID3DBlob>* cpuCopy, FillFn fill);
+    bool LoadGeometryCache();
+    void SaveGeometryCache();
     void BuildMaterials();
+    void BuildLights();
+    void BuildClusterBuffers();
+    void SetSubmesh(RenderItem& ri, const std::string& key);
     void BuildRenderItems();
+    RenderItem* NewRenderItem();
+    void AddToScene(RenderItem* ri, bool spawned);
+    void BuildInstanceBatches();
+    void BuildIndirectCommands();
     void BuildFrameResources();
     void BuildPSOs();
     void BuildTextures();
     void BuildDescriptorHeaps();
-
-    void DrawRenderItems(ID3D12GraphicsCommandList* cmdList, const std::vector<RenderItem*>& ritems);
+    void BuildHiZResources();
+    void BuildShadowMaps();
+    void BuildSceneTarget();
+    void BuildBenchmarkPath();
+    bool WriteBenchmarkReport();
+
+    void RecordWaves(ID3D12GraphicsCommandList* cmdList);
+    void RecordLightCulling(ID3D12GraphicsCommandList* cmdList);
+    void RecordShadowPass(ID3D12GraphicsCommandList* cmdList);
+    void DrawShadowCasters(ID3D12GraphicsCommandList* cmdList, const ShadowCascade& cascade, const std::vector<RenderItem*>& ritems, bool finestLod);
+    void RecordOccluderPrepass(ID3D12GraphicsCommandList* cmdList);
+    void RecordHiZ(ID3D12GraphicsCommandList* cmdList);
+    void RecordDrawCulling(ID3D12GraphicsCommandList* cmdList, bool occlusion);
+    void RecordDepthPrepass(ID3D12GraphicsCommandList* cmdList, ID3D12PipelineState* const* psos);
+    void RecordOpaqueDraws(
+        ID3D12GraphicsCommandList* cmdList,
+        ID3D12PipelineState* opaquePso,
+        ID3D12PipelineState* instancedPso,
+        UINT part,
+        UINT partCount);
+    void RecordScenePass(
+        ID3D12GraphicsCommandList* cmdList,
+        ID3D12PipelineState* opaquePso,
+        ID3D12PipelineState* instancedPso,
+        ID3D12PipelineState* transparentPso,
+        UINT part,
+        UINT partCount);
+    void RecordUpscale(ID3D12GraphicsCommandList* cmdList);
+    void RecordEndOfFrame(ID3D12GraphicsCommandList* cmdList);
+    void DrawRenderItems(ID3D12GraphicsCommandList* cmdList, const std::vector<RenderItem*>& ritems, size_t first, size_t last);
+    void DrawInstanceBatches(ID3D12GraphicsCommandList* cmdList, const std::vector<InstanceBatch>& batches, size_t first, size_t last);
     bool CheckCollision(const DirectX::XMFLOAT3& position, float radius);
 
+    std::array<const CD3DX12_STATIC_SAMPLER_DESC, 2> GetStaticSamplers();
+
+    // Where the scene pass draws: the offscreen target with dynamic resolution,
+    // the back buffer otherwise.
+    D3D12_CPU_DESCRIPTOR_HANDLE SceneColorView()const;
+
+    // Render items made and dropped while running.  The item shows up from the
+    // frame being built on and is gone from the next one; a handle to a
+    // destroyed item no longer resolves, and destroying it again does nothing.
+    // Only spawned items can be destroyed; the startup ones are baked into the
+    // batches and indirect buffers.
+    PoolHandle SpawnRenderItem(const std::string& key, const DirectX::XMMATRIX& world, const std::string& matName);
+    void DestroyRenderItem(PoolHandle handle);
+    void ReleaseDestroyedRitems();
+
 private:
     std::vector<std::unique_ptr<FrameResource>> mFrameResources;
     FrameResource* mCurrFrameResource = nullptr;
     int mCurrFrameResourceIndex = 0;
 
     ComPtr<ID3D12RootSignature> mRootSignature = nullptr;
+    ComPtr<ID3D12RootSignature> mLightCullRootSignature = nullptr;
+    ComPtr<ID3D12RootSignature> mBindlessRootSignature = nullptr;
+    ComPtr<ID3D12RootSignature> mDrawCullRootSignature = nullptr;
+    ComPtr<ID3D12RootSignature> mHiZRootSignature = nullptr;
+    ComPtr<ID3D12RootSignature> mShadowRootSignature = nullptr;
+    ComPtr<ID3D12RootSignature> mUpscaleRootSignature = nullptr;
+    ComPtr<ID3D12RootSignature> mWavesRootSignature = nullptr;
+    ComPtr<ID3D12CommandSignature> mCommandSignature = nullptr;
     ComPtr<ID3D12DescriptorHeap> mSrvDescriptorHeap = nullptr;
     std::unordered_map<std::string, std::unique_ptr<Texture>> mTextures;
+    std::unique_ptr<TextureStreamer> mTextureStreamer;
+
+    // Shared GPU memory.  Static buffers are placed in mDefaultBufferHeap and
+    // staged through mUploadRing, which is reclaimed against mFence; the frame
+    // resources' upload buffers are placed in mUploadBufferHeap.
+    std::unique_ptr<PlacedBufferHeap> mDefaultBufferHeap;
+    std::unique_ptr<PlacedBufferHeap> mUploadBufferHeap;
+    std::unique_ptr<UploadRing> mUploadRing;
+    UINT mUploadRingMB = 32;
     std::unordered_map<std::string, std::unique_ptr<MeshGeometry>> mGeometries;
+
+    // Generated geometry is cached here between runs; empty turns the cache off.
+    std::wstring mGeometryCacheFile = L"GeometryCache.bin";
+    bool mRebuildGeometryCache = false;
+
+    // Where the geometry builds generate their meshes before packing them for
+    // upload.  Kept between builds, so building again reuses the memory.
+    std::vector<GeometryGenerator::Vertex> mShapeVertexArena;
+    std::vector<Vertex> mMazeVertexArena;
+    std::vector<std::uint32_t> mGeometryIndexArena;
+    MeshOptimizer::Scratch mMeshOptimizerScratch;
     std::unordered_map<std::string, ComPtr<ID3DBlob>> mShaders;
     std::unordered_map<std::string, ComPtr<ID3D12PipelineState>> mPSOs;
+
+    // Compiled shaders and pipeline states are kept in this directory between
+    // runs; empty compiles and creates everything every time.
+    std::wstring mShaderCacheDirectory = L"ShaderCache";
+    std::unique_ptr<ShaderCache> mShaderCache;
+    std::unique_ptr<PipelineCache> mPipelineCache;
+
+    // Frame timings.  'P' writes them out, as do the -profileCsv and
+    // -profileJson options on exit.
+    std::unique_ptr<Profiler> mProfiler;
+    std::wstring mProfileCsvFile;
+    std::wstring mProfileJsonFile;
+
+    // Benchmark mode: the camera flies mBenchmarkSegments at a fixed time step
+    // with input ignored, the results go to mBenchmarkFile and the app quits.
+    // Warm-up frames on the first pose are left out of the results; cool-down
+    // frames on the last pose wait for the last GPU timings.
+    bool mBenchmarkEnabled = false;
+    std::wstring mBenchmarkFile = L"Benchmark.json";
+    std::vector<BenchmarkSegment> mBenchmarkSegments;
+    size_t mBenchmarkSegment = 0;
+    float mBenchmarkTime = 0.0f;
+    UINT mBenchmarkWarmupFrames = 60;
+    UINT mBenchmarkCooldownFrames = 0;
+
+    // Extra primitives per side of the field BuildRenderItems spreads over the
+    // terrain; zero leaves the scene as it is.
+    UINT mBenchmarkScale = 0;
+
+    // Running totals for the benchmark counters.  Draw calls are API calls, so
+    // an ExecuteIndirect counts once, and only items culled on the CPU count as
+    // visible.
+    std::atomic<UINT64> mDrawCallCount = { 0 };
+    UINT64 mVisibleItemCount = 0;
+
+    // mPSOs by PsoId for the regular [0] and bindless [1] root signatures,
+    // resolved at the end of BuildPSOs.  Missing states are null.
+    ID3D12PipelineState* mFramePsos[2][PsoCount] = {};
+    ID3D12PipelineState* mWireframePsos[2][PsoCount] = {};
+
+    // With the depth prepass: the depth-only states of the prepass, and the
+    // opaque states that then shade only where the depth is equal.  No
+    // transparent state in the first, the regular one in the second.
+    ID3D12PipelineState* mDepthPrepassPsos[2][PsoCount] = {};
+    ID3D12PipelineState* mEqualDepthPsos[2][PsoCount] = {};
     std::unordered_map<std::string, std::unique_ptr<Material>> mMaterials;
 
     std::vector<D3D12_INPUT_ELEMENT_DESC> mInputLayout;
-    std::vector<std::unique_ptr<RenderItem>> mAllRitems;
+    std::vector<D3D12_INPUT_ELEMENT_DESC> mDepthInputLayout;
+
+    // Every render item, built at startup or spawned later, and the object
+    // constant slots they take.  Destroyed items keep both until the GPU is
+    // past the last frame that could have drawn them.
+    ObjectPool<RenderItem> mRitemPool;
+    FreeList mObjectSlots;
+    std::deque<RetiredRenderItem> mRetiredRitems;
+
+    // Meshes by GeoSortId.
+    std::vector<MeshGeometry*> mSortGeos;
+
+    // -spawnRate N spawns N short-lived shapes per second over the terrain.
+    float mSpawnRate = 0.0f;
+    float mSpawnBudget = 0.0f;
+    std::uint32_t mSpawnSeed = 1;
+    std::deque<TransientItem> mTransients;
+
+    // World matrices of the render items and of the groups they hang off, and
+    // the item on each transform, if any.
+    std::unique_ptr<TransformStore> mTransforms;
+    std::vector<RenderItem*> mTransformRitems;
+
+    // Animated props: the diamonds on the towers and the fountain's rings, and
+    // with -benchmarkAnimate every -benchmarkScale primitive.  Only these and
+    // whatever hangs off them are updated and uploaded each frame.
+    bool mBenchmarkAnimate = false;
+    std::vector<SpinningTransform> mSpinningTransforms;
     std::vector<RenderItem*> mOpaqueRitems;
     std::vector<RenderItem*> mTransparentRitems;
+    std::vector<RenderItem*> mOccluderRitems;
+    std::vector<RenderItem*> mVisibleOpaqueRitems;
+    std::vector<RenderItem*> mVisibleTransparentRitems;
+
+    // Opaque items spawned after startup.  The instance batches and indirect
+    // commands only cover the items BuildRenderItems made, so these are drawn
+    // one by one in every mode.
+    std::vector<RenderItem*> mDynamicOpaqueRitems;
+    std::vector<RenderItem*> mVisibleDynamicRitems;
+    std::vector<InstanceBatch> mOpaqueBatches;
+
+    // Per-frame draw order of the visible items: opaque ones grouped by state
+    // and front-to-back, transparent ones back-to-front.
+    RenderQueue mOpaqueQueue;
+    RenderQueue mTransparentQueue;
+    std::vector<RenderItem*> mSortedRitems;
     PassConstants mMainPassCB;
+    FrameConstants mFrameConstants;
+
+    // The pass constants only change with the camera and the window size.  They
+    // are rebuilt when the camera versions differ from the ones cached here, and
+    // then copied to each frame resource in turn, like Material::NumFramesDirty.
+    UINT mPassViewVersion = 0;
+    UINT mPassProjVersion = 0;
+    int mPassNumFramesDirty = gNumFrameResources;
+
+    // Scene lights, directional lights first.  The point lights are binned into
+    // clusters on the GPU every frame; the two buffers below hold the result.
+    std::vector<Light> mLights;
+    UINT mDirectionalLightCount = 0;
+    int mLightsNumFramesDirty = gNumFrameResources;
+    ComPtr<ID3D12Resource> mClusterLightCounts = nullptr;
+    ComPtr<ID3D12Resource> mClusterLightIndices = nullptr;
+
+    // Water waves, simulated on the GPU into the vertices of "waterGeo".  Each
+    // step writes the next height field over the older of the two, and
+    // mWaveCurrent then names the newer.  UpdateWaves picks how many steps the
+    // frame takes and whether a drop lands first.
+    ComPtr<ID3D12Resource> mWaveHeights[2];
+    UINT mWaveCurrent = 0;
+    WaveConstants mWaveConstants;
+    float mWaveTime = 0.0f;
+    float mWaveDisturbTime = 0.0f;
+    UINT mWaveStepCount = 0;
+    bool mWaveDisturb = false;
+
+    // Async compute: the waves, the light binning and the Hi-Z pyramid go to
+    // the compute queue and overlap the occluder prepass and the shadow pass,
+    // rather than running in line on the direct queue.
+    bool mAsyncComputeEnabled = true;
+
+    // With async compute the direct work before the scene pass goes into these
+    // lists, split where the compute queue waits for it or it waits for the
+    // compute queue.  The whole frame is recorded before any of it is
+    // submitted, so the direct queue does not idle inside the Frame scope while
+    // the CPU records the rest.
+    ComPtr<ID3D12GraphicsCommandList> mPreSceneCmdLists[2];
+
+    // Cascaded shadow maps of the first directional light.  Static casters are
+    // drawn into mStaticShadowMap only when a cascade is refit or one of them
+    // moves; the other casters are drawn into mDynamicShadowMap every frame, and
+    // the pixel shader takes both.  -noShadowCache redraws everything every
+    // frame, for comparison.
+    ShadowCascade mShadowCascades[gShadowCascadeCount];
+    ComPtr<ID3D12Resource> mStaticShadowMap = nullptr;
+    ComPtr<ID3D12Resource> mDynamicShadowMap = nullptr;
+    std::vector<RenderItem*> mStaticCasterRitems;
+    std::vector<RenderItem*> mDynamicCasterRitems;
+    bool mShadowCacheEnabled = true;
+    UINT mShadowProjVersion = 0;
+    UINT64 mShadowCascadeRedraws = 0;
+
+    // Nothing has been drawn into the dynamic map since it was last cleared.
+    bool mDynamicShadowMapClear = false;
+
+    // Around every caster built at startup; the cascades' depth range.
+    BoundingSphere mShadowSceneBounds;
+
+    // Dynamic resolution: the scene is drawn into the top-left mRenderWidth x
+    // mRenderHeight of mSceneColor, which is the window's size, and stretched
+    // over the back buffer.  UpdateRenderScale moves the scale after the GPU
+    // frame time, towards mTargetGpuFrameMs.  Not available with MSAA.
+    bool mDynamicResolutionEnabled = false;
+    bool mUpscaleThisFrame = false;
+    float mTargetGpuFrameMs = 16.0f;
+    float mRenderScale = 1.0f;
+    UINT mRenderWidth = 0;
+    UINT mRenderHeight = 0;
+    ComPtr<ID3D12Resource> mSceneColor = nullptr;
+    D3D12_VIEWPORT mSceneViewport = {};
+    D3D12_RECT mSceneScissorRect = {};
+
+    // First frame drawn at the current size; earlier GPU timings do not count.
+    UINT64 mRenderSizeFrame = 0;
+
+    // Over a benchmark run.
+    double mRenderScaleSum = 0.0;
+    UINT64 mRenderScaleFrames = 0;
+    float mLowestRenderScale = 1.0f;
 
 
     bool mIsWireframe = false;
+    bool mInstancingEnabled = true;
+    bool mFrustumCullingEnabled = true;
+    bool mLodEnabled = true;
+    bool mParallelRecordingEnabled = true;
+
+    // Lays down the depth of the opaque items before they are shaded, so each
+    // pixel runs the lighting shader once.  Off in wireframe.
+    bool mDepthPrepassEnabled = false;
+
+    // Bindless mode: materials come from one structured buffer and textures from
+    // an unbounded SRV array, and each draw only sets its indices as root
+    // constants.  Needs resource binding tier 2.
+    bool mBindlessSupported = false;
+    bool mBindlessEnabled = true;
+
+    // GPU-driven mode: the opaque items are culled by a compute pass, which
+    // writes the draws of the visible ones for a single ExecuteIndirect.  Builds
+    // on the bindless root signature, so it is only on while bindless is.
+    bool mGpuDrivenEnabled = false;
+    UINT mIndirectCommandCount = 0;
+    ComPtr<ID3D12Resource> mIndirectCommands = nullptr;
+    ComPtr<ID3D12Resource> mDrawBounds = nullptr;
+    ComPtr<ID3D12Resource> mVisibleCommands = nullptr;
+    ComPtr<ID3D12Resource> mDrawCount = nullptr;
+    ComPtr<ID3D12Resource> mDrawCountReset = nullptr;
+
+    // Occlusion culling for the GPU-driven path: the occluders are drawn to the
+    // depth buffer first, reduced to a pyramid of farthest depths, and every
+    // item's box is tested against it.  Sized with the window; needs the depth
+    // buffer without MSAA.
+    bool mOcclusionCullingEnabled = true;
+    ComPtr<ID3D12Resource> mHiZBuffer = nullptr;
+    UINT mHiZMipCount = 0;
+
+    // Threads recording the scene pass when parallel recording is on.  Each
+    // worker fills its own command list of the current frame resource.
+    std::unique_ptr<WorkerPool> mWorkerPool;
+    UINT mNumRecordWorkers = 1;
+    std::vector<ID3D12CommandList*> mSubmitCmdLists;
 
     Camera mCamera;
     XMFLOAT4X4 mProj = MathHelper::Identity4x4();
 
+    // View-space frustum, rebuilt whenever the projection changes, and the same
+    // frustum in world space, rebuilt together with the pass constants.
+    BoundingFrustum mCamFrustum;
+    BoundingFrustum mWorldCamFrustum;
+
     float mStartX = 0.0f;
     float mStartY = 4.0f;
     float mStartZ = 0.0f;
 
     std::vector<DirectX::BoundingBox> mMazeWallBounds;
+    SpatialGrid mMazeCollisionGrid;
+    std::vector<XMFLOAT3> mMazeTorchPositions;
     float mCollisionRadius = 0.8f;
 
     POINT mLastMousePos;
@@ -124,15 +735,140 @@ int WINAPI WinMain(HINSTANCE hInstance, HINSTANCE prevInstance, PSTR cmdLine, in
     }
 }
 
+static BoundingBox ComputeMeshBounds(const GeometryGenerator::MeshData& mesh)
+{
+    BoundingBox bounds;
+    BoundingBox::CreateFromPoints(
+        bounds,
+        mesh.Vertices.size(),
+        &mesh.Vertices[0].Position,
+        sizeof(GeometryGenerator::Vertex));
+
+    return bounds;
+}
+
+static PackedVertex PackVertex(const XMFLOAT3& pos, const XMFLOAT3& normal, const XMFLOAT2& texC)
+{
+    PackedVertex packed;
+    packed.Pos = pos;
+    packed.Normal = MeshOptimizer::EncodeOctahedral(normal);
+    packed.TexC = XMHALF2(texC.x, texC.y);
+
+    return packed;
+}
+
+// The pointer forms write in order, so they can write into upload memory.
+static void PackVertices(const Vertex* vertices, size_t count, PackedVertex* packed)
+{
+    for (size_t i = 0; i < count; ++i)
+        packed[i] = PackVertex(vertices[i].Pos, vertices[i].Normal, vertices[i].TexC);
+}
+
+static void PackVertices(const GeometryGenerator::Vertex* vertices, size_t count, PackedVertex* packed)
+{
+    for (size_t i = 0; i < count; ++i)
+        packed[i] = PackVertex(vertices[i].Position, vertices[i].Normal, vertices[i].TexC);
+}
+
+static std::vector<PackedVertex> PackVertices(const std::vector<Vertex>& vertices)
+{
+    std::vector<PackedVertex> packed(vertices.size());
+    PackVertices(vertices.data(), vertices.size(), packed.data());
+
+    return packed;
+}
+
+static void NarrowIndices(const std::uint32_t* indices, size_t count, std::uint16_t* narrowed)
+{
+    for (size_t i = 0; i < count; ++i)
+        narrowed[i] = static_cast<std::uint16_t>(indices[i]);
+}
+
 ShapesApp::ShapesApp(HINSTANCE hInstance)
     : D3DApp(hInstance)
 {
+    // Frame pacing is picked per deployment, for example
+    //   -framesInFlight 1 -frameLatency 1            lowest latency
+    //   -framesInFlight 4 -frameLatency 3            more throughput
+    //   -noWaitableSwapChain                         let Present() throttle instead
+    CommandLine cmdLine;
+    gNumFrameResources = MathHelper::Clamp(cmdLine.GetInt(L"framesInFlight", gNumFrameResources), 1, 8);
+    mMaxFrameLatency = (UINT)MathHelper::Clamp(cmdLine.GetInt(L"frameLatency", (int)mMaxFrameLatency), 1, 16);
+    mWaitableSwapChain = !cmdLine.HasOption(L"noWaitableSwapChain");
+
+    // -gpuPreference highPerformance (the default), minimumPower or unspecified
+    // orders the adapters; -adapterLuid <hex> asks for one of them by the LUID
+    // the debug output lists.
+    std::wstring gpuPreference = cmdLine.GetString(L"gpuPreference", L"highPerformance");
+    if (_wcsicmp(gpuPreference.c_str(), L"minimumPower") == 0)
+        mGpuPreference = DXGI_GPU_PREFERENCE_MINIMUM_POWER;
+    else if (_wcsicmp(gpuPreference.c_str(), L"unspecified") == 0)
+        mGpuPreference = DXGI_GPU_PREFERENCE_UNSPECIFIED;
+    std::wstring adapterLuid = cmdLine.GetString(L"adapterLuid", L"");
+    if (!adapterLuid.empty())
+    {
+        unsigned long long luid = wcstoull(adapterLuid.c_str(), nullptr, 16);
+        mAdapterLuid.LowPart = (DWORD)luid;
+        mAdapterLuid.HighPart = (LONG)(luid >> 32);
+    }
+
+    // -gpuDriven starts with the compute-culled ExecuteIndirect path.
+    mGpuDrivenEnabled = cmdLine.HasOption(L"gpuDriven");
+
+    // Staging memory for geometry and for the texture streamer, each.
+    mUploadRingMB = (UINT)MathHelper::Clamp(cmdLine.GetInt(L"uploadRingMB", (int)mUploadRingMB), 4, 1024);
+
+    // -geometryCache <file> moves the cache, -noGeometryCache turns it off and
+    // -rebuildGeometryCache regenerates it.
+    mGeometryCacheFile = cmdLine.GetString(L"geometryCache", mGeometryCacheFile);
+    if (cmdLine.HasOption(L"noGeometryCache"))
+        mGeometryCacheFile.clear();
+    mRebuildGeometryCache = cmdLine.HasOption(L"rebuildGeometryCache");
+
+    // -noShaderCache compiles every shader and creates every pipeline state.
+    if (cmdLine.HasOption(L"noShaderCache"))
+        mShaderCacheDirectory.clear();
+
+    mProfileCsvFile = cmdLine.GetString(L"profileCsv", L"");
+    mProfileJsonFile = cmdLine.GetString(L"profileJson", L"");
+
+    // -benchmark flies the scripted path and writes -benchmarkOut <file>, by
+    // default Benchmark.json.  -benchmarkScale N adds N x N primitives to the
+    // scene, with or without -benchmark, and -benchmarkAnimate keeps them moving.
+    mBenchmarkEnabled = cmdLine.HasOption(L"benchmark");
+    mBenchmarkFile = cmdLine.GetString(L"benchmarkOut", mBenchmarkFile);
+    mBenchmarkScale = (UINT)MathHelper::Clamp(cmdLine.GetInt(L"benchmarkScale", 0), 0, 256);
+    mBenchmarkAnimate = cmdLine.HasOption(L"benchmarkAnimate");
+    mSpawnRate = (float)MathHelper::Clamp(cmdLine.GetInt(L"spawnRate", 0), 0, 100000);
+
+    // -noShadowCache draws every caster into every cascade each frame.
+    mShadowCacheEnabled = !cmdLine.HasOption(L"noShadowCache");
+
+    // -noAsyncCompute runs the compute passes in line; 'Y' toggles it.
+    mAsyncComputeEnabled = !cmdLine.HasOption(L"noAsyncCompute");
+
+    // -depthPrepass starts with the depth prepass on; 'Z' toggles it.
+    mDepthPrepassEnabled = cmdLine.HasOption(L"depthPrepass");
+
+    // -dynamicResolution starts with dynamic resolution on, holding the GPU
+    // frame time at -targetGpuMs, by default 16; 'R' toggles it.
+    mDynamicResolutionEnabled = cmdLine.HasOption(L"dynamicResolution");
+    mTargetGpuFrameMs = MathHelper::Clamp(cmdLine.GetFloat(L"targetGpuMs", 16.0f), 1.0f, 1000.0f);
+    mPauseWhenInactive = !mBenchmarkEnabled;
 }
 
 ShapesApp::~ShapesApp()
 {
     if (md3dDevice != nullptr)
         FlushCommandQueue();
+
+    if (mProfiler != nullptr)
+    {
+        if (!mProfileCsvFile.empty())
+            mProfiler->WriteCsv(mProfileCsvFile);
+        if (!mProfileJsonFile.empty())
+            mProfiler->WriteJson(mProfileJsonFile);
+    }
 }
 
 bool ShapesApp::Initialize()
@@ -140,19 +876,102 @@ bool ShapesApp::Initialize()
     if (!D3DApp::Initialize())
         return false;
 
+    mDefaultBufferHeap = std::make_unique<PlacedBufferHeap>(md3dDevice.Get(), D3D12_HEAP_TYPE_DEFAULT, 16 * 1024 * 1024);
+    mUploadBufferHeap = std::make_unique<PlacedBufferHeap>(md3dDevice.Get(), D3D12_HEAP_TYPE_UPLOAD, 4 * 1024 * 1024);
+    mUploadRing = std::make_unique<UploadRing>(md3dDevice.Get(), (UINT64)mUploadRingMB * 1024 * 1024);
+
+    // The profiler keeps every frame of a benchmark run.
+    UINT profileHistory = 4096;
+    if (mBenchmarkEnabled)
+    {
+        BuildBenchmarkPath();
+
+        float duration = 0.0f;
+        for (const auto& segment : mBenchmarkSegments)
+            duration += segment.Path.GetDuration();
+
+        UINT runFrames = mBenchmarkWarmupFrames + (UINT)(duration / gBenchmarkTimeStep) +
+            (UINT)mBenchmarkSegments.size() + (UINT)gNumFrameResources + 1;
+        profileHistory = MathHelper::Max(profileHistory, runFrames);
+
+        mTimer.SetFixedTimeStep(gBenchmarkTimeStep);
+    }
+
+    mProfiler = std::make_unique<Profiler>(md3dDevice.Get(), mCommandQueue.Get(), (UINT)gNumFrameResources, profileHistory);
+    mProfiler->AddQueue(mComputeQueue.Get());
+
+    const char* cpuScopeNames[CpuScopeCount] =
+    {
+        "Update", "FenceWait", "UpdateMainPassCB", "UpdateObjectCBs", "Draw", "DrawRenderItems"
+    };
+    for (const char* name : cpuScopeNames)
+        mProfiler->AddCpuScope(name);
+
+    const char* gpuScopeNames[GpuScopeCount] =
+    {
+        "Frame", "Waves", "LightCulling", "Shadows", "Occlusion", "HiZ", "DrawCulling", "DepthPrepass", "Scene", "Upscale"
+    };
+    for (const char* name : gpuScopeNames)
+        mProfiler->AddGpuScope(name);
+
+    for (auto& cmdList : mPreSceneCmdLists)
+    {
+        ThrowIfFailed(md3dDevice->CreateCommandList(0, D3D12_COMMAND_LIST_TYPE_DIRECT,
+            mDirectCmdListAlloc.Get(), nullptr, IID_PPV_ARGS(cmdList.GetAddressOf())));
+        ThrowIfFailed(cmdList->Close());
+    }
+
     ThrowIfFailed(mCommandList->Reset(mDirectCmdListAlloc.Get(), nullptr));
 
     BuildRootSignature();
+    BuildBindlessRootSignature();
+    BuildLightCullRootSignature();
+    BuildDrawCullRootSignature();
+    BuildHiZRootSignature();
+    BuildShadowRootSignature();
+    BuildUpscaleRootSignature();
+    BuildWavesRootSignature();
+    BuildCommandSignature();
+
+    mShaderCache = std::make_unique<ShaderCache>(mShaderCacheDirectory);
+    mPipelineCache = std::make_unique<PipelineCache>(md3dDevice.Get(),
+        mShaderCacheDirectory.empty() ? std::wstring() : mShaderCacheDirectory + L"\\Pipelines.bin");
+
     BuildShadersAndInputLayout();
-    BuildShapeGeometry();
-    BuildMazeGeometry();
+    if (!LoadGeometryCache())
+    {
+        // Only the cache writer reads the CPU copies; collision has its own
+        // boxes.
+        bool keepCpuCopies = !mGeometryCacheFile.empty();
+        BuildShapeGeometry(keepCpuCopies);
+        BuildMazeGeometry(keepCpuCopies);
+        SaveGeometryCache();
+    }
+    BuildWaterGeometry();
+    BuildDescriptorHeaps();
+    BuildHiZResources();
+    BuildShadowMaps();
+    BuildSceneTarget();
     BuildTextures();
     BuildMaterials();
+    BuildLights();
+    BuildClusterBuffers();
     BuildRenderItems();
-    BuildDescriptorHeaps();
+    BuildInstanceBatches();
+    BuildIndirectCommands();
+
+    // One recording worker per hardware thread, capped because past a handful
+    // of lists the per-list overhead outweighs the draws each one would get.
+    mNumRecordWorkers = MathHelper::Clamp(std::thread::hardware_concurrency(), 1u, 8u);
+    mWorkerPool = std::make_unique<WorkerPool>(mNumRecordWorkers - 1);
+
     BuildFrameResources();
     BuildPSOs();
 
+    // Not fatal: the next run creates the missing states again.
+    if (!mPipelineCache->Save())
+        ::OutputDebugStringW(L"Could not write the pipeline library\n");
+
     mStartX = 0.0f;
 
     float castleCenterZ = 15.0f;
@@ -177,60 +996,166 @@ bool ShapesApp::Initialize()
 
     FlushCommandQueue();
 
+    // The geometry staging memory is free again.
+    mUploadRing->Retire(mCurrentFence);
+    mUploadRing->Reclaim(mFence->GetCompletedValue());
+
     return true;
 }
+void ShapesApp::CreateRtvAndDsvDescriptorHeaps()
+{
+    D3D12_DESCRIPTOR_HEAP_DESC rtvHeapDesc;
+    // The swap chain's buffers, then the dynamic resolution scene target.
+    rtvHeapDesc.NumDescriptors = SwapChainBufferCount + 1;
+    rtvHeapDesc.Type = D3D12_DESCRIPTOR_HEAP_TYPE_RTV;
+    rtvHeapDesc.Flags = D3D12_DESCRIPTOR_HEAP_FLAG_NONE;
+    rtvHeapDesc.NodeMask = 0;
+    ThrowIfFailed(md3dDevice->CreateDescriptorHeap(
+        &rtvHeapDesc, IID_PPV_ARGS(mRtvHeap.GetAddressOf())));
+
+    // The depth buffer's view, then one per cascade of the static shadow map
+    // and one per cascade of the dynamic one.
+    D3D12_DESCRIPTOR_HEAP_DESC dsvHeapDesc;
+    dsvHeapDesc.NumDescriptors = 1 + 2 * gShadowCascadeCount;
+    dsvHeapDesc.Type = D3D12_DESCRIPTOR_HEAP_TYPE_DSV;
+    dsvHeapDesc.Flags = D3D12_DESCRIPTOR_HEAP_FLAG_NONE;
+    dsvHeapDesc.NodeMask = 0;
+    ThrowIfFailed(md3dDevice->CreateDescriptorHeap(
+        &dsvHeapDesc, IID_PPV_ARGS(mDsvHeap.GetAddressOf())));
+}
+
 void ShapesApp::OnResize()
 {
     D3DApp::OnResize();
     mCamera.SetLens(0.25f * MathHelper::Pi, AspectRatio(), 1.0f, 1000.0f);
+
+    BoundingFrustum::CreateFromMatrix(mCamFrustum, mCamera.GetProj());
+
+    // The first resize comes from D3DApp::Initialize, before the SRV heap
+    // exists; Initialize builds the pyramid and the scene target itself then.
+    if (mSrvDescriptorHeap != nullptr)
+    {
+        BuildHiZResources();
+        BuildSceneTarget();
+    }
 }
 
 void ShapesApp::Update(const GameTimer& gt)
 {
-    OnKeyboardInput(gt);
-    mCamera.UpdateViewMatrix();
-
     mCurrFrameResourceIndex = (mCurrFrameResourceIndex + 1) % gNumFrameResources;
     mCurrFrameResource = mFrameResources[mCurrFrameResourceIndex].get();
 
-    if (mCurrFrameResource->Fence != 0 && mFence->GetCompletedValue() < mCurrFrameResource->Fence)
+    mProfiler->BeginFrame(mCurrFrameResourceIndex);
+    Profiler::CpuScope updateScope(mProfiler.get(), CpuUpdate);
+
+    if (mBenchmarkEnabled)
+        UpdateBenchmark(gt);
+    else
+        OnKeyboardInput(gt);
+    mCamera.UpdateViewMatrix();
+
+    {
+        Profiler::CpuScope waitScope(mProfiler.get(), CpuFenceWait);
+        mCurrFrameResource->WaitForGpu(mFence.Get());
+    }
+    mProfiler->ReadGpuScopes();
+    UpdateRenderScale();
+
+    mUploadRing->Reclaim(mFence->GetCompletedValue());
+    ReleaseDestroyedRitems();
+
+    // Bindless materials carry their texture slot, which changes when a
+    // texture replaces the fallback.
+    if (mTextureStreamer->Update())
     {
-        HANDLE eventHandle = CreateEventEx(nullptr, nullptr, false, EVENT_ALL_ACCESS);
-        ThrowIfFailed(mFence->SetEventOnCompletion(mCurrFrameResource->Fence, eventHandle));
-        WaitForSingleObject(eventHandle, INFINITE);
-        CloseHandle(eventHandle);
+        for (auto& e : mMaterials)
+            e.second->NumFramesDirty = gNumFrameResources;
     }
 
+    UpdateTransients(gt);
+    UpdateMainPassCB(gt);
     UpdateObjectCBs(gt);
+    UpdateLods(gt);
+    UpdateVisibleRitems(gt);
+    mVisibleItemCount += mVisibleOpaqueRitems.size() + mVisibleDynamicRitems.size() + mVisibleTransparentRitems.size();
+    UpdateInstanceBuffer(gt);
+    UpdateLightBuffer(gt);
     UpdateMaterialCBs(gt);
-    UpdateMainPassCB(gt);
+    UpdateWaves(gt);
 }
 
 void ShapesApp::Draw(const GameTimer& gt)
 {
+    Profiler::CpuScope drawScope(mProfiler.get(), CpuDraw);
+
     auto cmdListAlloc = mCurrFrameResource->CmdListAlloc;
 
     ThrowIfFailed(cmdListAlloc->Reset());
 
-    if (mIsWireframe)
-    {
-        ThrowIfFailed(mCommandList->Reset(cmdListAlloc.Get(), mPSOs["opaque_wireframe"].Get()));
-    }
-    else
+    UINT bindless = mBindlessEnabled ? 1 : 0;
+    bool depthPrepass = mDepthPrepassEnabled && !mIsWireframe;
+
+    ID3D12PipelineState* const* psos =
+        depthPrepass ? mEqualDepthPsos[bindless] : (mIsWireframe ? mWireframePsos : mFramePsos)[bindless];
+    ID3D12PipelineState* opaquePso = psos[PsoOpaque];
+    ID3D12PipelineState* instancedPso = psos[PsoOpaqueInstanced];
+    ID3D12PipelineState* transparentPso = psos[PsoTransparent];
+
+    auto submit = [](ID3D12CommandQueue* queue, ID3D12GraphicsCommandList* cmdList)
+        {
+            ThrowIfFailed(cmdList->Close());
+            ID3D12CommandList* cmdLists[] = { cmdList };
+            queue->ExecuteCommandLists(_countof(cmdLists), cmdLists);
+        };
+
+    // The compute passes go into this list: the compute queue's with async
+    // compute, the direct one otherwise.
+    bool asyncCompute = mAsyncComputeEnabled;
+    ID3D12GraphicsCommandList* computeList = mCommandList.Get();
+    ID3D12CommandAllocator* computeAlloc = mCurrFrameResource->ComputeCmdListAlloc.Get();
+
+    if (asyncCompute)
     {
-        ThrowIfFailed(mCommandList->Reset(cmdListAlloc.Get(), mPSOs["opaque"].Get()));
+        ThrowIfFailed(computeAlloc->Reset());
+        ThrowIfFailed(mComputeCmdList->Reset(computeAlloc, nullptr));
+        computeList = mComputeCmdList.Get();
+
+        // The previous frame reads the water and the cluster lists up to its end.
+        ComputeWaitForDirect();
     }
 
-    mCommandList->RSSetViewports(1, &mScreenViewport);
-    mCommandList->RSSetScissorRects(1, &mScissorRect);
+    // The direct list being recorded.  Lists sharing the frame's allocator
+    // take turns: each is closed before the next is reset.
+    ID3D12GraphicsCommandList* directList = asyncCompute ? mPreSceneCmdLists[0].Get() : mCommandList.Get();
+    ThrowIfFailed(directList->Reset(cmdListAlloc.Get(), opaquePso));
 
-    mCommandList->ResourceBarrier(1, &CD3DX12_RESOURCE_BARRIER::Transition(
-        CurrentBackBuffer(),
-        D3D12_RESOURCE_STATE_PRESENT,
-        D3D12_RESOURCE_STATE_RENDER_TARGET));
+    mProfiler->BeginGpuScope(directList, GpuFrame);
 
-    mCommandList->ClearRenderTargetView(CurrentBackBufferView(), Colors::LightSteelBlue, 0, nullptr);
-    mCommandList->ClearDepthStencilView(
+    mProfiler->BeginGpuScope(computeList, GpuWaves);
+    RecordWaves(computeList);
+    mProfiler->EndGpuScope(computeList, GpuWaves);
+
+    mProfiler->BeginGpuScope(computeList, GpuLightCulling);
+    RecordLightCulling(computeList);
+    mProfiler->EndGpuScope(computeList, GpuLightCulling);
+
+    // Nothing in the direct frame has to run first.
+    if (asyncCompute)
+        submit(mComputeQueue.Get(), mComputeCmdList.Get());
+
+    // With dynamic resolution the back buffer only gets the upscaled scene at
+    // the end of the frame.
+    D3D12_RESOURCE_BARRIER toRenderTarget[] =
+    {
+        CD3DX12_RESOURCE_BARRIER::Transition(CurrentBackBuffer(),
+            D3D12_RESOURCE_STATE_PRESENT, D3D12_RESOURCE_STATE_RENDER_TARGET),
+        CD3DX12_RESOURCE_BARRIER::Transition(mSceneColor.Get(),
+            D3D12_RESOURCE_STATE_PIXEL_SHADER_RESOURCE, D3D12_RESOURCE_STATE_RENDER_TARGET)
+    };
+    directList->ResourceBarrier(mUpscaleThisFrame ? 2 : 1, toRenderTarget);
+
+    directList->ClearRenderTargetView(SceneColorView(), Colors::LightSteelBlue, 0, nullptr);
+    directList->ClearDepthStencilView(
         DepthStencilView(),
         D3D12_CLEAR_FLAG_DEPTH | D3D12_CLEAR_FLAG_STENCIL,
         1.0f,
@@ -238,330 +1163,1636 @@ void ShapesApp::Draw(const GameTimer& gt)
         0,
         nullptr);
 
-    mCommandList->OMSetRenderTargets(1, &CurrentBackBufferView(), true, &DepthStencilView());
+    // The occluders stay in the depth buffer for the scene pass.  With async
+    // compute the pyramid is built while the shadow pass runs.
+    bool occlusion = mGpuDrivenEnabled && mOcclusionCullingEnabled && mHiZBuffer != nullptr;
+    if (occlusion)
+    {
+        mProfiler->BeginGpuScope(directList, GpuOcclusion);
+        RecordOccluderPrepass(directList);
+        mProfiler->EndGpuScope(directList, GpuOcclusion);
 
-    ID3D12DescriptorHeap* descriptorHeaps[] = { mSrvDescriptorHeap.Get() };
-    mCommandList->SetDescriptorHeaps(_countof(descriptorHeaps), descriptorHeaps);
+        auto toRead = CD3DX12_RESOURCE_BARRIER::Transition(mDepthStencilBuffer.Get(),
+            D3D12_RESOURCE_STATE_DEPTH_WRITE, D3D12_RESOURCE_STATE_NON_PIXEL_SHADER_RESOURCE);
+        directList->ResourceBarrier(1, &toRead);
 
-    mCommandList->SetGraphicsRootSignature(mRootSignature.Get());
+        if (asyncCompute)
+        {
+            ThrowIfFailed(directList->Close());
+            directList = mPreSceneCmdLists[1].Get();
+            ThrowIfFailed(directList->Reset(cmdListAlloc.Get(), opaquePso));
 
-    ID3D12Resource* passCB = mCurrFrameResource->PassCB->Resource();
-    mCommandList->SetGraphicsRootConstantBufferView(2, passCB->GetGPUVirtualAddress());
+            // A submitted list can be reset at once; only its allocator has to
+            // wait for the GPU.
+            ThrowIfFailed(mComputeCmdList->Reset(computeAlloc, nullptr));
+        }
 
-    DrawRenderItems(mCommandList.Get(), mOpaqueRitems);
+        mProfiler->BeginGpuScope(computeList, GpuHiZ);
+        RecordHiZ(computeList);
+        mProfiler->EndGpuScope(computeList, GpuHiZ);
 
-    mCommandList->SetPipelineState(mPSOs["transparent"].Get());
-    DrawRenderItems(mCommandList.Get(), mTransparentRitems);
+        if (asyncCompute)
+            ThrowIfFailed(mComputeCmdList->Close());
+    }
 
-    mCommandList->ResourceBarrier(1, &CD3DX12_RESOURCE_BARRIER::Transition(
-        CurrentBackBuffer(),
-        D3D12_RESOURCE_STATE_RENDER_TARGET,
-        D3D12_RESOURCE_STATE_PRESENT));
+    mProfiler->BeginGpuScope(directList, GpuShadows);
+    RecordShadowPass(directList);
+    mProfiler->EndGpuScope(directList, GpuShadows);
 
-    ThrowIfFailed(mCommandList->Close());
+    if (asyncCompute)
+    {
+        ThrowIfFailed(directList->Close());
+        ThrowIfFailed(mCommandList->Reset(cmdListAlloc.Get(), opaquePso));
+    }
 
-    ID3D12CommandList* cmdsLists[] = { mCommandList.Get() };
-    mCommandQueue->ExecuteCommandLists(_countof(cmdsLists), cmdsLists);
+    if (occlusion)
+    {
+        auto toWrite = CD3DX12_RESOURCE_BARRIER::Transition(mDepthStencilBuffer.Get(),
+            D3D12_RESOURCE_STATE_NON_PIXEL_SHADER_RESOURCE, D3D12_RESOURCE_STATE_DEPTH_WRITE);
+        mCommandList->ResourceBarrier(1, &toWrite);
+    }
 
-    ThrowIfFailed(mSwapChain->Present(0, 0));
-    mCurrBackBuffer = (mCurrBackBuffer + 1) % SwapChainBufferCount;
+    if (mGpuDrivenEnabled)
+    {
+        mProfiler->BeginGpuScope(mCommandList.Get(), GpuDrawCulling);
+        RecordDrawCulling(mCommandList.Get(), occlusion);
+        mProfiler->EndGpuScope(mCommandList.Get(), GpuDrawCulling);
+    }
 
-    mCurrFrameResource->Fence = ++mCurrentFence;
-    mCommandQueue->Signal(mFence.Get(), mCurrentFence);
+    // Recorded on this thread in one go: every opaque item's depth has to be
+    // in before any part of the scene pass shades against it.
+    if (depthPrepass)
+    {
+        mProfiler->BeginGpuScope(mCommandList.Get(), GpuDepthPrepass);
+        RecordDepthPrepass(mCommandList.Get(), mDepthPrepassPsos[bindless]);
+        mProfiler->EndGpuScope(mCommandList.Get(), GpuDepthPrepass);
+    }
 
-}
+    // Ends in RecordEndOfFrame, which may be in another list.
+    mProfiler->BeginGpuScope(mCommandList.Get(), GpuScene);
 
-void ShapesApp::OnMouseDown(WPARAM btnState, int x, int y)
-{
-    mLastMousePos.x = x;
-    mLastMousePos.y = y;
-    SetCapture(mhMainWnd);
-}
+    mSubmitCmdLists.clear();
+    mSubmitCmdLists.push_back(mCommandList.Get());
 
-void ShapesApp::OnMouseUp(WPARAM btnState, int x, int y)
-{
-    ReleaseCapture();
-}
+    // The GPU-driven pass is a handful of commands, not worth splitting up.
+    if (mParallelRecordingEnabled && !mGpuDrivenEnabled)
+    {
+        // The main list only holds the passes before the scene.  Each
+        // worker records a slice of the scene into its own list, and the lists
+        // run in submission order, so the last one also draws the transparent
+        // items and ends the frame.
+        ThrowIfFailed(mCommandList->Close());
 
-void ShapesApp::OnMouseMove(WPARAM btnState, int x, int y)
-{
-    if ((btnState & MK_LBUTTON) != 0)
+        UINT workerCount = (UINT)mCurrFrameResource->WorkerCmdLists.size();
+
+        mWorkerPool->ParallelFor(workerCount, [&](unsigned worker)
+            {
+                auto alloc = mCurrFrameResource->WorkerCmdListAllocs[worker].Get();
+                auto cmdList = mCurrFrameResource->WorkerCmdLists[worker].Get();
+
+                ThrowIfFailed(alloc->Reset());
+                ThrowIfFailed(cmdList->Reset(alloc, opaquePso));
+
+                RecordScenePass(cmdList, opaquePso, instancedPso, transparentPso, worker, workerCount);
+
+                if (worker == workerCount - 1)
+                    RecordEndOfFrame(cmdList);
+
+                ThrowIfFailed(cmdList->Close());
+            });
+
+        for (auto& cmdList : mCurrFrameResource->WorkerCmdLists)
+            mSubmitCmdLists.push_back(cmdList.Get());
+    }
+    else
     {
-        float dx = XMConvertToRadians(0.25f * static_cast<float>(x - mLastMousePos.x));
-        float dy = XMConvertToRadians(0.25f * static_cast<float>(y - mLastMousePos.y));
+        RecordScenePass(mCommandList.Get(), opaquePso, instancedPso, transparentPso, 0, 1);
+        RecordEndOfFrame(mCommandList.Get());
 
-        mCamera.Pitch(dy);
-        mCamera.RotateY(dx);
+        ThrowIfFailed(mCommandList->Close());
     }
 
-    mLastMousePos.x = x;
-    mLastMousePos.y = y;
-}
+    if (asyncCompute)
+    {
+        ID3D12CommandList* preScene[] = { mPreSceneCmdLists[0].Get() };
+        mCommandQueue->ExecuteCommandLists(1, preScene);
 
-void ShapesApp::OnKeyboardInput(const GameTimer& gt)
-{
-    float dt = gt.DeltaTime();
+        // The pyramid is built from the occluders while the shadows are drawn.
+        if (occlusion)
+        {
+            ComputeWaitForDirect();
 
-    if (GetAsyncKeyState('1') & 0x8000)
-        mIsWireframe = true;
-    else
-        mIsWireframe = false;
+            ID3D12CommandList* hiZ[] = { mComputeCmdList.Get() };
+            mComputeQueue->ExecuteCommandLists(1, hiZ);
 
-    XMFLOAT3 oldPos = mCamera.GetPosition3f();
+            ID3D12CommandList* shadows[] = { mPreSceneCmdLists[1].Get() };
+            mCommandQueue->ExecuteCommandLists(1, shadows);
+        }
 
-    if (GetAsyncKeyState('W') & 0x8000)
-        mCamera.Walk(6.0f * dt);
+        // Everything from here on reads what the compute passes wrote.
+        DirectWaitForCompute();
+    }
 
-    if (GetAsyncKeyState('S') & 0x8000)
-        mCamera.Walk(-6.0f * dt);
+    mCommandQueue->ExecuteCommandLists((UINT)mSubmitCmdLists.size(), mSubmitCmdLists.data());
 
-    if (GetAsyncKeyState('A') & 0x8000)
-        mCamera.Strafe(-6.0f * dt);
+    ThrowIfFailed(mSwapChain->Present(0, 0));
+    mCurrBackBuffer = (mCurrBackBuffer + 1) % SwapChainBufferCount;
 
-    if (GetAsyncKeyState('D') & 0x8000)
-        mCamera.Strafe(6.0f * dt);
+    mCurrFrameResource->Fence = ++mCurrentFence;
+    mCommandQueue->Signal(mFence.Get(), mCurrentFence);
 
-    XMFLOAT3 newPos = mCamera.GetPosition3f();
+    // Staging memory allocated while recording this frame is free once the
+    // GPU passes this fence.
+    mUploadRing->Retire(mCurrentFence);
 
-    if (CheckCollision(newPos, mCollisionRadius))
-    {
-        mCamera.SetPosition(oldPos.x, oldPos.y, oldPos.z);
-    }
 }
 
+void ShapesApp::RecordWaves(ID3D12GraphicsCommandList* cmdList)
+{
+    if (mWaveStepCount == 0)
+        return;
 
+    cmdList->SetComputeRootSignature(mWavesRootSignature.Get());
+    cmdList->SetComputeRoot32BitConstants(0, sizeof(WaveConstants) / 4, &mWaveConstants, 0);
 
-bool ShapesApp::CheckCollision(const DirectX::XMFLOAT3& position, float radius)
-{
-    XMVECTOR pos = XMLoadFloat3(&position);
+    ID3D12Resource* vertexBuffer = mGeometries["waterGeo"]->VertexBufferGPU.Get();
+    cmdList->SetComputeRootUnorderedAccessView(3, vertexBuffer->GetGPUVirtualAddress());
+
+    auto bindHeights = [&]()
+        {
+            cmdList->SetComputeRootUnorderedAccessView(1, mWaveHeights[1 - mWaveCurrent]->GetGPUVirtualAddress());
+            cmdList->SetComputeRootUnorderedAccessView(2, mWaveHeights[mWaveCurrent]->GetGPUVirtualAddress());
+        };
+
+    UINT groupsX = (gWaveColumnCount + 15) / 16;
+    UINT groupsY = (gWaveRowCount + 15) / 16;
+
+    // The buffers rest in the common state and are promoted to unordered
+    // access by their first use here.
+    bindHeights();
+    if (mWaveDisturb)
+    {
+        cmdList->SetPipelineState(mPSOs["wavesDisturb"].Get());
+        cmdList->Dispatch(1, 1, 1);
+
+        auto uavBarrier = CD3DX12_RESOURCE_BARRIER::UAV(nullptr);
+        cmdList->ResourceBarrier(1, &uavBarrier);
+    }
 
-    for (const auto& box : mMazeWallBounds)
+    cmdList->SetPipelineState(mPSOs["wavesUpdate"].Get());
+    for (UINT step = 0; step < mWaveStepCount; ++step)
     {
-        XMVECTOR boxCenter = XMLoadFloat3(&box.Center);
-        XMVECTOR boxExtents = XMLoadFloat3(&box.Extents);
+        bindHeights();
+        cmdList->Dispatch(groupsX, groupsY, 1);
+
+        auto uavBarrier = CD3DX12_RESOURCE_BARRIER::UAV(nullptr);
+        cmdList->ResourceBarrier(1, &uavBarrier);
 
-        XMVECTOR closestPoint = XMVectorClamp(
-            pos,
-            XMVectorSubtract(boxCenter, boxExtents),
-            XMVectorAdd(boxCenter, boxExtents));
+        mWaveCurrent = 1 - mWaveCurrent;
+    }
 
-        XMVECTOR delta = XMVectorSubtract(closestPoint, pos);
-        float distance = XMVectorGetX(XMVector3Length(delta));
+    bindHeights();
+    cmdList->SetPipelineState(mPSOs["wavesVertices"].Get());
+    cmdList->Dispatch(groupsX, groupsY, 1);
 
-        if (distance < radius)
-            return true;
+    // Like the cluster lists, the vertices only need a transition when they
+    // are drawn from in this same list.
+    if (cmdList->GetType() == D3D12_COMMAND_LIST_TYPE_DIRECT)
+    {
+        auto toVertices = CD3DX12_RESOURCE_BARRIER::Transition(vertexBuffer,
+            D3D12_RESOURCE_STATE_UNORDERED_ACCESS, D3D12_RESOURCE_STATE_VERTEX_AND_CONSTANT_BUFFER);
+        cmdList->ResourceBarrier(1, &toVertices);
     }
 
-    return false;
+    mWaveStepCount = 0;
+    mWaveDisturb = false;
 }
 
-void ShapesApp::UpdateObjectCBs(const GameTimer& gt)
+void ShapesApp::RecordLightCulling(ID3D12GraphicsCommandList* cmdList)
 {
-    auto currObjectCB = mCurrFrameResource->ObjectCB.get();
+    cmdList->SetComputeRootSignature(mLightCullRootSignature.Get());
+    cmdList->SetPipelineState(mPSOs["lightCull"].Get());
 
-    for (auto& e : mAllRitems)
+    ID3D12Resource* passCB = mCurrFrameResource->PassCB->Resource();
+    ID3D12Resource* lightBuffer = mCurrFrameResource->LightBuffer->Resource();
+    cmdList->SetComputeRootConstantBufferView(0, passCB->GetGPUVirtualAddress());
+    cmdList->SetComputeRootShaderResourceView(1, lightBuffer->GetGPUVirtualAddress());
+    cmdList->SetComputeRootUnorderedAccessView(2, mClusterLightCounts->GetGPUVirtualAddress());
+    cmdList->SetComputeRootUnorderedAccessView(3, mClusterLightIndices->GetGPUVirtualAddress());
+
+    UINT clusterCount = gClusterCountX * gClusterCountY * gClusterCountZ;
+    cmdList->Dispatch((clusterCount + 63) / 64, 1, 1);
+
+    // The buffers are promoted out of the common state and decay back into it
+    // once the list has run.  On the compute queue that is all, since the
+    // direct queue promotes them again; in line they are read in this list.
+    if (cmdList->GetType() == D3D12_COMMAND_LIST_TYPE_DIRECT)
     {
-        if (e->NumFramesDirty > 0)
+        D3D12_RESOURCE_BARRIER barriers[] =
         {
-            XMMATRIX world = XMLoadFloat4x4(&e->World);
-
-            ObjectConstants objConstants;
-            XMStoreFloat4x4(&objConstants.World, XMMatrixTranspose(world));
-
-            currObjectCB->CopyData(e->ObjCBIndex, objConstants);
-            e->NumFramesDirty--;
-        }
+            CD3DX12_RESOURCE_BARRIER::Transition(mClusterLightCounts.Get(),
+                D3D12_RESOURCE_STATE_UNORDERED_ACCESS, D3D12_RESOURCE_STATE_PIXEL_SHADER_RESOURCE),
+            CD3DX12_RESOURCE_BARRIER::Transition(mClusterLightIndices.Get(),
+                D3D12_RESOURCE_STATE_UNORDERED_ACCESS, D3D12_RESOURCE_STATE_PIXEL_SHADER_RESOURCE)
+        };
+        cmdList->ResourceBarrier(_countof(barriers), barriers);
     }
 }
 
-void ShapesApp::UpdateMainPassCB(const GameTimer& gt)
+void ShapesApp::RecordShadowPass(ID3D12GraphicsCommandList* cmdList)
 {
-    XMMATRIX view = mCamera.GetView();
-    XMMATRIX proj = mCamera.GetProj();
+    bool redrawStatic = !mShadowCacheEnabled;
+    for (const auto& cascade : mShadowCascades)
+        redrawStatic = redrawStatic || cascade.StaticDirty;
 
-    XMMATRIX viewProj = XMMatrixMultiply(view, proj);
-    XMMATRIX invView = XMMatrixInverse(&XMMatrixDeterminant(view), view);
-    XMMATRIX invProj = XMMatrixInverse(&XMMatrixDeterminant(proj), proj);
-    XMMATRIX invViewProj = XMMatrixInverse(&XMMatrixDeterminant(viewProj), viewProj);
+    // With nothing moving, one clear leaves the dynamic map alone after that.
+    bool redrawDynamic = !mDynamicCasterRitems.empty() || !mDynamicShadowMapClear;
 
-    XMStoreFloat4x4(&mMainPassCB.View, XMMatrixTranspose(view));
-    XMStoreFloat4x4(&mMainPassCB.InvView, XMMatrixTranspose(invView));
-    XMStoreFloat4x4(&mMainPassCB.Proj, XMMatrixTranspose(proj));
-    XMStoreFloat4x4(&mMainPassCB.InvProj, XMMatrixTranspose(invProj));
-    XMStoreFloat4x4(&mMainPassCB.ViewProj, XMMatrixTranspose(viewProj));
-    XMStoreFloat4x4(&mMainPassCB.InvViewProj, XMMatrixTranspose(invViewProj));
+    if (!redrawStatic && !redrawDynamic)
+        return;
 
-    mMainPassCB.EyePosW = mCamera.GetPosition3f();
-    mMainPassCB.RenderTargetSize = XMFLOAT2((float)mClientWidth, (float)mClientHeight);
-    mMainPassCB.InvRenderTargetSize = XMFLOAT2(1.0f / mClientWidth, 1.0f / mClientHeight);
-    mMainPassCB.NearZ = 1.0f;
-    mMainPassCB.FarZ = 1000.0f;
-    mMainPassCB.TotalTime = gt.TotalTime();
-    mMainPassCB.DeltaTime = gt.DeltaTime();
+    D3D12_VIEWPORT viewport = { 0.0f, 0.0f, (float)gShadowMapSize, (float)gShadowMapSize, 0.0f, 1.0f };
+    D3D12_RECT scissorRect = { 0, 0, (LONG)gShadowMapSize, (LONG)gShadowMapSize };
+    cmdList->RSSetViewports(1, &viewport);
+    cmdList->RSSetScissorRects(1, &scissorRect);
 
-    mMainPassCB.AmbientLight = XMFLOAT4(0.12f, 0.12f, 0.16f, 1.0f);
+    cmdList->SetGraphicsRootSignature(mShadowRootSignature.Get());
+    cmdList->SetPipelineState(mPSOs["shadow"].Get());
 
-    // Main directional light
-    mMainPassCB.Lights[0].Direction = { 0.577f, -0.577f, 0.577f };
-    mMainPassCB.Lights[0].Strength = { 0.75f, 0.72f, 0.68f };
-
-    // Red point light
-    mMainPassCB.Lights[1].Position = { -7.0f, 2.2f, -5.0f };
-    mMainPassCB.Lights[1].Strength = { 1.0f, 0.2f, 0.2f };
-    mMainPassCB.Lights[1].FalloffStart = 1.0f;
-    mMainPassCB.Lights[1].FalloffEnd = 10.0f;
-
-    // Blue point light
-    mMainPassCB.Lights[2].Position = { 7.0f, 2.2f, -5.0f };
-    mMainPassCB.Lights[2].Strength = { 0.2f, 0.4f, 1.0f };
-    mMainPassCB.Lights[2].FalloffStart = 1.0f;
-    mMainPassCB.Lights[2].FalloffEnd = 10.0f;
-
-    // Purple point light
-    mMainPassCB.Lights[3].Position = { -7.0f, 2.2f, 5.0f };
-    mMainPassCB.Lights[3].Strength = { 0.8f, 0.2f, 1.0f };
-    mMainPassCB.Lights[3].FalloffStart = 1.0f;
-    mMainPassCB.Lights[3].FalloffEnd = 10.0f;
-
-    // Cyan point light
-    mMainPassCB.Lights[4].Position = { 7.0f, 2.2f, 5.0f };
-    mMainPassCB.Lights[4].Strength = { 0.2f, 1.0f, 1.0f };
-    mMainPassCB.Lights[4].FalloffStart = 1.0f;
-    mMainPassCB.Lights[4].FalloffEnd = 10.0f;
+    ID3D12Resource* objectCB = mCurrFrameResource->ObjectCB->Resource();
+    cmdList->SetGraphicsRootShaderResourceView(1, objectCB->GetGPUVirtualAddress());
 
-    // STRONG WHITE LIGHT (torus center highlight)
-    mMainPassCB.Lights[5].Position = { 0.0f, 2.8f, 0.0f };
-    mMainPassCB.Lights[5].Strength = { 2.5f, 2.5f, 2.5f };
-    mMainPassCB.Lights[5].FalloffStart = 0.5f;
-    mMainPassCB.Lights[5].FalloffEnd = 4.0f;
-    auto currPassCB = mCurrFrameResource->PassCB.get();
+    // The DSVs follow the depth buffer's, static cascades first.
+    auto drawMap = [&](ID3D12Resource* map, UINT firstDsv, const std::vector<RenderItem*>& ritems, bool isStatic)
+        {
+            auto toWrite = CD3DX12_RESOURCE_BARRIER::Transition(map,
+                D3D12_RESOURCE_STATE_PIXEL_SHADER_RESOURCE, D3D12_RESOURCE_STATE_DEPTH_WRITE);
+            cmdList->ResourceBarrier(1, &toWrite);
 
-    // Maze corner lights
-    mMainPassCB.Lights[6].Position = { -28.0f, 3.0f, -43.0f };
-    mMainPassCB.Lights[6].Strength = { 1.0f, 0.2f, 0.2f };   // red
-    mMainPassCB.Lights[6].FalloffStart = 1.0f;
-    mMainPassCB.Lights[6].FalloffEnd = 18.0f;
-
-    mMainPassCB.Lights[7].Position = { 20.0f, 3.0f, -43.0f };
-    mMainPassCB.Lights[7].Strength = { 0.2f, 0.4f, 1.0f };   // blue
-    mMainPassCB.Lights[7].FalloffStart = 1.0f;
-    mMainPassCB.Lights[7].FalloffEnd = 18.0f;
-
-    mMainPassCB.Lights[8].Position = { -28.0f, 3.0f, 5.0f };
-    mMainPassCB.Lights[8].Strength = { 0.8f, 0.2f, 1.0f };   // purple
-    mMainPassCB.Lights[8].FalloffStart = 1.0f;
-    mMainPassCB.Lights[8].FalloffEnd = 18.0f;
-
-    mMainPassCB.Lights[9].Position = { 20.0f, 3.0f, 5.0f };
-    mMainPassCB.Lights[9].Strength = { 0.2f, 1.0f, 1.0f };   // cyan
-    mMainPassCB.Lights[9].FalloffStart = 1.0f;
-    mMainPassCB.Lights[9].FalloffEnd = 18.0f;
+            for (UINT i = 0; i < gShadowCascadeCount; ++i)
+            {
+                ShadowCascade& cascade = mShadowCascades[i];
+                if (isStatic && mShadowCacheEnabled && !cascade.StaticDirty)
+                    continue;
+
+                CD3DX12_CPU_DESCRIPTOR_HANDLE dsv(
+                    mDsvHeap->GetCPUDescriptorHandleForHeapStart(), firstDsv + i, mDsvDescriptorSize);
+                cmdList->ClearDepthStencilView(dsv, D3D12_CLEAR_FLAG_DEPTH, 1.0f, 0, 0, nullptr);
+                cmdList->OMSetRenderTargets(0, nullptr, false, &dsv);
+
+                // The static maps are kept, so they take the finest level
+                // rather than whatever the camera picked this frame.
+                DrawShadowCasters(cmdList, cascade, ritems, isStatic);
+
+                if (isStatic)
+                {
+                    cascade.StaticDirty = false;
+                    ++mShadowCascadeRedraws;
+                }
+            }
+
+            auto toRead = CD3DX12_RESOURCE_BARRIER::Transition(map,
+                D3D12_RESOURCE_STATE_DEPTH_WRITE, D3D12_RESOURCE_STATE_PIXEL_SHADER_RESOURCE);
+            cmdList->ResourceBarrier(1, &toRead);
+        };
+
+    if (redrawStatic)
+        drawMap(mStaticShadowMap.Get(), 1, mStaticCasterRitems, true);
+
+    if (redrawDynamic)
+    {
+        drawMap(mDynamicShadowMap.Get(), 1 + gShadowCascadeCount, mDynamicCasterRitems, false);
+        mDynamicShadowMapClear = mDynamicCasterRitems.empty();
+    }
+}
+
+void ShapesApp::DrawShadowCasters(ID3D12GraphicsCommandList* cmdList, const ShadowCascade& cascade, const std::vector<RenderItem*>& ritems, bool finestLod)
+{
+    XMFLOAT4X4 viewProj;
+    XMStoreFloat4x4(&viewProj, XMMatrixTranspose(XMLoadFloat4x4(&cascade.ViewProj)));
+    cmdList->SetGraphicsRoot32BitConstants(0, 16, &viewProj, 0);
+
+    // Same redundant state filtering as DrawRenderItems.
+    MeshGeometry* currGeo = nullptr;
+    D3D12_PRIMITIVE_TOPOLOGY currTopology = D3D_PRIMITIVE_TOPOLOGY_UNDEFINED;
+    UINT64 drawCalls = 0;
+
+    for (auto ri : ritems)
+    {
+        if (!cascade.Bounds.Intersects(ri->WorldBounds))
+            continue;
+
+        if (ri->Geo != currGeo)
+        {
+            auto vbv = ri->Geo->VertexBufferView();
+            auto ibv = ri->Geo->IndexBufferView();
+            cmdList->IASetVertexBuffers(0, 1, &vbv);
+            cmdList->IASetIndexBuffer(&ibv);
+            currGeo = ri->Geo;
+        }
+
+        if (ri->PrimitiveType != currTopology)
+        {
+            cmdList->IASetPrimitiveTopology(ri->PrimitiveType);
+            currTopology = ri->PrimitiveType;
+        }
+
+        cmdList->SetGraphicsRoot32BitConstant(0, ri->ObjCBIndex, 16);
+
+        const SubmeshGeometry& submesh = ri->Lods[finestLod ? 0 : ri->Lod];
+        cmdList->DrawIndexedInstanced(submesh.IndexCount, 1, submesh.StartIndexLocation, submesh.BaseVertexLocation, 0);
+        ++drawCalls;
+    }
+
+    mDrawCallCount += drawCalls;
+}
+
+void ShapesApp::RecordOccluderPrepass(ID3D12GraphicsCommandList* cmdList)
+{
+    cmdList->RSSetViewports(1, &mSceneViewport);
+    cmdList->RSSetScissorRects(1, &mSceneScissorRect);
+
+    D3D12_CPU_DESCRIPTOR_HANDLE depthStencilView = DepthStencilView();
+    cmdList->OMSetRenderTargets(0, nullptr, false, &depthStencilView);
+
+    // Depth only: the vertex shader needs the pass and the object data, and
+    // DrawRenderItems sets the object index.
+    cmdList->SetGraphicsRootSignature(mBindlessRootSignature.Get());
+
+    ID3D12Resource* passCB = mCurrFrameResource->PassCB->Resource();
+    ID3D12Resource* objectCB = mCurrFrameResource->ObjectCB->Resource();
+    cmdList->SetGraphicsRootConstantBufferView(2, passCB->GetGPUVirtualAddress());
+    cmdList->SetGraphicsRootShaderResourceView(5, objectCB->GetGPUVirtualAddress());
+
+    cmdList->SetPipelineState(mPSOs["depth_bindless"].Get());
+    DrawRenderItems(cmdList, mOccluderRitems, 0, mOccluderRitems.size());
+}
+
+void ShapesApp::RecordHiZ(ID3D12GraphicsCommandList* cmdList)
+{
+    // The caller makes the depth buffer readable: a compute list cannot take
+    // it out of the depth write state.
+    auto toBuild = CD3DX12_RESOURCE_BARRIER::Transition(mHiZBuffer.Get(),
+        D3D12_RESOURCE_STATE_NON_PIXEL_SHADER_RESOURCE, D3D12_RESOURCE_STATE_UNORDERED_ACCESS);
+    cmdList->ResourceBarrier(1, &toBuild);
+
+    ID3D12DescriptorHeap* descriptorHeaps[] = { mSrvDescriptorHeap.Get() };
+    cmdList->SetDescriptorHeaps(_countof(descriptorHeaps), descriptorHeaps);
+
+    cmdList->SetComputeRootSignature(mHiZRootSignature.Get());
+    cmdList->SetPipelineState(mPSOs["hiZ"].Get());
+
+    CD3DX12_GPU_DESCRIPTOR_HANDLE hiZDescriptors(
+        mSrvDescriptorHeap->GetGPUDescriptorHandleForHeapStart(), gHiZDescriptorBase, mCbvSrvUavDescriptorSize);
+
+    // Only the part of the depth buffer the scene was drawn into.
+    UINT srcWidth = mRenderWidth;
+    UINT srcHeight = mRenderHeight;
+
+    // Level 0 copies the depth buffer, each later level reduces the one before,
+    // which is made readable once it has been written.
+    for (UINT mip = 0; mip < mHiZMipCount; ++mip)
+    {
+        UINT dstWidth = MathHelper::Max(mRenderWidth >> mip, 1u);
+        UINT dstHeight = MathHelper::Max(mRenderHeight >> mip, 1u);
+
+        if (mip > 0)
+        {
+            auto toRead = CD3DX12_RESOURCE_BARRIER::Transition(mHiZBuffer.Get(),
+                D3D12_RESOURCE_STATE_UNORDERED_ACCESS, D3D12_RESOURCE_STATE_NON_PIXEL_SHADER_RESOURCE, mip - 1);
+            cmdList->ResourceBarrier(1, &toRead);
+        }
+
+        UINT srcDescriptor = mip == 0 ? 0 : 2 + (mip - 1);
+        UINT dstDescriptor = 2 + gMaxHiZMips + mip;
+
+        UINT sizes[] = { srcWidth, srcHeight, dstWidth, dstHeight };
+        cmdList->SetComputeRoot32BitConstants(0, _countof(sizes), sizes, 0);
+        cmdList->SetComputeRootDescriptorTable(1,
+            CD3DX12_GPU_DESCRIPTOR_HANDLE(hiZDescriptors, srcDescriptor, mCbvSrvUavDescriptorSize));
+        cmdList->SetComputeRootDescriptorTable(2,
+            CD3DX12_GPU_DESCRIPTOR_HANDLE(hiZDescriptors, dstDescriptor, mCbvSrvUavDescriptorSize));
+
+        cmdList->Dispatch((dstWidth + 7) / 8, (dstHeight + 7) / 8, 1);
+
+        srcWidth = dstWidth;
+        srcHeight = dstHeight;
+    }
+
+    auto afterBuild = CD3DX12_RESOURCE_BARRIER::Transition(mHiZBuffer.Get(),
+        D3D12_RESOURCE_STATE_UNORDERED_ACCESS, D3D12_RESOURCE_STATE_NON_PIXEL_SHADER_RESOURCE, mHiZMipCount - 1);
+    cmdList->ResourceBarrier(1, &afterBuild);
+}
+
+void ShapesApp::RecordDrawCulling(ID3D12GraphicsCommandList* cmdList, bool occlusion)
+{
+    // Restart the draw count; the culling pass appends to the argument buffer.
+    auto toCopy = CD3DX12_RESOURCE_BARRIER::Transition(mDrawCount.Get(),
+        D3D12_RESOURCE_STATE_INDIRECT_ARGUMENT, D3D12_RESOURCE_STATE_COPY_DEST);
+    cmdList->ResourceBarrier(1, &toCopy);
+
+    cmdList->CopyBufferRegion(mDrawCount.Get(), 0, mDrawCountReset.Get(), 0, sizeof(UINT));
+
+    D3D12_RESOURCE_BARRIER toUav[] =
+    {
+        CD3DX12_RESOURCE_BARRIER::Transition(mDrawCount.Get(),
+            D3D12_RESOURCE_STATE_COPY_DEST, D3D12_RESOURCE_STATE_UNORDERED_ACCESS),
+        CD3DX12_RESOURCE_BARRIER::Transition(mVisibleCommands.Get(),
+            D3D12_RESOURCE_STATE_INDIRECT_ARGUMENT, D3D12_RESOURCE_STATE_UNORDERED_ACCESS)
+    };
+    cmdList->ResourceBarrier(_countof(toUav), toUav);
+
+    ID3D12DescriptorHeap* descriptorHeaps[] = { mSrvDescriptorHeap.Get() };
+    cmdList->SetDescriptorHeaps(_countof(descriptorHeaps), descriptorHeaps);
+
+    cmdList->SetComputeRootSignature(mDrawCullRootSignature.Get());
+    cmdList->SetPipelineState(mPSOs["drawCull"].Get());
+
+    // Zero thresholds keep every item at its finest level.
+    float lodCoverage[gMaxLods - 1] = {};
+    if (mLodEnabled)
+        std::copy(std::begin(gLodCoverage), std::end(gLodCoverage), lodCoverage);
+
+    UINT cullConstants[] =
+    {
+        mIndirectCommandCount,
+        mFrustumCullingEnabled ? 1u : 0u,
+        occlusion ? 1u : 0u,
+        mHiZMipCount,
+        mRenderWidth,
+        mRenderHeight,
+        0,
+        0
+    };
+    memcpy(&cullConstants[6], lodCoverage, sizeof(lodCoverage));
+    cmdList->SetComputeRoot32BitConstants(0, _countof(cullConstants), cullConstants, 0);
+
+    ID3D12Resource* passCB = mCurrFrameResource->PassCB->Resource();
+    ID3D12Resource* objectCB = mCurrFrameResource->ObjectCB->Resource();
+    cmdList->SetComputeRootConstantBufferView(1, passCB->GetGPUVirtualAddress());
+    cmdList->SetComputeRootShaderResourceView(2, mIndirectCommands->GetGPUVirtualAddress());
+    cmdList->SetComputeRootShaderResourceView(3, mDrawBounds->GetGPUVirtualAddress());
+    cmdList->SetComputeRootShaderResourceView(4, objectCB->GetGPUVirtualAddress());
+    cmdList->SetComputeRootUnorderedAccessView(5, mVisibleCommands->GetGPUVirtualAddress());
+    cmdList->SetComputeRootUnorderedAccessView(6, mDrawCount->GetGPUVirtualAddress());
+
+    // Only read with occlusion on, but the table is bound either way.
+    CD3DX12_GPU_DESCRIPTOR_HANDLE hiZSrv(
+        mSrvDescriptorHeap->GetGPUDescriptorHandleForHeapStart(), gHiZDescriptorBase + 1, mCbvSrvUavDescriptorSize);
+    cmdList->SetComputeRootDescriptorTable(7, hiZSrv);
+
+    cmdList->Dispatch((mIndirectCommandCount + 63) / 64, 1, 1);
+
+    D3D12_RESOURCE_BARRIER toIndirect[] =
+    {
+        CD3DX12_RESOURCE_BARRIER::Transition(mDrawCount.Get(),
+            D3D12_RESOURCE_STATE_UNORDERED_ACCESS, D3D12_RESOURCE_STATE_INDIRECT_ARGUMENT),
+        CD3DX12_RESOURCE_BARRIER::Transition(mVisibleCommands.Get(),
+            D3D12_RESOURCE_STATE_UNORDERED_ACCESS, D3D12_RESOURCE_STATE_INDIRECT_ARGUMENT)
+    };
+    cmdList->ResourceBarrier(_countof(toIndirect), toIndirect);
+}
+
+void ShapesApp::RecordScenePass(
+    ID3D12GraphicsCommandList* cmdList,
+    ID3D12PipelineState* opaquePso,
+    ID3D12PipelineState* instancedPso,
+    ID3D12PipelineState* transparentPso,
+    UINT part,
+    UINT partCount)
+{
+    // Command lists do not inherit state from each other, so every part sets up
+    // the full pass before drawing its share of the opaque items.
+    cmdList->RSSetViewports(1, &mSceneViewport);
+    cmdList->RSSetScissorRects(1, &mSceneScissorRect);
+
+    D3D12_CPU_DESCRIPTOR_HANDLE sceneColorView = SceneColorView();
+    D3D12_CPU_DESCRIPTOR_HANDLE depthStencilView = DepthStencilView();
+    cmdList->OMSetRenderTargets(1, &sceneColorView, true, &depthStencilView);
+
+    ID3D12DescriptorHeap* descriptorHeaps[] = { mSrvDescriptorHeap.Get() };
+    cmdList->SetDescriptorHeaps(_countof(descriptorHeaps), descriptorHeaps);
+
+    CD3DX12_GPU_DESCRIPTOR_HANDLE shadowMaps(
+        mSrvDescriptorHeap->GetGPUDescriptorHandleForHeapStart(), gShadowDescriptorBase, mCbvSrvUavDescriptorSize);
+
+    if (mBindlessEnabled)
+    {
+        // One table over the whole heap, and the buffers the per-draw indices
+        // point into, stay bound for the entire pass.
+        cmdList->SetGraphicsRootSignature(mBindlessRootSignature.Get());
+        cmdList->SetGraphicsRootDescriptorTable(0, mSrvDescriptorHeap->GetGPUDescriptorHandleForHeapStart());
+
+        ID3D12Resource* materialCB = mCurrFrameResource->MaterialCB->Resource();
+        ID3D12Resource* objectCB = mCurrFrameResource->ObjectCB->Resource();
+        cmdList->SetGraphicsRootShaderResourceView(3, materialCB->GetGPUVirtualAddress());
+        cmdList->SetGraphicsRootShaderResourceView(5, objectCB->GetGPUVirtualAddress());
+    }
+    else
+    {
+        cmdList->SetGraphicsRootSignature(mRootSignature.Get());
+    }
+
+    ID3D12Resource* passCB = mCurrFrameResource->PassCB->Resource();
+    cmdList->SetGraphicsRootConstantBufferView(2, passCB->GetGPUVirtualAddress());
+    cmdList->SetGraphicsRoot32BitConstants(9, sizeof(FrameConstants) / 4, &mFrameConstants, 0);
+    cmdList->SetGraphicsRootDescriptorTable(10, shadowMaps);
+
+    ID3D12Resource* lightBuffer = mCurrFrameResource->LightBuffer->Resource();
+    cmdList->SetGraphicsRootShaderResourceView(6, lightBuffer->GetGPUVirtualAddress());
+    cmdList->SetGraphicsRootShaderResourceView(7, mClusterLightCounts->GetGPUVirtualAddress());
+    cmdList->SetGraphicsRootShaderResourceView(8, mClusterLightIndices->GetGPUVirtualAddress());
+
+    RecordOpaqueDraws(cmdList, opaquePso, instancedPso, part, partCount);
+
+    // Transparent items are blended in order, so they all go into the last part.
+    if (part == partCount - 1)
+    {
+        cmdList->SetPipelineState(transparentPso);
+        DrawRenderItems(cmdList, mVisibleTransparentRitems, 0, mVisibleTransparentRitems.size());
+    }
+}
+
+void ShapesApp::RecordDepthPrepass(ID3D12GraphicsCommandList* cmdList, ID3D12PipelineState* const* psos)
+{
+    cmdList->RSSetViewports(1, &mSceneViewport);
+    cmdList->RSSetScissorRects(1, &mSceneScissorRect);
+
+    D3D12_CPU_DESCRIPTOR_HANDLE depthStencilView = DepthStencilView();
+    cmdList->OMSetRenderTargets(0, nullptr, false, &depthStencilView);
+
+    // The per-draw bindings of DrawRenderItems include a texture table without
+    // bindless, so the heap is needed even though nothing is sampled.
+    ID3D12DescriptorHeap* descriptorHeaps[] = { mSrvDescriptorHeap.Get() };
+    cmdList->SetDescriptorHeaps(_countof(descriptorHeaps), descriptorHeaps);
+
+    if (mBindlessEnabled)
+    {
+        cmdList->SetGraphicsRootSignature(mBindlessRootSignature.Get());
+
+        ID3D12Resource* objectCB = mCurrFrameResource->ObjectCB->Resource();
+        cmdList->SetGraphicsRootShaderResourceView(5, objectCB->GetGPUVirtualAddress());
+    }
+    else
+    {
+        cmdList->SetGraphicsRootSignature(mRootSignature.Get());
+    }
+
+    ID3D12Resource* passCB = mCurrFrameResource->PassCB->Resource();
+    cmdList->SetGraphicsRootConstantBufferView(2, passCB->GetGPUVirtualAddress());
+
+    RecordOpaqueDraws(cmdList, psos[PsoOpaque], psos[PsoOpaqueInstanced], 0, 1);
+}
+
+void ShapesApp::RecordOpaqueDraws(
+    ID3D12GraphicsCommandList* cmdList,
+    ID3D12PipelineState* opaquePso,
+    ID3D12PipelineState* instancedPso,
+    UINT part,
+    UINT partCount)
+{
+    // Parts are split by draw count, which is what the recording cost scales with.
+    if (mGpuDrivenEnabled)
+    {
+        // RecordDrawCulling left the visible items' draws and their number in
+        // the argument buffers; the command signature sets each one's buffers
+        // and draw constants.
+        cmdList->SetPipelineState(opaquePso);
+        cmdList->IASetPrimitiveTopology(D3D_PRIMITIVE_TOPOLOGY_TRIANGLELIST);
+        cmdList->ExecuteIndirect(
+            mCommandSignature.Get(),
+            mIndirectCommandCount,
+            mVisibleCommands.Get(),
+            0,
+            mDrawCount.Get(),
+            0);
+        ++mDrawCallCount;
+    }
+    else if (mInstancingEnabled)
+    {
+        ID3D12Resource* instanceBuffer = mCurrFrameResource->InstanceBuffer->Resource();
+        cmdList->SetGraphicsRootShaderResourceView(4, instanceBuffer->GetGPUVirtualAddress());
+
+        size_t count = mOpaqueBatches.size();
+        cmdList->SetPipelineState(instancedPso);
+        DrawInstanceBatches(cmdList, mOpaqueBatches, count * part / partCount, count * (part + 1) / partCount);
+    }
+    else
+    {
+        size_t count = mVisibleOpaqueRitems.size();
+        cmdList->SetPipelineState(opaquePso);
+        DrawRenderItems(cmdList, mVisibleOpaqueRitems, count * part / partCount, count * (part + 1) / partCount);
+    }
+
+    if (!mVisibleDynamicRitems.empty())
+    {
+        size_t count = mVisibleDynamicRitems.size();
+        cmdList->SetPipelineState(opaquePso);
+        DrawRenderItems(cmdList, mVisibleDynamicRitems, count * part / partCount, count * (part + 1) / partCount);
+    }
+}
+
+void ShapesApp::RecordUpscale(ID3D12GraphicsCommandList* cmdList)
+{
+    auto toRead = CD3DX12_RESOURCE_BARRIER::Transition(mSceneColor.Get(),
+        D3D12_RESOURCE_STATE_RENDER_TARGET, D3D12_RESOURCE_STATE_PIXEL_SHADER_RESOURCE);
+    cmdList->ResourceBarrier(1, &toRead);
+
+    cmdList->RSSetViewports(1, &mScreenViewport);
+    cmdList->RSSetScissorRects(1, &mScissorRect);
+
+    D3D12_CPU_DESCRIPTOR_HANDLE backBufferView = CurrentBackBufferView();
+    cmdList->OMSetRenderTargets(1, &backBufferView, true, nullptr);
+
+    ID3D12DescriptorHeap* descriptorHeaps[] = { mSrvDescriptorHeap.Get() };
+    cmdList->SetDescriptorHeaps(_countof(descriptorHeaps), descriptorHeaps);
+
+    cmdList->SetGraphicsRootSignature(mUpscaleRootSignature.Get());
+    cmdList->SetPipelineState(mPSOs["upscale"].Get());
+
+    // Half a texel in from the drawn part's far edges, so the bilinear filter
+    // never blends in what lies beyond it.
+    float upscaleConstants[] =
+    {
+        (float)mRenderWidth / mClientWidth,
+        (float)mRenderHeight / mClientHeight,
+        (mRenderWidth - 0.5f) / mClientWidth,
+        (mRenderHeight - 0.5f) / mClientHeight
+    };
+    cmdList->SetGraphicsRoot32BitConstants(0, _countof(upscaleConstants), upscaleConstants, 0);
+
+    CD3DX12_GPU_DESCRIPTOR_HANDLE sceneColor(
+        mSrvDescriptorHeap->GetGPUDescriptorHandleForHeapStart(), gUpscaleDescriptorBase, mCbvSrvUavDescriptorSize);
+    cmdList->SetGraphicsRootDescriptorTable(1, sceneColor);
+
+    cmdList->IASetPrimitiveTopology(D3D_PRIMITIVE_TOPOLOGY_TRIANGLELIST);
+    cmdList->DrawInstanced(3, 1, 0, 0);
+    ++mDrawCallCount;
+}
+
+void ShapesApp::RecordEndOfFrame(ID3D12GraphicsCommandList* cmdList)
+{
+    mProfiler->EndGpuScope(cmdList, GpuScene);
+
+    if (mUpscaleThisFrame)
+    {
+        mProfiler->BeginGpuScope(cmdList, GpuUpscale);
+        RecordUpscale(cmdList);
+        mProfiler->EndGpuScope(cmdList, GpuUpscale);
+    }
+
+    // Hand the back buffer to the swap chain.  The cluster lists decay to the
+    // common state by themselves.
+    auto toPresent = CD3DX12_RESOURCE_BARRIER::Transition(CurrentBackBuffer(),
+        D3D12_RESOURCE_STATE_RENDER_TARGET, D3D12_RESOURCE_STATE_PRESENT);
+    cmdList->ResourceBarrier(1, &toPresent);
+
+    mProfiler->EndGpuScope(cmdList, GpuFrame);
+    mProfiler->ResolveGpuScopes(cmdList);
+}
+
+void ShapesApp::OnMouseDown(WPARAM btnState, int x, int y)
+{
+    mLastMousePos.x = x;
+    mLastMousePos.y = y;
+    SetCapture(mhMainWnd);
+}
+
+void ShapesApp::OnMouseUp(WPARAM btnState, int x, int y)
+{
+    ReleaseCapture();
+}
+
+void ShapesApp::OnMouseMove(WPARAM btnState, int x, int y)
+{
+    if ((btnState & MK_LBUTTON) != 0 && !mBenchmarkEnabled)
+    {
+        float dx = XMConvertToRadians(0.25f * static_cast<float>(x - mLastMousePos.x));
+        float dy = XMConvertToRadians(0.25f * static_cast<float>(y - mLastMousePos.y));
+
+        mCamera.Pitch(dy);
+        mCamera.RotateY(dx);
+    }
+
+    mLastMousePos.x = x;
+    mLastMousePos.y = y;
+}
+
+void ShapesApp::OnKeyUp(WPARAM key)
+{
+    // A benchmark run keeps the modes it was started with.
+    if (mBenchmarkEnabled)
+        return;
+
+    // 'I' switches between the instanced batches and one draw per render item.
+    if (key == 'I')
+        mInstancingEnabled = !mInstancingEnabled;
+
+    // 'C' turns frustum culling off so every item is submitted again.
+    if (key == 'C')
+        mFrustumCullingEnabled = !mFrustumCullingEnabled;
+
+    // 'L' pins every item to its finest level of detail.
+    if (key == 'L')
+        mLodEnabled = !mLodEnabled;
+
+    // 'M' switches between recording on the worker threads and on this thread.
+    if (key == 'M')
+        mParallelRecordingEnabled = !mParallelRecordingEnabled;
+
+    // 'B' switches between bindless and per-draw descriptor binding.
+    if (key == 'B' && mBindlessSupported)
+    {
+        mBindlessEnabled = !mBindlessEnabled;
+        mGpuDrivenEnabled = mGpuDrivenEnabled && mBindlessEnabled;
+    }
+
+    // 'G' switches between GPU culling with ExecuteIndirect and the CPU paths.
+    if (key == 'G' && mBindlessEnabled)
+        mGpuDrivenEnabled = !mGpuDrivenEnabled;
+
+    // 'O' turns the Hi-Z occlusion test of the GPU-driven path on and off.
+    if (key == 'O')
+        mOcclusionCullingEnabled = !mOcclusionCullingEnabled;
+
+    // 'R' turns dynamic resolution on and off.
+    if (key == 'R')
+        mDynamicResolutionEnabled = !mDynamicResolutionEnabled;
+
+    // 'Y' switches between the async compute queue and in-line compute passes.
+    if (key == 'Y')
+        mAsyncComputeEnabled = !mAsyncComputeEnabled;
+
+    // 'Z' turns the depth prepass on and off.
+    if (key == 'Z')
+        mDepthPrepassEnabled = !mDepthPrepassEnabled;
+
+    // 'P' writes the frame timings collected so far.
+    if (key == 'P')
+    {
+        mProfiler->WriteCsv(mProfileCsvFile.empty() ? L"Profile.csv" : mProfileCsvFile);
+        mProfiler->WriteJson(mProfileJsonFile.empty() ? L"Profile.json" : mProfileJsonFile);
+    }
+}
+
+void ShapesApp::OnKeyboardInput(const GameTimer& gt)
+{
+    float dt = gt.DeltaTime();
+
+    if (GetAsyncKeyState('1') & 0x8000)
+        mIsWireframe = true;
+    else
+        mIsWireframe = false;
+
+    XMFLOAT3 oldPos = mCamera.GetPosition3f();
+
+    if (GetAsyncKeyState('W') & 0x8000)
+        mCamera.Walk(6.0f * dt);
+
+    if (GetAsyncKeyState('S') & 0x8000)
+        mCamera.Walk(-6.0f * dt);
+
+    if (GetAsyncKeyState('A') & 0x8000)
+        mCamera.Strafe(-6.0f * dt);
+
+    if (GetAsyncKeyState('D') & 0x8000)
+        mCamera.Strafe(6.0f * dt);
+
+    XMFLOAT3 newPos = mCamera.GetPosition3f();
+
+    if (CheckCollision(newPos, mCollisionRadius))
+    {
+        mCamera.SetPosition(oldPos.x, oldPos.y, oldPos.z);
+    }
+}
+
+
+
+void ShapesApp::UpdateBenchmark(const GameTimer& gt)
+{
+    // Texture streaming and first-use costs settle on the first pose.
+    if (mBenchmarkWarmupFrames > 0)
+    {
+        --mBenchmarkWarmupFrames;
+        mBenchmarkSegments.front().Path.Evaluate(0.0f, mCamera);
+        return;
+    }
+
+    // The previous frame was the last one of its segment.  The counters held
+    // the totals at its start.
+    if (mBenchmarkSegment < mBenchmarkSegments.size() &&
+        mBenchmarkTime > mBenchmarkSegments[mBenchmarkSegment].Path.GetDuration())
+    {
+        BenchmarkSegment& segment = mBenchmarkSegments[mBenchmarkSegment++];
+        segment.EndFrame = mProfiler->GetFrameNumber();
+        segment.DrawCalls = mDrawCallCount - segment.DrawCalls;
+        segment.VisibleItems = mVisibleItemCount - segment.VisibleItems;
+
+        mBenchmarkTime = 0.0f;
+    }
+
+    if (mBenchmarkSegment < mBenchmarkSegments.size())
+    {
+        BenchmarkSegment& segment = mBenchmarkSegments[mBenchmarkSegment];
+        if (segment.FirstFrame == 0)
+        {
+            segment.FirstFrame = mProfiler->GetFrameNumber();
+            segment.DrawCalls = mDrawCallCount;
+            segment.VisibleItems = mVisibleItemCount;
+        }
+
+        segment.Path.Evaluate(mBenchmarkTime, mCamera);
+        mBenchmarkTime += gt.DeltaTime();
+        return;
+    }
+
+    // The last frame's timings are read back gNumFrameResources frames later,
+    // after this point of the frame that reuses its frame resource.
+    if (mBenchmarkCooldownFrames++ < (UINT)gNumFrameResources)
+        return;
+
+    if (!WriteBenchmarkReport())
+        ::OutputDebugStringW(L"Could not write the benchmark report\n");
+
+    PostQuitMessage(0);
+}
+
+bool ShapesApp::CheckCollision(const DirectX::XMFLOAT3& position, float radius)
+{
+    return mMazeCollisionGrid.IntersectsSphere(position, radius);
+}
+
+void ShapesApp::UpdateObjectCBs(const GameTimer& gt)
+{
+    Profiler::CpuScope scope(mProfiler.get(), CpuUpdateObjectCBs);
+
+    // Spawned items may have taken more slots than this frame resource's buffer
+    // holds.  The GPU is done with this frame resource, so a larger buffer can
+    // replace it without waiting on the others, and every slot is written again.
+    if (mCurrFrameResource->ReserveObjects(md3dDevice.Get(), mObjectSlots.GetSize()))
+        mTransforms->InvalidateFrame(mCurrFrameResourceIndex);
+
+    for (const auto& t : mSpinningTransforms)
+    {
+        XMMATRIX spin = XMMatrixRotationY(t.Rate * gt.TotalTime());
+        mTransforms->SetLocal(t.Transform, XMMatrixMultiply(spin, XMLoadFloat4x4(&t.Rest)));
+    }
+
+    mTransforms->UpdateWorld();
+
+    // A static caster that moves goes to the dynamic shadow map from then on,
+    // and the cached cascades are drawn again without it.
+    bool castersMoved = false;
+
+    for (UINT i : mTransforms->GetChanged())
+    {
+        if (RenderItem* ri = mTransformRitems[i])
+        {
+            ri->Bounds.Transform(ri->WorldBounds, mTransforms->GetWorld(i));
+
+            if (ri->StaticCaster)
+            {
+                ri->StaticCaster = false;
+                mDynamicCasterRitems.push_back(ri);
+                castersMoved = true;
+            }
+        }
+    }
+
+    if (castersMoved)
+    {
+        mStaticCasterRitems.erase(
+            std::remove_if(mStaticCasterRitems.begin(), mStaticCasterRitems.end(),
+                [](RenderItem* ri) { return !ri->StaticCaster; }),
+            mStaticCasterRitems.end());
+
+        for (auto& cascade : mShadowCascades)
+            cascade.StaticDirty = true;
+    }
+
+    // Each frame resource gets every changed world the next time it comes up.
+    // ObjectConstants is just the transposed world.
+    static_assert(sizeof(ObjectConstants) == sizeof(XMFLOAT4X4), "TransformStore writes the world only");
+
+    auto currObjectCB = mCurrFrameResource->ObjectCB.get();
+    mTransforms->WriteConstants(mCurrFrameResourceIndex,
+        currObjectCB->MappedData(), currObjectCB->ElementByteSize(), mWorkerPool.get());
+}
+
+void ShapesApp::UpdateLods(const GameTimer& gt)
+{
+    // The world box's bounding sphere over the view height at its distance,
+    // measured the same way on the GPU-driven path.
+    XMVECTOR eyePos = mCamera.GetPosition();
+    float projScale = 1.0f / tanf(0.5f * mCamera.GetFovY());
+
+    mRitemPool.ForEach([&](RenderItem& e)
+        {
+            if (e.LodCount < 2)
+                return;
+
+            UINT lod = 0;
+
+            if (mLodEnabled)
+            {
+                XMVECTOR center = XMLoadFloat3(&e.WorldBounds.Center);
+                float radius = XMVectorGetX(XMVector3Length(XMLoadFloat3(&e.WorldBounds.Extents)));
+                float distance = XMVectorGetX(XMVector3Length(XMVectorSubtract(center, eyePos)));
+
+                float coverage = distance > radius ? radius * projScale / distance : 1.0f;
+
+                while (lod + 1 < e.LodCount && coverage < gLodCoverage[lod])
+                    ++lod;
+            }
+
+            e.Lod = lod;
+            e.IndexCount = e.Lods[lod].IndexCount;
+            e.StartIndexLocation = e.Lods[lod].StartIndexLocation;
+            e.BaseVertexLocation = e.Lods[lod].BaseVertexLocation;
+        });
+}
+
+void ShapesApp::UpdateVisibleRitems(const GameTimer& gt)
+{
+    // Test the cached world-space bounds of each item against the world-space
+    // frustum kept up to date by UpdateMainPassCB.
+    const BoundingFrustum& worldFrustum = mWorldCamFrustum;
+
+    auto cull = [&](const std::vector<RenderItem*>& ritems, std::vector<RenderItem*>& visible)
+        {
+            visible.clear();
+
+            for (auto ri : ritems)
+            {
+                ri->Visible = !mFrustumCullingEnabled || worldFrustum.Intersects(ri->WorldBounds);
+
+                if (ri->Visible)
+                    visible.push_back(ri);
+            }
+        };
+
+    // The GPU-driven path culls the opaque items in RecordDrawCulling.
+    if (mGpuDrivenEnabled)
+        mVisibleOpaqueRitems.clear();
+    else
+        cull(mOpaqueRitems, mVisibleOpaqueRitems);
+
+    cull(mDynamicOpaqueRitems, mVisibleDynamicRitems);
+    cull(mTransparentRitems, mVisibleTransparentRitems);
+
+    // The instanced path draws mOpaqueBatches, which are sorted once.
+    if (!mGpuDrivenEnabled && !mInstancingEnabled)
+        SortVisibleRitems(mOpaqueQueue, mVisibleOpaqueRitems, PsoOpaque);
+
+    SortVisibleRitems(mOpaqueQueue, mVisibleDynamicRitems, PsoOpaque);
+    SortVisibleRitems(mTransparentQueue, mVisibleTransparentRitems, PsoTransparent);
+}
+
+void ShapesApp::SortVisibleRitems(RenderQueue& queue, std::vector<RenderItem*>& ritems, PsoId pso)
+{
+    XMVECTOR eyePos = mCamera.GetPosition();
+    XMVECTOR look = mCamera.GetLook();
+
+    queue.Clear();
+    queue.Reserve(ritems.size());
+
+    for (size_t i = 0; i < ritems.size(); ++i)
+    {
+        auto ri = ritems[i];
+
+        // View depth of the box center.
+        XMVECTOR center = XMLoadFloat3(&ri->WorldBounds.Center);
+        float depth = XMVectorGetX(XMVector3Dot(XMVectorSubtract(center, eyePos), look));
+
+        UINT64 key = pso == PsoTransparent ?
+            RenderQueue::MakeTransparentKey(pso, ri->GeoSortId, (UINT)ri->Mat->MatCBIndex, depth) :
+            RenderQueue::MakeOpaqueKey(pso, ri->GeoSortId, (UINT)ri->Mat->MatCBIndex, depth);
+
+        queue.Push(key, (UINT)i);
+    }
+
+    queue.Sort();
+
+    mSortedRitems.clear();
+    for (size_t i = 0; i < queue.Size(); ++i)
+        mSortedRitems.push_back(ritems[queue[i].Index]);
+
+    ritems.swap(mSortedRitems);
+}
+
+void ShapesApp::UpdateInstanceBuffer(const GameTimer& gt)
+{
+    if (mGpuDrivenEnabled)
+        return;
+
+    auto currInstanceBuffer = mCurrFrameResource->InstanceBuffer.get();
+
+    UINT instanceCount = 0;
+    for (auto& batch : mOpaqueBatches)
+    {
+        for (UINT lod = 0; lod < batch.LodCount; ++lod)
+        {
+            batch.InstanceOffset[lod] = instanceCount;
+            batch.InstanceCount[lod] = 0;
+
+            for (auto ri : batch.Items)
+            {
+                if (!ri->Visible || ri->Lod != lod)
+                    continue;
+
+                XMMATRIX world = mTransforms->GetWorld(ri->TransformIndex);
+
+                InstanceData data;
+                XMStoreFloat4x4(&data.World, XMMatrixTranspose(world));
+
+                currInstanceBuffer->CopyData(instanceCount++, data);
+                batch.InstanceCount[lod]++;
+            }
+        }
+    }
+}
+
+void ShapesApp::UpdateMainPassCB(const GameTimer& gt)
+{
+    Profiler::CpuScope scope(mProfiler.get(), CpuUpdateMainPassCB);
+
+    mFrameConstants.TotalTime = gt.TotalTime();
+    mFrameConstants.DeltaTime = gt.DeltaTime();
+
+    // Everything else in the pass constants derives from the camera and the
+    // size the scene is drawn at.  A new window size resets the lens as well.
+    bool renderSizeChanged =
+        mMainPassCB.RenderTargetSize.x != (float)mRenderWidth ||
+        mMainPassCB.RenderTargetSize.y != (float)mRenderHeight;
+
+    if (mCamera.GetViewVersion() != mPassViewVersion || mCamera.GetProjVersion() != mPassProjVersion || renderSizeChanged)
+    {
+        mPassViewVersion = mCamera.GetViewVersion();
+        mPassProjVersion = mCamera.GetProjVersion();
+
+        XMMATRIX view = mCamera.GetView();
+        XMMATRIX proj = mCamera.GetProj();
+
+        XMMATRIX viewProj = XMMatrixMultiply(view, proj);
+        XMVECTOR viewDet = XMMatrixDeterminant(view);
+        XMVECTOR projDet = XMMatrixDeterminant(proj);
+        XMVECTOR viewProjDet = XMMatrixDeterminant(viewProj);
+        XMMATRIX invView = XMMatrixInverse(&viewDet, view);
+        XMMATRIX invProj = XMMatrixInverse(&projDet, proj);
+        XMMATRIX invViewProj = XMMatrixInverse(&viewProjDet, viewProj);
+
+        XMStoreFloat4x4(&mMainPassCB.View, XMMatrixTranspose(view));
+        XMStoreFloat4x4(&mMainPassCB.InvView, XMMatrixTranspose(invView));
+        XMStoreFloat4x4(&mMainPassCB.Proj, XMMatrixTranspose(proj));
+        XMStoreFloat4x4(&mMainPassCB.InvProj, XMMatrixTranspose(invProj));
+        XMStoreFloat4x4(&mMainPassCB.ViewProj, XMMatrixTranspose(viewProj));
+        XMStoreFloat4x4(&mMainPassCB.InvViewProj, XMMatrixTranspose(invViewProj));
+
+        mCamFrustum.Transform(mWorldCamFrustum, invView);
+
+        mMainPassCB.EyePosW = mCamera.GetPosition3f();
+        mMainPassCB.RenderTargetSize = XMFLOAT2((float)mRenderWidth, (float)mRenderHeight);
+        mMainPassCB.InvRenderTargetSize = XMFLOAT2(1.0f / mRenderWidth, 1.0f / mRenderHeight);
+        mMainPassCB.NearZ = mCamera.GetNearZ();
+        mMainPassCB.FarZ = mCamera.GetFarZ();
+
+        mMainPassCB.AmbientLight = XMFLOAT4(0.12f, 0.12f, 0.16f, 1.0f);
+
+        mMainPassCB.LightCount = (UINT)mLights.size();
+        mMainPassCB.DirectionalLightCount = mDirectionalLightCount;
+
+        // Slice k of the cluster grid spans view depths near * (far / near)^(k / Z)
+        // up to the next slice, which keeps clusters roughly cube-shaped.
+        float logDepthRange = logf(mMainPassCB.FarZ / mMainPassCB.NearZ);
+        mMainPassCB.ClusterDepthScale = gClusterCountZ / logDepthRange;
+        mMainPassCB.ClusterDepthBias = -(gClusterCountZ * logf(mMainPassCB.NearZ)) / logDepthRange;
+
+        mMainPassCB.ClusterCountX = gClusterCountX;
+        mMainPassCB.ClusterCountY = gClusterCountY;
+        mMainPassCB.ClusterCountZ = gClusterCountZ;
+        mMainPassCB.MaxLightsPerCluster = gMaxLightsPerCluster;
+        mMainPassCB.ClusterTileSize = XMFLOAT2(
+            (float)((mRenderWidth + gClusterCountX - 1) / gClusterCountX),
+            (float)((mRenderHeight + gClusterCountY - 1) / gClusterCountY));
+
+        UpdateShadowCascades();
+
+        // From NDC to shadow map texture coordinates.
+        XMMATRIX toTexture(
+            0.5f, 0.0f, 0.0f, 0.0f,
+            0.0f, -0.5f, 0.0f, 0.0f,
+            0.0f, 0.0f, 1.0f, 0.0f,
+            0.5f, 0.5f, 0.0f, 1.0f);
+
+        for (UINT i = 0; i < gShadowCascadeCount; ++i)
+        {
+            XMMATRIX shadowTransform = XMMatrixMultiply(XMLoadFloat4x4(&mShadowCascades[i].ViewProj), toTexture);
+            XMStoreFloat4x4(&mMainPassCB.ShadowTransforms[i], XMMatrixTranspose(shadowTransform));
+            mMainPassCB.ShadowCascadeEnds[i] = mShadowCascades[i].ViewEnd;
+        }
+        mMainPassCB.ShadowTexelSize = 1.0f / gShadowMapSize;
+
+        mPassNumFramesDirty = gNumFrameResources;
+    }
+
+    if (mPassNumFramesDirty > 0)
+    {
+        auto currPassCB = mCurrFrameResource->PassCB.get();
+        currPassCB->CopyData(0, mMainPassCB);
+
+        mPassNumFramesDirty--;
+    }
+}
+
+void ShapesApp::UpdateRenderScale()
+{
+    mUpscaleThisFrame = mDynamicResolutionEnabled && mSceneColor != nullptr;
+
+    float scale = 1.0f;
+    if (mUpscaleThisFrame)
+    {
+        scale = mRenderScale;
+
+        // The timings arrive a few frames late; only those of frames drawn at
+        // the current size say how it does.
+        UINT64 frame = mProfiler->GetLatestGpuFrame();
+        float gpuMs = mProfiler->GetGpuTime(frame, GpuFrame);
+
+        bool outsideBand = gpuMs > mTargetGpuFrameMs || gpuMs < gRenderScaleLowerBand * mTargetGpuFrameMs;
+        if (frame >= mRenderSizeFrame && gpuMs > 0.0f && outsideBand)
+        {
+            // Most of the frame's GPU time is per pixel, so it goes with the
+            // square of the scale.
+            float step = sqrtf(gRenderScaleAim * mTargetGpuFrameMs / gpuMs);
+            step = MathHelper::Clamp(step, 1.0f - gMaxRenderScaleStep, 1.0f + gMaxRenderScaleStep);
+            scale = MathHelper::Clamp(scale * step, gMinRenderScale, 1.0f);
+        }
+    }
+    mRenderScale = scale;
+
+    UINT width = MathHelper::Max((UINT)(mClientWidth * scale + 0.5f), 1u);
+    UINT height = MathHelper::Max((UINT)(mClientHeight * scale + 0.5f), 1u);
+    if (width != mRenderWidth || height != mRenderHeight)
+    {
+        mRenderWidth = width;
+        mRenderHeight = height;
+        mRenderSizeFrame = mProfiler->GetFrameNumber();
+    }
+
+    mSceneViewport = { 0.0f, 0.0f, (float)width, (float)height, 0.0f, 1.0f };
+    mSceneScissorRect = { 0, 0, (LONG)width, (LONG)height };
+
+    if (mBenchmarkEnabled)
+    {
+        mRenderScaleSum += scale;
+        ++mRenderScaleFrames;
+        mLowestRenderScale = MathHelper::Min(mLowestRenderScale, scale);
+    }
+}
+
+void ShapesApp::UpdateShadowCascades()
+{
+    if (mDirectionalLightCount == 0)
+        return;
+
+    XMVECTOR lightDir = XMVector3Normalize(XMLoadFloat3(&mLights[0].Direction));
+    XMMATRIX lightView = XMMatrixLookToLH(XMVectorZero(), lightDir, XMVectorSet(0.0f, 1.0f, 0.0f, 0.0f));
+    XMVECTOR lightViewDet = XMMatrixDeterminant(lightView);
+    XMMATRIX invLightView = XMMatrixInverse(&lightViewDet, lightView);
+
+    // The slices and the spheres around them only depend on the lens.
+    bool lensChanged = mCamera.GetProjVersion() != mShadowProjVersion;
+    if (lensChanged)
+    {
+        mShadowProjVersion = mCamera.GetProjVersion();
+
+        float nearZ = mCamera.GetNearZ();
+        float farZ = MathHelper::Min(gShadowDistance, mCamera.GetFarZ());
+        float tanY = tanf(0.5f * mCamera.GetFovY());
+        float tanX = tanY * mCamera.GetAspect();
+
+        float sliceStart = nearZ;
+        for (UINT i = 0; i < gShadowCascadeCount; ++i)
+        {
+            float t = (float)(i + 1) / gShadowCascadeCount;
+            float sliceEnd = gShadowSplitLambda * nearZ * powf(farZ / nearZ, t) +
+                (1.0f - gShadowSplitLambda) * (nearZ + (farZ - nearZ) * t);
+
+            float center = 0.5f * (sliceStart + sliceEnd);
+            float halfDepth = 0.5f * (sliceEnd - sliceStart);
+            float nearCorner = sliceStart * sqrtf(tanX * tanX + tanY * tanY);
+            float farCorner = sliceEnd * sqrtf(tanX * tanX + tanY * tanY);
+
+            ShadowCascade& cascade = mShadowCascades[i];
+            cascade.ViewEnd = sliceEnd;
+            cascade.SliceCenter = center;
+            cascade.Radius = sqrtf(halfDepth * halfDepth + MathHelper::Max(nearCorner * nearCorner, farCorner * farCorner));
+
+            // Radius plus gShadowCacheMarginTexels texels of the map's size.
+            cascade.HalfWidth = cascade.Radius / (1.0f - 2.0f * gShadowCacheMarginTexels / gShadowMapSize);
+
+            sliceStart = sliceEnd;
+        }
+    }
+
+    // The depth range spans the whole scene along the light, so casters outside
+    // the view still throw their shadows into it.
+    XMVECTOR sceneCenter = XMVector3TransformCoord(XMLoadFloat3(&mShadowSceneBounds.Center), lightView);
+    float zNear = XMVectorGetZ(sceneCenter) - mShadowSceneBounds.Radius;
+    float zFar = XMVectorGetZ(sceneCenter) + mShadowSceneBounds.Radius;
+
+    XMVECTOR eyePos = mCamera.GetPosition();
+    XMVECTOR look = mCamera.GetLook();
+
+    for (auto& cascade : mShadowCascades)
+    {
+        XMVECTOR sliceCenter = XMVector3TransformCoord(
+            XMVectorMultiplyAdd(look, XMVectorReplicate(cascade.SliceCenter), eyePos), lightView);
+
+        float x = XMVectorGetX(sliceCenter);
+        float y = XMVectorGetY(sliceCenter);
+        float margin = cascade.HalfWidth - cascade.Radius;
+
+        if (!lensChanged && fabsf(x - cascade.Center.x) <= margin && fabsf(y - cascade.Center.y) <= margin)
+            continue;
+
+        float w = cascade.HalfWidth;
+        cascade.Center = XMFLOAT2(x, y);
+
+        XMMATRIX proj = XMMatrixOrthographicOffCenterLH(x - w, x + w, y - w, y + w, zNear, zFar);
+        XMStoreFloat4x4(&cascade.ViewProj, XMMatrixMultiply(lightView, proj));
+
+        BoundingOrientedBox lightBounds(
+            XMFLOAT3(x, y, 0.5f * (zNear + zFar)),
+            XMFLOAT3(w, w, 0.5f * (zFar - zNear)),
+            XMFLOAT4(0.0f, 0.0f, 0.0f, 1.0f));
+        lightBounds.Transform(cascade.Bounds, invLightView);
+
+        cascade.StaticDirty = true;
+    }
+}
+
+void ShapesApp::UpdateLightBuffer(const GameTimer& gt)
+{
+    // The lights are static, so each frame resource's copy is written once after
+    // BuildLights() and left alone afterwards.
+    if (mLightsNumFramesDirty > 0)
+    {
+        auto currLightBuffer = mCurrFrameResource->LightBuffer.get();
+
+        for (size_t i = 0; i < mLights.size(); ++i)
+            currLightBuffer->CopyData((int)i, mLights[i]);
+
+        mLightsNumFramesDirty--;
+    }
+}
+
+void ShapesApp::UpdateMaterialCBs(const GameTimer& gt)
+{
+    auto currMaterialCB = mCurrFrameResource->MaterialCB.get();
+
+    for (auto& e : mMaterials)
+    {
+        Material* mat = e.second.get();
+
+        if (mat->NumFramesDirty > 0)
+        {
+            MaterialConstants matConstants;
+            matConstants.DiffuseAlbedo = mat->DiffuseAlbedo;
+            matConstants.FresnelR0 = mat->FresnelR0;
+            matConstants.Roughness = mat->Roughness;
+            matConstants.DiffuseMapIndex = mTextureStreamer->GetSrvIndex(mat->DiffuseSrvHeapIndex);
+
+            currMaterialCB->CopyData(mat->MatCBIndex, matConstants);
+            mat->NumFramesDirty--;
+        }
+    }
+}
+
+void ShapesApp::UpdateWaves(const GameTimer& gt)
+{
+    // Fixed steps keep the simulation stable at any frame rate.  A long frame
+    // drops the steps past the cap rather than falling further behind.
+    mWaveTime += gt.DeltaTime();
+    mWaveStepCount = 0;
+    while (mWaveTime >= gWaveTimeStep && mWaveStepCount < gMaxWaveStepsPerFrame)
+    {
+        mWaveTime -= gWaveTimeStep;
+        mWaveDisturbTime += gWaveTimeStep;
+        ++mWaveStepCount;
+    }
+    mWaveTime = MathHelper::Min(mWaveTime, gWaveTimeStep);
+
+    if (mWaveDisturbTime >= gWaveDisturbInterval)
+    {
+        mWaveDisturbTime -= gWaveDisturbInterval;
+        mWaveDisturb = true;
+
+        // Away from the flat border, so the whole drop lands inside.
+        mWaveConstants.DisturbCell.x = (UINT)MathHelper::Rand(4, (int)gWaveColumnCount - 5);
+        mWaveConstants.DisturbCell.y = (UINT)MathHelper::Rand(4, (int)gWaveRowCount - 5);
+        mWaveConstants.DisturbMagnitude = MathHelper::RandF(0.1f, 0.25f);
+    }
+}
+
+void ShapesApp::BuildRootSignature()
+{
+    CD3DX12_DESCRIPTOR_RANGE texTable;
+    texTable.Init(D3D12_DESCRIPTOR_RANGE_TYPE_SRV, 1, 0);
+
+    CD3DX12_DESCRIPTOR_RANGE shadowTable;
+    shadowTable.Init(D3D12_DESCRIPTOR_RANGE_TYPE_SRV, 2, 0, 5);
+
+    CD3DX12_ROOT_PARAMETER slotRootParameter[11];
+    slotRootParameter[0].InitAsDescriptorTable(1, &texTable, D3D12_SHADER_VISIBILITY_PIXEL);
+    slotRootParameter[1].InitAsConstantBufferView(0); // ObjectCB
+    slotRootParameter[2].InitAsConstantBufferView(1); // PassCB
+    slotRootParameter[3].InitAsConstantBufferView(2); // MaterialCB
+    slotRootParameter[4].InitAsShaderResourceView(0, 1, D3D12_SHADER_VISIBILITY_VERTEX); // InstanceData
+    slotRootParameter[5].InitAsConstants(1, 3, 0, D3D12_SHADER_VISIBILITY_VERTEX);       // instance offset
+    slotRootParameter[6].InitAsShaderResourceView(0, 2, D3D12_SHADER_VISIBILITY_PIXEL);  // Lights
+    slotRootParameter[7].InitAsShaderResourceView(1, 2, D3D12_SHADER_VISIBILITY_PIXEL);  // cluster light counts
+    slotRootParameter[8].InitAsShaderResourceView(2, 2, D3D12_SHADER_VISIBILITY_PIXEL);  // cluster light indices
+    slotRootParameter[9].InitAsConstants(2, 4, 0, D3D12_SHADER_VISIBILITY_PIXEL);        // FrameConstants
+    slotRootParameter[10].InitAsDescriptorTable(1, &shadowTable, D3D12_SHADER_VISIBILITY_PIXEL); // shadow maps
+
+    auto staticSamplers = GetStaticSamplers();
+
+    CD3DX12_ROOT_SIGNATURE_DESC rootSigDesc(
+        _countof(slotRootParameter),
+        slotRootParameter,
+        (UINT)staticSamplers.size(),
+        staticSamplers.data(),
+        D3D12_ROOT_SIGNATURE_FLAG_ALLOW_INPUT_ASSEMBLER_INPUT_LAYOUT);
+
+    ComPtr<ID3DBlob> serializedRootSig = nullptr;
+    ComPtr<ID3DBlob> errorBlob = nullptr;
+
+    HRESULT hr = D3D12SerializeRootSignature(
+        &rootSigDesc,
+        D3D_ROOT_SIGNATURE_VERSION_1,
+        serializedRootSig.GetAddressOf(),
+        errorBlob.GetAddressOf());
+
+    if (errorBlob != nullptr)
+        ::OutputDebugStringA((char*)errorBlob->GetBufferPointer());
+
+    ThrowIfFailed(hr);
+
+    ThrowIfFailed(md3dDevice->CreateRootSignature(
+        0,
+        serializedRootSig->GetBufferPointer(),
+        serializedRootSig->GetBufferSize(),
+        IID_PPV_ARGS(mRootSignature.GetAddressOf())));
+}
+
+void ShapesApp::BuildBindlessRootSignature()
+{
+    // Unbounded descriptor ranges need resource binding tier 2; without it only
+    // the regular root signature is used.
+    D3D12_FEATURE_DATA_D3D12_OPTIONS options = {};
+    ThrowIfFailed(md3dDevice->CheckFeatureSupport(D3D12_FEATURE_D3D12_OPTIONS, &options, sizeof(options)));
+
+    mBindlessSupported = options.ResourceBindingTier >= D3D12_RESOURCE_BINDING_TIER_2;
+    mBindlessEnabled = mBindlessEnabled && mBindlessSupported;
+    mGpuDrivenEnabled = mGpuDrivenEnabled && mBindlessSupported;
+
+    if (!mBindlessSupported)
+        return;
+
+    CD3DX12_DESCRIPTOR_RANGE texTable;
+    texTable.Init(D3D12_DESCRIPTOR_RANGE_TYPE_SRV, UINT_MAX, 0, 4);
+
+    // Same slots as BuildRootSignature where the meaning is the same, so the
+    // pass-wide bindings in RecordScenePass serve both.
+    CD3DX12_DESCRIPTOR_RANGE shadowTable;
+    shadowTable.Init(D3D12_DESCRIPTOR_RANGE_TYPE_SRV, 2, 0, 5);
+
+    CD3DX12_ROOT_PARAMETER slotRootParameter[11];
+    slotRootParameter[0].InitAsDescriptorTable(1, &texTable, D3D12_SHADER_VISIBILITY_PIXEL);
+    slotRootParameter[1].InitAsConstants(3, 5);                                          // object, material, instance offset
+    slotRootParameter[2].InitAsConstantBufferView(1);                                    // PassCB
+    slotRootParameter[3].InitAsShaderResourceView(0, 3, D3D12_SHADER_VISIBILITY_PIXEL);  // MaterialCB as a buffer
+    slotRootParameter[4].InitAsShaderResourceView(0, 1, D3D12_SHADER_VISIBILITY_VERTEX); // InstanceData
+    slotRootParameter[5].InitAsShaderResourceView(1, 1, D3D12_SHADER_VISIBILITY_VERTEX); // ObjectCB as a buffer
+    slotRootParameter[6].InitAsShaderResourceView(0, 2, D3D12_SHADER_VISIBILITY_PIXEL);  // Lights
+    slotRootParameter[7].InitAsShaderResourceView(1, 2, D3D12_SHADER_VISIBILITY_PIXEL);  // cluster light counts
+    slotRootParameter[8].InitAsShaderResourceView(2, 2, D3D12_SHADER_VISIBILITY_PIXEL);  // cluster light indices
+    slotRootParameter[9].InitAsConstants(2, 4, 0, D3D12_SHADER_VISIBILITY_PIXEL);        // FrameConstants
+    slotRootParameter[10].InitAsDescriptorTable(1, &shadowTable, D3D12_SHADER_VISIBILITY_PIXEL); // shadow maps
+
+    auto staticSamplers = GetStaticSamplers();
+
+    CD3DX12_ROOT_SIGNATURE_DESC rootSigDesc(
+        _countof(slotRootParameter),
+        slotRootParameter,
+        (UINT)staticSamplers.size(),
+        staticSamplers.data(),
+        D3D12_ROOT_SIGNATURE_FLAG_ALLOW_INPUT_ASSEMBLER_INPUT_LAYOUT);
+
+    ComPtr<ID3DBlob> serializedRootSig = nullptr;
+    ComPtr<ID3DBlob> errorBlob = nullptr;
+
+    HRESULT hr = D3D12SerializeRootSignature(
+        &rootSigDesc,
+        D3D_ROOT_SIGNATURE_VERSION_1,
+        serializedRootSig.GetAddressOf(),
+        errorBlob.GetAddressOf());
+
+    if (errorBlob != nullptr)
+        ::OutputDebugStringA((char*)errorBlob->GetBufferPointer());
+
+    ThrowIfFailed(hr);
+
+    ThrowIfFailed(md3dDevice->CreateRootSignature(
+        0,
+        serializedRootSig->GetBufferPointer(),
+        serializedRootSig->GetBufferSize(),
+        IID_PPV_ARGS(mBindlessRootSignature.GetAddressOf())));
+}
+
+void ShapesApp::BuildLightCullRootSignature()
+{
+    CD3DX12_ROOT_PARAMETER slotRootParameter[4];
+    slotRootParameter[0].InitAsConstantBufferView(1);  // PassCB
+    slotRootParameter[1].InitAsShaderResourceView(0);  // Lights
+    slotRootParameter[2].InitAsUnorderedAccessView(0); // cluster light counts
+    slotRootParameter[3].InitAsUnorderedAccessView(1); // cluster light indices
+
+    CD3DX12_ROOT_SIGNATURE_DESC rootSigDesc(
+        _countof(slotRootParameter),
+        slotRootParameter,
+        0,
+        nullptr,
+        D3D12_ROOT_SIGNATURE_FLAG_NONE);
+
+    ComPtr<ID3DBlob> serializedRootSig = nullptr;
+    ComPtr<ID3DBlob> errorBlob = nullptr;
+
+    HRESULT hr = D3D12SerializeRootSignature(
+        &rootSigDesc,
+        D3D_ROOT_SIGNATURE_VERSION_1,
+        serializedRootSig.GetAddressOf(),
+        errorBlob.GetAddressOf());
+
+    if (errorBlob != nullptr)
+        ::OutputDebugStringA((char*)errorBlob->GetBufferPointer());
+
+    ThrowIfFailed(hr);
+
+    ThrowIfFailed(md3dDevice->CreateRootSignature(
+        0,
+        serializedRootSig->GetBufferPointer(),
+        serializedRootSig->GetBufferSize(),
+        IID_PPV_ARGS(mLightCullRootSignature.GetAddressOf())));
+}
+
+void ShapesApp::BuildDrawCullRootSignature()
+{
+    if (!mBindlessSupported)
+        return;
+
+    CD3DX12_DESCRIPTOR_RANGE hiZTable;
+    hiZTable.Init(D3D12_DESCRIPTOR_RANGE_TYPE_SRV, 1, 3);
+
+    CD3DX12_ROOT_PARAMETER slotRootParameter[8];
+    slotRootParameter[0].InitAsConstants(8, 0);        // command count, culling, occlusion, Hi-Z size, LOD thresholds
+    slotRootParameter[1].InitAsConstantBufferView(1);  // PassCB
+    slotRootParameter[2].InitAsShaderResourceView(0);  // indirect commands
+    slotRootParameter[3].InitAsShaderResourceView(1);  // draw bounds
+    slotRootParameter[4].InitAsShaderResourceView(2);  // ObjectCB as a buffer
+    slotRootParameter[5].InitAsUnorderedAccessView(0); // visible commands
+    slotRootParameter[6].InitAsUnorderedAccessView(1); // draw count
+    slotRootParameter[7].InitAsDescriptorTable(1, &hiZTable);
 
-    // Castle corner lights
-    mMainPassCB.Lights[10].Position = { -27.0f, 8.0f, 17.0f };
-    mMainPassCB.Lights[10].Strength = { 1.0f, 0.5f, 0.2f };   // orange
-    mMainPassCB.Lights[10].FalloffStart = 1.0f;
-    mMainPassCB.Lights[10].FalloffEnd = 20.0f;
-
-    mMainPassCB.Lights[11].Position = { 27.0f, 8.0f, 17.0f };
-    mMainPassCB.Lights[11].Strength = { 0.3f, 1.0f, 0.3f };   // green
-    mMainPassCB.Lights[11].FalloffStart = 1.0f;
-    mMainPassCB.Lights[11].FalloffEnd = 20.0f;
-
-    mMainPassCB.Lights[12].Position = { -27.0f, 8.0f, 43.0f };
-    mMainPassCB.Lights[12].Strength = { 1.0f, 0.2f, 0.8f };   // pink
-    mMainPassCB.Lights[12].FalloffStart = 1.0f;
-    mMainPassCB.Lights[12].FalloffEnd = 20.0f;
-
-    mMainPassCB.Lights[13].Position = { 27.0f, 8.0f, 43.0f };
-    mMainPassCB.Lights[13].Strength = { 1.0f, 1.0f, 0.2f };   // yellow
-    mMainPassCB.Lights[13].FalloffStart = 1.0f;
-    mMainPassCB.Lights[13].FalloffEnd = 20.0f;
-    currPassCB->CopyData(0, mMainPassCB);
+    CD3DX12_ROOT_SIGNATURE_DESC rootSigDesc(
+        _countof(slotRootParameter),
+        slotRootParameter,
+        0,
+        nullptr,
+        D3D12_ROOT_SIGNATURE_FLAG_NONE);
 
-    // STRONG WHITE LIGHT (castle interior)
-    mMainPassCB.Lights[14].Position = { 0.0f, 6.0f, -15.0f };
-    mMainPassCB.Lights[14].Strength = { 2.5f, 2.5f, 2.5f };
-    mMainPassCB.Lights[14].FalloffStart = 0.5f;
-    mMainPassCB.Lights[14].FalloffEnd = 10.0f;
-    int lightIndex = 6;
-    int maxLights = 16;
+    ComPtr<ID3DBlob> serializedRootSig = nullptr;
+    ComPtr<ID3DBlob> errorBlob = nullptr;
 
-    // MAZE lights (grid system)
-    for (int x = -25; x < 20; x += 10)
-    {
-        for (int z = -40; z < 10; z += 10)
-        {
-            if (lightIndex >= maxLights)
-                break;
+    HRESULT hr = D3D12SerializeRootSignature(
+        &rootSigDesc,
+        D3D_ROOT_SIGNATURE_VERSION_1,
+        serializedRootSig.GetAddressOf(),
+        errorBlob.GetAddressOf());
+
+    if (errorBlob != nullptr)
+        ::OutputDebugStringA((char*)errorBlob->GetBufferPointer());
+
+    ThrowIfFailed(hr);
 
-            mMainPassCB.Lights[lightIndex].Position = { (float)x, 3.0f, (float)z };
+    ThrowIfFailed(md3dDevice->CreateRootSignature(
+        0,
+        serializedRootSig->GetBufferPointer(),
+        serializedRootSig->GetBufferSize(),
+        IID_PPV_ARGS(mDrawCullRootSignature.GetAddressOf())));
+}
 
-            // random color
-            float r = (rand() % 100) / 100.0f;
-            float g = (rand() % 100) / 100.0f;
-            float b = (rand() % 100) / 100.0f;
+void ShapesApp::BuildHiZRootSignature()
+{
+    if (!mBindlessSupported)
+        return;
 
-            mMainPassCB.Lights[lightIndex].Strength = { r, g, b };
+    CD3DX12_DESCRIPTOR_RANGE srcTable;
+    srcTable.Init(D3D12_DESCRIPTOR_RANGE_TYPE_SRV, 1, 0);
 
-            mMainPassCB.Lights[lightIndex].FalloffStart = 1.0f;
-            mMainPassCB.Lights[lightIndex].FalloffEnd = 15.0f;
+    CD3DX12_DESCRIPTOR_RANGE dstTable;
+    dstTable.Init(D3D12_DESCRIPTOR_RANGE_TYPE_UAV, 1, 0);
 
-            lightIndex++;
-        }
-    }
-    if (lightIndex < maxLights)
-    {
-        mMainPassCB.Lights[lightIndex].Position = { 0.0f, 6.0f, -15.0f };
-        mMainPassCB.Lights[lightIndex].Strength = { 2.5f, 2.2f, 2.0f };
-        mMainPassCB.Lights[lightIndex].FalloffStart = 0.5f;
-        mMainPassCB.Lights[lightIndex].FalloffEnd = 12.0f;
+    CD3DX12_ROOT_PARAMETER slotRootParameter[3];
+    slotRootParameter[0].InitAsConstants(4, 0);            // source and destination size
+    slotRootParameter[1].InitAsDescriptorTable(1, &srcTable);
+    slotRootParameter[2].InitAsDescriptorTable(1, &dstTable);
 
-        lightIndex++;
-    }
+    CD3DX12_ROOT_SIGNATURE_DESC rootSigDesc(
+        _countof(slotRootParameter),
+        slotRootParameter,
+        0,
+        nullptr,
+        D3D12_ROOT_SIGNATURE_FLAG_NONE);
+
+    ComPtr<ID3DBlob> serializedRootSig = nullptr;
+    ComPtr<ID3DBlob> errorBlob = nullptr;
+
+    HRESULT hr = D3D12SerializeRootSignature(
+        &rootSigDesc,
+        D3D_ROOT_SIGNATURE_VERSION_1,
+        serializedRootSig.GetAddressOf(),
+        errorBlob.GetAddressOf());
+
+    if (errorBlob != nullptr)
+        ::OutputDebugStringA((char*)errorBlob->GetBufferPointer());
+
+    ThrowIfFailed(hr);
+
+    ThrowIfFailed(md3dDevice->CreateRootSignature(
+        0,
+        serializedRootSig->GetBufferPointer(),
+        serializedRootSig->GetBufferSize(),
+        IID_PPV_ARGS(mHiZRootSignature.GetAddressOf())));
 }
-void ShapesApp::UpdateMaterialCBs(const GameTimer& gt)
+
+void ShapesApp::BuildShadowRootSignature()
 {
-    auto currMaterialCB = mCurrFrameResource->MaterialCB.get();
+    CD3DX12_ROOT_PARAMETER slotRootParameter[2];
+    slotRootParameter[0].InitAsConstants(17, 0, 0, D3D12_SHADER_VISIBILITY_VERTEX); // light view-projection, object index
+    slotRootParameter[1].InitAsShaderResourceView(0, 0, D3D12_SHADER_VISIBILITY_VERTEX); // ObjectCB as a buffer
 
-    for (auto& e : mMaterials)
-    {
-        Material* mat = e.second.get();
+    CD3DX12_ROOT_SIGNATURE_DESC rootSigDesc(
+        _countof(slotRootParameter),
+        slotRootParameter,
+        0,
+        nullptr,
+        D3D12_ROOT_SIGNATURE_FLAG_ALLOW_INPUT_ASSEMBLER_INPUT_LAYOUT);
 
-        if (mat->NumFramesDirty > 0)
-        {
-            MaterialConstants matConstants;
-            matConstants.DiffuseAlbedo = mat->DiffuseAlbedo;
-            matConstants.FresnelR0 = mat->FresnelR0;
-            matConstants.Roughness = mat->Roughness;
+    ComPtr<ID3DBlob> serializedRootSig = nullptr;
+    ComPtr<ID3DBlob> errorBlob = nullptr;
 
-            currMaterialCB->CopyData(mat->MatCBIndex, matConstants);
-            mat->NumFramesDirty--;
-        }
-    }
+    HRESULT hr = D3D12SerializeRootSignature(
+        &rootSigDesc,
+        D3D_ROOT_SIGNATURE_VERSION_1,
+        serializedRootSig.GetAddressOf(),
+        errorBlob.GetAddressOf());
+
+    if (errorBlob != nullptr)
+        ::OutputDebugStringA((char*)errorBlob->GetBufferPointer());
+
+    ThrowIfFailed(hr);
+
+    ThrowIfFailed(md3dDevice->CreateRootSignature(
+        0,
+        serializedRootSig->GetBufferPointer(),
+        serializedRootSig->GetBufferSize(),
+        IID_PPV_ARGS(mShadowRootSignature.GetAddressOf())));
 }
 
-void ShapesApp::BuildRootSignature()
+void ShapesApp::BuildUpscaleRootSignature()
 {
-    CD3DX12_DESCRIPTOR_RANGE texTable;
-    texTable.Init(D3D12_DESCRIPTOR_RANGE_TYPE_SRV, 1, 0);
+    CD3DX12_DESCRIPTOR_RANGE sceneTable;
+    sceneTable.Init(D3D12_DESCRIPTOR_RANGE_TYPE_SRV, 1, 0);
 
-    CD3DX12_ROOT_PARAMETER slotRootParameter[4];
-    slotRootParameter[0].InitAsDescriptorTable(1, &texTable, D3D12_SHADER_VISIBILITY_PIXEL);
-    slotRootParameter[1].InitAsConstantBufferView(0); // ObjectCB
-    slotRootParameter[2].InitAsConstantBufferView(1); // PassCB
-    slotRootParameter[3].InitAsConstantBufferView(2); // MaterialCB
+    CD3DX12_ROOT_PARAMETER slotRootParameter[2];
+    slotRootParameter[0].InitAsConstants(4, 0, 0, D3D12_SHADER_VISIBILITY_PIXEL); // texture coordinate scale and limit
+    slotRootParameter[1].InitAsDescriptorTable(1, &sceneTable, D3D12_SHADER_VISIBILITY_PIXEL);
 
     auto sampler = CD3DX12_STATIC_SAMPLER_DESC(
         0,
-        D3D12_FILTER_MIN_MAG_MIP_LINEAR);
+        D3D12_FILTER_MIN_MAG_MIP_LINEAR,
+        D3D12_TEXTURE_ADDRESS_MODE_CLAMP,
+        D3D12_TEXTURE_ADDRESS_MODE_CLAMP,
+        D3D12_TEXTURE_ADDRESS_MODE_CLAMP);
 
     CD3DX12_ROOT_SIGNATURE_DESC rootSigDesc(
-        4,
+        _countof(slotRootParameter),
         slotRootParameter,
         1,
         &sampler,
-        D3D12_ROOT_SIGNATURE_FLAG_ALLOW_INPUT_ASSEMBLER_INPUT_LAYOUT);
+        D3D12_ROOT_SIGNATURE_FLAG_NONE);
 
     ComPtr<ID3DBlob> serializedRootSig = nullptr;
     ComPtr<ID3DBlob> errorBlob = nullptr;
@@ -581,279 +2812,357 @@ void ShapesApp::BuildRootSignature()
         0,
         serializedRootSig->GetBufferPointer(),
         serializedRootSig->GetBufferSize(),
-        IID_PPV_ARGS(mRootSignature.GetAddressOf())));
+        IID_PPV_ARGS(mUpscaleRootSignature.GetAddressOf())));
+}
+
+void ShapesApp::BuildWavesRootSignature()
+{
+    CD3DX12_ROOT_PARAMETER slotRootParameter[4];
+    slotRootParameter[0].InitAsConstants(sizeof(WaveConstants) / 4, 0); // cbWaves
+    slotRootParameter[1].InitAsUnorderedAccessView(0); // next heights
+    slotRootParameter[2].InitAsUnorderedAccessView(1); // current heights
+    slotRootParameter[3].InitAsUnorderedAccessView(2); // water vertices
+
+    CD3DX12_ROOT_SIGNATURE_DESC rootSigDesc(
+        _countof(slotRootParameter),
+        slotRootParameter,
+        0,
+        nullptr,
+        D3D12_ROOT_SIGNATURE_FLAG_NONE);
+
+    ComPtr<ID3DBlob> serializedRootSig = nullptr;
+    ComPtr<ID3DBlob> errorBlob = nullptr;
+
+    HRESULT hr = D3D12SerializeRootSignature(
+        &rootSigDesc,
+        D3D_ROOT_SIGNATURE_VERSION_1,
+        serializedRootSig.GetAddressOf(),
+        errorBlob.GetAddressOf());
+
+    if (errorBlob != nullptr)
+        ::OutputDebugStringA((char*)errorBlob->GetBufferPointer());
+
+    ThrowIfFailed(hr);
+
+    ThrowIfFailed(md3dDevice->CreateRootSignature(
+        0,
+        serializedRootSig->GetBufferPointer(),
+        serializedRootSig->GetBufferSize(),
+        IID_PPV_ARGS(mWavesRootSignature.GetAddressOf())));
+}
+
+void ShapesApp::BuildCommandSignature()
+{
+    if (!mBindlessSupported)
+        return;
+
+    // Matches IndirectCommand.  The items come from several meshes, so the
+    // buffer views are part of every command rather than one ExecuteIndirect
+    // per mesh.
+    D3D12_INDIRECT_ARGUMENT_DESC arguments[4] = {};
+    arguments[0].Type = D3D12_INDIRECT_ARGUMENT_TYPE_VERTEX_BUFFER_VIEW;
+    arguments[0].VertexBuffer.Slot = 0;
+    arguments[1].Type = D3D12_INDIRECT_ARGUMENT_TYPE_INDEX_BUFFER_VIEW;
+    arguments[2].Type = D3D12_INDIRECT_ARGUMENT_TYPE_CONSTANT;
+    arguments[2].Constant.RootParameterIndex = 1;
+    arguments[2].Constant.DestOffsetIn32BitValues = 0;
+    arguments[2].Constant.Num32BitValuesToSet = 3;
+    arguments[3].Type = D3D12_INDIRECT_ARGUMENT_TYPE_DRAW_INDEXED;
+
+    D3D12_COMMAND_SIGNATURE_DESC commandSignatureDesc = {};
+    commandSignatureDesc.ByteStride = sizeof(IndirectCommand);
+    commandSignatureDesc.NumArgumentDescs = _countof(arguments);
+    commandSignatureDesc.pArgumentDescs = arguments;
+
+    ThrowIfFailed(md3dDevice->CreateCommandSignature(
+        &commandSignatureDesc,
+        mBindlessRootSignature.Get(),
+        IID_PPV_ARGS(mCommandSignature.GetAddressOf())));
 }
 
 void ShapesApp::BuildShadersAndInputLayout()
 {
-    mShaders["standardVS"] = d3dUtil::CompileShader(
-        L"Shaders\\VS.hlsl", nullptr, "VS", "vs_5_1");
+    const D3D_SHADER_MACRO instancedDefines[] =
+    {
+        "INSTANCED", "1",
+        NULL, NULL
+    };
 
-    mShaders["opaquePS"] = d3dUtil::CompileShader(
-        L"Shaders\\PS.hlsl", nullptr, "PS", "ps_5_1");
+    const D3D_SHADER_MACRO bindlessDefines[] =
+    {
+        "BINDLESS", "1",
+        NULL, NULL
+    };
 
-    mInputLayout =
+    const D3D_SHADER_MACRO bindlessInstancedDefines[] =
     {
-        { "POSITION", 0, DXGI_FORMAT_R32G32B32_FLOAT, 0, 0,  D3D12_INPUT_CLASSIFICATION_PER_VERTEX_DATA, 0 },
-        { "NORMAL",   0, DXGI_FORMAT_R32G32B32_FLOAT, 0, 12, D3D12_INPUT_CLASSIFICATION_PER_VERTEX_DATA, 0 },
-        { "TEXCOORD", 0, DXGI_FORMAT_R32G32_FLOAT,    0, 24, D3D12_INPUT_CLASSIFICATION_PER_VERTEX_DATA, 0 },
+        "BINDLESS", "1",
+        "INSTANCED", "1",
+        NULL, NULL
     };
-}
 
-void ShapesApp::BuildShapeGeometry()
-{
-    GeometryGenerator geoGen;
-    auto box = geoGen.CreateBox(1.0f, 1.0f, 1.0f, 0);
-    auto grid = geoGen.CreateGrid(80.0f, 120.0f, 160, 120);
-    auto sphere = geoGen.CreateSphere(0.5f, 20, 20);
-    auto cylinder = geoGen.CreateCylinder(0.5f, 0.5f, 3.0f, 20, 20);
-    auto cone = geoGen.CreateCone(1.0f, 1.0f, 20, 20);
-    auto torus = geoGen.CreateTorus(1.0f, 24, 16);
-    auto pyramid = geoGen.CreatePyramid(1.5f, 2.0f, 1.5f);
-    auto wedge = geoGen.CreateWedge(2.0f, 1.0f, 2.0f);
-    auto diamond = geoGen.CreateDiamond(0.8f);
-    auto triPrism = geoGen.CreateTriPrism(1.5f, 1.5f, 2.0f);
-
-    UINT boxVertexOffset = 0;
-    UINT gridVertexOffset = (UINT)box.Vertices.size();
-    UINT sphereVertexOffset = gridVertexOffset + (UINT)grid.Vertices.size();
-    UINT cylinderVertexOffset = sphereVertexOffset + (UINT)sphere.Vertices.size();
-    UINT coneVertexOffset = cylinderVertexOffset + (UINT)cylinder.Vertices.size();
-    UINT torusVertexOffset = coneVertexOffset + (UINT)cone.Vertices.size();
-    UINT pyramidVertexOffset = torusVertexOffset + (UINT)torus.Vertices.size();
-    UINT wedgeVertexOffset = pyramidVertexOffset + (UINT)pyramid.Vertices.size();
-    UINT diamondVertexOffset = wedgeVertexOffset + (UINT)wedge.Vertices.size();
-    UINT triPrismVertexOffset = diamondVertexOffset + (UINT)diamond.Vertices.size();
-
-    UINT boxIndexOffset = 0;
-    UINT gridIndexOffset = (UINT)box.Indices32.size();
-    UINT sphereIndexOffset = gridIndexOffset + (UINT)grid.Indices32.size();
-    UINT cylinderIndexOffset = sphereIndexOffset + (UINT)sphere.Indices32.size();
-    UINT coneIndexOffset = cylinderIndexOffset + (UINT)cylinder.Indices32.size();
-    UINT torusIndexOffset = coneIndexOffset + (UINT)cone.Indices32.size();
-    UINT pyramidIndexOffset = torusIndexOffset + (UINT)torus.Indices32.size();
-    UINT wedgeIndexOffset = pyramidIndexOffset + (UINT)pyramid.Indices32.size();
-    UINT diamondIndexOffset = wedgeIndexOffset + (UINT)wedge.Indices32.size();
-    UINT triPrismIndexOffset = diamondIndexOffset + (UINT)diamond.Indices32.size();
-
-    SubmeshGeometry boxSubmesh;
-    boxSubmesh.IndexCount = (UINT)box.Indices32.size();
-    boxSubmesh.StartIndexLocation = boxIndexOffset;
-    boxSubmesh.BaseVertexLocation = boxVertexOffset;
-
-    SubmeshGeometry gridSubmesh;
-    gridSubmesh.IndexCount = (UINT)grid.Indices32.size();
-    gridSubmesh.StartIndexLocation = gridIndexOffset;
-    gridSubmesh.BaseVertexLocation = gridVertexOffset;
-
-    SubmeshGeometry sphereSubmesh;
-    sphereSubmesh.IndexCount = (UINT)sphere.Indices32.size();
-    sphereSubmesh.StartIndexLocation = sphereIndexOffset;
-    sphereSubmesh.BaseVertexLocation = sphereVertexOffset;
-
-    SubmeshGeometry cylinderSubmesh;
-    cylinderSubmesh.IndexCount = (UINT)cylinder.Indices32.size();
-    cylinderSubmesh.StartIndexLocation = cylinderIndexOffset;
-    cylinderSubmesh.BaseVertexLocation = cylinderVertexOffset;
-
-    SubmeshGeometry coneSubmesh;
-    coneSubmesh.IndexCount = (UINT)cone.Indices32.size();
-    coneSubmesh.StartIndexLocation = coneIndexOffset;
-    coneSubmesh.BaseVertexLocation = coneVertexOffset;
-
-    SubmeshGeometry torusSubmesh;
-    torusSubmesh.IndexCount = (UINT)torus.Indices32.size();
-    torusSubmesh.StartIndexLocation = torusIndexOffset;
-    torusSubmesh.BaseVertexLocation = torusVertexOffset;
-
-    SubmeshGeometry pyramidSubmesh;
-    pyramidSubmesh.IndexCount = (UINT)pyramid.Indices32.size();
-    pyramidSubmesh.StartIndexLocation = pyramidIndexOffset;
-    pyramidSubmesh.BaseVertexLocation = pyramidVertexOffset;
-
-    SubmeshGeometry wedgeSubmesh;
-    wedgeSubmesh.IndexCount = (UINT)wedge.Indices32.size();
-    wedgeSubmesh.StartIndexLocation = wedgeIndexOffset;
-    wedgeSubmesh.BaseVertexLocation = wedgeVertexOffset;
-
-    SubmeshGeometry diamondSubmesh;
-    diamondSubmesh.IndexCount = (UINT)diamond.Indices32.size();
-    diamondSubmesh.StartIndexLocation = diamondIndexOffset;
-    diamondSubmesh.BaseVertexLocation = diamondVertexOffset;
-
-    SubmeshGeometry triPrismSubmesh;
-    triPrismSubmesh.IndexCount = (UINT)triPrism.Indices32.size();
-    triPrismSubmesh.StartIndexLocation = triPrismIndexOffset;
-    triPrismSubmesh.BaseVertexLocation = triPrismVertexOffset;
-
-    auto totalVertexCount =
-        box.Vertices.size() +
-        grid.Vertices.size() +
-        sphere.Vertices.size() +
-        cylinder.Vertices.size() +
-        cone.Vertices.size() +
-        torus.Vertices.size() +
-        pyramid.Vertices.size() +
-        wedge.Vertices.size() +
-        diamond.Vertices.size() +
-        triPrism.Vertices.size();
-
-    std::vector<Vertex> vertices(totalVertexCount);
-
-    UINT k = 0;
-
-    for (size_t i = 0; i < box.Vertices.size(); ++i, ++k)
-    {
-        vertices[k].Pos = box.Vertices[i].Position;
-        vertices[k].Normal = box.Vertices[i].Normal;
-
-        float localX = box.Vertices[i].Position.x;
-        float localY = box.Vertices[i].Position.y;
-        float localZ = box.Vertices[i].Position.z;
-
-        float texScaleSide = 1.0f;
-        float texScaleTop = 0.4f;
-
-        if (fabs(box.Vertices[i].Normal.y) > 0.9f)
-        {
-            // top / bottom
-            vertices[k].TexC = XMFLOAT2(
-                localX * texScaleTop + 0.5f,
-                localZ * texScaleTop + 0.5f
-            );
-        }
-        else if (fabs(box.Vertices[i].Normal.x) > 0.9f)
-        {
-            // left / right
-            vertices[k].TexC = XMFLOAT2(
-                localZ * texScaleSide + 0.5f,
-                localY * texScaleSide + 0.5f
-            );
-        }
-        else
-        {
-            // front / back
-            vertices[k].TexC = XMFLOAT2(
-                localX * texScaleSide + 0.5f,
-                localY * texScaleSide + 0.5f
-            );
-        }
-    }
-    for (size_t i = 0; i < grid.Vertices.size(); ++i, ++k)
+    const D3D_SHADER_MACRO depthDefines[] =
     {
-        vertices[k].Pos = grid.Vertices[i].Position;
-        vertices[k].Normal = grid.Vertices[i].Normal;
-        vertices[k].TexC = grid.Vertices[i].TexC;
-    }
-    for (size_t i = 0; i < sphere.Vertices.size(); ++i, ++k)
+        "DEPTH_ONLY", "1",
+        NULL, NULL
+    };
+
+    const D3D_SHADER_MACRO depthInstancedDefines[] =
     {
-        vertices[k].Pos = sphere.Vertices[i].Position;
-        vertices[k].Normal = sphere.Vertices[i].Normal;
-        vertices[k].TexC = sphere.Vertices[i].TexC;
-    }
-    for (size_t i = 0; i < cylinder.Vertices.size(); ++i, ++k)
+        "DEPTH_ONLY", "1",
+        "INSTANCED", "1",
+        NULL, NULL
+    };
+
+    const D3D_SHADER_MACRO bindlessDepthDefines[] =
     {
-        vertices[k].Pos = cylinder.Vertices[i].Position;
-        vertices[k].Normal = cylinder.Vertices[i].Normal;
-        vertices[k].TexC = cylinder.Vertices[i].TexC;
-    }
-    for (size_t i = 0; i < cone.Vertices.size(); ++i, ++k)
+        "DEPTH_ONLY", "1",
+        "BINDLESS", "1",
+        NULL, NULL
+    };
+
+    const D3D_SHADER_MACRO bindlessInstancedDepthDefines[] =
     {
-        vertices[k].Pos = cone.Vertices[i].Position;
-        vertices[k].Normal = cone.Vertices[i].Normal;
-        vertices[k].TexC = cone.Vertices[i].TexC;
-    }
-    for (size_t i = 0; i < torus.Vertices.size(); ++i, ++k)
+        "DEPTH_ONLY", "1",
+        "BINDLESS", "1",
+        "INSTANCED", "1",
+        NULL, NULL
+    };
+
+    mShaders["standardVS"] = mShaderCache->CompileShader(
+        L"Shaders\\VS.hlsl", nullptr, "VS", "vs_5_1");
+
+    mShaders["instancedVS"] = mShaderCache->CompileShader(
+        L"Shaders\\VS.hlsl", instancedDefines, "VS", "vs_5_1");
+
+    mShaders["opaquePS"] = mShaderCache->CompileShader(
+        L"Shaders\\PS.hlsl", nullptr, "PS", "ps_5_1");
+
+    mShaders["depthVS"] = mShaderCache->CompileShader(
+        L"Shaders\\VS.hlsl", depthDefines, "VS", "vs_5_1");
+
+    mShaders["depthInstancedVS"] = mShaderCache->CompileShader(
+        L"Shaders\\VS.hlsl", depthInstancedDefines, "VS", "vs_5_1");
+
+    if (mBindlessSupported)
     {
-        vertices[k].Pos = torus.Vertices[i].Position;
-        vertices[k].Normal = torus.Vertices[i].Normal;
-        vertices[k].TexC = torus.Vertices[i].TexC;
+        mShaders["bindlessVS"] = mShaderCache->CompileShader(
+            L"Shaders\\VS.hlsl", bindlessDefines, "VS", "vs_5_1");
+
+        mShaders["bindlessInstancedVS"] = mShaderCache->CompileShader(
+            L"Shaders\\VS.hlsl", bindlessInstancedDefines, "VS", "vs_5_1");
+
+        mShaders["bindlessPS"] = mShaderCache->CompileShader(
+            L"Shaders\\PS.hlsl", bindlessDefines, "PS", "ps_5_1");
+
+        mShaders["bindlessDepthVS"] = mShaderCache->CompileShader(
+            L"Shaders\\VS.hlsl", bindlessDepthDefines, "VS", "vs_5_1");
+
+        mShaders["bindlessInstancedDepthVS"] = mShaderCache->CompileShader(
+            L"Shaders\\VS.hlsl", bindlessInstancedDepthDefines, "VS", "vs_5_1");
     }
-    for (size_t i = 0; i < pyramid.Vertices.size(); ++i, ++k)
+
+    mShaders["shadowVS"] = mShaderCache->CompileShader(
+        L"Shaders\\Shadow.hlsl", nullptr, "VS", "vs_5_1");
+
+    mShaders["upscaleVS"] = mShaderCache->CompileShader(
+        L"Shaders\\Upscale.hlsl", nullptr, "VS", "vs_5_1");
+
+    mShaders["upscalePS"] = mShaderCache->CompileShader(
+        L"Shaders\\Upscale.hlsl", nullptr, "PS", "ps_5_1");
+
+    mShaders["lightCullCS"] = mShaderCache->CompileShader(
+        L"Shaders\\LightCulling.hlsl", nullptr, "CS", "cs_5_1");
+
+    mShaders["wavesUpdateCS"] = mShaderCache->CompileShader(
+        L"Shaders\\Waves.hlsl", nullptr, "UpdateCS", "cs_5_1");
+
+    mShaders["wavesDisturbCS"] = mShaderCache->CompileShader(
+        L"Shaders\\Waves.hlsl", nullptr, "DisturbCS", "cs_5_1");
+
+    mShaders["wavesVerticesCS"] = mShaderCache->CompileShader(
+        L"Shaders\\Waves.hlsl", nullptr, "VerticesCS", "cs_5_1");
+
+    if (mBindlessSupported)
     {
-        vertices[k].Pos = pyramid.Vertices[i].Position;
-        vertices[k].Normal = pyramid.Vertices[i].Normal;
-        vertices[k].TexC = pyramid.Vertices[i].TexC;
+        mShaders["drawCullCS"] = mShaderCache->CompileShader(
+            L"Shaders\\DrawCulling.hlsl", nullptr, "CS", "cs_5_1");
+
+        mShaders["hiZCS"] = mShaderCache->CompileShader(
+            L"Shaders\\HiZ.hlsl", nullptr, "CS", "cs_5_1");
     }
-    for (size_t i = 0; i < wedge.Vertices.size(); ++i, ++k)
+
+    mInputLayout =
     {
-        vertices[k].Pos = wedge.Vertices[i].Position;
-        vertices[k].Normal = wedge.Vertices[i].Normal;
-        vertices[k].TexC = wedge.Vertices[i].TexC;
-    }
-    for (size_t i = 0; i < diamond.Vertices.size(); ++i, ++k)
+        { "POSITION", 0, DXGI_FORMAT_R32G32B32_FLOAT, 0, 0,  D3D12_INPUT_CLASSIFICATION_PER_VERTEX_DATA, 0 },
+        { "NORMAL",   0, DXGI_FORMAT_R16G16_SNORM,    0, 12, D3D12_INPUT_CLASSIFICATION_PER_VERTEX_DATA, 0 },
+        { "TEXCOORD", 0, DXGI_FORMAT_R16G16_FLOAT,    0, 16, D3D12_INPUT_CLASSIFICATION_PER_VERTEX_DATA, 0 },
+    };
+
+    // Same vertex buffers; the input assembler skips the rest of each vertex.
+    mDepthInputLayout =
     {
-        vertices[k].Pos = diamond.Vertices[i].Position;
-        vertices[k].Normal = diamond.Vertices[i].Normal;
-        vertices[k].TexC = diamond.Vertices[i].TexC;
-    }
-    for (size_t i = 0; i < triPrism.Vertices.size(); ++i, ++k)
+        { "POSITION", 0, DXGI_FORMAT_R32G32B32_FLOAT, 0, 0,  D3D12_INPUT_CLASSIFICATION_PER_VERTEX_DATA, 0 },
+    };
+}
+
+template<typename FillFn>
+ComPtr<ID3D12Resource> ShapesApp::CreateGeometryBuffer(UINT byteSize, ComPtr<ID3DBlob>* cpuCopy, FillFn fill)
+{
+    void* stagingData = nullptr;
+    ComPtr<ID3D12Resource> buffer = d3dUtil::CreateDefaultBuffer(md3dDevice.Get(),
+        mCommandList.Get(), byteSize, *mDefaultBufferHeap, *mUploadRing, &stagingData);
+
+    // fill writes the data once, into the staging memory unless a CPU copy is
+    // wanted, which is then copied over rather than read back from there.
+    if (cpuCopy == nullptr)
     {
-        vertices[k].Pos = triPrism.Vertices[i].Position;
-        vertices[k].Normal = triPrism.Vertices[i].Normal;
-        vertices[k].TexC = triPrism.Vertices[i].TexC;
+        fill(stagingData);
+        return buffer;
     }
 
-    std::vector<std::uint16_t> indices;
-    indices.insert(indices.end(), std::begin(box.GetIndices16()), std::end(box.GetIndices16()));
-    indices.insert(indices.end(), std::begin(grid.GetIndices16()), std::end(grid.GetIndices16()));
-    indices.insert(indices.end(), std::begin(sphere.GetIndices16()), std::end(sphere.GetIndices16()));
-    indices.insert(indices.end(), std::begin(cylinder.GetIndices16()), std::end(cylinder.GetIndices16()));
-    indices.insert(indices.end(), begin(cone.GetIndices16()), end(cone.GetIndices16()));
-    indices.insert(indices.end(), begin(torus.GetIndices16()), end(torus.GetIndices16()));
-    indices.insert(indices.end(), begin(pyramid.GetIndices16()), end(pyramid.GetIndices16()));
-    indices.insert(indices.end(), begin(wedge.GetIndices16()), end(wedge.GetIndices16()));
-    indices.insert(indices.end(), begin(diamond.GetIndices16()), end(diamond.GetIndices16()));
-    indices.insert(indices.end(), begin(triPrism.GetIndices16()), end(triPrism.GetIndices16()));
+    ThrowIfFailed(D3DCreateBlob(byteSize, cpuCopy->GetAddressOf()));
+    fill((*cpuCopy)->GetBufferPointer());
+    memcpy(stagingData, (*cpuCopy)->GetBufferPointer(), byteSize);
 
-    const UINT vbByteSize = (UINT)vertices.size() * sizeof(Vertex);
-    const UINT ibByteSize = (UINT)indices.size() * sizeof(std::uint16_t);
+    return buffer;
+}
+
+void ShapesApp::BuildShapeGeometry(bool keepCpuCopies)
+{
+    using GeoVertex = GeometryGenerator::Vertex;
+
+    // Submeshes of shapeGeo, in buffer order.  A "_lodN" entry is a coarser
+    // tessellation of the mesh named before it; UpdateLods switches distant
+    // items over to them.  Given no arrays, Create only returns the size.
+    struct ShapeMesh
+    {
+        const char* Name;
+        GeometryGenerator::MeshSize (*Create)(GeometryGenerator& geoGen, GeoVertex* vertices, std::uint32_t* indices);
+    };
+
+    const ShapeMesh meshes[] =
+    {
+        { "box", [](GeometryGenerator& g, GeoVertex* v, std::uint32_t* i) { return g.CreateBox(1.0f, 1.0f, 1.0f, 0, v, i); } },
+        { "grid", [](GeometryGenerator& g, GeoVertex* v, std::uint32_t* i) { return g.CreateGrid(80.0f, 120.0f, 160, 120, v, i); } },
+        { "grid_lod1", [](GeometryGenerator& g, GeoVertex* v, std::uint32_t* i) { return g.CreateGrid(80.0f, 120.0f, 80, 60, v, i); } },
+        { "grid_lod2", [](GeometryGenerator& g, GeoVertex* v, std::uint32_t* i) { return g.CreateGrid(80.0f, 120.0f, 40, 30, v, i); } },
+        { "sphere", [](GeometryGenerator& g, GeoVertex* v, std::uint32_t* i) { return g.CreateSphere(0.5f, 20, 20, v, i); } },
+        { "sphere_lod1", [](GeometryGenerator& g, GeoVertex* v, std::uint32_t* i) { return g.CreateSphere(0.5f, 10, 10, v, i); } },
+        { "sphere_lod2", [](GeometryGenerator& g, GeoVertex* v, std::uint32_t* i) { return g.CreateSphere(0.5f, 6, 6, v, i); } },
+        { "cylinder", [](GeometryGenerator& g, GeoVertex* v, std::uint32_t* i) { return g.CreateCylinder(0.5f, 0.5f, 3.0f, 20, 20, v, i); } },
+        { "cylinder_lod1", [](GeometryGenerator& g, GeoVertex* v, std::uint32_t* i) { return g.CreateCylinder(0.5f, 0.5f, 3.0f, 10, 2, v, i); } },
+        { "cylinder_lod2", [](GeometryGenerator& g, GeoVertex* v, std::uint32_t* i) { return g.CreateCylinder(0.5f, 0.5f, 3.0f, 6, 1, v, i); } },
+        { "cone", [](GeometryGenerator& g, GeoVertex* v, std::uint32_t* i) { return g.CreateCone(1.0f, 1.0f, 20, 20, v, i); } },
+        { "cone_lod1", [](GeometryGenerator& g, GeoVertex* v, std::uint32_t* i) { return g.CreateCone(1.0f, 1.0f, 10, 2, v, i); } },
+        { "cone_lod2", [](GeometryGenerator& g, GeoVertex* v, std::uint32_t* i) { return g.CreateCone(1.0f, 1.0f, 6, 1, v, i); } },
+        { "torus", [](GeometryGenerator& g, GeoVertex* v, std::uint32_t* i) { return g.CreateTorus(1.0f, 24, 16, v, i); } },
+        { "torus_lod1", [](GeometryGenerator& g, GeoVertex* v, std::uint32_t* i) { return g.CreateTorus(1.0f, 12, 8, v, i); } },
+        { "torus_lod2", [](GeometryGenerator& g, GeoVertex* v, std::uint32_t* i) { return g.CreateTorus(1.0f, 8, 6, v, i); } },
+        { "pyramid", [](GeometryGenerator& g, GeoVertex* v, std::uint32_t* i) { return g.CreatePyramid(1.5f, 2.0f, 1.5f, v, i); } },
+        { "wedge", [](GeometryGenerator& g, GeoVertex* v, std::uint32_t* i) { return g.CreateWedge(2.0f, 1.0f, 2.0f, v, i); } },
+        { "diamond", [](GeometryGenerator& g, GeoVertex* v, std::uint32_t* i) { return g.CreateDiamond(0.8f, v, i); } },
+        { "triPrism", [](GeometryGenerator& g, GeoVertex* v, std::uint32_t* i) { return g.CreateTriPrism(1.5f, 1.5f, 2.0f, v, i); } },
+    };
+
+    GeometryGenerator geoGen;
+
+    // Sized first, so every mesh is generated in place in one arena.
+    GeometryGenerator::MeshSize sizes[_countof(meshes)];
+    SubmeshGeometry submeshes[_countof(meshes)];
+    UINT vertexCount = 0;
+    UINT indexCount = 0;
+    UINT maxMeshVertexCount = 0;
+    UINT maxMeshIndexCount = 0;
+
+    for (size_t m = 0; m < _countof(meshes); ++m)
+    {
+        sizes[m] = meshes[m].Create(geoGen, nullptr, nullptr);
+        maxMeshVertexCount = MathHelper::Max(maxMeshVertexCount, sizes[m].VertexCount);
+        maxMeshIndexCount = MathHelper::Max(maxMeshIndexCount, sizes[m].IndexCount);
+
+        submeshes[m].IndexCount = sizes[m].IndexCount;
+        submeshes[m].StartIndexLocation = indexCount;
+        submeshes[m].BaseVertexLocation = (INT)vertexCount;
+
+        vertexCount += sizes[m].VertexCount;
+        indexCount += sizes[m].IndexCount;
+    }
+
+    mShapeVertexArena.resize(vertexCount);
+    mGeometryIndexArena.resize(indexCount);
+    mMeshOptimizerScratch.Reserve(maxMeshVertexCount, maxMeshIndexCount);
 
     auto geo = std::make_unique<MeshGeometry>();
     geo->Name = "shapeGeo";
 
-    ThrowIfFailed(D3DCreateBlob(vbByteSize, &geo->VertexBufferCPU));
-    CopyMemory(geo->VertexBufferCPU->GetBufferPointer(), vertices.data(), vbByteSize);
+    for (size_t m = 0; m < _countof(meshes); ++m)
+    {
+        SubmeshGeometry& submesh = submeshes[m];
+        GeoVertex* vertices = &mShapeVertexArena[submesh.BaseVertexLocation];
+        std::uint32_t* indices = &mGeometryIndexArena[submesh.StartIndexLocation];
+
+        meshes[m].Create(geoGen, vertices, indices);
 
-    ThrowIfFailed(D3DCreateBlob(ibByteSize, &geo->IndexBufferCPU));
-    CopyMemory(geo->IndexBufferCPU->GetBufferPointer(), indices.data(), ibByteSize);
+        // The box gets planar texture coordinates per face, so scaled walls tile
+        // the texture instead of stretching it.
+        if (strcmp(meshes[m].Name, "box") == 0)
+        {
+            for (UINT i = 0; i < sizes[m].VertexCount; ++i)
+            {
+                GeoVertex& v = vertices[i];
 
-    geo->VertexBufferGPU = d3dUtil::CreateDefaultBuffer(md3dDevice.Get(),
-        mCommandList.Get(), vertices.data(), vbByteSize, geo->VertexBufferUploader);
+                float texScaleSide = 1.0f;
+                float texScaleTop = 0.4f;
 
-    geo->IndexBufferGPU = d3dUtil::CreateDefaultBuffer(md3dDevice.Get(),
-        mCommandList.Get(), indices.data(), ibByteSize, geo->IndexBufferUploader);
+                if (fabs(v.Normal.y) > 0.9f)
+                {
+                    // top / bottom
+                    v.TexC = XMFLOAT2(v.Position.x * texScaleTop + 0.5f, v.Position.z * texScaleTop + 0.5f);
+                }
+                else if (fabs(v.Normal.x) > 0.9f)
+                {
+                    // left / right
+                    v.TexC = XMFLOAT2(v.Position.z * texScaleSide + 0.5f, v.Position.y * texScaleSide + 0.5f);
+                }
+                else
+                {
+                    // front / back
+                    v.TexC = XMFLOAT2(v.Position.x * texScaleSide + 0.5f, v.Position.y * texScaleSide + 0.5f);
+                }
+            }
+        }
+
+        // Reorder for the vertex cache, overdraw and vertex fetch before the
+        // submesh is taken from it.
+        MeshOptimizer::Optimize(vertices, sizes[m].VertexCount, indices, sizes[m].IndexCount,
+            &GeoVertex::Position, mMeshOptimizerScratch);
+
+        BoundingBox::CreateFromPoints(submesh.Bounds, sizes[m].VertexCount, &vertices[0].Position, sizeof(GeoVertex));
+        geo->DrawArgs[meshes[m].Name] = submesh;
+    }
+
+    const UINT vbByteSize = vertexCount * sizeof(PackedVertex);
+    const UINT ibByteSize = indexCount * sizeof(std::uint16_t);
+
+    geo->VertexBufferGPU = CreateGeometryBuffer(vbByteSize, keepCpuCopies ? &geo->VertexBufferCPU : nullptr,
+        [&](void* data) { PackVertices(mShapeVertexArena.data(), vertexCount, static_cast<PackedVertex*>(data)); });
 
-    geo->VertexByteStride = sizeof(Vertex);
+    geo->IndexBufferGPU = CreateGeometryBuffer(ibByteSize, keepCpuCopies ? &geo->IndexBufferCPU : nullptr,
+        [&](void* data) { NarrowIndices(mGeometryIndexArena.data(), indexCount, static_cast<std::uint16_t*>(data)); });
+
+    geo->VertexByteStride = sizeof(PackedVertex);
     geo->VertexBufferByteSize = vbByteSize;
     geo->IndexFormat = DXGI_FORMAT_R16_UINT;
     geo->IndexBufferByteSize = ibByteSize;
 
-    geo->DrawArgs["box"] = boxSubmesh;
-    geo->DrawArgs["grid"] = gridSubmesh;
-    geo->DrawArgs["sphere"] = sphereSubmesh;
-    geo->DrawArgs["cylinder"] = cylinderSubmesh;
-    geo->DrawArgs["cone"] = coneSubmesh;
-    geo->DrawArgs["torus"] = torusSubmesh;
-    geo->DrawArgs["pyramid"] = pyramidSubmesh;
-    geo->DrawArgs["wedge"] = wedgeSubmesh;
-    geo->DrawArgs["diamond"] = diamondSubmesh;
-    geo->DrawArgs["triPrism"] = triPrismSubmesh;
-
     mGeometries[geo->Name] = std::move(geo);
 }
 
-
-void ShapesApp::BuildMazeGeometry()
+void ShapesApp::BuildMazeGeometry(bool keepCpuCopies)
 {
-    GeometryGenerator geoGen;
-
     mMazeWallBounds.clear(); // clear old collision boxes
 
-    std::vector<Vertex> allVertices;
-    std::vector<std::uint16_t> allIndices;
-    UINT vertexOffset = 0;
-
     // 2D maze layout (1 = wall, 0 = empty space)
     const int maze[15][15] =
     {
@@ -877,125 +3186,400 @@ void ShapesApp::BuildMazeGeometry()
     const int rows = 15;
     const int cols = 15;
 
-    float cellSize = 3.0f;   // size of each cell
+    // The maze is split into square tiles of chunkCells x chunkCells cells.  Each
+    // tile becomes its own submesh with its own bounds so it can be culled.
+    const int chunkCells = 8;
+
+    float cellSize = gMazeCellSize;
     float wallHeight = 7.0f; // height of walls
-    float wallThickness = 1.0f;
 
     float startX = -25.0f;   // maze position in world
     float startZ = -40.0f;
 
-    // function to add one wall cube
-    auto addWall = [&](float x, float z)
-        {
-            float groundY = -0.5f;
+    float groundY = -0.5f;
+    float wallCenterY = groundY + wallHeight * 0.5f;
 
-            // collision box for this wall
-            DirectX::BoundingBox box;
-            box.Center = XMFLOAT3(x, groundY + wallHeight * 0.5f, z);
-            box.Extents = XMFLOAT3(cellSize * 0.5f, wallHeight * 0.5f, cellSize * 0.5f);
-            mMazeWallBounds.push_back(box);
+    auto isWall = [&](int r, int c)
+        {
+            return r >= 0 && r < rows && c >= 0 && c < cols && maze[r][c] == 1;
+        };
 
-            // create cube mesh
-            auto cube = geoGen.CreateBox(cellSize, wallHeight, cellSize, 0);
+    // Every exposed face is a quad, so counting them sizes the arenas once and
+    // the walls are appended without reallocating.
+    UINT wallCount = 0;
+    UINT faceCount = 0;
+    for (int r = 0; r < rows; r++)
+    {
+        for (int c = 0; c < cols; c++)
+        {
+            if (!isWall(r, c))
+                continue;
+
+            ++wallCount;
+            faceCount += 1;
+            faceCount += isWall(r, c - 1) ? 0 : 1;
+            faceCount += isWall(r, c + 1) ? 0 : 1;
+            faceCount += isWall(r - 1, c) ? 0 : 1;
+            faceCount += isWall(r + 1, c) ? 0 : 1;
+        }
+    }
 
-            for (auto& v : cube.Vertices)
+    std::vector<Vertex>& allVertices = mMazeVertexArena;
+    std::vector<std::uint32_t>& allIndices = mGeometryIndexArena;
+    allVertices.clear();
+    allIndices.clear();
+    allVertices.reserve(4 * faceCount);
+    allIndices.reserve(6 * faceCount);
+    mMazeWallBounds.reserve(wallCount);
+
+    UINT chunkVertexStart = 0;
+    UINT maxChunkVertexCount = 0;
+
+    // Adds one quad.  'right' and 'up' span the face as seen from outside, so
+    // the (0,1,2)(0,2,3) triangles come out clockwise like GeometryGenerator's.
+    auto addFace = [&](const XMFLOAT3& center, const XMFLOAT3& n,
+        const XMFLOAT3& right, float halfRight,
+        const XMFLOAT3& up, float halfUp)
+        {
+            const float corners[4][2] =
             {
-                Vertex vert;
+                { -1.0f, -1.0f },
+                { -1.0f, +1.0f },
+                { +1.0f, +1.0f },
+                { +1.0f, -1.0f }
+            };
+
+            UINT base = (UINT)allVertices.size() - chunkVertexStart;
 
-                // convert local vertex to world position
-                float worldX = v.Position.x + x;
-                float worldY = v.Position.y + groundY + wallHeight * 0.5f;
-                float worldZ = v.Position.z + z;
+            for (int i = 0; i < 4; ++i)
+            {
+                float sr = corners[i][0] * halfRight;
+                float su = corners[i][1] * halfUp;
 
-                vert.Pos = XMFLOAT3(worldX, worldY, worldZ);
-                vert.Normal = v.Normal;
+                Vertex vert;
+                vert.Pos = XMFLOAT3(
+                    center.x + right.x * sr + up.x * su,
+                    center.y + right.y * sr + up.y * su,
+                    center.z + right.z * sr + up.z * su);
+                vert.Normal = n;
 
                 // simple texture mapping
                 float texScale = 0.2f;
 
-                if (fabs(v.Normal.y) > 0.9f)
+                if (fabs(n.y) > 0.9f)
                 {
-                    // top/bottom faces
-                    vert.TexC = XMFLOAT2(worldX * texScale, worldZ * texScale);
+                    // top faces
+                    vert.TexC = XMFLOAT2(vert.Pos.x * texScale, vert.Pos.z * texScale);
                 }
-                else if (fabs(v.Normal.x) > 0.9f)
+                else if (fabs(n.x) > 0.9f)
                 {
                     // side faces (left/right)
-                    vert.TexC = XMFLOAT2(worldZ * texScale, worldY * texScale);
+                    vert.TexC = XMFLOAT2(vert.Pos.z * texScale, vert.Pos.y * texScale);
                 }
                 else
                 {
                     // front/back faces
-                    vert.TexC = XMFLOAT2(worldX * texScale, worldY * texScale);
+                    vert.TexC = XMFLOAT2(vert.Pos.x * texScale, vert.Pos.y * texScale);
                 }
 
                 allVertices.push_back(vert);
             }
 
-            // add indices with offset
-            for (auto idx : cube.Indices32)
+            // Move the face's coordinates next to the origin, a whole number of
+            // repeats away, so they keep their precision as halves.
+            Vertex* face = &allVertices[allVertices.size() - 4];
+            float minU = MathHelper::Min(MathHelper::Min(face[0].TexC.x, face[1].TexC.x), MathHelper::Min(face[2].TexC.x, face[3].TexC.x));
+            float minV = MathHelper::Min(MathHelper::Min(face[0].TexC.y, face[1].TexC.y), MathHelper::Min(face[2].TexC.y, face[3].TexC.y));
+            for (int i = 0; i < 4; ++i)
             {
-                allIndices.push_back((std::uint16_t)(vertexOffset + idx));
+                face[i].TexC.x -= floorf(minU);
+                face[i].TexC.y -= floorf(minV);
             }
 
-            vertexOffset += (UINT)cube.Vertices.size();
+            allIndices.push_back(base + 0);
+            allIndices.push_back(base + 1);
+            allIndices.push_back(base + 2);
+            allIndices.push_back(base + 0);
+            allIndices.push_back(base + 2);
+            allIndices.push_back(base + 3);
         };
 
-    // loop through maze and place walls
-    for (int r = 0; r < rows; r++)
+    // Emits the visible faces of one wall cell.  Faces shared with a
+    // neighbouring wall cell are never seen, and the bottom face is below the
+    // ground, so neither is generated.
+    auto addWall = [&](int r, int c)
+        {
+            float x = startX + c * cellSize;
+            float z = startZ + r * cellSize;
+
+            float hs = cellSize * 0.5f;
+            float hh = wallHeight * 0.5f;
+
+            // collision box for this wall
+            DirectX::BoundingBox box;
+            box.Center = XMFLOAT3(x, wallCenterY, z);
+            box.Extents = XMFLOAT3(hs, hh, hs);
+            mMazeWallBounds.push_back(box);
+
+            const XMFLOAT3 up(0.0f, 1.0f, 0.0f);
+
+            if (!isWall(r, c - 1))
+                addFace(XMFLOAT3(x - hs, wallCenterY, z), XMFLOAT3(-1.0f, 0.0f, 0.0f), XMFLOAT3(0.0f, 0.0f, -1.0f), hs, up, hh);
+            if (!isWall(r, c + 1))
+                addFace(XMFLOAT3(x + hs, wallCenterY, z), XMFLOAT3(+1.0f, 0.0f, 0.0f), XMFLOAT3(0.0f, 0.0f, +1.0f), hs, up, hh);
+            if (!isWall(r - 1, c))
+                addFace(XMFLOAT3(x, wallCenterY, z - hs), XMFLOAT3(0.0f, 0.0f, -1.0f), XMFLOAT3(+1.0f, 0.0f, 0.0f), hs, up, hh);
+            if (!isWall(r + 1, c))
+                addFace(XMFLOAT3(x, wallCenterY, z + hs), XMFLOAT3(0.0f, 0.0f, +1.0f), XMFLOAT3(-1.0f, 0.0f, 0.0f), hs, up, hh);
+
+            addFace(XMFLOAT3(x, groundY + wallHeight, z), XMFLOAT3(0.0f, 1.0f, 0.0f),
+                XMFLOAT3(1.0f, 0.0f, 0.0f), hs, XMFLOAT3(0.0f, 0.0f, 1.0f), hs);
+        };
+
+    auto geo = std::make_unique<MeshGeometry>();
+    geo->Name = "mazeGeo";
+
+    // loop through the chunks, and through the maze cells of each chunk
+    for (int chunkR = 0; chunkR * chunkCells < rows; ++chunkR)
     {
-        for (int c = 0; c < cols; c++)
+        for (int chunkC = 0; chunkC * chunkCells < cols; ++chunkC)
         {
-            if (maze[r][c] == 1) // if wall
+            UINT chunkIndexStart = (UINT)allIndices.size();
+            chunkVertexStart = (UINT)allVertices.size();
+
+            for (int r = chunkR * chunkCells; r < MathHelper::Min(rows, (chunkR + 1) * chunkCells); r++)
             {
-                float x = startX + c * cellSize;
-                float z = startZ + r * cellSize;
-                addWall(x, z);
+                for (int c = chunkC * chunkCells; c < MathHelper::Min(cols, (chunkC + 1) * chunkCells); c++)
+                {
+                    if (isWall(r, c))
+                        addWall(r, c);
+                }
             }
+
+            UINT chunkVertexCount = (UINT)allVertices.size() - chunkVertexStart;
+            if (chunkVertexCount == 0)
+                continue;
+
+            maxChunkVertexCount = MathHelper::Max(maxChunkVertexCount, chunkVertexCount);
+
+            MeshOptimizer::Optimize(
+                &allVertices[chunkVertexStart], chunkVertexCount,
+                &allIndices[chunkIndexStart], allIndices.size() - chunkIndexStart,
+                &Vertex::Pos, mMeshOptimizerScratch);
+
+            // define submesh
+            SubmeshGeometry submesh;
+            submesh.IndexCount = (UINT)allIndices.size() - chunkIndexStart;
+            submesh.StartIndexLocation = chunkIndexStart;
+            submesh.BaseVertexLocation = (INT)chunkVertexStart;
+
+            BoundingBox::CreateFromPoints(
+                submesh.Bounds,
+                chunkVertexCount,
+                &allVertices[chunkVertexStart].Pos,
+                sizeof(Vertex));
+
+            geo->DrawArgs["mazeChunk_" + std::to_string(chunkR) + "_" + std::to_string(chunkC)] = submesh;
+        }
+    }
+
+    // Chunk indices are relative to the chunk's BaseVertexLocation, so 16-bit
+    // indices are enough unless a single chunk has more than 65535 vertices.
+    const bool use32BitIndices = maxChunkVertexCount > 0xffff;
+    const UINT indexByteStride = use32BitIndices ? sizeof(std::uint32_t) : sizeof(std::uint16_t);
+
+    // create GPU buffers, packed straight into their staging memory
+    const UINT vbByteSize = (UINT)allVertices.size() * sizeof(PackedVertex);
+    const UINT ibByteSize = (UINT)allIndices.size() * indexByteStride;
+
+    geo->VertexBufferGPU = CreateGeometryBuffer(vbByteSize, keepCpuCopies ? &geo->VertexBufferCPU : nullptr,
+        [&](void* data) { PackVertices(allVertices.data(), allVertices.size(), static_cast<PackedVertex*>(data)); });
+
+    geo->IndexBufferGPU = CreateGeometryBuffer(ibByteSize, keepCpuCopies ? &geo->IndexBufferCPU : nullptr,
+        [&](void* data)
+        {
+            if (use32BitIndices)
+                memcpy(data, allIndices.data(), ibByteSize);
+            else
+                NarrowIndices(allIndices.data(), allIndices.size(), static_cast<std::uint16_t*>(data));
+        });
+
+    geo->VertexByteStride = sizeof(PackedVertex);
+    geo->VertexBufferByteSize = vbByteSize;
+    geo->IndexFormat = use32BitIndices ? DXGI_FORMAT_R32_UINT : DXGI_FORMAT_R16_UINT;
+    geo->IndexBufferByteSize = ibByteSize;
+
+    mGeometries["mazeGeo"] = std::move(geo);
+
+    // The walls sit on the cell grid and are one cell wide, so with the grid's
+    // origin at the lowest wall corner every wall's max corner lands on a cell
+    // boundary. CellRange() includes that boundary, so each wall box is listed
+    // in a 2x2 block of cells.
+    mMazeCollisionGrid.Build(mMazeWallBounds, gMazeCellSize);
+
+    // A torch hangs above every open cell; BuildLights() turns these into lights.
+    mMazeTorchPositions.clear();
+    for (int r = 0; r < rows; r++)
+    {
+        for (int c = 0; c < cols; c++)
+        {
+            if (!isWall(r, c))
+                mMazeTorchPositions.push_back(XMFLOAT3(startX + c * cellSize, groundY + wallHeight * 0.6f, startZ + r * cellSize));
         }
     }
+}
+
+void ShapesApp::BuildWaterGeometry()
+{
+    // Left in GeometryGenerator's order, which the wave kernels index by row
+    // and column, so it is not run through MeshOptimizer.
+    GeometryGenerator geoGen;
+    GeometryGenerator::MeshData grid = geoGen.CreateGrid(
+        (gWaveColumnCount - 1) * gWaveSpacing, (gWaveRowCount - 1) * gWaveSpacing, gWaveRowCount, gWaveColumnCount);
+
+    std::vector<Vertex> vertices(grid.Vertices.size());
+    for (size_t i = 0; i < grid.Vertices.size(); ++i)
+    {
+        vertices[i].Pos = grid.Vertices[i].Position;
+        vertices[i].Normal = grid.Vertices[i].Normal;
+        vertices[i].TexC = grid.Vertices[i].TexC;
+    }
 
-    // create GPU buffers
-    const UINT vbByteSize = (UINT)allVertices.size() * sizeof(Vertex);
-    const UINT ibByteSize = (UINT)allIndices.size() * sizeof(std::uint16_t);
+    std::vector<PackedVertex> packedVertices = PackVertices(vertices);
+    std::vector<std::uint16_t> indices = grid.GetIndices16();
 
     auto geo = std::make_unique<MeshGeometry>();
-    geo->Name = "mazeGeo";
+    geo->Name = "waterGeo";
+
+    SubmeshGeometry submesh;
+    submesh.IndexCount = (UINT)indices.size();
+    submesh.StartIndexLocation = 0;
+    submesh.BaseVertexLocation = 0;
+    submesh.Bounds = ComputeMeshBounds(grid);
+    submesh.Bounds.Extents.y = gMaxWaveHeight;
+    geo->DrawArgs["water"] = submesh;
 
-    ThrowIfFailed(D3DCreateBlob(vbByteSize, &geo->VertexBufferCPU));
-    CopyMemory(geo->VertexBufferCPU->GetBufferPointer(), allVertices.data(), vbByteSize);
+    const UINT vbByteSize = (UINT)packedVertices.size() * sizeof(PackedVertex);
+    const UINT ibByteSize = (UINT)indices.size() * sizeof(std::uint16_t);
+    const UINT heightsByteSize = (UINT)grid.Vertices.size() * sizeof(float);
 
-    ThrowIfFailed(D3DCreateBlob(ibByteSize, &geo->IndexBufferCPU));
-    CopyMemory(geo->IndexBufferCPU->GetBufferPointer(), allIndices.data(), ibByteSize);
+    geo->IndexBufferGPU = d3dUtil::CreateDefaultBuffer(md3dDevice.Get(),
+        mCommandList.Get(), indices.data(), ibByteSize, *mDefaultBufferHeap, *mUploadRing);
 
-    geo->VertexBufferGPU = d3dUtil::CreateDefaultBuffer(
-        md3dDevice.Get(),
-        mCommandList.Get(),
-        allVertices.data(),
-        vbByteSize,
-        geo->VertexBufferUploader);
+    // The vertices and heights are written by the wave kernels on either
+    // queue, so they rest in the common state; the copies here promote them
+    // and they decay back once the list has run.
+    auto createCommonBuffer = [&](const void* initData, UINT byteSize)
+        {
+            ComPtr<ID3D12Resource> buffer = mDefaultBufferHeap->CreateBuffer(
+                byteSize,
+                D3D12_RESOURCE_STATE_COMMON,
+                D3D12_RESOURCE_FLAG_ALLOW_UNORDERED_ACCESS);
+
+            UploadAllocation staging;
+            if (!mUploadRing->Allocate(byteSize, 16, staging))
+                throw DxException(E_OUTOFMEMORY, L"UploadRing::Allocate", AnsiToWString(__FILE__), __LINE__);
+
+            if (initData != nullptr)
+                memcpy(staging.CpuAddress, initData, byteSize);
+            else
+                memset(staging.CpuAddress, 0, byteSize);
+            mCommandList->CopyBufferRegion(buffer.Get(), 0, staging.Resource, staging.Offset, byteSize);
+
+            return buffer;
+        };
 
-    geo->IndexBufferGPU = d3dUtil::CreateDefaultBuffer(
-        md3dDevice.Get(),
-        mCommandList.Get(),
-        allIndices.data(),
-        ibByteSize,
-        geo->IndexBufferUploader);
+    geo->VertexBufferGPU = createCommonBuffer(packedVertices.data(), vbByteSize);
+    mWaveHeights[0] = createCommonBuffer(nullptr, heightsByteSize);
+    mWaveHeights[1] = createCommonBuffer(nullptr, heightsByteSize);
+    mWaveCurrent = 0;
 
-    geo->VertexByteStride = sizeof(Vertex);
+    geo->VertexByteStride = sizeof(PackedVertex);
     geo->VertexBufferByteSize = vbByteSize;
     geo->IndexFormat = DXGI_FORMAT_R16_UINT;
     geo->IndexBufferByteSize = ibByteSize;
 
-    // define submesh
-    SubmeshGeometry submesh;
-    submesh.IndexCount = (UINT)allIndices.size();
-    submesh.StartIndexLocation = 0;
-    submesh.BaseVertexLocation = 0;
+    mGeometries[geo->Name] = std::move(geo);
 
-    geo->DrawArgs["mazeWalls"] = submesh;
+    // Damped wave equation on the grid, as in Frank Luna's Waves sample.
+    float dt = gWaveTimeStep;
+    float d = gWaveDamping * dt + 2.0f;
+    float e = (gWaveSpeed * gWaveSpeed) * (dt * dt) / (gWaveSpacing * gWaveSpacing);
+
+    mWaveConstants.K1 = (gWaveDamping * dt - 2.0f) / d;
+    mWaveConstants.K2 = (4.0f - 8.0f * e) / d;
+    mWaveConstants.K3 = (2.0f * e) / d;
+    mWaveConstants.SpatialStep = gWaveSpacing;
+    mWaveConstants.ColumnCount = gWaveColumnCount;
+    mWaveConstants.RowCount = gWaveRowCount;
+}
 
-    mGeometries["mazeGeo"] = std::move(geo);
+bool ShapesApp::LoadGeometryCache()
+{
+    if (mGeometryCacheFile.empty() || mRebuildGeometryCache)
+        return false;
+
+    MeshCacheReader cache;
+    if (!cache.Open(mGeometryCacheFile, gGeometryCacheVersion))
+        return false;
+
+    const char* geoNames[] = { "shapeGeo", "mazeGeo" };
+    MeshCacheReader::GeometryView views[_countof(geoNames)];
+
+    for (size_t i = 0; i < _countof(geoNames); ++i)
+    {
+        if (!cache.FindGeometry(geoNames[i], views[i]) || views[i].VertexByteStride != sizeof(PackedVertex))
+            return false;
+    }
+
+    std::vector<BoundingBox> wallBounds;
+    std::vector<XMFLOAT3> torchPositions;
+    if (!cache.FindBoxes("mazeWalls", wallBounds) || !cache.FindPoints("mazeTorches", torchPositions))
+        return false;
+
+    // Straight from the mapped file into the upload ring.  Nothing reads the
+    // CPU copies of cached geometry, so they are left empty.
+    for (size_t i = 0; i < _countof(geoNames); ++i)
+    {
+        auto geo = std::make_unique<MeshGeometry>();
+        geo->Name = geoNames[i];
+
+        geo->VertexBufferGPU = d3dUtil::CreateDefaultBuffer(md3dDevice.Get(),
+            mCommandList.Get(), views[i].VertexData, views[i].VertexBufferByteSize, *mDefaultBufferHeap, *mUploadRing);
+
+        geo->IndexBufferGPU = d3dUtil::CreateDefaultBuffer(md3dDevice.Get(),
+            mCommandList.Get(), views[i].IndexData, views[i].IndexBufferByteSize, *mDefaultBufferHeap, *mUploadRing);
+
+        geo->VertexByteStride = views[i].VertexByteStride;
+        geo->VertexBufferByteSize = views[i].VertexBufferByteSize;
+        geo->IndexFormat = views[i].IndexFormat;
+        geo->IndexBufferByteSize = views[i].IndexBufferByteSize;
+        geo->DrawArgs = std::move(views[i].DrawArgs);
+
+        mGeometries[geo->Name] = std::move(geo);
+    }
+
+    mMazeWallBounds = std::move(wallBounds);
+    mMazeCollisionGrid.Build(mMazeWallBounds, gMazeCellSize);
+    mMazeTorchPositions = std::move(torchPositions);
+
+    return true;
+}
+
+void ShapesApp::SaveGeometryCache()
+{
+    if (mGeometryCacheFile.empty())
+        return;
+
+    MeshCacheWriter cache;
+    cache.AddGeometry(*mGeometries["shapeGeo"]);
+    cache.AddGeometry(*mGeometries["mazeGeo"]);
+    cache.AddBoxes("mazeWalls", mMazeWallBounds);
+    cache.AddPoints("mazeTorches", mMazeTorchPositions);
+
+    // Not fatal: the next run generates the geometry again.
+    if (!cache.Save(mGeometryCacheFile, gGeometryCacheVersion))
+        ::OutputDebugStringW((L"Could not write the geometry cache " + mGeometryCacheFile + L"\n").c_str());
 }
 
 void ShapesApp::BuildMaterials()
@@ -1046,41 +3630,148 @@ void ShapesApp::BuildMaterials()
     mMaterials["water"] = std::move(water);
     mMaterials["tile"] = std::move(tile);
 }
+void ShapesApp::BuildLights()
+{
+    mLights.clear();
+
+    auto addPointLight = [&](XMFLOAT3 position, XMFLOAT3 strength, float falloffStart, float falloffEnd)
+        {
+            Light light;
+            light.Position = position;
+            light.Strength = strength;
+            light.FalloffStart = falloffStart;
+            light.FalloffEnd = falloffEnd;
+            mLights.push_back(light);
+        };
+
+    // Main directional light
+    Light sun;
+    sun.Direction = { 0.577f, -0.577f, 0.577f };
+    sun.Strength = { 0.75f, 0.72f, 0.68f };
+    mLights.push_back(sun);
+
+    mDirectionalLightCount = (UINT)mLights.size();
+
+    // Red, blue, purple and cyan point lights
+    addPointLight({ -7.0f, 2.2f, -5.0f }, { 1.0f, 0.2f, 0.2f }, 1.0f, 10.0f);
+    addPointLight({ 7.0f, 2.2f, -5.0f }, { 0.2f, 0.4f, 1.0f }, 1.0f, 10.0f);
+    addPointLight({ -7.0f, 2.2f, 5.0f }, { 0.8f, 0.2f, 1.0f }, 1.0f, 10.0f);
+    addPointLight({ 7.0f, 2.2f, 5.0f }, { 0.2f, 1.0f, 1.0f }, 1.0f, 10.0f);
+
+    // STRONG WHITE LIGHT (torus center highlight)
+    addPointLight({ 0.0f, 2.8f, 0.0f }, { 2.5f, 2.5f, 2.5f }, 0.5f, 4.0f);
+
+    // Maze corner lights
+    addPointLight({ -28.0f, 3.0f, -43.0f }, { 1.0f, 0.2f, 0.2f }, 1.0f, 18.0f);   // red
+    addPointLight({ 20.0f, 3.0f, -43.0f }, { 0.2f, 0.4f, 1.0f }, 1.0f, 18.0f);    // blue
+    addPointLight({ -28.0f, 3.0f, 5.0f }, { 0.8f, 0.2f, 1.0f }, 1.0f, 18.0f);     // purple
+    addPointLight({ 20.0f, 3.0f, 5.0f }, { 0.2f, 1.0f, 1.0f }, 1.0f, 18.0f);      // cyan
+
+    // Castle corner lights
+    addPointLight({ -27.0f, 8.0f, 17.0f }, { 1.0f, 0.5f, 0.2f }, 1.0f, 20.0f);    // orange
+    addPointLight({ 27.0f, 8.0f, 17.0f }, { 0.3f, 1.0f, 0.3f }, 1.0f, 20.0f);     // green
+    addPointLight({ -27.0f, 8.0f, 43.0f }, { 1.0f, 0.2f, 0.8f }, 1.0f, 20.0f);    // pink
+    addPointLight({ 27.0f, 8.0f, 43.0f }, { 1.0f, 1.0f, 0.2f }, 1.0f, 20.0f);     // yellow
+
+    // STRONG WHITE LIGHT (castle interior)
+    addPointLight({ 0.0f, 6.0f, -15.0f }, { 2.5f, 2.5f, 2.5f }, 0.5f, 10.0f);
+
+    // Maze torches.  The brightness varies a little from torch to torch so the
+    // corridors do not look tiled.
+    for (size_t i = 0; i < mMazeTorchPositions.size(); ++i)
+    {
+        float flicker = 0.8f + 0.05f * (float)((i * 7) % 5);
+        addPointLight(mMazeTorchPositions[i], { 1.0f * flicker, 0.55f * flicker, 0.2f * flicker }, 0.5f, 6.0f);
+    }
+
+    assert(mLights.size() <= MaxLights);
+
+    mLightsNumFramesDirty = gNumFrameResources;
+}
+
+void ShapesApp::BuildClusterBuffers()
+{
+    // Written by the light culling pass, read by the pixel shader.  The grid is
+    // a fixed number of tiles, so the buffers do not depend on the window size.
+    // They rest in the common state between frames, so either queue can take
+    // them.
+    UINT clusterCount = gClusterCountX * gClusterCountY * gClusterCountZ;
+
+    mClusterLightCounts = mDefaultBufferHeap->CreateBuffer(
+        (UINT64)clusterCount * sizeof(UINT),
+        D3D12_RESOURCE_STATE_COMMON,
+        D3D12_RESOURCE_FLAG_ALLOW_UNORDERED_ACCESS);
+
+    mClusterLightIndices = mDefaultBufferHeap->CreateBuffer(
+        (UINT64)clusterCount * gMaxLightsPerCluster * sizeof(UINT),
+        D3D12_RESOURCE_STATE_COMMON,
+        D3D12_RESOURCE_FLAG_ALLOW_UNORDERED_ACCESS);
+}
+
+void ShapesApp::SetSubmesh(RenderItem& ri, const std::string& key)
+{
+    // The coarser levels, where the geometry has them.
+    ri.Lods[0] = ri.Geo->DrawArgs[key];
+    ri.LodCount = 1;
+
+    while (ri.LodCount < gMaxLods)
+    {
+        auto it = ri.Geo->DrawArgs.find(key + "_lod" + std::to_string(ri.LodCount));
+        if (it == ri.Geo->DrawArgs.end())
+            break;
+
+        ri.Lods[ri.LodCount++] = it->second;
+    }
+
+    ri.Lod = 0;
+    ri.IndexCount = ri.Lods[0].IndexCount;
+    ri.StartIndexLocation = ri.Lods[0].StartIndexLocation;
+    ri.BaseVertexLocation = ri.Lods[0].BaseVertexLocation;
+
+    // The finest level bounds them all.
+    ri.Bounds = ri.Lods[0].Bounds;
+}
+
 void ShapesApp::BuildRenderItems()
 {
-    UINT objCBIndex = 0;
+    mTransforms = std::make_unique<TransformStore>((UINT)gNumFrameResources);
 
-    auto gridRitem = std::make_unique<RenderItem>();
-    gridRitem->World = MathHelper::Identity4x4();
-    gridRitem->ObjCBIndex = objCBIndex++;
+    RenderItem* gridRitem = NewRenderItem();
+    gridRitem->TransformIndex = mTransforms->Add(XMMatrixIdentity(), TransformStore::None, gridRitem->ObjCBIndex);
     gridRitem->Geo = mGeometries["shapeGeo"].get();
     gridRitem->PrimitiveType = D3D_PRIMITIVE_TOPOLOGY_TRIANGLELIST;
-    gridRitem->IndexCount = gridRitem->Geo->DrawArgs["grid"].IndexCount;
-    gridRitem->StartIndexLocation = gridRitem->Geo->DrawArgs["grid"].StartIndexLocation;
-    gridRitem->BaseVertexLocation = gridRitem->Geo->DrawArgs["grid"].BaseVertexLocation;
+    SetSubmesh(*gridRitem, "grid");
     gridRitem->Mat = mMaterials["grass"].get();
-    mAllRitems.push_back(std::move(gridRitem));
 
+    //  TÜM KALEYE TEK NOKTADAN ROTATION
     XMMATRIX castleRot = XMMatrixRotationY(XMConvertToRadians(180.0f));
+    UINT castleTransform = mTransforms->Add(castleRot);
 
-    auto AddItem = [&](const std::string& key, const XMMATRIX& world, const std::string& matName)
+    // Adds an item below the given transform and returns the item's transform.
+    auto AddItemTo = [&](UINT parent, const std::string& key, const XMMATRIX& world, const std::string& matName)
         {
-            auto r = std::make_unique<RenderItem>();
-
-            //  TÜM KALEYE TEK NOKTADAN ROTATION
-            XMMATRIX finalWorld = world * castleRot;
-
-            XMStoreFloat4x4(&r->World, finalWorld);
-
-            r->ObjCBIndex = objCBIndex++;
+            RenderItem* r = NewRenderItem();
+            r->TransformIndex = mTransforms->Add(world, parent, r->ObjCBIndex);
             r->Geo = mGeometries["shapeGeo"].get();
             r->PrimitiveType = D3D_PRIMITIVE_TOPOLOGY_TRIANGLELIST;
-            r->IndexCount = r->Geo->DrawArgs[key].IndexCount;
-            r->StartIndexLocation = r->Geo->DrawArgs[key].StartIndexLocation;
-            r->BaseVertexLocation = r->Geo->DrawArgs[key].BaseVertexLocation;
+            SetSubmesh(*r, key);
             r->Mat = mMaterials[matName].get();
 
-            mAllRitems.push_back(std::move(r));
+            return r->TransformIndex;
+        };
+
+    auto AddItem = [&](const std::string& key, const XMMATRIX& world, const std::string& matName)
+        {
+            return AddItemTo(castleTransform, key, world, matName);
+        };
+
+    auto AddSpinner = [&](UINT transform, const XMMATRIX& rest, float rate)
+        {
+            SpinningTransform t;
+            t.Transform = transform;
+            XMStoreFloat4x4(&t.Rest, rest);
+            t.Rate = rate;
+            mSpinningTransforms.push_back(t);
         };
 
     const float castleX = 0.0f;
@@ -1186,7 +3877,8 @@ void ShapesApp::BuildRenderItems()
 
     auto AddDiamondOnCone = [&](float x, float z)
         {
-            AddItem("diamond", XMMatrixScaling(diamondS, diamondS * 1.6f, diamondS) * XMMatrixTranslation(x, diamondY, z), "crystal");
+            XMMATRIX world = XMMatrixScaling(diamondS, diamondS * 1.6f, diamondS) * XMMatrixTranslation(x, diamondY, z);
+            AddSpinner(AddItem("diamond", world, "crystal"), world, 0.8f);
         };
 
     AddDiamondOnCone(TLx, backZ2);
@@ -1198,35 +3890,41 @@ void ShapesApp::BuildRenderItems()
         const float fountainX = 0;
         const float fountainZ =  50.0f;
 
+        // The parts are placed relative to the fountain's own transform.
+        UINT fountain = mTransforms->Add(XMMatrixTranslation(fountainX, 0.0f, fountainZ), castleTransform);
+
         const float bowl1Major = 8.0f;
         const float bowl2Major = 5.5f;
         const float bowlYScale = 1.0f;
 
         const float baseCylH = 5.5f;
         const float baseCylR = 3.5f;
-        AddItem("cylinder", XMMatrixScaling(baseCylR, baseCylH / cylMeshH, baseCylR) * XMMatrixTranslation(fountainX, (baseCylH * 0.5f), fountainZ), "tile");
+        AddItemTo(fountain, "cylinder", XMMatrixScaling(baseCylR, baseCylH / cylMeshH, baseCylR) * XMMatrixTranslation(0.0f, (baseCylH * 0.5f), 0.0f), "tile");
 
         const float colH = 7.0f;
         const float colR = 1.8f;
-        AddItem("cylinder", XMMatrixScaling(colR, colH / cylMeshH, colR) * XMMatrixTranslation(fountainX, baseCylH + (colH * 0.5f), fountainZ), "tile");
+        AddItemTo(fountain, "cylinder", XMMatrixScaling(colR, colH / cylMeshH, colR) * XMMatrixTranslation(0.0f, baseCylH + (colH * 0.5f), 0.0f), "tile");
 
         const float bowl1Y = baseCylH + colH + 0.55f;
-        AddItem("torus", XMMatrixScaling(bowl1Major, bowlYScale, bowl1Major) * XMMatrixTranslation(fountainX, bowl1Y, fountainZ), "crystal");
+        XMMATRIX bowl1 = XMMatrixScaling(bowl1Major, bowlYScale, bowl1Major) * XMMatrixTranslation(0.0f, bowl1Y, 0.0f);
+        AddSpinner(AddItemTo(fountain, "torus", bowl1, "crystal"), bowl1, 0.3f);
 
         const float torusMinor = bowl1Major * 0.30f;
         const float sphereR = torusMinor * 0.85f;
-        AddItem("sphere", XMMatrixScaling(sphereR, sphereR, sphereR) * XMMatrixTranslation(fountainX, bowl1Y, fountainZ), "tile");
+        AddItemTo(fountain, "sphere", XMMatrixScaling(sphereR, sphereR, sphereR) * XMMatrixTranslation(0.0f, bowl1Y, 0.0f), "tile");
 
         const float topColH = 1.2f;
         const float topColR = 0.35f;
-        AddItem("cylinder", XMMatrixScaling(topColR, topColH / cylMeshH, topColR) * XMMatrixTranslation(fountainX, bowl1Y + 0.65f + (topColH * 0.5f), fountainZ), "tile");
+        AddItemTo(fountain, "cylinder", XMMatrixScaling(topColR, topColH / cylMeshH, topColR) * XMMatrixTranslation(0.0f, bowl1Y + 0.65f + (topColH * 0.5f), 0.0f), "tile");
 
         const float bowl2Y = bowl1Y + 1.55f;
-        AddItem("torus", XMMatrixScaling(bowl2Major, bowlYScale, bowl2Major) * XMMatrixTranslation(fountainX, bowl2Y, fountainZ), "crystal");
+        XMMATRIX bowl2 = XMMatrixScaling(bowl2Major, bowlYScale, bowl2Major) * XMMatrixTranslation(0.0f, bowl2Y, 0.0f);
+        AddSpinner(AddItemTo(fountain, "torus", bowl2, "crystal"), bowl2, -0.5f);
 
         const float ring3Major = 1.0f;
         const float ring3Y = bowl2Y + 0.85f;
-        AddItem("torus", XMMatrixScaling(ring3Major, bowlYScale, ring3Major) * XMMatrixTranslation(fountainX, ring3Y, fountainZ), "crystal");
+        XMMATRIX ring3 = XMMatrixScaling(ring3Major, bowlYScale, ring3Major) * XMMatrixTranslation(0.0f, ring3Y, 0.0f);
+        AddSpinner(AddItemTo(fountain, "torus", ring3, "crystal"), ring3, 1.2f);
     }
 
     const float triMeshW = 1.5f;
@@ -1263,70 +3961,431 @@ void ShapesApp::BuildRenderItems()
     AddItem("pyramid", S * XMMatrixTranslation(-(halfW - inset), y, +(halfD - inset)), "stone");
     AddItem("pyramid", S * XMMatrixTranslation(+(halfW - inset), y, +(halfD - inset)), "stone");
 
-    const float innerEndZ = innerCenterZ - (innerDepth * 0.5f);
+    const float innerEndZ = innerCenterZ - (innerDepth * 0.5f);
+
+    const float miniPostWorldH = wallH * 1.0f;
+    const float miniScaleY = miniPostWorldH / cylMeshH;
+    const float miniScaleXZ = scaleXZ * 0.8f;
+    XMMATRIX miniPostS = XMMatrixScaling(miniScaleXZ, miniScaleY, miniScaleXZ);
+
+    const float miniPostY = (cylMeshH * miniScaleY) * 0.5f;
+    const float miniPostWorldR = cylMeshR * miniScaleXZ;
+    const float miniConeWorldR = miniPostWorldR * 1.5f;
+    const float miniConeWorldH = miniPostWorldH * 1.3f;
+
+    XMMATRIX miniConeS = XMMatrixScaling(miniConeWorldR, miniConeWorldH, miniConeWorldR);
+    const float miniConeY = miniPostWorldH + (miniConeWorldH * 0.5f);
+
+    AddItem("cylinder", miniPostS * XMMatrixTranslation(innerLeftX, miniPostY, innerEndZ), "stone");
+    AddItem("cone", miniConeS * XMMatrixTranslation(innerLeftX, miniConeY, innerEndZ), "stone");
+    AddItem("cylinder", miniPostS * XMMatrixTranslation(innerRightX, miniPostY, innerEndZ), "stone");
+    AddItem("cone", miniConeS * XMMatrixTranslation(innerRightX, miniConeY, innerEndZ), "stone");
+
+    {
+        const float wedgeMeshW = 2.0f;
+        const float wedgeMeshH = 1.0f;
+        const float wedgeMeshD = 2.0f;
+
+        const float wedgeW = 1.2f;
+        const float wedgeH = 0.6f;
+        const float wedgeD = 1.6f;
+
+        const float wsX = wedgeW / wedgeMeshW;
+        const float wsY = wedgeH / wedgeMeshH;
+        const float wsZ = wedgeD / wedgeMeshD;
+
+        const float wedgeX = tentX;
+        const float wedgeZ = tentZ - (tentD * 0.5f) - 0.9f;
+        const float wedgeY = wedgeH * 0.5f;
+
+        XMMATRIX W = XMMatrixScaling(wsX, wsY, wsZ) *
+            XMMatrixRotationY(XMConvertToRadians(45.0f)) *
+            XMMatrixTranslation(wedgeX, wedgeY, wedgeZ);
+
+        AddItem("wedge", W, "stone");
+    }
+
+    // The water is not part of the castle; its grid already spans the ground.
+    RenderItem* waterRitem = NewRenderItem();
+    waterRitem->TransformIndex = mTransforms->Add(
+        XMMatrixTranslation(0.0f, gWaterHeight, 0.0f), TransformStore::None, waterRitem->ObjCBIndex);
+    waterRitem->Geo = mGeometries["waterGeo"].get();
+    waterRitem->PrimitiveType = D3D_PRIMITIVE_TOPOLOGY_TRIANGLELIST;
+    SetSubmesh(*waterRitem, "water");
+    waterRitem->Mat = mMaterials["water"].get();
+
+    // One render item per maze chunk so each chunk is culled on its own.
+    auto mazeGeo = mGeometries["mazeGeo"].get();
+    for (auto& chunk : mazeGeo->DrawArgs)
+    {
+        RenderItem* mazeRitem = NewRenderItem();
+        mazeRitem->TransformIndex = mTransforms->Add(XMMatrixIdentity(), TransformStore::None, mazeRitem->ObjCBIndex);
+        mazeRitem->Geo = mazeGeo;
+        mazeRitem->Mat = mMaterials["stone"].get();
+        mazeRitem->PrimitiveType = D3D_PRIMITIVE_TOPOLOGY_TRIANGLELIST;
+        SetSubmesh(*mazeRitem, chunk.first);
+    }
+
+    // -benchmarkScale: an N x N field of primitives over the ground, jittered from
+    // a fixed seed so every run builds the same scene.  Spots on the maze walls
+    // are left empty to keep the maze walkable.
+    if (mBenchmarkScale > 0)
+    {
+        const char* shapes[] = { "box", "sphere", "cylinder", "cone", "torus" };
+        const char* materials[] = { "stone", "tile", "crystal", "grass" };
+
+        std::uint32_t seed = 1;
+        auto random = [&seed]()
+            {
+                seed = seed * 1664525u + 1013904223u;
+                return (float)(seed >> 8) / 16777216.0f;
+            };
+
+        const float fieldW = 80.0f;
+        const float fieldD = 120.0f;
+        const float cellW = fieldW / mBenchmarkScale;
+        const float cellD = fieldD / mBenchmarkScale;
+        const float size = 0.5f * MathHelper::Min(cellW, cellD);
+
+        for (UINT i = 0; i < mBenchmarkScale; ++i)
+        {
+            for (UINT j = 0; j < mBenchmarkScale; ++j)
+            {
+                float x = -0.5f * fieldW + (j + random()) * cellW;
+                float z = -0.5f * fieldD + (i + random()) * cellD;
+                float scale = size * (0.5f + random());
+                const char* shape = shapes[(UINT)(random() * _countof(shapes)) % _countof(shapes)];
+                const char* material = materials[(UINT)(random() * _countof(materials)) % _countof(materials)];
+                float angle = XM_2PI * random();
+
+                if (CheckCollision(XMFLOAT3(x, 1.0f, z), scale))
+                    continue;
+
+                RenderItem* r = NewRenderItem();
+                r->Geo = mGeometries["shapeGeo"].get();
+                r->PrimitiveType = D3D_PRIMITIVE_TOPOLOGY_TRIANGLELIST;
+                SetSubmesh(*r, shape);
+                r->Mat = mMaterials[material].get();
+
+                // Resting on the ground.
+                float y = scale * (r->Bounds.Extents.y - r->Bounds.Center.y);
+                XMMATRIX local = XMMatrixScaling(scale, scale, scale) * XMMatrixRotationY(angle) * XMMatrixTranslation(x, y, z);
+                r->TransformIndex = mTransforms->Add(local, TransformStore::None, r->ObjCBIndex);
+
+                if (mBenchmarkAnimate)
+                {
+                    SpinningTransform t;
+                    t.Transform = r->TransformIndex;
+                    XMStoreFloat4x4(&t.Rest, local);
+                    t.Rate = 1.0f;
+                    mSpinningTransforms.push_back(t);
+                }
+            }
+        }
+    }
+
+
+    // The worlds are needed for the bounds now; the object constants are written
+    // in the first frames.
+    mTransforms->UpdateWorld();
+
+    mRitemPool.ForEach([this](RenderItem& ri) { AddToScene(&ri, false); });
+
+    // Walls and maze chunks; small pieces hide little and would only add
+    // vertices to the prepass.
+    for (auto ri : mOpaqueRitems)
+    {
+        const XMFLOAT3& e = ri->WorldBounds.Extents;
+        ri->Occluder = MathHelper::Max(e.x, MathHelper::Max(e.y, e.z)) >= gMinOccluderExtent;
+
+        if (ri->Occluder)
+            mOccluderRitems.push_back(ri);
+    }
+
+    // The shadow cascades' depth range has to take in every caster.
+    mShadowSceneBounds = BoundingSphere(XMFLOAT3(0.0f, 0.0f, 0.0f), 1.0f);
+    for (size_t i = 0; i < mOpaqueRitems.size(); ++i)
+    {
+        BoundingSphere sphere;
+        BoundingSphere::CreateFromBoundingBox(sphere, mOpaqueRitems[i]->WorldBounds);
+
+        if (i == 0)
+            mShadowSceneBounds = sphere;
+        else
+            BoundingSphere::CreateMerged(mShadowSceneBounds, mShadowSceneBounds, sphere);
+    }
+}
+
+RenderItem* ShapesApp::NewRenderItem()
+{
+    PoolHandle handle = mRitemPool.Allocate();
+
+    RenderItem* ri = mRitemPool.Get(handle);
+    ri->Handle = handle;
+    ri->ObjCBIndex = mObjectSlots.Allocate();
+    return ri;
+}
+
+void ShapesApp::AddToScene(RenderItem* ri, bool spawned)
+{
+    if (ri->TransformIndex >= (UINT)mTransformRitems.size())
+        mTransformRitems.resize(mTransforms->GetCount(), nullptr);
+    mTransformRitems[ri->TransformIndex] = ri;
+    ri->Spawned = spawned;
+
+    // A world still waiting for UpdateWorld is redone with the bounds there.
+    ri->Bounds.Transform(ri->WorldBounds, mTransforms->GetWorld(ri->TransformIndex));
+
+    // Number the meshes for the sort keys.
+    auto it = std::find(mSortGeos.begin(), mSortGeos.end(), ri->Geo);
+    ri->GeoSortId = (UINT)(it - mSortGeos.begin());
+
+    if (it == mSortGeos.end())
+        mSortGeos.push_back(ri->Geo);
+
+    if (ri->Mat && ri->Mat->Name == "water")
+        mTransparentRitems.push_back(ri);
+    else if (spawned)
+        mDynamicOpaqueRitems.push_back(ri);
+    else
+        mOpaqueRitems.push_back(ri);
+
+    // Water casts no shadow.  A caster added after startup dirties no cached
+    // cascade, since it goes straight to the dynamic map.
+    if (ri->Mat && ri->Mat->Name == "water")
+        return;
+
+    ri->StaticCaster = !spawned;
+    if (ri->StaticCaster)
+        mStaticCasterRitems.push_back(ri);
+    else
+        mDynamicCasterRitems.push_back(ri);
+}
+
+PoolHandle ShapesApp::SpawnRenderItem(const std::string& key, const XMMATRIX& world, const std::string& matName)
+{
+    RenderItem* ri = NewRenderItem();
+    ri->TransformIndex = mTransforms->Add(world, TransformStore::None, ri->ObjCBIndex);
+    ri->Geo = mGeometries["shapeGeo"].get();
+    ri->PrimitiveType = D3D_PRIMITIVE_TOPOLOGY_TRIANGLELIST;
+    SetSubmesh(*ri, key);
+    ri->Mat = mMaterials[matName].get();
+
+    AddToScene(ri, true);
+    return ri->Handle;
+}
+
+void ShapesApp::DestroyRenderItem(PoolHandle handle)
+{
+    RenderItem* ri = mRitemPool.Get(handle);
+    if (ri == nullptr || ri->TransformIndex == TransformStore::None)
+        return;
+
+    assert(ri->Spawned);
+    if (!ri->Spawned)
+        return;
+
+    // Order does not matter here; the visible lists are sorted every frame.
+    auto remove = [ri](std::vector<RenderItem*>& ritems)
+        {
+            auto it = std::find(ritems.begin(), ritems.end(), ri);
+            if (it != ritems.end())
+            {
+                *it = ritems.back();
+                ritems.pop_back();
+            }
+        };
+    // Spawned items are never static casters.
+    remove(mDynamicOpaqueRitems);
+    remove(mTransparentRitems);
+    remove(mDynamicCasterRitems);
+
+    mTransformRitems[ri->TransformIndex] = nullptr;
+    mTransforms->Remove(ri->TransformIndex);
+    ri->TransformIndex = TransformStore::None;
+
+    // The frame being built may still draw it, so the entry and the slot stay
+    // taken until its fence comes back.
+    RetiredRenderItem retired;
+    retired.Handle = handle;
+    retired.Fence = mCurrentFence + 1;
+    mRetiredRitems.push_back(retired);
+}
+
+void ShapesApp::ReleaseDestroyedRitems()
+{
+    UINT64 completedFence = mFence->GetCompletedValue();
+
+    while (!mRetiredRitems.empty() && mRetiredRitems.front().Fence <= completedFence)
+    {
+        PoolHandle handle = mRetiredRitems.front().Handle;
+        mRetiredRitems.pop_front();
+
+        mObjectSlots.Release(mRitemPool.Get(handle)->ObjCBIndex);
+        mRitemPool.Free(handle);
+    }
+}
+
+void ShapesApp::UpdateTransients(const GameTimer& gt)
+{
+    while (!mTransients.empty() && mTransients.front().ExpireTime <= gt.TotalTime())
+    {
+        DestroyRenderItem(mTransients.front().Handle);
+        mTransients.pop_front();
+    }
+
+    if (mSpawnRate <= 0.0f)
+        return;
+
+    const char* shapes[] = { "box", "sphere", "cylinder", "cone", "torus" };
+    const char* materials[] = { "stone", "tile", "crystal", "grass" };
+
+    auto random = [this]()
+        {
+            mSpawnSeed = mSpawnSeed * 1664525u + 1013904223u;
+            return (float)(mSpawnSeed >> 8) / 16777216.0f;
+        };
+
+    // At most a second's worth at once, so a long frame does not flood the scene.
+    mSpawnBudget = MathHelper::Min(mSpawnBudget + mSpawnRate * gt.DeltaTime(), mSpawnRate);
+
+    for (; mSpawnBudget >= 1.0f; mSpawnBudget -= 1.0f)
+    {
+        // Over the same area as the -benchmarkScale field, above the ground.
+        float x = 80.0f * (random() - 0.5f);
+        float z = 120.0f * (random() - 0.5f);
+        float y = 2.0f + 6.0f * random();
+        float scale = 0.3f + 0.5f * random();
+        const char* shape = shapes[(UINT)(random() * _countof(shapes)) % _countof(shapes)];
+        const char* material = materials[(UINT)(random() * _countof(materials)) % _countof(materials)];
+
+        TransientItem item;
+        item.Handle = SpawnRenderItem(shape, XMMatrixScaling(scale, scale, scale) * XMMatrixTranslation(x, y, z), material);
+        item.ExpireTime = gt.TotalTime() + gTransientLifetime;
+        mTransients.push_back(item);
+    }
+}
+
+void ShapesApp::BuildInstanceBatches()
+{
+    // Group the opaque items by the submesh chain they draw and the material they
+    // use; the finest level identifies the chain.
+    // Transparent items stay on the per-item path so they keep their draw order.
+    mOpaqueBatches.clear();
 
-    const float miniPostWorldH = wallH * 1.0f;
-    const float miniScaleY = miniPostWorldH / cylMeshH;
-    const float miniScaleXZ = scaleXZ * 0.8f;
-    XMMATRIX miniPostS = XMMatrixScaling(miniScaleXZ, miniScaleY, miniScaleXZ);
+    for (auto ri : mOpaqueRitems)
+    {
+        auto it = std::find_if(mOpaqueBatches.begin(), mOpaqueBatches.end(),
+            [ri](const InstanceBatch& b)
+            {
+                return b.Geo == ri->Geo &&
+                    b.Mat == ri->Mat &&
+                    b.PrimitiveType == ri->PrimitiveType &&
+                    b.Lods[0].IndexCount == ri->Lods[0].IndexCount &&
+                    b.Lods[0].StartIndexLocation == ri->Lods[0].StartIndexLocation &&
+                    b.Lods[0].BaseVertexLocation == ri->Lods[0].BaseVertexLocation;
+            });
+
+        if (it == mOpaqueBatches.end())
+        {
+            InstanceBatch batch;
+            batch.Geo = ri->Geo;
+            batch.GeoSortId = ri->GeoSortId;
+            batch.Mat = ri->Mat;
+            batch.PrimitiveType = ri->PrimitiveType;
+            batch.LodCount = ri->LodCount;
+            for (UINT lod = 0; lod < ri->LodCount; ++lod)
+                batch.Lods[lod] = ri->Lods[lod];
+
+            mOpaqueBatches.push_back(batch);
+            it = mOpaqueBatches.end() - 1;
+        }
 
-    const float miniPostY = (cylMeshH * miniScaleY) * 0.5f;
-    const float miniPostWorldR = cylMeshR * miniScaleXZ;
-    const float miniConeWorldR = miniPostWorldR * 1.5f;
-    const float miniConeWorldH = miniPostWorldH * 1.3f;
+        it->Items.push_back(ri);
+    }
 
-    XMMATRIX miniConeS = XMMatrixScaling(miniConeWorldR, miniConeWorldH, miniConeWorldR);
-    const float miniConeY = miniPostWorldH + (miniConeWorldH * 0.5f);
+    // Batches of the same mesh next to each other, then by material, so
+    // DrawInstanceBatches can skip the state they share.
+    std::stable_sort(mOpaqueBatches.begin(), mOpaqueBatches.end(),
+        [](const InstanceBatch& a, const InstanceBatch& b)
+        {
+            return RenderQueue::MakeOpaqueKey(PsoOpaqueInstanced, a.GeoSortId, (UINT)a.Mat->MatCBIndex, 0.0f) <
+                RenderQueue::MakeOpaqueKey(PsoOpaqueInstanced, b.GeoSortId, (UINT)b.Mat->MatCBIndex, 0.0f);
+        });
+}
 
-    AddItem("cylinder", miniPostS * XMMatrixTranslation(innerLeftX, miniPostY, innerEndZ), "stone");
-    AddItem("cone", miniConeS * XMMatrixTranslation(innerLeftX, miniConeY, innerEndZ), "stone");
-    AddItem("cylinder", miniPostS * XMMatrixTranslation(innerRightX, miniPostY, innerEndZ), "stone");
-    AddItem("cone", miniConeS * XMMatrixTranslation(innerRightX, miniConeY, innerEndZ), "stone");
+void ShapesApp::BuildIndirectCommands()
+{
+    if (!mBindlessSupported)
+        return;
 
+    // The opaque items are static, so their draws are uploaded once; only the
+    // world matrices are read from the frame's object buffer when culling.
+    std::vector<IndirectCommand> commands;
+    std::vector<DrawBounds> bounds;
+    commands.reserve(mOpaqueRitems.size());
+    bounds.reserve(mOpaqueRitems.size());
+
+    for (auto ri : mOpaqueRitems)
     {
-        const float wedgeMeshW = 2.0f;
-        const float wedgeMeshH = 1.0f;
-        const float wedgeMeshD = 2.0f;
+        // ExecuteIndirect cannot change the topology between draws.
+        assert(ri->PrimitiveType == D3D_PRIMITIVE_TOPOLOGY_TRIANGLELIST);
+
+        IndirectCommand command;
+        command.VertexBufferView = ri->Geo->VertexBufferView();
+        command.IndexBufferView = ri->Geo->IndexBufferView();
+        command.ObjectIndex = ri->ObjCBIndex;
+        command.MaterialIndex = (UINT)ri->Mat->MatCBIndex;
+        command.InstanceOffset = 0;
+        command.DrawArguments.IndexCountPerInstance = ri->Lods[0].IndexCount;
+        command.DrawArguments.InstanceCount = 1;
+        command.DrawArguments.StartIndexLocation = ri->Lods[0].StartIndexLocation;
+        command.DrawArguments.BaseVertexLocation = ri->Lods[0].BaseVertexLocation;
+        command.DrawArguments.StartInstanceLocation = 0;
+        commands.push_back(command);
+
+        DrawBounds b = {};
+        b.Center = ri->Bounds.Center;
+        b.Extents = ri->Bounds.Extents;
+        b.LodCount = ri->LodCount;
+        for (UINT lod = 0; lod < ri->LodCount; ++lod)
+        {
+            b.Lods[lod] = XMUINT4(ri->Lods[lod].IndexCount, ri->Lods[lod].StartIndexLocation,
+                (UINT)ri->Lods[lod].BaseVertexLocation, 0);
+        }
+        bounds.push_back(b);
+    }
 
-        const float wedgeW = 1.2f;
-        const float wedgeH = 0.6f;
-        const float wedgeD = 1.6f;
+    mIndirectCommandCount = (UINT)commands.size();
 
-        const float wsX = wedgeW / wedgeMeshW;
-        const float wsY = wedgeH / wedgeMeshH;
-        const float wsZ = wedgeD / wedgeMeshD;
+    const UINT64 commandsByteSize = (UINT64)commands.size() * sizeof(IndirectCommand);
+    const UINT64 boundsByteSize = (UINT64)bounds.size() * sizeof(DrawBounds);
 
-        const float wedgeX = tentX;
-        const float wedgeZ = tentZ - (tentD * 0.5f) - 0.9f;
-        const float wedgeY = wedgeH * 0.5f;
+    mIndirectCommands = d3dUtil::CreateDefaultBuffer(md3dDevice.Get(),
+        mCommandList.Get(), commands.data(), commandsByteSize, *mDefaultBufferHeap, *mUploadRing);
 
-        XMMATRIX W = XMMatrixScaling(wsX, wsY, wsZ) *
-            XMMatrixRotationY(XMConvertToRadians(45.0f)) *
-            XMMatrixTranslation(wedgeX, wedgeY, wedgeZ);
+    mDrawBounds = d3dUtil::CreateDefaultBuffer(md3dDevice.Get(),
+        mCommandList.Get(), bounds.data(), boundsByteSize, *mDefaultBufferHeap, *mUploadRing);
 
-        AddItem("wedge", W, "stone");
-    }
-    AddItem("box", XMMatrixScaling(90.0f, 0.2f, 130.0f) * XMMatrixTranslation(0.0f, -0.15f, 0.0f), "water");
+    // Filled by the culling pass every frame and read by ExecuteIndirect; both
+    // rest in INDIRECT_ARGUMENT between frames.
+    mVisibleCommands = mDefaultBufferHeap->CreateBuffer(
+        commandsByteSize,
+        D3D12_RESOURCE_STATE_INDIRECT_ARGUMENT,
+        D3D12_RESOURCE_FLAG_ALLOW_UNORDERED_ACCESS);
 
-    auto mazeRitem = std::make_unique<RenderItem>();
-    mazeRitem->World = MathHelper::Identity4x4();
-    mazeRitem->ObjCBIndex = objCBIndex++;
-    mazeRitem->Geo = mGeometries["mazeGeo"].get();
-    mazeRitem->Mat = mMaterials["stone"].get();
-    mazeRitem->PrimitiveType = D3D_PRIMITIVE_TOPOLOGY_TRIANGLELIST;
-    mazeRitem->IndexCount = mazeRitem->Geo->DrawArgs["mazeWalls"].IndexCount;
-    mazeRitem->StartIndexLocation = mazeRitem->Geo->DrawArgs["mazeWalls"].StartIndexLocation;
-    mazeRitem->BaseVertexLocation = mazeRitem->Geo->DrawArgs["mazeWalls"].BaseVertexLocation;
-    mAllRitems.push_back(std::move(mazeRitem));
+    mDrawCount = mDefaultBufferHeap->CreateBuffer(
+        sizeof(UINT),
+        D3D12_RESOURCE_STATE_INDIRECT_ARGUMENT,
+        D3D12_RESOURCE_FLAG_ALLOW_UNORDERED_ACCESS);
 
+    // A zero to copy over the draw count at the start of the culling pass.
+    mDrawCountReset = mUploadBufferHeap->CreateBuffer(sizeof(UINT), D3D12_RESOURCE_STATE_GENERIC_READ);
 
-    for (auto& e : mAllRitems)
-    {
-        if (e->Mat && e->Mat->Name == "water")
-            mTransparentRitems.push_back(e.get());
-        else
-            mOpaqueRitems.push_back(e.get());
-    }
+    UINT* mappedCount = nullptr;
+    ThrowIfFailed(mDrawCountReset->Map(0, nullptr, reinterpret_cast<void**>(&mappedCount)));
+    *mappedCount = 0;
+    mDrawCountReset->Unmap(0, nullptr);
 }
 
 void ShapesApp::BuildFrameResources()
@@ -1336,14 +4395,39 @@ void ShapesApp::BuildFrameResources()
         mFrameResources.push_back(
             std::make_unique<FrameResource>(
                 md3dDevice.Get(),
+                *mUploadBufferHeap,
                 1,
-                (UINT)mAllRitems.size(),
-                (UINT)mMaterials.size()));
+                mObjectSlots.GetSize(),
+                (UINT)mMaterials.size(),
+                (UINT)mOpaqueRitems.size(),
+                MaxLights,
+                mNumRecordWorkers));
     }
 }
 
 void ShapesApp::BuildPSOs()
 {
+    // Through the pipeline library; the scene states also get a wireframe
+    // variant, named with a "_wireframe" suffix.
+    auto createPso = [this](const std::string& name, const D3D12_GRAPHICS_PIPELINE_STATE_DESC& desc)
+        {
+            mPipelineCache->CreateGraphicsPipeline(AnsiToWString(name), desc, mPSOs[name]);
+        };
+
+    auto createPsoAndWireframe = [&](const std::string& name, const D3D12_GRAPHICS_PIPELINE_STATE_DESC& desc)
+        {
+            createPso(name, desc);
+
+            D3D12_GRAPHICS_PIPELINE_STATE_DESC wireframeDesc = desc;
+            wireframeDesc.RasterizerState.FillMode = D3D12_FILL_MODE_WIREFRAME;
+            createPso(name + "_wireframe", wireframeDesc);
+        };
+
+    auto createComputePso = [this](const std::string& name, const D3D12_COMPUTE_PIPELINE_STATE_DESC& desc)
+        {
+            mPipelineCache->CreateComputePipeline(AnsiToWString(name), desc, mPSOs[name]);
+        };
+
     D3D12_GRAPHICS_PIPELINE_STATE_DESC opaquePsoDesc;
     ZeroMemory(&opaquePsoDesc, sizeof(D3D12_GRAPHICS_PIPELINE_STATE_DESC));
 
@@ -1374,7 +4458,51 @@ void ShapesApp::BuildPSOs()
     opaquePsoDesc.SampleDesc.Quality = m4xMsaaState ? (m4xMsaaQuality - 1) : 0;
     opaquePsoDesc.DSVFormat = mDepthStencilFormat;
 
-    ThrowIfFailed(md3dDevice->CreateGraphicsPipelineState(&opaquePsoDesc, IID_PPV_ARGS(&mPSOs["opaque"])));
+    createPsoAndWireframe("opaque", opaquePsoDesc);
+
+    D3D12_GRAPHICS_PIPELINE_STATE_DESC instancedPsoDesc = opaquePsoDesc;
+    instancedPsoDesc.VS =
+    {
+        reinterpret_cast<BYTE*>(mShaders["instancedVS"]->GetBufferPointer()),
+        mShaders["instancedVS"]->GetBufferSize()
+    };
+    createPsoAndWireframe("opaque_instanced", instancedPsoDesc);
+
+    // Depth prepass: positions only and no pixel shader.  The opaque states
+    // after it test for the depth it left and do not write their own.
+    auto createDepthPrepassPsos = [&](const std::string& suffix, const D3D12_GRAPHICS_PIPELINE_STATE_DESC& desc,
+        const std::string& depthVS, const std::string& depthInstancedVS, const D3D12_SHADER_BYTECODE& instancedVS)
+        {
+            D3D12_GRAPHICS_PIPELINE_STATE_DESC depthPsoDesc = desc;
+            depthPsoDesc.InputLayout = { mDepthInputLayout.data(), (UINT)mDepthInputLayout.size() };
+            depthPsoDesc.VS =
+            {
+                reinterpret_cast<BYTE*>(mShaders[depthVS]->GetBufferPointer()),
+                mShaders[depthVS]->GetBufferSize()
+            };
+            depthPsoDesc.PS = { nullptr, 0 };
+            depthPsoDesc.DepthStencilState.DepthFunc = D3D12_COMPARISON_FUNC_LESS;
+            depthPsoDesc.NumRenderTargets = 0;
+            depthPsoDesc.RTVFormats[0] = DXGI_FORMAT_UNKNOWN;
+            createPso("depth" + suffix, depthPsoDesc);
+
+            depthPsoDesc.VS =
+            {
+                reinterpret_cast<BYTE*>(mShaders[depthInstancedVS]->GetBufferPointer()),
+                mShaders[depthInstancedVS]->GetBufferSize()
+            };
+            createPso("depth_instanced" + suffix, depthPsoDesc);
+
+            D3D12_GRAPHICS_PIPELINE_STATE_DESC equalPsoDesc = desc;
+            equalPsoDesc.DepthStencilState.DepthFunc = D3D12_COMPARISON_FUNC_EQUAL;
+            equalPsoDesc.DepthStencilState.DepthWriteMask = D3D12_DEPTH_WRITE_MASK_ZERO;
+            createPso("opaque_equal" + suffix, equalPsoDesc);
+
+            equalPsoDesc.VS = instancedVS;
+            createPso("opaque_instanced_equal" + suffix, equalPsoDesc);
+        };
+
+    createDepthPrepassPsos("", opaquePsoDesc, "depthVS", "depthInstancedVS", instancedPsoDesc.VS);
     ///////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
     D3D12_GRAPHICS_PIPELINE_STATE_DESC transparentPsoDesc = opaquePsoDesc;
 
@@ -1392,41 +4520,246 @@ void ShapesApp::BuildPSOs()
 
     transparentPsoDesc.BlendState.RenderTarget[0] = transparencyBlendDesc;
 
-    ThrowIfFailed(md3dDevice->CreateGraphicsPipelineState(
-        &transparentPsoDesc,
-        IID_PPV_ARGS(&mPSOs["transparent"])));
+    createPsoAndWireframe("transparent", transparentPsoDesc);
+
+    if (mBindlessSupported)
+    {
+        D3D12_SHADER_BYTECODE bindlessVS =
+        {
+            reinterpret_cast<BYTE*>(mShaders["bindlessVS"]->GetBufferPointer()),
+            mShaders["bindlessVS"]->GetBufferSize()
+        };
+        D3D12_SHADER_BYTECODE bindlessInstancedVS =
+        {
+            reinterpret_cast<BYTE*>(mShaders["bindlessInstancedVS"]->GetBufferPointer()),
+            mShaders["bindlessInstancedVS"]->GetBufferSize()
+        };
+        D3D12_SHADER_BYTECODE bindlessPS =
+        {
+            reinterpret_cast<BYTE*>(mShaders["bindlessPS"]->GetBufferPointer()),
+            mShaders["bindlessPS"]->GetBufferSize()
+        };
+
+        // The depth states also serve the occluder prepass.
+        D3D12_GRAPHICS_PIPELINE_STATE_DESC bindlessPsoDesc = opaquePsoDesc;
+        bindlessPsoDesc.pRootSignature = mBindlessRootSignature.Get();
+        bindlessPsoDesc.VS = bindlessVS;
+        bindlessPsoDesc.PS = bindlessPS;
+        createDepthPrepassPsos("_bindless", bindlessPsoDesc, "bindlessDepthVS", "bindlessInstancedDepthVS", bindlessInstancedVS);
+
+        // The occluders are drawn again at the depth the occluder prepass left.
+        bindlessPsoDesc = opaquePsoDesc;
+        bindlessPsoDesc.pRootSignature = mBindlessRootSignature.Get();
+        bindlessPsoDesc.VS = bindlessVS;
+        bindlessPsoDesc.PS = bindlessPS;
+        bindlessPsoDesc.DepthStencilState.DepthFunc = D3D12_COMPARISON_FUNC_LESS_EQUAL;
+        createPsoAndWireframe("opaque_bindless", bindlessPsoDesc);
+        bindlessPsoDesc.DepthStencilState.DepthFunc = D3D12_COMPARISON_FUNC_LESS;
+
+        bindlessPsoDesc.VS = bindlessInstancedVS;
+        createPsoAndWireframe("opaque_instanced_bindless", bindlessPsoDesc);
+
+        bindlessPsoDesc = transparentPsoDesc;
+        bindlessPsoDesc.pRootSignature = mBindlessRootSignature.Get();
+        bindlessPsoDesc.VS = bindlessVS;
+        bindlessPsoDesc.PS = bindlessPS;
+        createPsoAndWireframe("transparent_bindless", bindlessPsoDesc);
+    }
+
+    // Depth only.  The bias keeps lit surfaces from shadowing themselves, more
+    // of it on slopes where one texel spans a larger depth range.
+    D3D12_GRAPHICS_PIPELINE_STATE_DESC shadowPsoDesc = opaquePsoDesc;
+    shadowPsoDesc.pRootSignature = mShadowRootSignature.Get();
+    shadowPsoDesc.VS =
+    {
+        reinterpret_cast<BYTE*>(mShaders["shadowVS"]->GetBufferPointer()),
+        mShaders["shadowVS"]->GetBufferSize()
+    };
+    shadowPsoDesc.PS = { nullptr, 0 };
+    shadowPsoDesc.RasterizerState.DepthBias = 100000;
+    shadowPsoDesc.RasterizerState.DepthBiasClamp = 0.0f;
+    shadowPsoDesc.RasterizerState.SlopeScaledDepthBias = 1.0f;
+    shadowPsoDesc.NumRenderTargets = 0;
+    shadowPsoDesc.RTVFormats[0] = DXGI_FORMAT_UNKNOWN;
+    shadowPsoDesc.SampleDesc.Count = 1;
+    shadowPsoDesc.SampleDesc.Quality = 0;
+    shadowPsoDesc.DSVFormat = DXGI_FORMAT_D32_FLOAT;
+    createPso("shadow", shadowPsoDesc);
+
+    // One screen-covering triangle made up in the vertex shader; no depth.
+    D3D12_GRAPHICS_PIPELINE_STATE_DESC upscalePsoDesc;
+    ZeroMemory(&upscalePsoDesc, sizeof(D3D12_GRAPHICS_PIPELINE_STATE_DESC));
+    upscalePsoDesc.InputLayout = { nullptr, 0 };
+    upscalePsoDesc.pRootSignature = mUpscaleRootSignature.Get();
+    upscalePsoDesc.VS =
+    {
+        reinterpret_cast<BYTE*>(mShaders["upscaleVS"]->GetBufferPointer()),
+        mShaders["upscaleVS"]->GetBufferSize()
+    };
+    upscalePsoDesc.PS =
+    {
+        reinterpret_cast<BYTE*>(mShaders["upscalePS"]->GetBufferPointer()),
+        mShaders["upscalePS"]->GetBufferSize()
+    };
+    upscalePsoDesc.RasterizerState = CD3DX12_RASTERIZER_DESC(D3D12_DEFAULT);
+    upscalePsoDesc.BlendState = CD3DX12_BLEND_DESC(D3D12_DEFAULT);
+    upscalePsoDesc.DepthStencilState = CD3DX12_DEPTH_STENCIL_DESC(D3D12_DEFAULT);
+    upscalePsoDesc.DepthStencilState.DepthEnable = false;
+    upscalePsoDesc.DepthStencilState.DepthWriteMask = D3D12_DEPTH_WRITE_MASK_ZERO;
+    upscalePsoDesc.SampleMask = UINT_MAX;
+    upscalePsoDesc.PrimitiveTopologyType = D3D12_PRIMITIVE_TOPOLOGY_TYPE_TRIANGLE;
+    upscalePsoDesc.NumRenderTargets = 1;
+    upscalePsoDesc.RTVFormats[0] = mBackBufferFormat;
+    upscalePsoDesc.SampleDesc.Count = 1;
+    upscalePsoDesc.SampleDesc.Quality = 0;
+    upscalePsoDesc.DSVFormat = DXGI_FORMAT_UNKNOWN;
+    createPso("upscale", upscalePsoDesc);
+
+    D3D12_COMPUTE_PIPELINE_STATE_DESC lightCullPsoDesc = {};
+    lightCullPsoDesc.pRootSignature = mLightCullRootSignature.Get();
+    lightCullPsoDesc.CS =
+    {
+        reinterpret_cast<BYTE*>(mShaders["lightCullCS"]->GetBufferPointer()),
+        mShaders["lightCullCS"]->GetBufferSize()
+    };
+    lightCullPsoDesc.Flags = D3D12_PIPELINE_STATE_FLAG_NONE;
+    createComputePso("lightCull", lightCullPsoDesc);
+
+    const std::pair<const char*, const char*> wavesKernels[] =
+    {
+        { "wavesUpdate", "wavesUpdateCS" },
+        { "wavesDisturb", "wavesDisturbCS" },
+        { "wavesVertices", "wavesVerticesCS" }
+    };
+    for (const auto& kernel : wavesKernels)
+    {
+        D3D12_COMPUTE_PIPELINE_STATE_DESC wavesPsoDesc = {};
+        wavesPsoDesc.pRootSignature = mWavesRootSignature.Get();
+        wavesPsoDesc.CS =
+        {
+            reinterpret_cast<BYTE*>(mShaders[kernel.second]->GetBufferPointer()),
+            mShaders[kernel.second]->GetBufferSize()
+        };
+        wavesPsoDesc.Flags = D3D12_PIPELINE_STATE_FLAG_NONE;
+        createComputePso(kernel.first, wavesPsoDesc);
+    }
+
+    if (mBindlessSupported)
+    {
+        D3D12_COMPUTE_PIPELINE_STATE_DESC drawCullPsoDesc = {};
+        drawCullPsoDesc.pRootSignature = mDrawCullRootSignature.Get();
+        drawCullPsoDesc.CS =
+        {
+            reinterpret_cast<BYTE*>(mShaders["drawCullCS"]->GetBufferPointer()),
+            mShaders["drawCullCS"]->GetBufferSize()
+        };
+        drawCullPsoDesc.Flags = D3D12_PIPELINE_STATE_FLAG_NONE;
+        createComputePso("drawCull", drawCullPsoDesc);
+
+        D3D12_COMPUTE_PIPELINE_STATE_DESC hiZPsoDesc = {};
+        hiZPsoDesc.pRootSignature = mHiZRootSignature.Get();
+        hiZPsoDesc.CS =
+        {
+            reinterpret_cast<BYTE*>(mShaders["hiZCS"]->GetBufferPointer()),
+            mShaders["hiZCS"]->GetBufferSize()
+        };
+        hiZPsoDesc.Flags = D3D12_PIPELINE_STATE_FLAG_NONE;
+        createComputePso("hiZ", hiZPsoDesc);
+    }
+
+    auto findPso = [this](const char* name) -> ID3D12PipelineState*
+        {
+            auto it = mPSOs.find(name);
+            return it != mPSOs.end() ? it->second.Get() : nullptr;
+        };
+
+    mFramePsos[0][PsoOpaque] = findPso("opaque");
+    mFramePsos[0][PsoOpaqueInstanced] = findPso("opaque_instanced");
+    mFramePsos[0][PsoTransparent] = findPso("transparent");
+    mFramePsos[1][PsoOpaque] = findPso("opaque_bindless");
+    mFramePsos[1][PsoOpaqueInstanced] = findPso("opaque_instanced_bindless");
+    mFramePsos[1][PsoTransparent] = findPso("transparent_bindless");
+    mWireframePsos[0][PsoOpaque] = findPso("opaque_wireframe");
+    mWireframePsos[0][PsoOpaqueInstanced] = findPso("opaque_instanced_wireframe");
+    mWireframePsos[0][PsoTransparent] = findPso("transparent_wireframe");
+    mWireframePsos[1][PsoOpaque] = findPso("opaque_bindless_wireframe");
+    mWireframePsos[1][PsoOpaqueInstanced] = findPso("opaque_instanced_bindless_wireframe");
+    mWireframePsos[1][PsoTransparent] = findPso("transparent_bindless_wireframe");
+    mDepthPrepassPsos[0][PsoOpaque] = findPso("depth");
+    mDepthPrepassPsos[0][PsoOpaqueInstanced] = findPso("depth_instanced");
+    mDepthPrepassPsos[1][PsoOpaque] = findPso("depth_bindless");
+    mDepthPrepassPsos[1][PsoOpaqueInstanced] = findPso("depth_instanced_bindless");
+    mEqualDepthPsos[0][PsoOpaque] = findPso("opaque_equal");
+    mEqualDepthPsos[0][PsoOpaqueInstanced] = findPso("opaque_instanced_equal");
+    mEqualDepthPsos[0][PsoTransparent] = findPso("transparent");
+    mEqualDepthPsos[1][PsoOpaque] = findPso("opaque_equal_bindless");
+    mEqualDepthPsos[1][PsoOpaqueInstanced] = findPso("opaque_instanced_equal_bindless");
+    mEqualDepthPsos[1][PsoTransparent] = findPso("transparent_bindless");
 
 }
 
-void ShapesApp::DrawRenderItems(ID3D12GraphicsCommandList* cmdList, const std::vector<RenderItem*>& ritems)
+void ShapesApp::DrawRenderItems(ID3D12GraphicsCommandList* cmdList, const std::vector<RenderItem*>& ritems, size_t first, size_t last)
 {
+    // Summed over the recording workers.
+    Profiler::CpuScope scope(mProfiler.get(), CpuDrawRenderItems);
+
     UINT objCBByteSize = d3dUtil::CalcConstantBufferByteSize(sizeof(ObjectConstants));
     UINT matCBByteSize = d3dUtil::CalcConstantBufferByteSize(sizeof(MaterialConstants));
 
     auto objectCB = mCurrFrameResource->ObjectCB->Resource();
     auto matCB = mCurrFrameResource->MaterialCB->Resource();
 
-    for (size_t i = 0; i < ritems.size(); ++i)
+    // The items come sorted by state; only what changes from the previous item
+    // is set.  A command list starts with nothing set, so neither do we.
+    MeshGeometry* currGeo = nullptr;
+    Material* currMat = nullptr;
+    D3D12_PRIMITIVE_TOPOLOGY currTopology = D3D_PRIMITIVE_TOPOLOGY_UNDEFINED;
+
+    for (size_t i = first; i < last; ++i)
     {
         auto ri = ritems[i];
 
-        cmdList->IASetVertexBuffers(0, 1, &ri->Geo->VertexBufferView());
-        cmdList->IASetIndexBuffer(&ri->Geo->IndexBufferView());
-        cmdList->IASetPrimitiveTopology(ri->PrimitiveType);
+        if (ri->Geo != currGeo)
+        {
+            auto vbv = ri->Geo->VertexBufferView();
+            auto ibv = ri->Geo->IndexBufferView();
+            cmdList->IASetVertexBuffers(0, 1, &vbv);
+            cmdList->IASetIndexBuffer(&ibv);
+            currGeo = ri->Geo;
+        }
+
+        if (ri->PrimitiveType != currTopology)
+        {
+            cmdList->IASetPrimitiveTopology(ri->PrimitiveType);
+            currTopology = ri->PrimitiveType;
+        }
+
+        if (mBindlessEnabled)
+        {
+            UINT drawConstants[] = { ri->ObjCBIndex, (UINT)ri->Mat->MatCBIndex };
+            cmdList->SetGraphicsRoot32BitConstants(1, _countof(drawConstants), drawConstants, 0);
+        }
+        else
+        {
+            if (ri->Mat != currMat)
+            {
+                CD3DX12_GPU_DESCRIPTOR_HANDLE texHandle(
+                    mSrvDescriptorHeap->GetGPUDescriptorHandleForHeapStart());
+                texHandle.Offset(mTextureStreamer->GetSrvIndex(ri->Mat->DiffuseSrvHeapIndex), mCbvSrvUavDescriptorSize);
 
-        CD3DX12_GPU_DESCRIPTOR_HANDLE texHandle(
-            mSrvDescriptorHeap->GetGPUDescriptorHandleForHeapStart());
-        texHandle.Offset(ri->Mat->DiffuseSrvHeapIndex, mCbvSrvUavDescriptorSize);
+                D3D12_GPU_VIRTUAL_ADDRESS matCBAddress =
+                    matCB->GetGPUVirtualAddress() + ri->Mat->MatCBIndex * matCBByteSize;
 
-        D3D12_GPU_VIRTUAL_ADDRESS objCBAddress =
-            objectCB->GetGPUVirtualAddress() + ri->ObjCBIndex * objCBByteSize;
+                cmdList->SetGraphicsRootDescriptorTable(0, texHandle);
+                cmdList->SetGraphicsRootConstantBufferView(3, matCBAddress);
+                currMat = ri->Mat;
+            }
 
-        D3D12_GPU_VIRTUAL_ADDRESS matCBAddress =
-            matCB->GetGPUVirtualAddress() + ri->Mat->MatCBIndex * matCBByteSize;
+            D3D12_GPU_VIRTUAL_ADDRESS objCBAddress =
+                objectCB->GetGPUVirtualAddress() + ri->ObjCBIndex * objCBByteSize;
 
-        cmdList->SetGraphicsRootDescriptorTable(0, texHandle);
-        cmdList->SetGraphicsRootConstantBufferView(1, objCBAddress);
-        cmdList->SetGraphicsRootConstantBufferView(3, matCBAddress);
+            cmdList->SetGraphicsRootConstantBufferView(1, objCBAddress);
+        }
 
         cmdList->DrawIndexedInstanced(
             ri->IndexCount,
@@ -1435,106 +4768,483 @@ void ShapesApp::DrawRenderItems(ID3D12GraphicsCommandList* cmdList, const std::v
             ri->BaseVertexLocation,
             0);
     }
+
+    mDrawCallCount += last - first;
+}
+
+void ShapesApp::DrawInstanceBatches(ID3D12GraphicsCommandList* cmdList, const std::vector<InstanceBatch>& batches, size_t first, size_t last)
+{
+    UINT matCBByteSize = d3dUtil::CalcConstantBufferByteSize(sizeof(MaterialConstants));
+
+    auto matCB = mCurrFrameResource->MaterialCB->Resource();
+
+    // Same redundant state filtering as DrawRenderItems.
+    MeshGeometry* currGeo = nullptr;
+    D3D12_PRIMITIVE_TOPOLOGY currTopology = D3D_PRIMITIVE_TOPOLOGY_UNDEFINED;
+    UINT64 drawCalls = 0;
+
+    for (size_t i = first; i < last; ++i)
+    {
+        const auto& batch = batches[i];
+
+        UINT instanceCount = 0;
+        for (UINT lod = 0; lod < batch.LodCount; ++lod)
+            instanceCount += batch.InstanceCount[lod];
+
+        if (instanceCount == 0)
+            continue;
+
+        if (batch.Geo != currGeo)
+        {
+            auto vbv = batch.Geo->VertexBufferView();
+            auto ibv = batch.Geo->IndexBufferView();
+            cmdList->IASetVertexBuffers(0, 1, &vbv);
+            cmdList->IASetIndexBuffer(&ibv);
+            currGeo = batch.Geo;
+        }
+
+        if (batch.PrimitiveType != currTopology)
+        {
+            cmdList->IASetPrimitiveTopology(batch.PrimitiveType);
+            currTopology = batch.PrimitiveType;
+        }
+
+        if (!mBindlessEnabled)
+        {
+            CD3DX12_GPU_DESCRIPTOR_HANDLE texHandle(
+                mSrvDescriptorHeap->GetGPUDescriptorHandleForHeapStart());
+            texHandle.Offset(mTextureStreamer->GetSrvIndex(batch.Mat->DiffuseSrvHeapIndex), mCbvSrvUavDescriptorSize);
+
+            D3D12_GPU_VIRTUAL_ADDRESS matCBAddress =
+                matCB->GetGPUVirtualAddress() + batch.Mat->MatCBIndex * matCBByteSize;
+
+            cmdList->SetGraphicsRootDescriptorTable(0, texHandle);
+            cmdList->SetGraphicsRootConstantBufferView(3, matCBAddress);
+        }
+
+        for (UINT lod = 0; lod < batch.LodCount; ++lod)
+        {
+            if (batch.InstanceCount[lod] == 0)
+                continue;
+
+            if (mBindlessEnabled)
+            {
+                UINT drawConstants[] = { 0, (UINT)batch.Mat->MatCBIndex, batch.InstanceOffset[lod] };
+                cmdList->SetGraphicsRoot32BitConstants(1, _countof(drawConstants), drawConstants, 0);
+            }
+            else
+            {
+                cmdList->SetGraphicsRoot32BitConstant(5, batch.InstanceOffset[lod], 0);
+            }
+
+            cmdList->DrawIndexedInstanced(
+                batch.Lods[lod].IndexCount,
+                batch.InstanceCount[lod],
+                batch.Lods[lod].StartIndexLocation,
+                batch.Lods[lod].BaseVertexLocation,
+                0);
+            ++drawCalls;
+        }
+    }
+
+    mDrawCallCount += drawCalls;
 }
 void ShapesApp::BuildTextures()
 {
-    auto grassTex = std::make_unique<Texture>();
-    grassTex->Name = "grassTex";
-    grassTex->Filename = L"Textures/grass.dds";
-
-    auto brickTex = std::make_unique<Texture>();
-    brickTex->Name = "brickTex";
-    brickTex->Filename = L"Textures/bricks3.dds";
-
-    auto iceTex = std::make_unique<Texture>();
-    iceTex->Name = "iceTex";
-    iceTex->Filename = L"Textures/ice.dds";
-
-    auto waterTex = std::make_unique<Texture>();
-    waterTex->Name = "waterTex";
-    waterTex->Filename = L"Textures/mywatertexture.dds";
-
-    auto tileTex = std::make_unique<Texture>();
-    tileTex->Name = "tileTex";
-    tileTex->Filename = L"Textures/tile.dds";
-
-    ThrowIfFailed(DirectX::CreateDDSTextureFromFile12(
-        md3dDevice.Get(), mCommandList.Get(),
-        grassTex->Filename.c_str(),
-        grassTex->Resource, grassTex->UploadHeap));
-
-    ThrowIfFailed(DirectX::CreateDDSTextureFromFile12(
-        md3dDevice.Get(), mCommandList.Get(),
-        brickTex->Filename.c_str(),
-        brickTex->Resource, brickTex->UploadHeap));
-
-    ThrowIfFailed(DirectX::CreateDDSTextureFromFile12(
-        md3dDevice.Get(), mCommandList.Get(),
-        iceTex->Filename.c_str(),
-        iceTex->Resource, iceTex->UploadHeap));
-
-    ThrowIfFailed(DirectX::CreateDDSTextureFromFile12(
-        md3dDevice.Get(), mCommandList.Get(),
-        waterTex->Filename.c_str(),
-        waterTex->Resource, waterTex->UploadHeap));
-
-    ThrowIfFailed(DirectX::CreateDDSTextureFromFile12(
-        md3dDevice.Get(), mCommandList.Get(),
-        tileTex->Filename.c_str(),
-        tileTex->Resource, tileTex->UploadHeap));
-
-    mTextures["grassTex"] = std::move(grassTex);
-    mTextures["brickTex"] = std::move(brickTex);
-    mTextures["iceTex"] = std::move(iceTex);
-    mTextures["waterTex"] = std::move(waterTex);
-    mTextures["tileTex"] = std::move(tileTex);
+    // The files are read on the streamer's loader threads and copied on its
+    // copy queue; materials draw with the fallback texture until then.
+    unsigned loaderThreads = MathHelper::Clamp(std::thread::hardware_concurrency() / 2, 1u, 4u);
+    mTextureStreamer = std::make_unique<TextureStreamer>(
+        md3dDevice.Get(), mSrvDescriptorHeap.Get(), mCbvSrvUavDescriptorSize,
+        gTextureCount, loaderThreads, (UINT64)mUploadRingMB * 1024 * 1024);
+
+    struct TextureFile
+    {
+        const char* Name;
+        const wchar_t* Filename;
+    };
+
+    // In SRV heap order; Material::DiffuseSrvHeapIndex refers to these slots.
+    const TextureFile textureFiles[gTextureCount] =
+    {
+        { "grassTex", L"Textures/grass.dds" },
+        { "brickTex", L"Textures/bricks3.dds" },
+        { "iceTex", L"Textures/ice.dds" },
+        { "waterTex", L"Textures/mywatertexture.dds" },
+        { "tileTex", L"Textures/tile.dds" },
+    };
+
+    for (UINT i = 0; i < gTextureCount; ++i)
+    {
+        auto tex = std::make_unique<Texture>();
+        tex->Name = textureFiles[i].Name;
+        tex->Filename = textureFiles[i].Filename;
+
+        // The streamer owns the GPU resources.
+        mTextureStreamer->Request(tex->Filename, i);
+
+        mTextures[tex->Name] = std::move(tex);
+    }
 }
 void ShapesApp::BuildDescriptorHeaps()
 {
+    // The SRVs are written by the texture streamer as the textures arrive.
     D3D12_DESCRIPTOR_HEAP_DESC srvHeapDesc = {};
-    srvHeapDesc.NumDescriptors = 5;
+    srvHeapDesc.NumDescriptors = gUpscaleDescriptorBase + gUpscaleDescriptorCount;
     srvHeapDesc.Type = D3D12_DESCRIPTOR_HEAP_TYPE_CBV_SRV_UAV;
     srvHeapDesc.Flags = D3D12_DESCRIPTOR_HEAP_FLAG_SHADER_VISIBLE;
 
     ThrowIfFailed(md3dDevice->CreateDescriptorHeap(
         &srvHeapDesc, IID_PPV_ARGS(&mSrvDescriptorHeap)));
+}
 
-    CD3DX12_CPU_DESCRIPTOR_HANDLE hDescriptor(
-        mSrvDescriptorHeap->GetCPUDescriptorHandleForHeapStart());
+void ShapesApp::BuildHiZResources()
+{
+    // Reads the depth buffer as a plain texture, which MSAA would rule out.
+    mHiZBuffer.Reset();
+    mHiZMipCount = 0;
+
+    if (!mBindlessSupported || m4xMsaaState)
+        return;
+
+    // Full chain down to 1x1; D3DApp::OnResize has flushed the queue, so the
+    // old pyramid and its descriptors are free.
+    UINT largest = (UINT)MathHelper::Max(mClientWidth, mClientHeight);
+    while (mHiZMipCount < gMaxHiZMips && (largest >> mHiZMipCount) > 0)
+        ++mHiZMipCount;
+
+    D3D12_RESOURCE_DESC hiZDesc = CD3DX12_RESOURCE_DESC::Tex2D(
+        DXGI_FORMAT_R32_FLOAT,
+        mClientWidth,
+        mClientHeight,
+        1,
+        (UINT16)mHiZMipCount,
+        1,
+        0,
+        D3D12_RESOURCE_FLAG_ALLOW_UNORDERED_ACCESS);
+
+    auto defaultHeap = CD3DX12_HEAP_PROPERTIES(D3D12_HEAP_TYPE_DEFAULT);
+    ThrowIfFailed(md3dDevice->CreateCommittedResource(
+        &defaultHeap,
+        D3D12_HEAP_FLAG_NONE,
+        &hiZDesc,
+        D3D12_RESOURCE_STATE_NON_PIXEL_SHADER_RESOURCE,
+        nullptr,
+        IID_PPV_ARGS(&mHiZBuffer)));
 
-    auto grassTex = mTextures["grassTex"]->Resource;
-    auto brickTex = mTextures["brickTex"]->Resource;
-    auto iceTex = mTextures["iceTex"]->Resource;
-    auto waterTex = mTextures["waterTex"]->Resource;
-    auto tileTex = mTextures["tileTex"]->Resource;
+    CD3DX12_CPU_DESCRIPTOR_HANDLE hDescriptor(
+        mSrvDescriptorHeap->GetCPUDescriptorHandleForHeapStart(), gHiZDescriptorBase, mCbvSrvUavDescriptorSize);
 
     D3D12_SHADER_RESOURCE_VIEW_DESC srvDesc = {};
     srvDesc.Shader4ComponentMapping = D3D12_DEFAULT_SHADER_4_COMPONENT_MAPPING;
     srvDesc.ViewDimension = D3D12_SRV_DIMENSION_TEXTURE2D;
+    srvDesc.Format = DXGI_FORMAT_R24_UNORM_X8_TYPELESS;
     srvDesc.Texture2D.MostDetailedMip = 0;
-    srvDesc.Texture2D.ResourceMinLODClamp = 0.0f;
-
-    srvDesc.Format = grassTex->GetDesc().Format;
-    srvDesc.Texture2D.MipLevels = grassTex->GetDesc().MipLevels;
-    md3dDevice->CreateShaderResourceView(grassTex.Get(), &srvDesc, hDescriptor);
-
-    hDescriptor.Offset(1, mCbvSrvUavDescriptorSize);
-    srvDesc.Format = brickTex->GetDesc().Format;
-    srvDesc.Texture2D.MipLevels = brickTex->GetDesc().MipLevels;
-    md3dDevice->CreateShaderResourceView(brickTex.Get(), &srvDesc, hDescriptor);
-
-    hDescriptor.Offset(1, mCbvSrvUavDescriptorSize);
-    srvDesc.Format = iceTex->GetDesc().Format;
-    srvDesc.Texture2D.MipLevels = iceTex->GetDesc().MipLevels;
-    md3dDevice->CreateShaderResourceView(iceTex.Get(), &srvDesc, hDescriptor);
-
-    hDescriptor.Offset(1, mCbvSrvUavDescriptorSize);
-    srvDesc.Format = waterTex->GetDesc().Format;
-    srvDesc.Texture2D.MipLevels = waterTex->GetDesc().MipLevels;
-    md3dDevice->CreateShaderResourceView(waterTex.Get(), &srvDesc, hDescriptor);
-
-    hDescriptor.Offset(1, mCbvSrvUavDescriptorSize);
-    srvDesc.Format = tileTex->GetDesc().Format;
-    srvDesc.Texture2D.MipLevels = tileTex->GetDesc().MipLevels;
-    md3dDevice->CreateShaderResourceView(tileTex.Get(), &srvDesc, hDescriptor);
-}
\ No newline at end of file
+    srvDesc.Texture2D.MipLevels = 1;
+    md3dDevice->CreateShaderResourceView(mDepthStencilBuffer.Get(), &srvDesc, hDescriptor);
+
+    srvDesc.Format = DXGI_FORMAT_R32_FLOAT;
+    srvDesc.Texture2D.MipLevels = mHiZMipCount;
+    md3dDevice->CreateShaderResourceView(mHiZBuffer.Get(), &srvDesc, hDescriptor.Offset(1, mCbvSrvUavDescriptorSize));
+
+    for (UINT mip = 0; mip < mHiZMipCount; ++mip)
+    {
+        CD3DX12_CPU_DESCRIPTOR_HANDLE mipSrv(hDescriptor, 1 + mip, mCbvSrvUavDescriptorSize);
+        srvDesc.Texture2D.MostDetailedMip = mip;
+        srvDesc.Texture2D.MipLevels = 1;
+        md3dDevice->CreateShaderResourceView(mHiZBuffer.Get(), &srvDesc, mipSrv);
+
+        CD3DX12_CPU_DESCRIPTOR_HANDLE mipUav(hDescriptor, 1 + gMaxHiZMips + mip, mCbvSrvUavDescriptorSize);
+        D3D12_UNORDERED_ACCESS_VIEW_DESC uavDesc = {};
+        uavDesc.Format = DXGI_FORMAT_R32_FLOAT;
+        uavDesc.ViewDimension = D3D12_UAV_DIMENSION_TEXTURE2D;
+        uavDesc.Texture2D.MipSlice = mip;
+        md3dDevice->CreateUnorderedAccessView(mHiZBuffer.Get(), nullptr, &uavDesc, mipUav);
+    }
+}
+
+void ShapesApp::BuildShadowMaps()
+{
+    // Typeless, to be written through a depth view and read through a float one.
+    D3D12_RESOURCE_DESC shadowDesc = CD3DX12_RESOURCE_DESC::Tex2D(
+        DXGI_FORMAT_R32_TYPELESS,
+        gShadowMapSize,
+        gShadowMapSize,
+        (UINT16)gShadowCascadeCount,
+        1,
+        1,
+        0,
+        D3D12_RESOURCE_FLAG_ALLOW_DEPTH_STENCIL);
+
+    D3D12_CLEAR_VALUE optClear;
+    optClear.Format = DXGI_FORMAT_D32_FLOAT;
+    optClear.DepthStencil.Depth = 1.0f;
+    optClear.DepthStencil.Stencil = 0;
+
+    ID3D12Resource** maps[] = { mStaticShadowMap.ReleaseAndGetAddressOf(), mDynamicShadowMap.ReleaseAndGetAddressOf() };
+
+    auto defaultHeap = CD3DX12_HEAP_PROPERTIES(D3D12_HEAP_TYPE_DEFAULT);
+    for (UINT map = 0; map < _countof(maps); ++map)
+    {
+        ThrowIfFailed(md3dDevice->CreateCommittedResource(
+            &defaultHeap,
+            D3D12_HEAP_FLAG_NONE,
+            &shadowDesc,
+            D3D12_RESOURCE_STATE_PIXEL_SHADER_RESOURCE,
+            &optClear,
+            IID_PPV_ARGS(maps[map])));
+
+        // One depth view per cascade, after the depth buffer's.
+        for (UINT i = 0; i < gShadowCascadeCount; ++i)
+        {
+            D3D12_DEPTH_STENCIL_VIEW_DESC dsvDesc = {};
+            dsvDesc.Flags = D3D12_DSV_FLAG_NONE;
+            dsvDesc.ViewDimension = D3D12_DSV_DIMENSION_TEXTURE2DARRAY;
+            dsvDesc.Format = DXGI_FORMAT_D32_FLOAT;
+            dsvDesc.Texture2DArray.MipSlice = 0;
+            dsvDesc.Texture2DArray.FirstArraySlice = i;
+            dsvDesc.Texture2DArray.ArraySize = 1;
+
+            CD3DX12_CPU_DESCRIPTOR_HANDLE dsv(
+                mDsvHeap->GetCPUDescriptorHandleForHeapStart(), 1 + map * gShadowCascadeCount + i, mDsvDescriptorSize);
+            md3dDevice->CreateDepthStencilView(*maps[map], &dsvDesc, dsv);
+        }
+
+        D3D12_SHADER_RESOURCE_VIEW_DESC srvDesc = {};
+        srvDesc.Shader4ComponentMapping = D3D12_DEFAULT_SHADER_4_COMPONENT_MAPPING;
+        srvDesc.ViewDimension = D3D12_SRV_DIMENSION_TEXTURE2DARRAY;
+        srvDesc.Format = DXGI_FORMAT_R32_FLOAT;
+        srvDesc.Texture2DArray.MostDetailedMip = 0;
+        srvDesc.Texture2DArray.MipLevels = 1;
+        srvDesc.Texture2DArray.FirstArraySlice = 0;
+        srvDesc.Texture2DArray.ArraySize = gShadowCascadeCount;
+
+        CD3DX12_CPU_DESCRIPTOR_HANDLE srv(
+            mSrvDescriptorHeap->GetCPUDescriptorHandleForHeapStart(), gShadowDescriptorBase + map, mCbvSrvUavDescriptorSize);
+        md3dDevice->CreateShaderResourceView(*maps[map], &srvDesc, srv);
+    }
+
+    // Both maps start out uncleared.
+    for (auto& cascade : mShadowCascades)
+        cascade.StaticDirty = true;
+    mDynamicShadowMapClear = false;
+}
+
+void ShapesApp::BuildSceneTarget()
+{
+    mSceneColor.Reset();
+
+    // The next UpdateRenderScale sizes the scene for the new window.
+    mRenderWidth = 0;
+    mRenderHeight = 0;
+
+    // Multisampled, the scene would need a resolve before the upscale; MSAA
+    // keeps drawing into the back buffer at full size instead.
+    if (m4xMsaaState)
+        return;
+
+    D3D12_RESOURCE_DESC sceneDesc = CD3DX12_RESOURCE_DESC::Tex2D(
+        mBackBufferFormat,
+        mClientWidth,
+        mClientHeight,
+        1,
+        1,
+        1,
+        0,
+        D3D12_RESOURCE_FLAG_ALLOW_RENDER_TARGET);
+
+    D3D12_CLEAR_VALUE optClear;
+    optClear.Format = mBackBufferFormat;
+    memcpy(optClear.Color, &Colors::LightSteelBlue, sizeof(optClear.Color));
+
+    auto defaultHeap = CD3DX12_HEAP_PROPERTIES(D3D12_HEAP_TYPE_DEFAULT);
+    ThrowIfFailed(md3dDevice->CreateCommittedResource(
+        &defaultHeap,
+        D3D12_HEAP_FLAG_NONE,
+        &sceneDesc,
+        D3D12_RESOURCE_STATE_PIXEL_SHADER_RESOURCE,
+        &optClear,
+        IID_PPV_ARGS(&mSceneColor)));
+
+    CD3DX12_CPU_DESCRIPTOR_HANDLE rtv(
+        mRtvHeap->GetCPUDescriptorHandleForHeapStart(), SwapChainBufferCount, mRtvDescriptorSize);
+    md3dDevice->CreateRenderTargetView(mSceneColor.Get(), nullptr, rtv);
+
+    CD3DX12_CPU_DESCRIPTOR_HANDLE srv(
+        mSrvDescriptorHeap->GetCPUDescriptorHandleForHeapStart(), gUpscaleDescriptorBase, mCbvSrvUavDescriptorSize);
+    md3dDevice->CreateShaderResourceView(mSceneColor.Get(), nullptr, srv);
+}
+
+D3D12_CPU_DESCRIPTOR_HANDLE ShapesApp::SceneColorView()const
+{
+    if (!mUpscaleThisFrame)
+        return CurrentBackBufferView();
+
+    return CD3DX12_CPU_DESCRIPTOR_HANDLE(
+        mRtvHeap->GetCPUDescriptorHandleForHeapStart(), SwapChainBufferCount, mRtvDescriptorSize);
+}
+
+void ShapesApp::BuildBenchmarkPath()
+{
+    mBenchmarkSegments.clear();
+
+    // Castle exterior: one turn around the castle, looking at its middle.
+    {
+        BenchmarkSegment segment;
+        segment.Name = "CastleExterior";
+
+        const XMFLOAT3 castleCenter(0.0f, 8.0f, 30.0f);
+        const float radius = 50.0f;
+        const int keyCount = 16;
+        for (int i = 0; i <= keyCount; ++i)
+        {
+            float angle = XM_2PI * i / keyCount;
+            segment.Path.AddKey(
+                12.0f * i / keyCount,
+                XMFLOAT3(castleCenter.x + radius * sinf(angle), 16.0f, castleCenter.z - radius * cosf(angle)),
+                castleCenter);
+        }
+
+        mBenchmarkSegments.push_back(std::move(segment));
+    }
+
+    // Maze interior: from the entrance to the exit at walking speed, through the
+    // corners of the solution of the layout in BuildMazeGeometry.  Each key looks
+    // at the next one.
+    {
+        BenchmarkSegment segment;
+        segment.Name = "MazeInterior";
+
+        const int route[][2] =
+        {
+            { -1, 9 }, { 1, 9 }, { 1, 5 }, { 3, 5 }, { 3, 3 }, { 1, 3 }, { 1, 1 }, { 5, 1 }, { 5, 3 },
+            { 7, 3 }, { 7, 5 }, { 9, 5 }, { 9, 3 }, { 13, 3 }, { 13, 13 }, { 9, 13 }, { 9, 15 }, { 9, 17 }
+        };
+        const int routeLength = _countof(route);
+
+        auto cellCenter = [](const int cell[2])
+            {
+                return XMFLOAT3(-25.0f + cell[1] * gMazeCellSize, 2.0f, -40.0f + cell[0] * gMazeCellSize);
+            };
+
+        for (int i = 0; i + 1 < routeLength; ++i)
+            segment.Path.AddKeyAtSpeed(6.0f, cellCenter(route[i]), cellCenter(route[i + 1]));
+
+        mBenchmarkSegments.push_back(std::move(segment));
+    }
+
+    // Terrain overview: high along three sides of the ground, looking at its
+    // middle, so most of the scene is in view at once.
+    {
+        BenchmarkSegment segment;
+        segment.Name = "TerrainOverview";
+
+        const XMFLOAT3 center(0.0f, 0.0f, 0.0f);
+        segment.Path.AddKey(0.0f, XMFLOAT3(-70.0f, 45.0f, -90.0f), center);
+        segment.Path.AddKey(4.0f, XMFLOAT3(+70.0f, 45.0f, -90.0f), center);
+        segment.Path.AddKey(8.0f, XMFLOAT3(+70.0f, 45.0f, +90.0f), center);
+        segment.Path.AddKey(12.0f, XMFLOAT3(-70.0f, 45.0f, +90.0f), center);
+
+        mBenchmarkSegments.push_back(std::move(segment));
+    }
+}
+
+bool ShapesApp::WriteBenchmarkReport()
+{
+    std::ofstream fout(mBenchmarkFile, std::ios::trunc);
+    if (!fout)
+        return false;
+
+    auto writePercentiles = [&](const Profiler::Percentiles& p)
+        {
+            fout << "{ \"p50\": " << p.P50 << ", \"p95\": " << p.P95
+                << ", \"p99\": " << p.P99 << ", \"max\": " << p.Max << " }";
+        };
+
+    auto writeTimings = [&](UINT64 firstFrame, UINT64 endFrame)
+        {
+            fout << "\"frames\": " << (endFrame - firstFrame) << ", \"frame_ms\": ";
+            writePercentiles(mProfiler->GetFrameTimePercentiles(firstFrame, endFrame));
+            fout << ", \"gpu_frame_ms\": ";
+            writePercentiles(mProfiler->GetGpuTimePercentiles(GpuFrame, firstFrame, endFrame));
+        };
+
+    // Adapter names go out as ASCII without the characters JSON would need escaped.
+    auto toJsonText = [](const std::wstring& text)
+        {
+            std::string result;
+            for (wchar_t c : text)
+            {
+                if (c >= L' ' && c < 0x7f && c != L'"' && c != L'\\')
+                    result += (char)c;
+            }
+            return result;
+        };
+    DXGI_QUERY_VIDEO_MEMORY_INFO memoryInfo = GetVideoMemoryInfo();
+
+    fout << "{\n";
+    fout << "  \"time_step\": " << gBenchmarkTimeStep << ",\n";
+    fout << "  \"adapter\": { \"name\": \"" << toJsonText(mAdapterDesc.Description)
+        << "\", \"luid\": \"" << toJsonText(FormatLuid(mAdapterDesc.AdapterLuid)) << "\""
+        << ", \"dedicated_mb\": " << (mAdapterDesc.DedicatedVideoMemory >> 20)
+        << ", \"budget_mb\": " << (memoryInfo.Budget >> 20)
+        << ", \"usage_mb\": " << (memoryInfo.CurrentUsage >> 20) << " },\n";
+    fout << "  \"width\": " << mClientWidth << ", \"height\": " << mClientHeight << ",\n";
+    fout << "  \"scale\": " << mBenchmarkScale << ", \"render_items\": " << mRitemPool.GetLiveCount() << ",\n";
+    fout << "  \"gpu_driven\": " << (mGpuDrivenEnabled ? "true" : "false")
+        << ", \"bindless\": " << (mBindlessEnabled ? "true" : "false")
+        << ", \"instancing\": " << (mInstancingEnabled ? "true" : "false")
+        << ", \"parallel_recording\": " << (mParallelRecordingEnabled ? "true" : "false")
+        << ", \"depth_prepass\": " << (mDepthPrepassEnabled ? "true" : "false")
+        << ", \"async_compute\": " << (mAsyncComputeEnabled ? "true" : "false") << ",\n";
+    fout << "  \"shader_cache\": { \"hits\": " << mShaderCache->GetHitCount()
+        << ", \"misses\": " << mShaderCache->GetMissCount() << " },\n";
+    fout << "  \"pipeline_cache\": { \"loaded\": " << mPipelineCache->GetLoadedCount()
+        << ", \"created\": " << mPipelineCache->GetCreatedCount() << " },\n";
+    fout << "  \"dynamic_resolution\": { \"enabled\": " << (mDynamicResolutionEnabled ? "true" : "false")
+        << ", \"target_gpu_ms\": " << mTargetGpuFrameMs
+        << ", \"mean_scale\": " << (mRenderScaleFrames > 0 ? mRenderScaleSum / mRenderScaleFrames : 1.0)
+        << ", \"min_scale\": " << mLowestRenderScale << " },\n";
+    fout << "  \"shadows\": { \"cache\": " << (mShadowCacheEnabled ? "true" : "false")
+        << ", \"cascade_redraws\": " << mShadowCascadeRedraws << " },\n";
+
+    fout << "  \"total\": { ";
+    writeTimings(mBenchmarkSegments.front().FirstFrame, mBenchmarkSegments.back().EndFrame);
+    fout << " },\n";
+
+    fout << "  \"segments\": [";
+    for (size_t i = 0; i < mBenchmarkSegments.size(); ++i)
+    {
+        const BenchmarkSegment& segment = mBenchmarkSegments[i];
+        double frames = (double)MathHelper::Max(segment.EndFrame - segment.FirstFrame, (UINT64)1);
+
+        fout << (i == 0 ? "\n" : ",\n") << "    { \"name\": \"" << segment.Name << "\", ";
+        writeTimings(segment.FirstFrame, segment.EndFrame);
+        fout << ",\n      \"draw_calls_per_frame\": " << segment.DrawCalls / frames
+            << ", \"visible_items_per_frame\": " << segment.VisibleItems / frames << " }";
+    }
+    fout << "\n  ]\n}\n";
+
+    return (bool)fout;
+}
+
+std::array<const CD3DX12_STATIC_SAMPLER_DESC, 2> ShapesApp::GetStaticSamplers()
+{
+    const CD3DX12_STATIC_SAMPLER_DESC linearWrap(
+        0,                                // shaderRegister
+        D3D12_FILTER_MIN_MAG_MIP_LINEAR); // filter
+
+    // Outside the map counts as lit.
+    const CD3DX12_STATIC_SAMPLER_DESC shadow(
+        1,                                                // shaderRegister
+        D3D12_FILTER_COMPARISON_MIN_MAG_LINEAR_MIP_POINT, // filter
+        D3D12_TEXTURE_ADDRESS_MODE_BORDER,                // addressU
+        D3D12_TEXTURE_ADDRESS_MODE_BORDER,                // addressV
+        D3D12_TEXTURE_ADDRESS_MODE_BORDER,                // addressW
+        0.0f,                                             // mipLODBias
+        16,                                               // maxAnisotropy
+        D3D12_COMPARISON_FUNC_LESS_EQUAL,
+        D3D12_STATIC_BORDER_COLOR_OPAQUE_WHITE);
+
+    return { linearWrap, shadow };
+}